@@ -44,18 +44,6 @@ good_ip_header(const Packet *p)
 	return iph;
 }
 
-static inline bool
-operator==(const AggregateIPFlows::HostPair &a, const AggregateIPFlows::HostPair &b)
-{
-    return a.a == b.a && a.b == b.b;
-}
-
-inline hashcode_t
-AggregateIPFlows::HostPair::hashcode() const
-{
-    return (a << 12) + b + ((a >> 20) & 0x1F);
-}
-
 static inline bool
 ports_reverse_order(uint32_t ports)
 {
@@ -72,8 +60,9 @@ flip_ports(uint32_t ports)
 // actual AggregateIPFlows operations
 
 AggregateIPFlows::AggregateIPFlows()
+    : _partitions(0)
 #if CLICK_USERLEVEL
-    : _traceinfo_file(0), _packet_source(0), _filepos_h(0)
+    , _traceinfo_file(0), _packet_source(0), _filepos_h(0)
 #endif
 {
 }
@@ -102,6 +91,7 @@ AggregateIPFlows::configure(Vector<String> &conf, ErrorHandler *errh)
     _fragment_timeout = 30;
     _gc_interval = 20 * 60;
     _fragments = 2;
+    _npartitions = 1;
     bool handle_icmp_errors = false;
     bool fragments_parsed;
     bool fragments = true;
@@ -118,9 +108,13 @@ AggregateIPFlows::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("SOURCE", ElementArg(), _packet_source)
 #endif
 	.read("FRAGMENTS", fragments).read_status(fragments_parsed)
+	.read("PARTITIONS", _npartitions)
 	.complete() < 0)
 	return -1;
 
+    if (_npartitions == 0)
+	return errh->error("PARTITIONS must be positive");
+
     _smallest_timeout = (_tcp_timeout < _tcp_done_timeout ? _tcp_timeout : _tcp_done_timeout);
     _smallest_timeout = (_smallest_timeout < _udp_timeout ? _smallest_timeout : _udp_timeout);
     _handle_icmp_errors = handle_icmp_errors;
@@ -133,8 +127,8 @@ int
 AggregateIPFlows::initialize(ErrorHandler *errh)
 {
     _next = 1;
-    _active_sec = _gc_sec = 0;
     _timestamp_warning = false;
+    _partitions = new Partition[_npartitions];
 
 #if CLICK_USERLEVEL
     if (_traceinfo_filename == "-")
@@ -164,8 +158,17 @@ AggregateIPFlows::initialize(ErrorHandler *errh)
 void
 AggregateIPFlows::cleanup(CleanupStage)
 {
-    clean_map(_tcp_map);
-    clean_map(_udp_map);
+    for (uint32_t i = 0; _partitions && i < _npartitions; ++i) {
+	Partition &pt = _partitions[i];
+	clean_map(pt._tcp_map);
+	clean_map(pt._udp_map);
+	while (Packet *p = pt._emit_head) {
+	    pt._emit_head = p->next();
+	    p->kill();
+	}
+    }
+    delete[] _partitions;
+    _partitions = 0;
 #if CLICK_USERLEVEL
     if (_traceinfo_file && _traceinfo_file != stdout) {
 	fprintf(_traceinfo_file, "</trace>\n");
@@ -265,12 +268,38 @@ AggregateIPFlows::packet_emit_hook(const Packet *p, const click_ip *iph, FlowInf
 #endif
 }
 
+inline AggregateIPFlows::Partition &
+AggregateIPFlows::partition(const HostPair &hp) const
+{
+    // HostPair is symmetric, so both directions share a partition; ports
+    // are not used, so fragments find their flows
+    return _partitions[hp.hashcode() % _npartitions];
+}
+
+inline Packet *
+AggregateIPFlows::Partition::take_emitted()
+{
+    Packet *p = _emit_head;
+    _emit_head = 0;
+    return p;
+}
+
 void
-AggregateIPFlows::reap_map(Map &table, uint32_t timeout, uint32_t done_timeout)
+AggregateIPFlows::emit_packets(Packet *head)
 {
-    timeout = _active_sec - timeout;
-    done_timeout = _active_sec - done_timeout;
-    int frag_timeout = _active_sec - _fragment_timeout;
+    while (Packet *p = head) {
+	head = p->next();
+	p->set_next(0);
+	output(0).push(p);
+    }
+}
+
+void
+AggregateIPFlows::reap_map(Partition &pt, Map &table, uint32_t timeout, uint32_t done_timeout)
+{
+    timeout = pt._active_sec - timeout;
+    done_timeout = pt._active_sec - done_timeout;
+    int frag_timeout = pt._active_sec - _fragment_timeout;
 
     // free completed flows and emit fragments
     for (Map::iterator iter = table.begin(); iter.live(); iter++) {
@@ -280,7 +309,7 @@ AggregateIPFlows::reap_map(Map &table, uint32_t timeout, uint32_t done_timeout)
 	while ((head = hpinfo->_fragment_head)
 	       && (head->timestamp_anno().sec() < frag_timeout
 		   || !IP_ISFRAG(good_ip_header(head))))
-	    emit_fragment_head(hpinfo);
+	    emit_fragment_head(pt, hpinfo);
 
 	// can't delete any flows if there are fragments
 	if (hpinfo->_fragment_head)
@@ -304,13 +333,13 @@ AggregateIPFlows::reap_map(Map &table, uint32_t timeout, uint32_t done_timeout)
 }
 
 void
-AggregateIPFlows::reap()
+AggregateIPFlows::reap(Partition &pt)
 {
-    if (_gc_sec) {
-	reap_map(_tcp_map, _tcp_timeout, _tcp_done_timeout);
-	reap_map(_udp_map, _udp_timeout, _udp_timeout);
+    if (pt._gc_sec) {
+	reap_map(pt, pt._tcp_map, _tcp_timeout, _tcp_done_timeout);
+	reap_map(pt, pt._udp_map, _udp_timeout, _udp_timeout);
     }
-    _gc_sec = _active_sec + _gc_interval;
+    pt._gc_sec = pt._active_sec + _gc_interval;
 }
 
 const click_ip *
@@ -333,9 +362,9 @@ AggregateIPFlows::icmp_encapsulated_header(const Packet *p)
 }
 
 int
-AggregateIPFlows::relevant_timeout(const FlowInfo *f, const Map &m) const
+AggregateIPFlows::relevant_timeout(const FlowInfo *f, const Partition &pt, const Map &m) const
 {
-    if (&m == &_udp_map)
+    if (&m == &pt._udp_map)
 	return _udp_timeout;
     else if (f->_flow_over == 3)
 	return _tcp_done_timeout;
@@ -346,7 +375,7 @@ AggregateIPFlows::relevant_timeout(const FlowInfo *f, const Map &m) const
 // XXX timing when fragments are merged back in?
 
 AggregateIPFlows::FlowInfo *
-AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, bool flipped, const Packet *p)
+AggregateIPFlows::find_flow_info(Partition &pt, Map &m, HostPairInfo *hpinfo, uint32_t ports, bool flipped, const Packet *p)
 {
     FlowInfo **pprev = &hpinfo->_flows;
     for (FlowInfo *finfo = *pprev; finfo; pprev = &finfo->_next, finfo = finfo->_next)
@@ -357,7 +386,7 @@ AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, b
 	    // 4.Feb.2004 - Also start a new flow if the old flow closed off,
 	    // and we have a SYN.
 	    if ((age > (int) _smallest_timeout
-		 && age > relevant_timeout(finfo, m))
+		 && age > relevant_timeout(finfo, pt, m))
 		|| (finfo->_flow_over == 3
 		    && p->ip_header()->ip_p == IP_PROTO_TCP
 		    && (p->tcp_header()->th_flags & TH_SYN))) {
@@ -368,8 +397,7 @@ AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, b
 		delete_flowinfo(hp, finfo, false);
 
 		// make a new aggregate
-		finfo->_aggregate = _next;
-		_next++;
+		finfo->_aggregate = _next.fetch_and_add(1);
 		finfo->_reverse = flipped;
 		finfo->_flow_over = 0;
 #if CLICK_USERLEVEL
@@ -388,23 +416,23 @@ AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, b
 
     // make and install new FlowInfo pair
     FlowInfo *finfo;
+    uint32_t agg = _next.fetch_and_add(1);
 #if CLICK_USERLEVEL
     if (stats()) {
-	finfo = new StatFlowInfo(ports, hpinfo->_flows, _next);
+	finfo = new StatFlowInfo(ports, hpinfo->_flows, agg);
 	stat_new_flow_hook(p, finfo);
     } else
 #endif
-	finfo = new FlowInfo(ports, hpinfo->_flows, _next);
+	finfo = new FlowInfo(ports, hpinfo->_flows, agg);
 
     finfo->_reverse = flipped;
     hpinfo->_flows = finfo;
-    _next++;
     notify(finfo->aggregate(), AggregateListener::NEW_AGG, p);
     return finfo;
 }
 
 void
-AggregateIPFlows::emit_fragment_head(HostPairInfo *hpinfo)
+AggregateIPFlows::emit_fragment_head(Partition &pt, HostPairInfo *hpinfo)
 {
     Packet *head = hpinfo->_fragment_head;
     hpinfo->_fragment_head = head->next();
@@ -444,11 +472,18 @@ AggregateIPFlows::emit_fragment_head(HostPairInfo *hpinfo)
 
     assert(finfo);
     packet_emit_hook(head, iph, finfo);
-    output(0).push(head);
+
+    // queue for emission once the partition is unlocked
+    head->set_next(0);
+    if (pt._emit_head)
+	pt._emit_tail->set_next(head);
+    else
+	pt._emit_head = head;
+    pt._emit_tail = head;
 }
 
 int
-AggregateIPFlows::handle_fragment(Packet *p, HostPairInfo *hpinfo)
+AggregateIPFlows::handle_fragment(Partition &pt, Packet *p, HostPairInfo *hpinfo)
 {
     if (hpinfo->_fragment_head)
 	hpinfo->_fragment_tail->set_next(p);
@@ -456,21 +491,21 @@ AggregateIPFlows::handle_fragment(Packet *p, HostPairInfo *hpinfo)
 	hpinfo->_fragment_head = p;
     hpinfo->_fragment_tail = p;
     p->set_next(0);
-    _active_sec = p->timestamp_anno().sec();
+    pt._active_sec = p->timestamp_anno().sec();
 
     // get rid of old fragments
-    int frag_timeout = _active_sec - _fragment_timeout;
+    int frag_timeout = pt._active_sec - _fragment_timeout;
     Packet *head;
     while ((head = hpinfo->_fragment_head)
 	   && (head->timestamp_anno().sec() < frag_timeout
 	       || !IP_ISFRAG(good_ip_header(head))))
-	emit_fragment_head(hpinfo);
+	emit_fragment_head(pt, hpinfo);
 
     return ACT_NONE;
 }
 
 int
-AggregateIPFlows::handle_packet(Packet *p)
+AggregateIPFlows::handle_packet(Packet *p, Partition *&ptp)
 {
     const click_ip *iph = p->ip_header();
     int paint = 0;
@@ -497,9 +532,14 @@ AggregateIPFlows::handle_packet(Packet *p)
 	|| (iph->ip_src.s_addr == 0 && iph->ip_dst.s_addr == 0))
 	return ACT_DROP;
 
-    // find relevant HostPairInfo
-    Map &m = (iph->ip_p == IP_PROTO_TCP ? _tcp_map : _udp_map);
+    // find and lock relevant partition; caller unlocks
     HostPair hosts(iph->ip_src.s_addr, iph->ip_dst.s_addr);
+    Partition &pt = partition(hosts);
+    pt._lock.acquire();
+    ptp = &pt;
+
+    // find relevant HostPairInfo
+    Map &m = (iph->ip_p == IP_PROTO_TCP ? pt._tcp_map : pt._udp_map);
     if (hosts.a != iph->ip_src.s_addr)
 	paint ^= 1;
     HostPairInfo *hpinfo = &m[hosts];
@@ -520,7 +560,7 @@ AggregateIPFlows::handle_packet(Packet *p)
 	if (paint & 1)
 	    ports = flip_ports(ports);
 
-	finfo = find_flow_info(m, hpinfo, ports, paint & 1, p);
+	finfo = find_flow_info(pt, m, hpinfo, ports, paint & 1, p);
 	if (!finfo) {
 	    click_chatter("out of memory!");
 	    return ACT_DROP;
@@ -539,12 +579,12 @@ AggregateIPFlows::handle_packet(Packet *p)
 
     // check for fragment
     if ((_fragments && IP_ISFRAG(iph)) || hpinfo->_fragment_head)
-	return handle_fragment(p, hpinfo);
+	return handle_fragment(pt, p, hpinfo);
     else if (!finfo)
 	return ACT_DROP;
 
     // packet emit hook
-    _active_sec = p->timestamp_anno().sec();
+    pt._active_sec = p->timestamp_anno().sec();
     packet_emit_hook(p, iph, finfo);
 
     return ACT_EMIT;
@@ -553,11 +593,17 @@ AggregateIPFlows::handle_packet(Packet *p)
 void
 AggregateIPFlows::push(int, Packet *p)
 {
-    int action = handle_packet(p);
-
-    // GC if necessary
-    if (_active_sec >= _gc_sec)
-	reap();
+    Partition *pt = 0;
+    int action = handle_packet(p, pt);
+
+    if (pt) {
+	// GC if necessary
+	if (pt->_active_sec >= pt->_gc_sec)
+	    reap(*pt);
+	Packet *emit = pt->take_emitted();
+	pt->_lock.release();
+	emit_packets(emit);
+    }
 
     if (action == ACT_EMIT)
 	output(0).push(p);
@@ -569,11 +615,17 @@ Packet *
 AggregateIPFlows::pull(int)
 {
     Packet *p = input(0).pull();
-    int action = (p ? handle_packet(p) : ACT_NONE);
-
-    // GC if necessary
-    if (_active_sec >= _gc_sec)
-	reap();
+    Partition *pt = 0;
+    int action = (p ? handle_packet(p, pt) : ACT_NONE);
+
+    if (pt) {
+	// GC if necessary
+	if (pt->_active_sec >= pt->_gc_sec)
+	    reap(*pt);
+	Packet *emit = pt->take_emitted();
+	pt->_lock.release();
+	emit_packets(emit);
+    }
 
     if (action == ACT_EMIT)
 	return p;
@@ -589,13 +641,19 @@ AggregateIPFlows::write_handler(const String &, Element *e, void *thunk, ErrorHa
 {
     AggregateIPFlows *af = static_cast<AggregateIPFlows *>(e);
     switch ((intptr_t)thunk) {
-      case H_CLEAR: {
-	  int active_sec = af->_active_sec, gc_sec = af->_gc_sec;
-	  af->_active_sec = af->_gc_sec = 0x7FFFFFFF;
-	  af->reap();
-	  af->_active_sec = active_sec, af->_gc_sec = gc_sec;
-	  return 0;
-      }
+      case H_CLEAR:
+	for (uint32_t i = 0; i < af->_npartitions; ++i) {
+	    Partition &pt = af->_partitions[i];
+	    pt._lock.acquire();
+	    int active_sec = pt._active_sec, gc_sec = pt._gc_sec;
+	    pt._active_sec = pt._gc_sec = 0x7FFFFFFF;
+	    af->reap(pt);
+	    pt._active_sec = active_sec, pt._gc_sec = gc_sec;
+	    Packet *emit = pt.take_emitted();
+	    pt._lock.release();
+	    af->emit_packets(emit);
+	}
+	return 0;
       default:
 	return -1;
     }
@@ -4,6 +4,7 @@
 #include <click/element.hh>
 #include <click/ipflowid.hh>
 #include <click/hashtable.hh>
+#include <click/sync.hh>
 #include "aggregatenotifier.hh"
 CLICK_DECLS
 class HandlerCall;
@@ -110,10 +111,27 @@ Boolean. If true, then try to assign aggregate annotations to all fragments.
 May only be set to true if AggregateIPFlows is running in a push context.
 Default is true in a push context and false in a pull context.
 
+=item PARTITIONS
+
+Unsigned. Split the flow tables into this many partitions, each with its own
+lock, timestamps, and garbage collection. A packet's partition is chosen by a
+symmetric hash of its source and destination addresses, so both directions of
+a flow, and all of its fragments, always use the same partition. Set this to
+the number of threads that push packets into AggregateIPFlows; if traffic is
+steered to threads by a symmetric hash (for example, symmetric RSS), each
+thread will mostly use its own partitions and the locks will be uncontended.
+Default is 1.
+
 =back
 
+AggregateIPFlows may be used by several threads at once. Flow numbers are
+unique across all partitions, although with more than one partition they are
+no longer assigned in exactly the order flows are seen.
+
 AggregateIPFlows is an AggregateNotifier, so AggregateListeners can request
 notifications when new aggregates are created and old ones are deleted.
+Notifications are serialized, so listeners see one event at a time even when
+packets arrive on several threads.
 
 =h clear write-only
 
@@ -209,12 +227,22 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
     };
 
     typedef HashTable<HostPair, HostPairInfo> Map;
-    Map _tcp_map;
-    Map _udp_map;
 
-    uint32_t _next;
-    unsigned _active_sec;
-    unsigned _gc_sec;
+    struct Partition {
+	Map _tcp_map;
+	Map _udp_map;
+	unsigned _active_sec;
+	unsigned _gc_sec;
+	Packet *_emit_head;	// fragments ready to emit once unlocked
+	Packet *_emit_tail;
+	Spinlock _lock;
+	Partition() : _active_sec(0), _gc_sec(0), _emit_head(0), _emit_tail(0) { }
+	inline Packet *take_emitted();
+    };
+
+    Partition *_partitions;
+    uint32_t _npartitions;
+    atomic_uint32_t _next;
 
     uint32_t _tcp_timeout;
     uint32_t _tcp_done_timeout;
@@ -238,28 +266,45 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
 
     static const click_ip *icmp_encapsulated_header(const Packet *);
 
+    inline Partition &partition(const HostPair &) const;
+
     void clean_map(Map &);
-    void reap_map(Map &, uint32_t, uint32_t);
-    void reap();
+    void reap_map(Partition &, Map &, uint32_t, uint32_t);
+    void reap(Partition &);
+    void emit_packets(Packet *);
 
-    inline int relevant_timeout(const FlowInfo *, const Map &) const;
+    inline int relevant_timeout(const FlowInfo *, const Partition &, const Map &) const;
 #if CLICK_USERLEVEL
     void stat_new_flow_hook(const Packet *, FlowInfo *);
 #endif
     inline void packet_emit_hook(const Packet *, const click_ip *, FlowInfo *);
     inline void delete_flowinfo(const HostPair &, FlowInfo *, bool really_delete = true);
-    void emit_fragment_head(HostPairInfo *hpinfo);
-    FlowInfo *find_flow_info(Map &, HostPairInfo *, uint32_t ports, bool flipped, const Packet *);
+    void emit_fragment_head(Partition &, HostPairInfo *hpinfo);
+    FlowInfo *find_flow_info(Partition &, Map &, HostPairInfo *, uint32_t ports, bool flipped, const Packet *);
 
     FlowInfo *uncommon_case(FlowInfo *finfo, const click_ip *iph);
 
     enum { ACT_EMIT, ACT_DROP, ACT_NONE };
-    int handle_fragment(Packet *, HostPairInfo *);
-    int handle_packet(Packet *);
+    int handle_fragment(Partition &, Packet *, HostPairInfo *);
+    int handle_packet(Packet *, Partition *&);
 
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
 
 };
 
+// defined here because every file that includes this header instantiates
+// HashTable<HostPair, HostPairInfo>
+inline bool
+operator==(const AggregateIPFlows::HostPair &a, const AggregateIPFlows::HostPair &b)
+{
+    return a.a == b.a && a.b == b.b;
+}
+
+inline hashcode_t
+AggregateIPFlows::HostPair::hashcode() const
+{
+    return (a << 12) + b + ((a >> 20) & 0x1F);
+}
+
 CLICK_ENDDECLS
 #endif
@@ -2,6 +2,7 @@
 #ifndef CLICK_AGGREGATENOTIFIER_HH
 #define CLICK_AGGREGATENOTIFIER_HH
 #include <click/vector.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 class Packet;
 
@@ -28,14 +29,19 @@ class AggregateNotifier { public:
   private:
 
     Vector<AggregateListener *> _listeners;
+    mutable Spinlock _notify_lock;	// listeners see one event at a time
 
 };
 
 inline void
 AggregateNotifier::notify(uint32_t agg, AggregateListener::AggregateEvent e, const Packet *p) const
 {
-    for (int i = 0; i < _listeners.size(); i++)
-	_listeners[i]->aggregate_notify(agg, e, p);
+    if (_listeners.size()) {
+	_notify_lock.acquire();
+	for (int i = 0; i < _listeners.size(); i++)
+	    _listeners[i]->aggregate_notify(agg, e, p);
+	_notify_lock.release();
+    }
 }
 
 CLICK_ENDDECLS
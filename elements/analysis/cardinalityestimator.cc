@@ -0,0 +1,171 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * cardinalityestimator.{cc,hh} -- estimate number of distinct aggregates
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "cardinalityestimator.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <click/integers.hh>
+#include <click/master.hh>
+#include <math.h>
+CLICK_DECLS
+
+CardinalityEstimator::CardinalityEstimator()
+{
+}
+
+CardinalityEstimator::~CardinalityEstimator()
+{
+}
+
+int
+CardinalityEstimator::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _precision = 12;
+    if (Args(conf, this, errh)
+	.read("PRECISION", _precision)
+	.complete() < 0)
+	return -1;
+    if (_precision < 4 || _precision > 16)
+	return errh->error("PRECISION must be between 4 and 16");
+    return 0;
+}
+
+int
+CardinalityEstimator::initialize(ErrorHandler *errh)
+{
+    _state.resize(click_max_thread_index(master()->nthreads()));
+    for (int t = 0; t < _state.size(); ++t)
+	if (!(_state[t].registers = new uint8_t[1 << _precision]()))
+	    return errh->error("out of memory!");
+    return 0;
+}
+
+void
+CardinalityEstimator::cleanup(CleanupStage)
+{
+    for (int t = 0; t < _state.size(); ++t) {
+	delete[] _state[t].registers;
+	_state[t].registers = 0;
+    }
+}
+
+inline uint64_t
+CardinalityEstimator::hash(uint32_t x)
+{
+    // splitmix64 finalizer; HyperLogLog needs well-mixed high bits
+    uint64_t z = x + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+Packet *
+CardinalityEstimator::simple_action(Packet *p)
+{
+    State *s = _state.get();
+    uint64_t h = hash(AGGREGATE_ANNO(p));
+    uint32_t idx = h >> (64 - _precision);
+    uint64_t w = h << _precision;
+    int rho = w ? ffs_msb(w) : 65 - _precision;
+    if (s->registers[idx] < rho)
+	s->registers[idx] = rho;
+    s->count++;
+    return p;
+}
+
+double
+CardinalityEstimator::estimate() const
+{
+    const per_thread<State> &st = _state;
+    int m = 1 << _precision;
+    double sum = 0;
+    int zeros = 0;
+    for (int j = 0; j < m; ++j) {
+	uint8_t r = 0;
+	for (int t = 0; t < st.size(); ++t)
+	    if (st[t].registers[j] > r)
+		r = st[t].registers[j];
+	sum += ldexp(1.0, -r);
+	zeros += (r == 0);
+    }
+
+    double alpha;
+    if (m == 16)
+	alpha = 0.673;
+    else if (m == 32)
+	alpha = 0.697;
+    else if (m == 64)
+	alpha = 0.709;
+    else
+	alpha = 0.7213 / (1 + 1.079 / m);
+    double e = alpha * m * m / sum;
+    // small-range correction: fall back to linear counting
+    if (e <= 2.5 * m && zeros)
+	e = m * log((double) m / zeros);
+    return e;
+}
+
+enum { H_ESTIMATE, H_ERROR, H_COUNT, H_CLEAR };
+
+String
+CardinalityEstimator::read_handler(Element *e, void *thunk)
+{
+    CardinalityEstimator *ce = static_cast<CardinalityEstimator *>(e);
+    switch ((intptr_t)thunk) {
+      case H_ESTIMATE:
+	return String((uint64_t) (ce->estimate() + 0.5));
+      case H_ERROR:
+	return String(1.04 / sqrt((double) (1 << ce->_precision)));
+      case H_COUNT: {
+	  uint64_t count = 0;
+	  for (int t = 0; t < ce->_state.size(); ++t)
+	      count += ce->_state[t].count;
+	  return String(count);
+      }
+      default:
+	return "<error>";
+    }
+}
+
+int
+CardinalityEstimator::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
+{
+    CardinalityEstimator *ce = static_cast<CardinalityEstimator *>(e);
+    switch ((intptr_t)thunk) {
+      case H_CLEAR:
+	for (int t = 0; t < ce->_state.size(); ++t) {
+	    memset(ce->_state[t].registers, 0, 1 << ce->_precision);
+	    ce->_state[t].count = 0;
+	}
+	return 0;
+      default:
+	return -1;
+    }
+}
+
+void
+CardinalityEstimator::add_handlers()
+{
+    add_read_handler("estimate", read_handler, H_ESTIMATE);
+    add_read_handler("error", read_handler, H_ERROR);
+    add_read_handler("count", read_handler, H_COUNT);
+    add_write_handler("clear", write_handler, H_CLEAR, Handler::BUTTON);
+}
+
+ELEMENT_REQUIRES(userlevel int64)
+EXPORT_ELEMENT(CardinalityEstimator)
+CLICK_ENDDECLS
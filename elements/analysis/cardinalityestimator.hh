@@ -0,0 +1,103 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_CARDINALITYESTIMATOR_HH
+#define CLICK_CARDINALITYESTIMATOR_HH
+#include <click/element.hh>
+#include <click/multithread.hh>
+CLICK_DECLS
+
+/*
+=c
+
+CardinalityEstimator([I<KEYWORDS>])
+
+=s aggregates
+
+estimates the number of distinct aggregate annotations
+
+=d
+
+CardinalityEstimator estimates how many distinct aggregate annotation values
+it has seen, using the HyperLogLog algorithm.  It uses 2^PRECISION bytes of
+memory per thread regardless of the number of distinct values.  Combine it
+with AggregateIP to count distinct sources, destinations, or ports.
+
+Each driver thread updates its own registers; handlers merge them when read.
+
+Keyword arguments are:
+
+=over 8
+
+=item PRECISION
+
+Integer between 4 and 16.  Use 2^PRECISION registers.  The relative standard
+error of the estimate is about 1.04/sqrt(2^PRECISION).  Default is 12, giving
+about 1.6% error in 4 kilobytes.
+
+=back
+
+=h estimate read-only
+
+Returns the estimated number of distinct aggregates seen.
+
+=h error read-only
+
+Returns the relative standard error of the estimate, as a fraction.
+
+=h count read-only
+
+Returns the number of packets seen.
+
+=h clear write-only
+
+Resets the estimator.
+
+=e
+
+  ... -> AggregateIP(ip src) -> srcs :: CardinalityEstimator -> ...
+
+Reading C<srcs.estimate> returns the approximate number of distinct source
+addresses.
+
+=a
+
+AggregateIP, AggregateCounter, HeavyHitters, QuantileEstimator */
+
+class CardinalityEstimator : public Element { public:
+
+    CardinalityEstimator() CLICK_COLD;
+    ~CardinalityEstimator() CLICK_COLD;
+
+    const char *class_name() const	{ return "CardinalityEstimator"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    Packet *simple_action(Packet *);
+
+    double estimate() const;
+
+  private:
+
+    struct State {
+	uint8_t *registers;
+	uint64_t count;
+	State()
+	    : registers(0), count(0) {
+	}
+    };
+
+    int _precision;
+    per_thread<State> _state;
+
+    static inline uint64_t hash(uint32_t);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,341 @@
+/*
+ * heavyhitters.{cc,hh} -- find most frequent aggregates in bounded memory
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "heavyhitters.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet_anno.hh>
+#include <click/ipaddress.hh>
+#include <click/master.hh>
+CLICK_DECLS
+
+void
+HeavyHitters::Summary::configure(uint32_t capacity)
+{
+    _capacity = capacity;
+    clear();
+    _heap.reserve(capacity);
+}
+
+void
+HeavyHitters::Summary::clear()
+{
+    _lock.acquire();
+    _count = 0;
+    _heap.clear();
+    _pos.clear();
+    _lock.release();
+}
+
+uint64_t
+HeavyHitters::Summary::count() const
+{
+    _lock.acquire();
+    uint64_t c = _count;
+    _lock.release();
+    return c;
+}
+
+int
+HeavyHitters::Summary::size() const
+{
+    _lock.acquire();
+    int n = _heap.size();
+    _lock.release();
+    return n;
+}
+
+void
+HeavyHitters::Summary::snapshot(Summary &x) const
+{
+    _lock.acquire();
+    x._capacity = _capacity;
+    x._count = _count;
+    x._heap = _heap;
+    x._pos = _pos;
+    _lock.release();
+}
+
+void
+HeavyHitters::Summary::sift_down(int i)
+{
+    // Counts only increase, so existing counters only move down the heap.
+    int n = _heap.size();
+    Counter c = _heap[i];
+    while (1) {
+	int child = 2 * i + 1;
+	if (child >= n)
+	    break;
+	if (child + 1 < n && _heap[child + 1].count < _heap[child].count)
+	    ++child;
+	if (_heap[child].count >= c.count)
+	    break;
+	_heap[i] = _heap[child];
+	_pos[_heap[i].aggregate] = i;
+	i = child;
+    }
+    _heap[i] = c;
+    _pos[c.aggregate] = i;
+}
+
+void
+HeavyHitters::Summary::sift_up(int i)
+{
+    // A new counter, appended at the end, may be the smallest.
+    Counter c = _heap[i];
+    while (i > 0) {
+	int parent = (i - 1) / 2;
+	if (_heap[parent].count <= c.count)
+	    break;
+	_heap[i] = _heap[parent];
+	_pos[_heap[i].aggregate] = i;
+	i = parent;
+    }
+    _heap[i] = c;
+    _pos[c.aggregate] = i;
+}
+
+const HeavyHitters::Counter *
+HeavyHitters::Summary::find(uint32_t aggregate) const
+{
+    if (HashTable<uint32_t, int>::const_iterator it = _pos.find(aggregate))
+	return &_heap[it.value()];
+    else
+	return 0;
+}
+
+
+HeavyHitters::HeavyHitters()
+{
+}
+
+HeavyHitters::~HeavyHitters()
+{
+}
+
+int
+HeavyHitters::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    bool bytes = false;
+    bool ip_bytes = false;
+    bool packet_count = true;
+    bool extra_length = true;
+    bool k_given;
+    _capacity = 1024;
+    _k = 10;
+    _threshold = (uint64_t) -1;
+
+    if (Args(conf, this, errh)
+	.read("CAPACITY", _capacity)
+	.read("K", _k).read_status(k_given)
+	.read("THRESHOLD", _threshold)
+	.read("BYTES", bytes)
+	.read("IP_BYTES", ip_bytes)
+	.read("MULTIPACKET", packet_count)
+	.read("EXTRA_LENGTH", extra_length)
+	.complete() < 0)
+	return -1;
+
+    if (_capacity == 0)
+	return errh->error("CAPACITY must be positive");
+    if (_k > _capacity && !k_given)
+	_k = _capacity;
+    else if (_k > _capacity)
+	return errh->error("K must be no larger than CAPACITY");
+
+    _bytes = bytes;
+    _ip_bytes = ip_bytes;
+    _use_packet_count = packet_count;
+    _use_extra_length = extra_length;
+    return 0;
+}
+
+int
+HeavyHitters::initialize(ErrorHandler *)
+{
+    _summaries.resize(click_max_thread_index(master()->nthreads()));
+    for (int i = 0; i < _summaries.size(); ++i)
+	_summaries[i].configure(_capacity);
+    return 0;
+}
+
+void
+HeavyHitters::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _summaries.size(); ++i)
+	_summaries[i].clear();
+}
+
+inline uint64_t
+HeavyHitters::update(Packet *p)
+{
+    uint64_t amount;
+    if (!_bytes)
+	amount = 1 + (_use_packet_count ? EXTRA_PACKETS_ANNO(p) : 0);
+    else {
+	amount = p->length() + (_use_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
+	if (_ip_bytes && p->has_network_header())
+	    amount -= p->network_header_offset();
+    }
+    // AGGREGATE_ANNO is already in host byte order!
+    return _summaries->update(AGGREGATE_ANNO(p), amount);
+}
+
+void
+HeavyHitters::push(int, Packet *p)
+{
+    uint64_t c = update(p);
+    output(noutputs() == 2 && c >= _threshold).push(p);
+}
+
+Packet *
+HeavyHitters::pull(int)
+{
+    Packet *p = input(0).pull();
+    if (p)
+	update(p);
+    return p;
+}
+
+
+// MERGING
+
+static int
+counter_compar(const void *ap, const void *bp, void *)
+{
+    const HeavyHitters::Counter *a = static_cast<const HeavyHitters::Counter *>(ap);
+    const HeavyHitters::Counter *b = static_cast<const HeavyHitters::Counter *>(bp);
+    if (a->count != b->count)
+	return a->count > b->count ? -1 : 1;
+    else
+	return a->aggregate < b->aggregate ? -1 : (a->aggregate > b->aggregate);
+}
+
+void
+HeavyHitters::merge(Vector<Counter> &result) const
+{
+    // Merge Space-Saving summaries: an aggregate absent from a full summary
+    // may have been counted there up to that summary's minimum count, so
+    // charge the minimum to both its count and its error.  Threads keep
+    // updating their summaries, so merge snapshots taken under each
+    // summary's lock.
+    int n = _summaries.size();
+    Summary *s = new Summary[n];
+    for (int t = 0; t < n; ++t)
+	_summaries[t].snapshot(s[t]);
+
+    HashTable<uint32_t, int> seen;
+    result.clear();
+    for (int t = 0; t < n; ++t)
+	for (const Counter *c = s[t].counters().begin();
+	     c != s[t].counters().end(); ++c)
+	    if (seen.set(c->aggregate, 1)) {
+		Counter x = {c->aggregate, 0, 0};
+		result.push_back(x);
+	    }
+
+    for (Counter *r = result.begin(); r != result.end(); ++r)
+	for (int t = 0; t < n; ++t)
+	    if (const Counter *c = s[t].find(r->aggregate)) {
+		r->count += c->count;
+		r->error += c->error;
+	    } else {
+		r->count += s[t].min_count();
+		r->error += s[t].min_count();
+	    }
+    delete[] s;
+
+    click_qsort(result.begin(), result.size(), sizeof(Counter), counter_compar);
+}
+
+
+// HANDLERS
+
+enum { H_COUNT, H_ERROR_BOUND, H_NAGG, H_CLEAR };
+
+String
+HeavyHitters::read_handler(Element *e, void *thunk)
+{
+    HeavyHitters *hh = static_cast<HeavyHitters *>(e);
+    uint64_t count = 0;
+    int nagg = 0;
+    for (int t = 0; t < hh->_summaries.size(); ++t) {
+	count += hh->_summaries[t].count();
+	nagg += hh->_summaries[t].size();
+    }
+    switch ((intptr_t)thunk) {
+      case H_COUNT:
+	return String(count);
+      case H_ERROR_BOUND:
+	return String(count / hh->_capacity);
+      case H_NAGG:
+	return String(nagg);
+      default:
+	return "<error>";
+    }
+}
+
+int
+HeavyHitters::topk_handler(int, String &s, Element *e, const Handler *h, ErrorHandler *errh)
+{
+    HeavyHitters *hh = static_cast<HeavyHitters *>(e);
+    uint32_t k = hh->_k;
+    if (s && !IntArg().parse(cp_uncomment(s), k))
+	return errh->error("expected count");
+
+    Vector<Counter> v;
+    hh->merge(v);
+    bool ip = h->read_user_data() != 0;
+    StringAccum sa;
+    for (int i = 0; i < v.size() && (uint32_t) i < k; ++i) {
+	if (ip)
+	    sa << IPAddress(htonl(v[i].aggregate));
+	else
+	    sa << v[i].aggregate;
+	sa << ' ' << v[i].count << ' ' << v[i].error << '\n';
+    }
+    s = sa.take_string();
+    return 0;
+}
+
+int
+HeavyHitters::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
+{
+    HeavyHitters *hh = static_cast<HeavyHitters *>(e);
+    switch ((intptr_t)thunk) {
+      case H_CLEAR:
+	for (int t = 0; t < hh->_summaries.size(); ++t)
+	    hh->_summaries[t].clear();
+	return 0;
+      default:
+	return -1;
+    }
+}
+
+void
+HeavyHitters::add_handlers()
+{
+    set_handler("topk", Handler::OP_READ | Handler::READ_PARAM, topk_handler, 0);
+    set_handler("topk_ip", Handler::OP_READ | Handler::READ_PARAM, topk_handler, 1);
+    add_read_handler("count", read_handler, H_COUNT);
+    add_read_handler("error_bound", read_handler, H_ERROR_BOUND);
+    add_read_handler("nagg", read_handler, H_NAGG);
+    add_write_handler("clear", write_handler, H_CLEAR, Handler::BUTTON);
+}
+
+ELEMENT_REQUIRES(int64)
+EXPORT_ELEMENT(HeavyHitters)
+CLICK_ENDDECLS
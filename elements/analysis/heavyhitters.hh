@@ -0,0 +1,241 @@
+#ifndef CLICK_HEAVYHITTERS_HH
+#define CLICK_HEAVYHITTERS_HH
+#include <click/element.hh>
+#include <click/hashtable.hh>
+#include <click/multithread.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+
+/*
+=c
+
+HeavyHitters([I<KEYWORDS>])
+
+=s aggregates
+
+finds the most frequent aggregate annotations in bounded memory
+
+=d
+
+HeavyHitters estimates the packet or byte counts of the most frequent
+aggregate annotation values it sees, using at most CAPACITY counters per
+thread.  Unlike AggregateCounter, its memory use does not grow with the
+number of distinct aggregates, so it is suitable for high-cardinality
+aggregates like source addresses.
+
+HeavyHitters implements the Space-Saving algorithm.  Every aggregate with a
+true count greater than I<N>/CAPACITY, where I<N> is the total count seen, is
+guaranteed to be reported.  Each reported count overestimates the true count
+by at most the reported error, which is itself at most I<N>/CAPACITY.
+
+Each driver thread updates its own summary, so HeavyHitters may be used
+from several threads at once without contention.  Handlers merge the
+per-thread summaries when read.  Each summary has its own lock, held by its
+thread for every update and by a handler only while it copies or clears
+that summary, so handlers see a consistent snapshot of each thread and
+never stall more than one thread at a time.
+
+HeavyHitters may have one or two outputs.  If it has two, and is push, then
+packets whose aggregate's estimated count on the current thread has reached
+THRESHOLD are emitted on the second output, and other packets on the first.
+
+Keyword arguments are:
+
+=over 8
+
+=item CAPACITY
+
+Unsigned.  Number of counters kept per thread.  Default is 1024.
+
+=item K
+
+Unsigned.  Number of aggregates reported by the C<topk> handlers when no
+argument is supplied.  Must be no larger than CAPACITY.  Default is 10, or
+CAPACITY if that is smaller.
+
+=item THRESHOLD
+
+Unsigned.  Count at which packets are emitted on the second output, if there
+is one.  Default is never.
+
+=item BYTES
+
+Boolean.  If true, then count bytes, not packets.  Default is false.
+
+=item IP_BYTES
+
+Boolean.  If true, then do not count bytes from the link header.  Default is
+false.
+
+=item MULTIPACKET
+
+Boolean.  If true, and BYTES is false, then use packets' packet count
+annotations to add to the number of packets seen.  Default is true.
+
+=item EXTRA_LENGTH
+
+Boolean.  If true, and BYTES is true, then include packets' extra length
+annotations in the byte counts.  Default is true.
+
+=back
+
+=h topk read-only
+
+Returns the top aggregates, one per line, in decreasing order of estimated
+count.  Each line contains the aggregate ID in decimal, the estimated count,
+and the maximum overestimation error.  Takes an optional argument, the
+number of aggregates to report; the default is K.
+
+=h topk_ip read-only
+
+Like C<topk>, but aggregate IDs are printed as IP addresses.
+
+=h count read-only
+
+Returns the total count of packets or bytes seen.
+
+=h error_bound read-only
+
+Returns the maximum error of any count estimate, which is the total count
+divided by CAPACITY.
+
+=h nagg read-only
+
+Returns the number of aggregates currently monitored, summed across threads.
+
+=h clear write-only
+
+Resets all counters.
+
+=n
+
+The aggregate identifier is stored in host byte order, as by AggregateIP.
+
+=e
+
+  FromDevice(eth0) -> Strip(14) -> CheckIPHeader
+	-> AggregateIP(ip src)
+	-> hh :: HeavyHitters(CAPACITY 4096, K 20, BYTES true)
+	-> Discard;
+
+Reading C<hh.topk_ip> then lists the twenty sources sending the most bytes.
+
+=a
+
+AggregateCounter, AggregateIP, CardinalityEstimator */
+
+class HeavyHitters : public Element { public:
+
+    HeavyHitters() CLICK_COLD;
+    ~HeavyHitters() CLICK_COLD;
+
+    const char *class_name() const	{ return "HeavyHitters"; }
+    const char *port_count() const	{ return "1/1-2"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+    Packet *pull(int);
+
+    struct Counter {
+	uint32_t aggregate;
+	uint64_t count;
+	uint64_t error;
+    };
+
+    /* One thread's counters.  update(), clear(), count(), size(), and
+     * snapshot() lock the summary and may be called from any thread; the
+     * other accessors do not, and are meant for snapshots. */
+    class Summary { public:
+
+	Summary()
+	    : _capacity(0), _count(0) {
+	}
+
+	void configure(uint32_t capacity);
+	void clear();
+
+	inline uint64_t update(uint32_t aggregate, uint64_t amount);
+
+	uint64_t count() const;
+	int size() const;
+	// Copy this summary's counters into @a x, which nobody else uses.
+	void snapshot(Summary &x) const;
+
+	bool full() const		{ return (uint32_t) _heap.size() >= _capacity; }
+	uint64_t min_count() const	{ return full() ? _heap[0].count : 0; }
+	const Counter *find(uint32_t aggregate) const;
+
+	const Vector<Counter> &counters() const { return _heap; }
+
+      private:
+
+	uint32_t _capacity;
+	uint64_t _count;
+	Vector<Counter> _heap;		// min-heap on count
+	HashTable<uint32_t, int> _pos;	// aggregate -> index in _heap
+	mutable SimpleSpinlock _lock;
+
+	void sift_down(int i);
+	void sift_up(int i);
+
+    };
+
+    void merge(Vector<Counter> &result) const;
+
+  private:
+
+    bool _bytes : 1;
+    bool _ip_bytes : 1;
+    bool _use_packet_count : 1;
+    bool _use_extra_length : 1;
+
+    uint32_t _capacity;
+    uint32_t _k;
+    uint64_t _threshold;
+
+    per_thread<Summary> _summaries;
+
+    inline uint64_t update(Packet *);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int topk_handler(int, String &, Element *, const Handler *, ErrorHandler *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+inline uint64_t
+HeavyHitters::Summary::update(uint32_t aggregate, uint64_t amount)
+{
+    _lock.acquire();
+    _count += amount;
+    int i;
+    if (HashTable<uint32_t, int>::iterator it = _pos.find(aggregate))
+	i = it.value();
+    else if (!full()) {
+	Counter c = {aggregate, amount, 0};
+	_heap.push_back(c);
+	_pos.set(aggregate, _heap.size() - 1);
+	sift_up(_heap.size() - 1);
+	_lock.release();
+	return amount;
+    } else {
+	// replace the minimum counter; its count bounds the new error
+	i = 0;
+	_pos.erase(_heap[0].aggregate);
+	_pos.set(aggregate, 0);
+	_heap[0].aggregate = aggregate;
+	_heap[0].error = _heap[0].count;
+    }
+    _heap[i].count += amount;
+    uint64_t c = _heap[i].count;
+    sift_down(i);
+    _lock.release();
+    return c;
+}
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,543 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * ipfixexporter.{cc,hh} -- export IP flow records as IPFIX or NetFlow v9
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "ipfixexporter.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+#include <clicknet/icmp.h>
+CLICK_DECLS
+
+// Template fields, in record order.  NetFlow v9 has no flow end reason and
+// uses 32-bit uptime milliseconds for times.
+static const struct {
+    uint16_t ipfix_id;
+    uint16_t v9_id;
+    uint8_t ipfix_length;
+    uint8_t v9_length;
+} fields[] = {
+    { 8, 8, 4, 4 },		// sourceIPv4Address / IPV4_SRC_ADDR
+    { 12, 12, 4, 4 },		// destinationIPv4Address / IPV4_DST_ADDR
+    { 7, 7, 2, 2 },		// sourceTransportPort / L4_SRC_PORT
+    { 11, 11, 2, 2 },		// destinationTransportPort / L4_DST_PORT
+    { 4, 4, 1, 1 },		// protocolIdentifier / PROTOCOL
+    { 5, 5, 1, 1 },		// ipClassOfService / SRC_TOS
+    { 6, 6, 1, 1 },		// tcpControlBits / TCP_FLAGS
+    { 136, 0, 1, 0 },		// flowEndReason
+    { 2, 2, 8, 8 },		// packetDeltaCount / IN_PKTS
+    { 1, 1, 8, 8 },		// octetDeltaCount / IN_BYTES
+    { 152, 22, 8, 4 },		// flowStartMilliseconds / FIRST_SWITCHED
+    { 153, 21, 8, 4 }		// flowEndMilliseconds / LAST_SWITCHED
+};
+static const int nfields = sizeof(fields) / sizeof(fields[0]);
+
+enum { TEMPLATE_ID = 256 };
+
+static inline uint8_t *
+put8(uint8_t *x, uint8_t v)
+{
+    *x = v;
+    return x + 1;
+}
+
+static inline uint8_t *
+put16(uint8_t *x, uint16_t v)
+{
+    x[0] = v >> 8;
+    x[1] = v;
+    return x + 2;
+}
+
+static inline uint8_t *
+put32(uint8_t *x, uint32_t v)
+{
+    x = put16(x, v >> 16);
+    return put16(x, v);
+}
+
+static inline uint8_t *
+put64(uint8_t *x, uint64_t v)
+{
+    x = put32(x, v >> 32);
+    return put32(x, v);
+}
+
+inline bool
+IPFIXExporter::FlowKey::operator==(const FlowKey &x) const
+{
+    return src == x.src && dst == x.dst && sport == x.sport
+	&& dport == x.dport && proto == x.proto && tos == x.tos;
+}
+
+inline uint32_t
+IPFIXExporter::FlowKey::hashcode() const
+{
+    uint32_t h = src * 0x9E3779B1U;
+    h ^= dst + 0x7F4A7C15U + (h << 6) + (h >> 2);
+    h ^= ((sport << 16) | dport) + (h << 6) + (h >> 2);
+    h ^= ((proto << 8) | tos) + (h << 6) + (h >> 2);
+    return h;
+}
+
+
+IPFIXExporter::IPFIXExporter()
+    : _flows(0), _buckets(0), _msg(0), _timer(this)
+{
+}
+
+IPFIXExporter::~IPFIXExporter()
+{
+}
+
+int
+IPFIXExporter::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _version = 10;
+    _domain = 0;
+    _capacity = 65536;
+    _active_timeout = 1800;
+    _idle_timeout = 15;
+    _template_interval = 600;
+    _mtu = 1400;
+
+    if (Args(conf, this, errh)
+	.read("VERSION", _version)
+	.read("DOMAIN", _domain)
+	.read("CAPACITY", _capacity)
+	.read("ACTIVE_TIMEOUT", SecondsArg(), _active_timeout)
+	.read("IDLE_TIMEOUT", SecondsArg(), _idle_timeout)
+	.read("TEMPLATE_INTERVAL", SecondsArg(), _template_interval)
+	.read("MTU", _mtu)
+	.complete() < 0)
+	return -1;
+
+    if (_version != 9 && _version != 10)
+	return errh->error("VERSION must be 9 or 10");
+    if (_capacity == 0 || _capacity > 0x10000000)
+	return errh->error("bad CAPACITY");
+    // the first message must hold a template and one record
+    uint32_t min_mtu = (_version == 9 ? 20 : 16) + 8 + 4 + record_length();
+    for (int i = 0; i < nfields; ++i)
+	if (_version == 10 || fields[i].v9_id)
+	    min_mtu += 4;
+    if (_mtu < min_mtu)
+	return errh->error("MTU must be at least %u", min_mtu);
+    return 0;
+}
+
+int
+IPFIXExporter::initialize(ErrorHandler *errh)
+{
+    uint32_t nbuckets = 1;
+    while (nbuckets < _capacity)
+	nbuckets <<= 1;
+    _bucket_mask = nbuckets - 1;
+
+    if (!(_flows = new Flow[_capacity]) || !(_buckets = new int[nbuckets]))
+	return errh->error("out of memory!");
+    for (uint32_t i = 0; i < nbuckets; ++i)
+	_buckets[i] = -1;
+    for (uint32_t i = 0; i < _capacity; ++i)
+	_flows[i].next = (i + 1 < _capacity ? i + 1 : -1);
+    _free = 0;
+    _lru_head = _lru_tail = -1;
+    _nflows = 0;
+
+    _nrecords = 0;
+    _template_pending = true;
+    _start = _clock = Timestamp();
+    _sequence = 0;
+    _exported_flows = _evicted_flows = 0;
+    _exported_messages = 0;
+
+    _timer.initialize(this);
+    _timer.schedule_after_sec(1);
+    return 0;
+}
+
+void
+IPFIXExporter::cleanup(CleanupStage)
+{
+    if (_msg)
+	_msg->kill();
+    _msg = 0;
+    delete[] _flows;
+    delete[] _buckets;
+    _flows = 0;
+    _buckets = 0;
+}
+
+
+// FLOW CACHE
+
+inline int
+IPFIXExporter::find_flow(const FlowKey &key, uint32_t hash) const
+{
+    int i = _buckets[hash & _bucket_mask];
+    while (i >= 0 && !(_flows[i].key == key))
+	i = _flows[i].hnext;
+    return i;
+}
+
+inline void
+IPFIXExporter::lru_unlink(int i)
+{
+    Flow &f = _flows[i];
+    if (f.prev >= 0)
+	_flows[f.prev].next = f.next;
+    else
+	_lru_head = f.next;
+    if (f.next >= 0)
+	_flows[f.next].prev = f.prev;
+    else
+	_lru_tail = f.prev;
+}
+
+inline void
+IPFIXExporter::lru_append(int i)
+{
+    Flow &f = _flows[i];
+    f.prev = _lru_tail;
+    f.next = -1;
+    if (_lru_tail >= 0)
+	_flows[_lru_tail].next = i;
+    else
+	_lru_head = i;
+    _lru_tail = i;
+}
+
+int
+IPFIXExporter::new_flow(const FlowKey &key, uint32_t hash, const Timestamp &now)
+{
+    if (_free < 0) {
+	// cache full: export the least recently used flow
+	++_evicted_flows;
+	export_flow(_lru_head, END_RESOURCES);
+    }
+
+    int i = _free;
+    Flow &f = _flows[i];
+    _free = f.next;
+    f.key = key;
+    f.tcp_flags = 0;
+    f.ended = false;
+    f.packets = f.bytes = 0;
+    f.first_seen = now;
+    f.hnext = _buckets[hash & _bucket_mask];
+    _buckets[hash & _bucket_mask] = i;
+    lru_append(i);
+    ++_nflows;
+    return i;
+}
+
+void
+IPFIXExporter::remove_flow(int i)
+{
+    Flow &f = _flows[i];
+    int *pprev = &_buckets[f.key.hashcode() & _bucket_mask];
+    while (*pprev != i)
+	pprev = &_flows[*pprev].hnext;
+    *pprev = f.hnext;
+    lru_unlink(i);
+    f.next = _free;
+    _free = i;
+    --_nflows;
+}
+
+void
+IPFIXExporter::push(int, Packet *p)
+{
+    if (p->has_network_header() && p->network_length() >= (int) sizeof(click_ip)) {
+	const click_ip *iph = p->ip_header();
+	FlowKey key;
+	key.src = iph->ip_src.s_addr;
+	key.dst = iph->ip_dst.s_addr;
+	key.sport = key.dport = 0;
+	key.proto = iph->ip_p;
+	key.tos = iph->ip_tos;
+	uint8_t tcp_flags = 0;
+
+	if (IP_FIRSTFRAG(iph) && p->has_transport_header()) {
+	    const uint8_t *th = p->transport_header();
+	    int tlen = p->transport_length();
+	    if ((key.proto == IP_PROTO_TCP || key.proto == IP_PROTO_UDP)
+		&& tlen >= 4) {
+		key.sport = (th[0] << 8) | th[1];
+		key.dport = (th[2] << 8) | th[3];
+		if (key.proto == IP_PROTO_TCP && tlen >= 14)
+		    tcp_flags = p->tcp_header()->th_flags;
+	    } else if (key.proto == IP_PROTO_ICMP && tlen >= 2)
+		// conventional encoding of ICMP type and code
+		key.dport = (th[0] << 8) | th[1];
+	}
+
+	Timestamp now = Timestamp::now();
+	Timestamp ts = p->timestamp_anno() ? p->timestamp_anno() : now;
+	if (!_start)
+	    _start = ts;
+	if (ts > _clock)
+	    _clock = ts;
+	uint32_t hash = key.hashcode();
+	int i = find_flow(key, hash);
+	if (i < 0) {
+	    i = new_flow(key, hash, now);
+	    _flows[i].first = ts;
+	} else {
+	    lru_unlink(i);
+	    lru_append(i);
+	}
+
+	Flow &f = _flows[i];
+	f.packets++;
+	f.bytes += ntohs(iph->ip_len);
+	f.tcp_flags |= tcp_flags;
+	f.last = ts;
+	f.last_seen = now;
+	if (tcp_flags & (TH_FIN | TH_RST))
+	    f.ended = true;
+    }
+
+    if (noutputs() == 2)
+	output(0).push(p);
+    else
+	p->kill();
+}
+
+void
+IPFIXExporter::expire_flows(const Timestamp &now, bool force)
+{
+    Timestamp idle = now - Timestamp(_idle_timeout, 0);
+    Timestamp active = now - Timestamp(_active_timeout, 0);
+    int next;
+    for (int i = _lru_head; i >= 0; i = next) {
+	Flow &f = _flows[i];
+	next = f.next;
+	if (force)
+	    export_flow(i, END_FORCED);
+	else if (f.ended)
+	    export_flow(i, END_DETECTED);
+	else if (f.last_seen <= idle)
+	    export_flow(i, END_IDLE);
+	else if (f.first_seen <= active)
+	    export_flow(i, END_ACTIVE);
+    }
+}
+
+void
+IPFIXExporter::run_timer(Timer *)
+{
+    Timestamp now = Timestamp::now();
+    expire_flows(now, false);
+    if (!_template_pending && _template_interval
+	&& now - _template_sent >= Timestamp(_template_interval, 0))
+	_template_pending = true;
+    if (_template_pending && !_msg)
+	start_message(now);
+    if (_msg)
+	finish_message();
+    _timer.reschedule_after_sec(1);
+}
+
+
+// EXPORT MESSAGES
+
+int
+IPFIXExporter::record_length() const
+{
+    int len = 0;
+    for (int i = 0; i < nfields; ++i)
+	len += (_version == 9 ? fields[i].v9_length : fields[i].ipfix_length);
+    return len;
+}
+
+void
+IPFIXExporter::start_message(const Timestamp &now)
+{
+    assert(!_msg);
+    if (!(_msg = Packet::make(Packet::default_headroom, 0, _mtu, 0)))
+	return;
+    _msg_len = (_version == 9 ? 20 : 16);
+    _nrecords = 0;
+    _msg->timestamp_anno() = now;
+    if (_template_pending) {
+	append_template();
+	_template_pending = false;
+	_template_sent = now;
+    }
+    _set_offset = _msg_len;
+    _msg_len += 4;
+}
+
+void
+IPFIXExporter::append_template()
+{
+    uint8_t *start = _msg->data() + _msg_len;
+    uint8_t *x = start + 4;
+    int n = 0;
+    for (int i = 0; i < nfields; ++i)
+	if (_version == 10 || fields[i].v9_id)
+	    ++n;
+    x = put16(x, TEMPLATE_ID);
+    x = put16(x, n);
+    for (int i = 0; i < nfields; ++i)
+	if (_version == 10)
+	    x = put16(put16(x, fields[i].ipfix_id), fields[i].ipfix_length);
+	else if (fields[i].v9_id)
+	    x = put16(put16(x, fields[i].v9_id), fields[i].v9_length);
+    // template set header: set ID 2 for IPFIX, flowset ID 0 for NetFlow v9
+    put16(put16(start, _version == 10 ? 2 : 0), x - start);
+    _msg_len += x - start;
+    if (_version == 9)
+	++_nrecords;		// v9 count includes template records
+}
+
+void
+IPFIXExporter::export_flow(int i, int reason)
+{
+    Flow &f = _flows[i];
+    Timestamp now = Timestamp::now();
+    int reclen = record_length();
+    if (_msg && _msg_len + reclen > _mtu)
+	finish_message();
+    if (!_msg)
+	start_message(now);
+
+    if (_msg) {
+	uint8_t *x = _msg->data() + _msg_len;
+	x = put32(x, ntohl(f.key.src));
+	x = put32(x, ntohl(f.key.dst));
+	x = put16(x, f.key.sport);
+	x = put16(x, f.key.dport);
+	x = put8(x, f.key.proto);
+	x = put8(x, f.key.tos);
+	x = put8(x, f.tcp_flags);
+	if (_version == 10) {
+	    x = put8(x, reason);
+	    x = put64(x, f.packets);
+	    x = put64(x, f.bytes);
+	    x = put64(x, f.first.msecval());
+	    x = put64(x, f.last.msecval());
+	} else {
+	    x = put64(x, f.packets);
+	    x = put64(x, f.bytes);
+	    x = put32(x, (f.first - _start).msecval());
+	    x = put32(x, (f.last - _start).msecval());
+	}
+	_msg_len += reclen;
+	++_nrecords;
+	++_exported_flows;
+    }
+
+    remove_flow(i);
+}
+
+void
+IPFIXExporter::finish_message()
+{
+    WritablePacket *q = _msg;
+    _msg = 0;
+    uint8_t *data = q->data();
+
+    // patch data set length, or drop an empty data set
+    if (_msg_len == _set_offset + 4)
+	_msg_len = _set_offset;
+    else
+	put16(put16(data + _set_offset, TEMPLATE_ID), _msg_len - _set_offset);
+
+    const Timestamp &now = q->timestamp_anno();
+    if (_version == 10) {
+	uint8_t *x = put16(data, 10);
+	x = put16(x, _msg_len);
+	x = put32(x, now.sec());
+	x = put32(x, _sequence);
+	put32(x, _domain);
+	_sequence += _nrecords;
+    } else {
+	// uptime runs on the packet clock, so a collector reconstructs the
+	// same flow times as from IPFIX
+	Timestamp clock = (_clock ? _clock : now);
+	Timestamp start = (_start ? _start : clock);
+	uint8_t *x = put16(data, 9);
+	x = put16(x, _nrecords);
+	x = put32(x, (clock - start).msecval());
+	x = put32(x, clock.sec());
+	x = put32(x, _sequence);
+	put32(x, _domain);
+	_sequence++;
+    }
+
+    q->take(q->length() - _msg_len);
+    ++_exported_messages;
+    output(noutputs() - 1).push(q);
+}
+
+
+// HANDLERS
+
+enum { H_FLOWS, H_EXPORTED_FLOWS, H_EXPORTED_MESSAGES, H_EVICTED_FLOWS,
+       H_FLUSH, H_SEND_TEMPLATE };
+
+String
+IPFIXExporter::read_handler(Element *e, void *thunk)
+{
+    IPFIXExporter *fx = static_cast<IPFIXExporter *>(e);
+    switch ((intptr_t)thunk) {
+      case H_FLOWS:
+	return String(fx->_nflows);
+      case H_EXPORTED_FLOWS:
+	return String(fx->_exported_flows);
+      case H_EXPORTED_MESSAGES:
+	return String(fx->_exported_messages);
+      case H_EVICTED_FLOWS:
+	return String(fx->_evicted_flows);
+      default:
+	return "<error>";
+    }
+}
+
+int
+IPFIXExporter::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
+{
+    IPFIXExporter *fx = static_cast<IPFIXExporter *>(e);
+    switch ((intptr_t)thunk) {
+      case H_FLUSH:
+	fx->expire_flows(Timestamp::now(), true);
+	if (fx->_msg)
+	    fx->finish_message();
+	return 0;
+      case H_SEND_TEMPLATE:
+	fx->_template_pending = true;
+	return 0;
+      default:
+	return -1;
+    }
+}
+
+void
+IPFIXExporter::add_handlers()
+{
+    add_read_handler("flows", read_handler, H_FLOWS);
+    add_read_handler("exported_flows", read_handler, H_EXPORTED_FLOWS);
+    add_read_handler("exported_messages", read_handler, H_EXPORTED_MESSAGES);
+    add_read_handler("evicted_flows", read_handler, H_EVICTED_FLOWS);
+    add_write_handler("flush", write_handler, H_FLUSH, Handler::BUTTON);
+    add_write_handler("send_template", write_handler, H_SEND_TEMPLATE, Handler::BUTTON);
+}
+
+ELEMENT_REQUIRES(int64)
+EXPORT_ELEMENT(IPFIXExporter)
+CLICK_ENDDECLS
@@ -0,0 +1,225 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IPFIXEXPORTER_HH
+#define CLICK_IPFIXEXPORTER_HH
+#include <click/element.hh>
+#include <click/timer.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+
+/*
+=c
+
+IPFIXExporter([I<KEYWORDS>])
+
+=s ipmeasure
+
+exports IP flow records as IPFIX or NetFlow v9 messages
+
+=d
+
+IPFIXExporter meters the IP packets passing through it into flows, keyed by
+source and destination address, source and destination port, protocol, and
+TOS, and exports a record for each flow when it ends.  Export messages are
+emitted as UDP payloads, ready for UDPIPEncap; they carry no IP or UDP
+headers of their own.
+
+IPFIXExporter may have one or two outputs.  If it has two, input packets are
+passed unchanged to output 0 and export messages are emitted on output 1.  If
+it has one, input packets are killed after metering and export messages are
+emitted on output 0.  Input packets must have their IP header annotations
+set.
+
+A flow ends when it has seen no packets for IDLE_TIMEOUT, when it has been
+active for ACTIVE_TIMEOUT (a long flow is then exported in several records),
+when a TCP FIN or RST is seen, or when the flow cache is full and the flow is
+the least recently used.  Flows are checked once a second.  Records for
+several flows are packed into one message of at most MTU bytes; a message is
+sent when it is full or at the next check.
+
+Templates are sent in the first message and again every TEMPLATE_INTERVAL,
+as UDP transport requires.
+
+Each record contains the flow key, TCP flags seen, packet and byte counts,
+start and end times, and (for IPFIX) the reason the flow ended.  Times are
+taken from packet timestamp annotations if set, and the current time
+otherwise; timeouts use the current time.  NetFlow v9 times are relative to
+a system uptime that starts at the first packet's timestamp, and message
+headers report the latest packet timestamp, so IPFIX and NetFlow v9 exports
+of the same trace yield the same flow times.
+
+IPFIXExporter must not be used by more than one thread at a time.
+
+Keyword arguments are:
+
+=over 8
+
+=item VERSION
+
+Integer, either 10 (IPFIX) or 9 (NetFlow version 9).  Default is 10.
+
+=item DOMAIN
+
+Unsigned.  The observation domain ID (IPFIX) or source ID (NetFlow v9).
+Default is 0.
+
+=item CAPACITY
+
+Unsigned.  Maximum number of flows in the cache.  Default is 65536.
+
+=item ACTIVE_TIMEOUT
+
+Time in seconds.  Default is 1800 (30 minutes).
+
+=item IDLE_TIMEOUT
+
+Time in seconds.  Default is 15.
+
+=item TEMPLATE_INTERVAL
+
+Time in seconds.  Default is 600.
+
+=item MTU
+
+Unsigned.  Maximum size of an export message in bytes.  Default is 1400.
+
+=back
+
+=h flows read-only
+
+Returns the number of flows in the cache.
+
+=h exported_flows read-only
+
+Returns the number of flow records exported.
+
+=h exported_messages read-only
+
+Returns the number of export messages emitted.
+
+=h evicted_flows read-only
+
+Returns the number of flows exported early because the cache was full.
+
+=h flush write-only
+
+Export all flows in the cache now.
+
+=h send_template write-only
+
+Send the template in the next message.
+
+=e
+
+  FromDevice(eth0) -> Strip(14) -> CheckIPHeader
+	-> fx :: IPFIXExporter(IDLE_TIMEOUT 10);
+  fx[0] -> ToHost;
+  fx[1] -> UDPIPEncap(10.0.0.1, 4739, 10.0.0.2, 4739)
+	-> EtherEncap(0x0800, 00:01:02:03:04:05, 00:0a:0b:0c:0d:0e)
+	-> Queue -> ToDevice(eth1);
+
+=a
+
+AggregateIPFlows, FromNetFlowSummaryDump, UDPIPEncap */
+
+class IPFIXExporter : public Element { public:
+
+    IPFIXExporter() CLICK_COLD;
+    ~IPFIXExporter() CLICK_COLD;
+
+    const char *class_name() const	{ return "IPFIXExporter"; }
+    const char *port_count() const	{ return "1/1-2"; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+    void run_timer(Timer *);
+
+    enum {
+	END_IDLE = 1, END_ACTIVE = 2, END_DETECTED = 3, END_FORCED = 4,
+	END_RESOURCES = 5
+    };
+
+  private:
+
+    struct FlowKey {
+	uint32_t src;
+	uint32_t dst;
+	uint16_t sport;
+	uint16_t dport;
+	uint8_t proto;
+	uint8_t tos;
+	inline bool operator==(const FlowKey &x) const;
+	inline uint32_t hashcode() const;
+    };
+
+    struct Flow {
+	FlowKey key;
+	uint8_t tcp_flags;
+	bool ended;
+	uint64_t packets;
+	uint64_t bytes;
+	Timestamp first;
+	Timestamp last;
+	Timestamp first_seen;	// current time at creation and last update,
+	Timestamp last_seen;	// for timeouts
+	int hnext;		// hash chain
+	int prev;		// LRU list, or free list via next
+	int next;
+    };
+
+    int _version;
+    uint32_t _domain;
+    uint32_t _capacity;
+    uint32_t _active_timeout;
+    uint32_t _idle_timeout;
+    uint32_t _template_interval;
+    uint32_t _mtu;
+
+    Flow *_flows;
+    int *_buckets;
+    uint32_t _bucket_mask;
+    int _free;
+    int _lru_head;		// least recently used
+    int _lru_tail;
+    uint32_t _nflows;
+
+    WritablePacket *_msg;	// export message being built
+    uint32_t _msg_len;
+    uint32_t _set_offset;	// offset of data set header in _msg
+    int _nrecords;		// records in _msg
+    Timestamp _template_sent;
+    bool _template_pending;
+    Timestamp _start;		// first packet time, for NetFlow v9 uptime
+    Timestamp _clock;		// latest packet time
+    uint32_t _sequence;
+
+    uint64_t _exported_flows;
+    uint32_t _exported_messages;
+    uint64_t _evicted_flows;
+
+    Timer _timer;
+
+    inline int find_flow(const FlowKey &, uint32_t hash) const;
+    int new_flow(const FlowKey &, uint32_t hash, const Timestamp &now);
+    void remove_flow(int);
+    inline void lru_unlink(int);
+    inline void lru_append(int);
+
+    void export_flow(int, int reason);
+    void expire_flows(const Timestamp &now, bool force);
+    int record_length() const;
+    void start_message(const Timestamp &now);
+    void append_template();
+    void finish_message();
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,319 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * quantileestimator.{cc,hh} -- estimate quantiles of packet values
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "quantileestimator.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet_anno.hh>
+#include <click/master.hh>
+#include <math.h>
+#include <limits.h>
+CLICK_DECLS
+
+bool
+QuantileEstimator::Sketch::initialize(int nbins)
+{
+    delete[] _bins;
+    _nbins = nbins;
+    if (!(_bins = new uint64_t[nbins]))
+	return false;
+    clear();
+    return true;
+}
+
+void
+QuantileEstimator::Sketch::clear()
+{
+    if (_bins)
+	memset(_bins, 0, sizeof(uint64_t) * _nbins);
+    _lo = 0;
+    _empty = true;
+    _zero_count = _count = 0;
+    sum = min = max = 0;
+}
+
+void
+QuantileEstimator::Sketch::add(int index, uint64_t count)
+{
+    if (_empty) {
+	// center the window on the first value
+	_lo = index - _nbins / 2;
+	_empty = false;
+    }
+    if (index < _lo)
+	index = _lo;
+    else if (index >= _lo + _nbins) {
+	// slide the window up, collapsing the lowest bins
+	int shift = index - (_lo + _nbins - 1);
+	if (shift >= _nbins) {
+	    uint64_t total = 0;
+	    for (int i = 0; i < _nbins; ++i)
+		total += _bins[i];
+	    memset(_bins, 0, sizeof(uint64_t) * _nbins);
+	    _bins[0] = total;
+	} else {
+	    uint64_t total = 0;
+	    for (int i = 0; i <= shift; ++i)
+		total += _bins[i];
+	    memmove(_bins, _bins + shift, sizeof(uint64_t) * (_nbins - shift));
+	    memset(_bins + _nbins - shift, 0, sizeof(uint64_t) * shift);
+	    _bins[0] = total;
+	}
+	_lo += shift;
+    }
+    _bins[index - _lo] += count;
+    _count += count;
+}
+
+void
+QuantileEstimator::Sketch::merge(const Sketch &x)
+{
+    if (x._count == 0)
+	return;
+    if (_count == 0)
+	min = x.min, max = x.max;
+    else {
+	min = (x.min < min ? x.min : min);
+	max = (x.max > max ? x.max : max);
+    }
+    sum += x.sum;
+    add_zero(x._zero_count);
+    if (!x._empty)
+	for (int i = 0; i < x._nbins; ++i)
+	    if (x._bins[i])
+		add(x._lo + i, x._bins[i]);
+}
+
+int
+QuantileEstimator::Sketch::index_at_rank(uint64_t rank) const
+{
+    if (rank < _zero_count)
+	return INT_MIN;
+    rank -= _zero_count;
+    for (int i = 0; i < _nbins; ++i) {
+	if (rank < _bins[i])
+	    return _lo + i;
+	rank -= _bins[i];
+    }
+    return _lo + _nbins - 1;
+}
+
+
+QuantileEstimator::QuantileEstimator()
+{
+}
+
+QuantileEstimator::~QuantileEstimator()
+{
+}
+
+int
+QuantileEstimator::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String value = "LENGTH";
+    String quantiles = "0.5 0.9 0.99";
+    _accuracy = 0.01;
+    _max_bins = 2048;
+
+    if (Args(conf, this, errh)
+	.read("VALUE", WordArg(), value)
+	.read("ACCURACY", _accuracy)
+	.read("MAX_BINS", _max_bins)
+	.read("QUANTILES", AnyArg(), quantiles)
+	.complete() < 0)
+	return -1;
+
+    if (value == "LENGTH")
+	_value = V_LENGTH;
+    else if (value == "IP_LENGTH")
+	_value = V_IP_LENGTH;
+    else if (value == "LATENCY")
+	_value = V_LATENCY;
+    else
+	return errh->error("bad VALUE");
+
+    if (!(_accuracy > 0 && _accuracy < 1))
+	return errh->error("ACCURACY must be between 0 and 1");
+    if (_max_bins < 16)
+	return errh->error("MAX_BINS must be at least 16");
+    _gamma = (1 + _accuracy) / (1 - _accuracy);
+    _log_gamma = log(_gamma);
+
+    _quantiles.clear();
+    Vector<String> words;
+    cp_spacevec(quantiles, words);
+    for (String *w = words.begin(); w != words.end(); ++w) {
+	double q;
+	if (!DoubleArg().parse(*w, q) || q < 0 || q > 1)
+	    return errh->error("QUANTILES should be numbers between 0 and 1");
+	_quantiles.push_back(q);
+    }
+    return 0;
+}
+
+int
+QuantileEstimator::initialize(ErrorHandler *errh)
+{
+    _sketches.resize(click_max_thread_index(master()->nthreads()));
+    for (int t = 0; t < _sketches.size(); ++t)
+	if (!_sketches[t].initialize(_max_bins))
+	    return errh->error("out of memory!");
+    return 0;
+}
+
+void
+QuantileEstimator::cleanup(CleanupStage)
+{
+    for (int t = 0; t < _sketches.size(); ++t)
+	_sketches[t].clear();
+}
+
+Packet *
+QuantileEstimator::simple_action(Packet *p)
+{
+    double x;
+    if (_value == V_LENGTH)
+	x = p->length() + EXTRA_LENGTH_ANNO(p);
+    else if (_value == V_IP_LENGTH)
+	x = p->has_network_header() ? p->network_length() : p->length();
+    else {
+	if (!p->timestamp_anno())
+	    return p;
+	Timestamp delta = Timestamp::now() - p->timestamp_anno();
+	x = delta.doubleval() * 1000000;
+	if (x < 0)
+	    x = 0;
+    }
+
+    Sketch *s = _sketches.get();
+    if (s->count() == 0)
+	s->min = s->max = x;
+    else if (x < s->min)
+	s->min = x;
+    else if (x > s->max)
+	s->max = x;
+    s->sum += x;
+    if (x < 1e-9)
+	s->add_zero(1);
+    else
+	s->add((int) ceil(log(x) / _log_gamma), 1);
+    return p;
+}
+
+void
+QuantileEstimator::merge(Sketch &result) const
+{
+    const per_thread<Sketch> &s = _sketches;
+    result.initialize(_max_bins);
+    for (int t = 0; t < s.size(); ++t)
+	result.merge(s[t]);
+}
+
+double
+QuantileEstimator::quantile(const Sketch &merged, double q) const
+{
+    if (merged.count() == 0)
+	return 0;
+    uint64_t rank = (uint64_t) (q * (merged.count() - 1));
+    // the extremes are tracked exactly
+    if (rank == 0)
+	return merged.min;
+    else if (rank == merged.count() - 1)
+	return merged.max;
+    int index = merged.index_at_rank(rank);
+    if (index == INT_MIN)
+	return 0;
+    double x = 2 * exp(index * _log_gamma) / (_gamma + 1);
+    // clamp to the observed range
+    if (x < merged.min)
+	x = merged.min;
+    if (x > merged.max)
+	x = merged.max;
+    return x;
+}
+
+enum { H_QUANTILES, H_COUNT, H_MIN, H_MAX, H_MEAN, H_CLEAR };
+
+String
+QuantileEstimator::read_handler(Element *e, void *thunk)
+{
+    QuantileEstimator *qe = static_cast<QuantileEstimator *>(e);
+    Sketch merged;
+    qe->merge(merged);
+    switch ((intptr_t)thunk) {
+      case H_QUANTILES: {
+	  StringAccum sa;
+	  for (int i = 0; i < qe->_quantiles.size(); ++i)
+	      sa << qe->_quantiles[i] << ' '
+		 << qe->quantile(merged, qe->_quantiles[i]) << '\n';
+	  return sa.take_string();
+      }
+      case H_COUNT:
+	return String(merged.count());
+      case H_MIN:
+	return String(merged.min);
+      case H_MAX:
+	return String(merged.max);
+      case H_MEAN:
+	return String(merged.count() ? merged.sum / merged.count() : 0.);
+      default:
+	return "<error>";
+    }
+}
+
+int
+QuantileEstimator::quantile_handler(int, String &s, Element *e, const Handler *, ErrorHandler *errh)
+{
+    QuantileEstimator *qe = static_cast<QuantileEstimator *>(e);
+    double q;
+    if (!DoubleArg().parse(cp_uncomment(s), q) || q < 0 || q > 1)
+	return errh->error("expected quantile between 0 and 1");
+    Sketch merged;
+    qe->merge(merged);
+    s = String(qe->quantile(merged, q));
+    return 0;
+}
+
+int
+QuantileEstimator::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
+{
+    QuantileEstimator *qe = static_cast<QuantileEstimator *>(e);
+    switch ((intptr_t)thunk) {
+      case H_CLEAR:
+	for (int t = 0; t < qe->_sketches.size(); ++t)
+	    qe->_sketches[t].clear();
+	return 0;
+      default:
+	return -1;
+    }
+}
+
+void
+QuantileEstimator::add_handlers()
+{
+    set_handler("quantile", Handler::OP_READ | Handler::READ_PARAM, quantile_handler);
+    add_read_handler("quantiles", read_handler, H_QUANTILES);
+    add_read_handler("count", read_handler, H_COUNT);
+    add_read_handler("min", read_handler, H_MIN);
+    add_read_handler("max", read_handler, H_MAX);
+    add_read_handler("mean", read_handler, H_MEAN);
+    add_write_handler("clear", write_handler, H_CLEAR, Handler::BUTTON);
+}
+
+ELEMENT_REQUIRES(userlevel int64)
+EXPORT_ELEMENT(QuantileEstimator)
+CLICK_ENDDECLS
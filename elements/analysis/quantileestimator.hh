@@ -0,0 +1,172 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_QUANTILEESTIMATOR_HH
+#define CLICK_QUANTILEESTIMATOR_HH
+#include <click/element.hh>
+#include <click/multithread.hh>
+CLICK_DECLS
+
+/*
+=c
+
+QuantileEstimator([I<KEYWORDS>])
+
+=s measurement
+
+estimates quantiles of packet sizes or latencies
+
+=d
+
+QuantileEstimator estimates the distribution of a per-packet value, such as
+packet length or the time since the packet's timestamp annotation, using a
+DDSketch.  Every estimated quantile is within a relative error of ACCURACY
+of a true value from the data.  Memory use is fixed at MAX_BINS counters per
+thread; if the values span more than MAX_BINS bins, the lowest bins are
+collapsed together, losing accuracy only for the smallest values.
+
+Each driver thread updates its own sketch; handlers merge them when read.
+
+Keyword arguments are:
+
+=over 8
+
+=item VALUE
+
+The value to measure.  C<LENGTH> means the packet length, plus any extra
+length annotation; C<IP_LENGTH> means the length from the network header on;
+C<LATENCY> means the difference between the current time and the packet's
+timestamp annotation, in microseconds.  Packets with zero timestamps are not
+measured for C<LATENCY>.  Default is C<LENGTH>.
+
+=item ACCURACY
+
+Real number between 0 and 1.  The relative accuracy guarantee.  Default is
+0.01.
+
+=item MAX_BINS
+
+Unsigned.  Maximum number of bins per thread.  Default is 2048.
+
+=item QUANTILES
+
+Space-separated list of quantiles reported by the C<quantiles> handler.
+Default is "0.5 0.9 0.99".
+
+=back
+
+=h quantile read-only
+
+Takes a quantile between 0 and 1 as an argument, and returns the estimated
+value at that quantile.
+
+=h quantiles read-only
+
+Returns the QUANTILES, one per line, each followed by its estimated value.
+
+=h count read-only
+
+Returns the number of values measured.
+
+=h min read-only
+
+Returns the minimum value measured.
+
+=h max read-only
+
+Returns the maximum value measured.
+
+=h mean read-only
+
+Returns the mean value measured.
+
+=h clear write-only
+
+Resets the estimator.
+
+=e
+
+  FromDevice(eth0) -> q :: QuantileEstimator(VALUE LENGTH) -> ...
+
+Reading C<q.quantile 0.99> returns the approximate 99th percentile packet
+length.
+
+=a
+
+TimestampAccum, CardinalityEstimator, HeavyHitters */
+
+class QuantileEstimator : public Element { public:
+
+    QuantileEstimator() CLICK_COLD;
+    ~QuantileEstimator() CLICK_COLD;
+
+    const char *class_name() const	{ return "QuantileEstimator"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    Packet *simple_action(Packet *);
+
+    class Sketch { public:
+
+	Sketch()
+	    : _bins(0), _nbins(0) {
+	}
+	~Sketch() {
+	    delete[] _bins;
+	}
+
+	bool initialize(int nbins);
+	void clear();
+
+	void add(int index, uint64_t count);
+	void add_zero(uint64_t count)	{ _zero_count += count; _count += count; }
+	void merge(const Sketch &x);
+
+	uint64_t count() const		{ return _count; }
+	// Return the index of the bin at rank @a rank, or INT_MIN for zero.
+	int index_at_rank(uint64_t rank) const;
+
+	double sum;
+	double min;
+	double max;
+
+      private:
+
+	uint64_t *_bins;
+	int _nbins;
+	int _lo;		// index of _bins[0]
+	bool _empty;
+	uint64_t _zero_count;
+	uint64_t _count;
+
+	Sketch(const Sketch &);
+	Sketch &operator=(const Sketch &);
+
+    };
+
+    void merge(Sketch &result) const;
+    double quantile(const Sketch &merged, double q) const;
+
+  private:
+
+    enum { V_LENGTH, V_IP_LENGTH, V_LATENCY };
+
+    int _value;
+    double _accuracy;
+    double _gamma;
+    double _log_gamma;
+    uint32_t _max_bins;
+    Vector<double> _quantiles;
+
+    per_thread<Sketch> _sketches;
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int quantile_handler(int, String &, Element *, const Handler *, ErrorHandler *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
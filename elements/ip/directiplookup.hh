@@ -92,6 +92,7 @@ class DirectIPLookup : public IPRouteTable { public:
     const char *class_name() const	{ return "DirectIPLookup"; }
     const char *port_count() const	{ return "1/-"; }
     const char *processing() const	{ return PUSH; }
+    const char *flags() const		{ return "P"; }
 
     int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
     void cleanup(CleanupStage stage) CLICK_COLD;
@@ -39,6 +39,9 @@ cp_ip_route(String s, IPRoute *r_store, bool remove_route, Element *context)
     String word = cp_shift_spacevec(s);
     if (word == "-")
 	/* null gateway; do nothing */;
+    else if (!s && !remove_route)
+	// common case: a lone OUTPUT; don't look it up as a gateway name
+	goto two_words;
     else if (IPAddressArg().parse(word, r.gw, context))
 	/* do nothing */;
     else
@@ -88,6 +88,7 @@ class RangeIPLookup : public IPRouteTable { public:
     const char *class_name() const      { return "RangeIPLookup"; }
     const char *port_count() const	{ return "1/-"; }
     const char *processing() const      { return PUSH; }
+    const char *flags() const           { return "P"; }
 
     int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
     int initialize(ErrorHandler *errh) CLICK_COLD;
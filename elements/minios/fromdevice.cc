@@ -146,4 +146,5 @@ FromDevice::reset_counts(const String &, Element *e, void *, ErrorHandler *)
 }
 
 CLICK_ENDDECLS
+ELEMENT_REQUIRES(minios)
 EXPORT_ELEMENT(FromDevice)
@@ -160,4 +160,5 @@ ToDevice::reset_counts(const String &, Element *e, void *, ErrorHandler *)
 }
 
 CLICK_ENDDECLS
+ELEMENT_REQUIRES(minios)
 EXPORT_ELEMENT(ToDevice)
@@ -16,6 +16,10 @@ CLICK_DECLS
  * MODULUS must be 2, 4, or 8.
  * =n
  *
+ * Packets that are already aligned pass through untouched.  Device elements
+ * such as FromDevice choose their packets' headroom to satisfy their
+ * ALIGNMENT argument, so an Align that matches it costs only a test.
+ *
  * The click-align(1) tool will insert this element automatically wherever it
  * is required.
  *
@@ -238,6 +238,13 @@ ConfParseTest::initialize(ErrorHandler *errh)
 	CHECK(IPPrefixArg().parse("18.26.4/24", a, m, this) == true
 	      && a.unparse_with_mask(m) == "18.26.4.0/24");
 	CHECK(IPPrefixArg().parse("18.26.4/28", a, m, this) == false);
+	CHECK(IPPrefixArg().parse("0.0.0.0/0", a, m, this) == true
+	      && a.unparse_with_mask(m) == "0.0.0.0/0");
+	CHECK(IPPrefixArg().parse("18.26.4.9/32", a, m, this) == true
+	      && a.unparse_with_mask(m) == "18.26.4.9/32");
+	CHECK(IPPrefixArg().parse("18.26.4.9/33", a, m, this) == false);
+	CHECK(IPPrefixArg().parse("18.0.0.0/07", a, m, this) == true
+	      && a.unparse_with_mask(m) == "18.0.0.0/7");
     }
 
 #if HAVE_IP6
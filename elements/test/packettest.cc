@@ -137,6 +137,13 @@ PacketTest::initialize(ErrorHandler *errh)
     CHECK_ALIGNED(p->data());
     p->kill();
 
+    CHECK(Packet::aligned_headroom(28, 4, 2) == 30);
+    CHECK(Packet::aligned_headroom(30, 4, 2) == 30);
+    CHECK(Packet::aligned_headroom(28, 8, 0) == 32);
+    p = Packet::make(Packet::aligned_headroom(Packet::default_headroom, 4, 2), lowers, 60, 0);
+    CHECK_ALIGNED(p->data() + 14);
+    p->kill();
+
     // Also check some packet header definition properties.
     union {
 	click_ip ip4;
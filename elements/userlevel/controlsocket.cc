@@ -23,6 +23,7 @@
 #include <click/args.hh>
 #include <click/error.hh>
 #include <click/timer.hh>
+#include <click/timestamp.hh>
 #include <click/router.hh>
 #include <click/straccum.hh>
 #include <click/llrpc.h>
@@ -33,7 +34,41 @@
 #include <fcntl.h>
 CLICK_DECLS
 
-const char ControlSocket::protocol_version[] = "1.3";
+const char ControlSocket::protocol_version[] = "1.4";
+
+struct ControlSocket::subscription {
+    ControlSocket *cs;
+    connection *conn;
+    uint32_t tag;
+    uint32_t interval;		// msec
+    Vector<uint32_t> handles;
+    Timer timer;
+    subscription(ControlSocket *cs_, connection *conn_, uint32_t tag_)
+	: cs(cs_), conn(conn_), tag(tag_), timer(subscription_hook, this) {
+    }
+};
+
+static inline uint32_t
+get_u32(const char *s)
+{
+    uint32_t x;
+    memcpy(&x, s, 4);
+    return ntohl(x);
+}
+
+static inline void
+append_u32(StringAccum &sa, uint32_t x)
+{
+    x = htonl(x);
+    sa.append(reinterpret_cast<const char *>(&x), 4);
+}
+
+static inline void
+append_u16(StringAccum &sa, uint16_t x)
+{
+    x = htons(x);
+    sa.append(reinterpret_cast<const char *>(&x), 2);
+}
 
 class ControlSocketErrorHandler : public ErrorHandler { public:
 
@@ -301,6 +336,10 @@ ControlSocket::take_state(Element *e, ErrorHandler *errh)
     _unix_pathname = cs->_unix_pathname; // in case _unix_pathname == "41930+"
     cs->_socket_fd = -1;
     _conns.swap(cs->_conns);
+    // binary handles point into the old router
+    for (connection **it = _conns.begin(); it != _conns.end(); ++it)
+	if (*it)
+	    (*it)->invalidate();
 
     if (_socket_fd >= 0)
 	add_select(_socket_fd, SELECT_READ);
@@ -341,11 +380,22 @@ ControlSocket::cleanup(CleanupStage)
     }
 }
 
+ControlSocket::connection::~connection()
+{
+    for (subscription **it = subs.begin(); it != subs.end(); ++it)
+	delete *it;
+}
+
 int
 ControlSocket::connection::message(int code, const String &msg, bool continuation)
 {
     assert(code >= 100 && code <= 999);
-    if (fd >= 0 && !out_closed)
+    if (binary) {
+	// collected for the response frame
+	bin_code = code;
+	if (msg)
+	    bin_msg << msg << '\n';
+    } else if (fd >= 0 && !out_closed)
 	out_text << code << (continuation ? '-' : ' ') << msg.printable() << '\r' << '\n';
     return ANY_ERR;
 }
@@ -404,6 +454,29 @@ ControlSocket::connection::read(int len, String &data)
     return 0;
 }
 
+void
+ControlSocket::connection::frame(int op, int code, uint32_t tag, const String &payload)
+{
+    if (fd >= 0 && !out_closed) {
+	append_u32(out_text, 8 + payload.length());
+	out_text << (char) op << '\0';
+	append_u16(out_text, code);
+	append_u32(out_text, tag);
+	out_text << payload;
+    }
+}
+
+void
+ControlSocket::connection::invalidate()
+{
+    for (handle *h = handles.begin(); h != handles.end(); ++h)
+	h->e = 0;
+    handle_names.clear();
+    for (subscription **it = subs.begin(); it != subs.end(); ++it)
+	delete *it;
+    subs.clear();
+}
+
 void
 ControlSocket::connection::flush_write(ControlSocket *cs, bool read_needs_processing)
 {
@@ -770,6 +843,13 @@ ControlSocket::parse_command(connection &conn, const String &line)
 	return r;
     return llrpc_command(conn, words[1], data);
 
+  } else if (command == "BINARY") {
+    if (words.size() != 1)
+      return conn.message(CSERR_SYNTAX, "Wrong number of arguments");
+    conn.message(CSERR_OK, "Binary mode");
+    conn.binary = true;
+    return 0;
+
   } else if (command == "CLOSE" || command == "QUIT") {
     if (words.size() != 1)
       conn.message(CSERR_SYNTAX, "Bad command syntax");
@@ -790,6 +870,7 @@ ControlSocket::parse_command(connection &conn, const String &line)
     conn.message(CSERR_OK, "CHECKREAD handler       check if read handler is valid", true);
     conn.message(CSERR_OK, "CHECKWRITE handler      check if write handler is valid", true);
     conn.message(CSERR_OK, "LLRPC elt#number [len]  call LLRPC, pass len data bytes, return DATA", true);
+    conn.message(CSERR_OK, "BINARY                  switch to the binary protocol", true);
     conn.message(CSERR_OK, "QUIT                    close connection");
     return 0;
 
@@ -797,6 +878,190 @@ ControlSocket::parse_command(connection &conn, const String &line)
     return conn.message(CSERR_UNIMPLEMENTED, "Command '" + command + "' unimplemented");
 }
 
+String
+ControlSocket::call_handle(connection &conn, uint32_t hid, bool write, const String &data)
+{
+    if (hid >= (uint32_t) conn.handles.size() || !conn.handles[hid].e) {
+	conn.message(CSERR_NO_SUCH_HANDLER, "No handle " + String(hid));
+	return String();
+    }
+    const handle &hi = conn.handles[hid];
+    const Handler *h = hi.h;
+    if (write && !h->writable()) {
+	conn.message(CSERR_PERMISSION, "Handler '" + hi.name + "' read-only");
+	return String();
+    } else if (!write && !h->read_visible()) {
+	conn.message(CSERR_PERMISSION, "Handler '" + hi.name + "' write-only");
+	return String();
+    } else if (write && _read_only) {
+	conn.message(CSERR_PERMISSION, "Permission denied for '" + hi.name + "'");
+	return String();
+    }
+
+    // collect errors from proxy
+    ControlSocketErrorHandler errh;
+    _proxied_handler = h->name();
+    _proxied_errh = &errh;
+    String result;
+    int r = 0;
+    if (write)
+	r = h->call_write(data, hi.e, &errh);
+    else
+	result = h->call_read(hi.e, data, &errh);
+    _proxied_errh = 0;
+
+    int code = errh.error_code();
+    if (code == CSERR_OK) {
+	if (errh.nerrors() > 0 || r < 0)
+	    code = (write ? CSERR_HANDLER_ERROR : CSERR_UNSPECIFIED);
+	else if (write && errh.nwarnings() > 0)
+	    code = CSERR_OK_HANDLER_WARNING;
+    }
+    conn.transfer_messages(code, String(), &errh);
+    conn.bin_code = code;
+    return result;
+}
+
+void
+ControlSocket::binary_command(connection &conn, int op, uint32_t tag, const char *data, int len)
+{
+    conn.bin_code = CSERR_OK;
+    conn.bin_msg.clear();
+    String result;
+
+    switch (op) {
+    case bin_resolve: {
+	String name(data, len);
+	if (uint32_t *hid = conn.handle_names.get_pointer(name)) {
+	    const Handler *h = conn.handles[*hid].h;
+	    StringAccum sa;
+	    append_u32(sa, *hid);
+	    sa << (char) ((h->read_visible() ? 1 : 0) | (h->write_visible() ? 2 : 0));
+	    result = sa.take_string();
+	    break;
+	}
+	Element *e;
+	if (const Handler *h = parse_handler(conn, name, &e)) {
+	    handle hi;
+	    hi.e = e;
+	    hi.h = h;
+	    hi.name = name;
+	    conn.handles.push_back(hi);
+	    conn.handle_names.set(name, conn.handles.size() - 1);
+	    StringAccum sa;
+	    append_u32(sa, conn.handles.size() - 1);
+	    sa << (char) ((h->read_visible() ? 1 : 0) | (h->write_visible() ? 2 : 0));
+	    result = sa.take_string();
+	}
+	break;
+    }
+
+    case bin_read:
+    case bin_write:
+	if (len < 4)
+	    conn.message(CSERR_SYNTAX, "Missing handle");
+	else
+	    result = call_handle(conn, get_u32(data), op == bin_write, String(data + 4, len - 4));
+	break;
+
+    case bin_subscribe: {
+	if (len < 4 || (len & 3)) {
+	    conn.message(CSERR_SYNTAX, "Bad subscription");
+	    break;
+	}
+	uint32_t interval = get_u32(data);
+	if (interval == 0) {
+	    conn.message(CSERR_SYNTAX, "Bad subscription interval");
+	    break;
+	}
+	subscription *sub = new subscription(this, &conn, tag);
+	sub->interval = interval;
+	for (int i = 4; i < len; i += 4)
+	    sub->handles.push_back(get_u32(data + i));
+	sub->timer.initialize(this);
+	sub->timer.schedule_after_msec(interval);
+	conn.subs.push_back(sub);
+	break;
+    }
+
+    case bin_unsubscribe: {
+	uint32_t subtag = (len == 4 ? get_u32(data) : 0);
+	subscription **it = conn.subs.begin();
+	while (it != conn.subs.end() && (*it)->tag != subtag)
+	    ++it;
+	if (len != 4 || it == conn.subs.end())
+	    conn.message(CSERR_SYNTAX, "No such subscription");
+	else {
+	    delete *it;
+	    conn.subs.erase(it);
+	}
+	break;
+    }
+
+    default:
+	conn.message(CSERR_UNIMPLEMENTED, "Operation " + String(op) + " unimplemented");
+	break;
+    }
+
+    if (conn.bin_code == CSERR_OK || (conn.bin_code == CSERR_OK_HANDLER_WARNING
+				      && !conn.bin_msg.length()))
+	conn.frame(op, conn.bin_code, tag, result);
+    else
+	conn.frame(op, conn.bin_code, tag, conn.bin_msg.take_string());
+}
+
+bool
+ControlSocket::parse_binary(connection &conn)
+{
+    // handle every complete frame, up to a limit; return true if more
+    // complete frames remain
+    for (int n = 0; n < bin_max_batch; ++n) {
+	int avail = conn.in_text.length() - conn.inpos;
+	if (avail < 4)
+	    return false;
+	const char *s = conn.in_text.begin() + conn.inpos;
+	uint32_t len = get_u32(s);
+	if (len < 8 || len > bin_max_frame) {
+	    conn.frame(0, CSERR_SYNTAX, 0, "Bad frame length");
+	    conn.in_closed = true;
+	    conn.in_text.clear();
+	    conn.inpos = 0;
+	    return false;
+	}
+	if ((uint32_t) avail < 4 + len)
+	    return false;
+	binary_command(conn, (unsigned char) s[4], get_u32(s + 8), s + 12, len - 8);
+	conn.inpos += 4 + len;
+    }
+    return conn.in_text.length() - conn.inpos >= 4;
+}
+
+void
+ControlSocket::subscription_hook(Timer *t, void *thunk)
+{
+    subscription *sub = static_cast<subscription *>(thunk);
+    connection &conn = *sub->conn;
+    if (conn.out_text.length() - conn.outpos < bin_max_backlog) {
+	Timestamp now = Timestamp::now();
+	StringAccum sa;
+	append_u32(sa, now.sec());
+	append_u32(sa, now.nsec());
+	for (uint32_t *hid = sub->handles.begin(); hid != sub->handles.end(); ++hid) {
+	    conn.bin_code = CSERR_OK;
+	    conn.bin_msg.clear();
+	    String result = sub->cs->call_handle(conn, *hid, false, String());
+	    if (conn.bin_code != CSERR_OK)
+		result = conn.bin_msg.take_string();
+	    append_u16(sa, conn.bin_code);
+	    append_u32(sa, result.length());
+	    sa << result;
+	}
+	conn.frame(bin_snapshot, CSERR_OK, sub->tag, sa.take_string());
+	conn.flush_write(sub->cs, conn.in_text.length());
+    }
+    t->reschedule_after_msec(sub->interval);
+}
+
 void
 ControlSocket::initialize_connection(int fd)
 {
@@ -845,9 +1110,10 @@ ControlSocket::selected(int fd, int)
     connection *conn = _conns[fd];
 
     // read commands from socket (but only a bit on each select)
+    int readlen = conn->binary ? 65536 : 2048;
     if (!conn->in_closed)
-	if (char *buf = conn->in_text.reserve(2048)) {
-	    ssize_t r = read(conn->fd, buf, 2048);
+	if (char *buf = conn->in_text.reserve(readlen)) {
+	    ssize_t r = read(conn->fd, buf, readlen);
 	    if (r != 0 && r != -1)
 		conn->in_text.adjust_length(r);
 	    else if (r == 0 || (r == -1 && errno != EAGAIN && errno != EINTR))
@@ -857,7 +1123,16 @@ ControlSocket::selected(int fd, int)
     // parse commands
     // 16.Jun.2004: process only one command each time through
     bool blocked = false;
-    if (conn->in_text.length()) {
+    if (conn->binary && conn->in_text.length()) {
+	// binary requests are pipelined: handle them in batches
+	blocked = !parse_binary(*conn);
+	if (conn->in_closed && blocked) {
+	    // drop a partial frame
+	    conn->in_text.clear();
+	    conn->inpos = 0;
+	}
+	connection::contract(conn->in_text, conn->inpos);
+    } else if (conn->in_text.length()) {
 	const char *in_text = conn->in_text.begin() + conn->inpos;
 	const char *in_end = conn->in_text.end();
 	const char *line_end = in_text;
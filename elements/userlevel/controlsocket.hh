@@ -2,6 +2,7 @@
 #define CLICK_CONTROLSOCKET_HH
 #include "elements/userlevel/handlerproxy.hh"
 #include <click/straccum.hh>
+#include <click/hashtable.hh>
 CLICK_DECLS
 class ControlSocketErrorHandler;
 class Timer;
@@ -39,8 +40,8 @@ The server will accept lines terminated by CR, LF, or CRLF. Its response
 lines are always terminated by CRLF.
 
 When a connection is opened, the server responds by stating its protocol
-version number with a line like "Click::ControlSocket/1.3". The current
-version number is 1.3. Changes in minor version number will only add commands
+version number with a line like "Click::ControlSocket/1.4". The current
+version number is 1.4. Changes in minor version number will only add commands
 and functionality to this specification, not change existing functionality.
 
 ControlSocket supports hot-swapping, meaning you can change configurations
@@ -175,6 +176,12 @@ ControlSocket will not call an LLRPC unless it can determine (from the command
 number) how much data the LLRPC expects and returns. (Only "flat" LLRPCs may
 be called; they are declared using the _CLICK_IOC_[RWS]F macros.)
 
+=item BINARY
+
+Switch the connection to the binary protocol, described below.  The server
+responds with a 200 message; every byte after the BINARY line belongs to the
+binary protocol.  Introduced in version 1.4 of the ControlSocket protocol.
+
 =item QUIT
 
 Close the connection.
@@ -205,6 +212,62 @@ Here are some of the particular error messages:
   530 Permission denied.
   540 No router installed.
 
+=head1 BINARY PROTOCOL
+
+The binary protocol suits clients that call many handlers, such as
+monitoring systems.  Requests and responses are frames, and a client may send
+any number of requests without waiting for responses; the server handles
+every complete request it has received before writing, and answers requests
+in order.  All integers are unsigned and in network byte order.
+
+A request frame is a 4-byte I<length> (the number of bytes that follow it),
+a 1-byte I<op>, 3 bytes of padding, a 4-byte I<tag>, and I<length> - 8 bytes
+of payload.  A response frame is a 4-byte I<length>, the request's 1-byte
+I<op>, 1 byte of padding, a 2-byte I<status> (a response code as above), the
+request's 4-byte I<tag>, and payload.  A response's payload is described
+below if I<status> is 200; otherwise it holds error messages separated by
+newlines.
+
+Handlers are named by I<handles>, small integers that the server assigns
+once per connection, so the server does not look up a handler's name on
+every call.  A hot-swap invalidates the handles and subscriptions of
+existing connections: their calls fail with status 511.
+
+=over 5
+
+=item RESOLVE (op 3)
+
+The payload is a handler name.  The response payload is a 4-byte handle
+followed by a 1-byte flag: 1 if the handler is readable, plus 2 if it is
+writable.  Resolving the same name again returns the same handle.
+
+=item READ (op 1)
+
+The payload is a 4-byte handle followed by parameters.  The response
+payload is the handler's result.
+
+=item WRITE (op 2)
+
+The payload is a 4-byte handle followed by the data to write.  A successful
+response has status 200, or 220 and warnings as payload.
+
+=item SUBSCRIBE (op 4)
+
+The payload is a 4-byte interval in milliseconds followed by any number of
+4-byte read handles.  After the 200 response, the server sends a snapshot
+frame every interval until the subscription is cancelled: op 6, status 200,
+the SUBSCRIBE request's tag, and a payload of the snapshot's 4-byte seconds
+and 4-byte nanoseconds, then, for each handle, a 2-byte status, a 4-byte
+length, and that many bytes of result (or error messages).  Snapshots are
+skipped while the client does not keep up.
+
+=item UNSUBSCRIBE (op 5)
+
+The payload is the 4-byte tag of a SUBSCRIBE request.  Cancels the
+subscription.
+
+=back
+
 ControlSocket is only available in user-level processes.
 
 =e
@@ -267,6 +330,13 @@ class ControlSocket : public Element { public:
     Element *_proxy;
     HandlerProxy *_full_proxy;
 
+    struct handle {
+	Element *e;		// null if invalidated by a hot-swap
+	const Handler *h;
+	String name;
+    };
+    struct subscription;
+
     struct connection {
 	int fd;
 	StringAccum in_text;
@@ -275,16 +345,25 @@ class ControlSocket : public Element { public:
 	int outpos;
 	bool in_closed;
 	bool out_closed;
+	bool binary;
+	int bin_code;		// status of the current binary request
+	StringAccum bin_msg;	// its messages
+	Vector<handle> handles;
+	HashTable<String, uint32_t> handle_names;
+	Vector<subscription *> subs;
 	connection(int fd_)
 	    : fd(fd_), inpos(0), outpos(0),
-	      in_closed(false), out_closed(false) {
+	      in_closed(false), out_closed(false), binary(false) {
 	}
+	~connection();
 	int message(int code, const String &msg, bool continuation = false);
 	int transfer_messages(int default_code, const String &msg, ControlSocketErrorHandler *);
 	static void contract(StringAccum &sa, int &pos);
 	void flush_write(ControlSocket *cs, bool read_needs_processing);
 	int read(int len, String &data);
 	int read_insufficient();
+	void frame(int op, int code, uint32_t tag, const String &payload);
+	void invalidate();
     };
     Vector<connection *> _conns;
 
@@ -296,6 +375,11 @@ class ControlSocket : public Element { public:
 
     enum { READ_CLOSED = 1, WRITE_CLOSED = 2, ANY_ERR = -1 };
 
+    enum { bin_read = 1, bin_write = 2, bin_resolve = 3, bin_subscribe = 4,
+	   bin_unsubscribe = 5, bin_snapshot = 6 };
+    enum { bin_max_frame = 1 << 24, bin_max_batch = 256,
+	   bin_max_backlog = 1 << 20 };
+
     static const char protocol_version[];
 
     int initialize_socket_error(ErrorHandler *, const char *);
@@ -311,6 +395,11 @@ class ControlSocket : public Element { public:
     int llrpc_command(connection &conn, const String &, String);
     int parse_command(connection &conn, const String &);
 
+    bool parse_binary(connection &conn);
+    void binary_command(connection &conn, int op, uint32_t tag, const char *data, int len);
+    String call_handle(connection &conn, uint32_t hid, bool write, const String &data);
+    static void subscription_hook(Timer *, void *);
+
     static ErrorHandler *proxy_error_function(const String &, void *);
 
 };
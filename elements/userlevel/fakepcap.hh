@@ -78,6 +78,62 @@ struct fake_modified_pcap_pkthdr {
 	uint8_t pad;		/* pad to a 4-byte boundary */
 };
 
+/*
+ * pcap-ng (draft-ietf-opsawg-pcapng).  A file is a sequence of blocks, each
+ * starting with a type and total length and ending with the total length
+ * again; block bodies are padded to 4 bytes.
+ */
+#define FAKE_PCAPNG_SHB			0x0A0D0D0A	/* section header */
+#define FAKE_PCAPNG_IDB			1	/* interface description */
+#define FAKE_PCAPNG_SPB			3	/* simple packet */
+#define FAKE_PCAPNG_EPB			6	/* enhanced packet */
+#define FAKE_PCAPNG_BYTE_ORDER_MAGIC	0x1A2B3C4D
+#define FAKE_PCAPNG_VERSION_MAJOR	1
+#define FAKE_PCAPNG_VERSION_MINOR	0
+
+#define FAKE_PCAPNG_OPT_ENDOFOPT	0
+#define FAKE_PCAPNG_OPT_SHB_USERAPPL	4
+#define FAKE_PCAPNG_OPT_IF_NAME		2
+#define FAKE_PCAPNG_OPT_IF_TSRESOL	9
+#define FAKE_PCAPNG_OPT_CUSTOM_STRING	2988
+#define FAKE_PCAPNG_OPT_CUSTOM_BINARY	2989
+
+/* Click's custom options use the documentation enterprise number (RFC 5612).
+   The section header carries "annotations NAME..."; each enhanced packet
+   block carries those annotations' bytes, in order. */
+#define FAKE_PCAPNG_CLICK_PEN		32473
+
+struct fake_pcapng_block_header {
+	uint32_t type;
+	uint32_t length;	/* total block length, including trailer */
+};
+
+struct fake_pcapng_section_header {
+	uint32_t byte_order_magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	uint32_t section_length[2];	/* 64 bits; -1 means unknown */
+};
+
+struct fake_pcapng_interface_description {
+	uint16_t linktype;
+	uint16_t reserved;
+	uint32_t snaplen;
+};
+
+struct fake_pcapng_enhanced_packet {
+	uint32_t interface_id;
+	uint32_t timestamp_high;
+	uint32_t timestamp_low;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+struct fake_pcapng_option_header {
+	uint16_t code;
+	uint16_t length;	/* not including padding */
+};
+
 // Parsing and unparsing.
 int fake_pcap_parse_dlt(const String&);
 String fake_pcap_unparse_dlt(int);
@@ -63,9 +63,15 @@ CLICK_DECLS
 
 FromDevice::FromDevice()
     :
-#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP
+#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_RING || FROMDEVICE_ALLOW_XDP
       _task(this),
 #endif
+#if FROMDEVICE_ALLOW_RING
+      _ring(0),
+#endif
+#if FROMDEVICE_ALLOW_XDP
+      _xdp(0),
+#endif
 #if FROMDEVICE_ALLOW_PCAP
       _pcap(0), _pcap_complaints(0),
 #endif
@@ -87,11 +93,16 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     _protocol = 0;
     _snaplen = default_snaplen;
     _headroom = Packet::default_headroom;
-    _headroom += (4 - (_headroom + 2) % 4) % 4; // default 4/2 alignment
     _force_ip = false;
     _burst = 1;
-    String bpf_filter, capture, encap_type;
-    bool has_encap;
+    String bpf_filter, capture, encap_type, fanout_mode = "HASH", alignment;
+    bool has_encap, has_fanout, has_headroom;
+    uint16_t fanout = 0;
+    uint32_t ring_block_size = 1 << 20, ring_blocks = 64;
+    uint32_t queue = 0, nqueues = 1, xdp_frames = 4096;
+    bool has_queue;
+    String xdp_mode = "AUTO";
+    bool zerocopy = false, has_zerocopy;
     if (Args(conf, this, errh)
 	.read_mp("DEVNAME", _ifname)
 	.read_p("PROMISC", promisc)
@@ -103,12 +114,35 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("BPF_FILTER", bpf_filter)
 	.read("PROTOCOL", _protocol)
 	.read("OUTBOUND", outbound)
-	.read("HEADROOM", _headroom)
+	.read("HEADROOM", _headroom).read_status(has_headroom)
+	.read("ALIGNMENT", AnyArg(), alignment)
 	.read("ENCAP", WordArg(), encap_type).read_status(has_encap)
 	.read("BURST", _burst)
 	.read("TIMESTAMP", timestamp)
+	.read("RING_BLOCK_SIZE", ring_block_size)
+	.read("RING_BLOCKS", ring_blocks)
+	.read("FANOUT", fanout).read_status(has_fanout)
+	.read("FANOUT_MODE", WordArg(), fanout_mode)
+	.read("QUEUE", queue).read_status(has_queue)
+	.read("N_QUEUES", nqueues)
+	.read("XDP_MODE", WordArg(), xdp_mode)
+	.read("ZEROCOPY", zerocopy).read_status(has_zerocopy)
+	.read("XDP_FRAMES", xdp_frames)
 	.complete() < 0)
 	return -1;
+    int modulus = 4, offset = 2;
+    if (alignment) {
+	if (Args(this, errh).push_back_words(alignment)
+	    .read_mp("MODULUS", modulus)
+	    .read_mp("OFFSET", offset)
+	    .complete() < 0)
+	    return -1;
+	else if ((modulus != 2 && modulus != 4 && modulus != 8)
+		 || offset < 0 || offset >= modulus)
+	    return errh->error("bad ALIGNMENT modulus and/or offset");
+	_headroom = Packet::aligned_headroom(_headroom, modulus, offset);
+    } else if (!has_headroom)
+	_headroom = Packet::aligned_headroom(_headroom, 4, 2);
     if (_snaplen > 8190 || _snaplen < 14)
 	return errh->error("SNAPLEN out of range");
     if (_headroom > 8190)
@@ -142,6 +176,14 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     else if (capture == "LINUX")
 	_method = method_linux;
 #endif
+#if FROMDEVICE_ALLOW_RING
+    else if (capture == "RING")
+	_method = method_ring;
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    else if (capture == "XDP")
+	_method = method_xdp;
+#endif
 #if FROMDEVICE_ALLOW_PCAP
     else if (capture == "PCAP")
 	_method = method_pcap;
@@ -155,6 +197,53 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 
     if (bpf_filter && _method != method_pcap)
 	errh->warning("not using METHOD PCAP, BPF filter ignored");
+#if FROMDEVICE_ALLOW_RING
+    // the kernel places ring packets; Ethernet frames land at "4 2"
+    if (_method == method_ring && (modulus != 4 || offset != 2))
+	return errh->error("METHOD RING requires ALIGNMENT 4 2");
+#endif
+
+#if FROMDEVICE_ALLOW_LINUX
+    _fanout = has_fanout ? fanout : -1;
+    _fanout_mode = fanout_mode;
+    if (has_fanout && _method != method_linux && _method != method_ring)
+	errh->warning("not using METHOD LINUX or RING, FANOUT ignored");
+#else
+    if (has_fanout)
+	errh->warning("FANOUT ignored on this platform");
+#endif
+#if FROMDEVICE_ALLOW_RING
+    if (ring_blocks == 0)
+	return errh->error("RING_BLOCKS out of range");
+    _ring_block_size = ring_block_size;
+    _ring_blocks = ring_blocks;
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    if (xdp_mode == "AUTO")
+	_xdp_mode = XDPSocket::mode_auto;
+    else if (xdp_mode == "NATIVE")
+	_xdp_mode = XDPSocket::mode_native;
+    else if (xdp_mode == "SKB")
+	_xdp_mode = XDPSocket::mode_skb;
+    else
+	return errh->error("bad XDP_MODE");
+    if (!has_zerocopy)
+	_xdp_copy = XDPSocket::copy_auto;
+    else
+	_xdp_copy = zerocopy ? XDPSocket::zerocopy_force : XDPSocket::copy_force;
+    _xdp_queue = queue;
+    _xdp_frames = xdp_frames;
+#endif
+#if FROMDEVICE_ALLOW_NETMAP
+    if (nqueues == 0 || (nqueues > 1 && !has_queue))
+	return errh->error("N_QUEUES requires QUEUE");
+    _netmap_queue = has_queue ? (int) queue : -1;
+    _netmap_nqueues = nqueues;
+    _netmap_zerocopy = has_zerocopy && zerocopy;
+    // zero-copy packets start at the beginning of a netmap buffer
+    if (_method == method_netmap && _netmap_zerocopy && alignment && offset != 0)
+	return errh->error("zero-copy METHOD NETMAP requires ALIGNMENT offset 0");
+#endif
 
     _sniffer = sniffer;
     _promisc = promisc;
@@ -286,11 +375,27 @@ FromDevice::initialize(ErrorHandler *errh)
 
 #if FROMDEVICE_ALLOW_NETMAP
     if (_method == method_default || _method == method_netmap) {
-	_fd = _netmap.open(_ifname, _method == method_netmap, errh);
-	if (_fd >= 0) {
+	// one port per bound ring, or one for all rings
+	int nq = (_netmap_queue >= 0 ? _netmap_nqueues : 1);
+	_netmap.resize(nq);
+	for (int i = 0; i < nq; ++i) {
+	    int fd = _netmap[i].open(_ifname, _netmap_queue < 0 ? -1 : _netmap_queue + i,
+				     _netmap_zerocopy ? netmap_extra_bufs : 0,
+				     _method == method_netmap, errh);
+	    if (fd < 0) {
+		while (--i >= 0)
+		    _netmap[i].close(_netmap[i].fd);
+		_netmap.clear();
+		if (_method == method_netmap)
+		    return -1;
+		break;
+	    }
+	    _netmap[i].initialize_rings_rx(_timestamp);
+	}
+	if (_netmap.size()) {
+	    _fd = _netmap[0].fd;
 	    _datalink = FAKE_DLT_EN10MB;
 	    _method = method_netmap;
-	    _netmap.initialize_rings_rx(_timestamp);
 	}
     }
 #endif
@@ -360,11 +465,23 @@ FromDevice::initialize(ErrorHandler *errh)
 #endif
 
 #if FROMDEVICE_ALLOW_LINUX
-    if (_method == method_default || _method == method_linux) {
+    if (_method == method_default || _method == method_linux
+	|| _method == method_ring) {
 	_fd = open_packet_socket(_ifname, errh);
 	if (_fd < 0)
 	    return -1;
 
+	PrefixErrorHandler perrh(errh, _ifname + ": ");
+# if FROMDEVICE_ALLOW_RING
+	if (_method == method_ring
+	    && !(_ring = PacketRing::open_rx(_fd, _ring_block_size, _ring_blocks, &perrh)))
+	    return -1;
+# endif
+	// the socket must be bound, and any ring set up, before joining
+	if (_fanout >= 0
+	    && PacketRing::set_fanout(_fd, _fanout, _fanout_mode, &perrh) < 0)
+	    return -1;
+
 	int promisc_ok = set_promiscuous(_fd, _ifname, _promisc);
 	if (promisc_ok < 0) {
 	    if (_promisc)
@@ -373,15 +490,45 @@ FromDevice::initialize(ErrorHandler *errh)
 	} else
 	    _was_promisc = promisc_ok;
 
+	if (_method != method_ring) {
+	    // read bursts with recvmmsg; timestamps come as control messages
+	    unsigned controllen = 0;
+	    int one = 1;
+	    if (_timestamp
+		&& setsockopt(_fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) == 0)
+		controllen = CMSG_SPACE(sizeof(struct timespec));
+	    if (_linux_batch.initialize(_burst, _headroom, _snaplen, true, controllen) < 0)
+		return errh->error("out of memory");
+	}
+
 	_datalink = FAKE_DLT_EN10MB;
-	_method = method_linux;
+	if (_method != method_ring)
+	    _method = method_linux;
     }
 #endif
 
-#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP
-    if (_method == method_pcap || _method == method_netmap)
+#if FROMDEVICE_ALLOW_XDP
+    if (_method == method_xdp) {
+	PrefixErrorHandler perrh(errh, _ifname + ": ");
+	_xdp = XDPSocket::open(_ifname, _xdp_queue, true, _xdp_mode, _xdp_copy,
+			       _xdp_frames, _headroom, &perrh);
+	if (!_xdp)
+	    return -1;
+	_fd = _xdp->fd();
+	_datalink = FAKE_DLT_EN10MB;
+    }
+#endif
+
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_RING || FROMDEVICE_ALLOW_XDP
+    if (_method == method_pcap || _method == method_netmap
+	|| _method == method_ring || _method == method_xdp)
 	ScheduleInfo::initialize_task(this, &_task, false, errh);
 #endif
+#if FROMDEVICE_ALLOW_NETMAP
+    if (_method == method_netmap)
+	for (int i = 1; i < _netmap.size(); ++i)
+	    add_select(_netmap[i].fd, SELECT_READ);
+#endif
 #if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_LINUX || FROMDEVICE_ALLOW_NETMAP
     if (_fd >= 0)
 	add_select(_fd, SELECT_READ);
@@ -400,15 +547,32 @@ FromDevice::cleanup(CleanupStage stage)
     if (stage >= CLEANUP_INITIALIZED && !_sniffer)
 	KernelFilter::device_filter(_ifname, false, ErrorHandler::default_handler());
 #if FROMDEVICE_ALLOW_NETMAP
-    if (_fd >= 0 && _method == method_netmap)
-	_netmap.close(_fd);
+    if (_fd >= 0 && _method == method_netmap) {
+	for (int i = 0; i < _netmap.size(); ++i) {
+	    remove_select(_netmap[i].fd, SELECT_READ);
+	    _netmap[i].close(_netmap[i].fd);
+	}
+	_netmap.clear();
+	_fd = -1;
+    }
+#endif
+#if FROMDEVICE_ALLOW_RING
+    if (_ring)
+	_ring->close();
+    _ring = 0;
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    if (_xdp)
+	_xdp->close();
+    _xdp = 0;
 #endif
 #if FROMDEVICE_ALLOW_LINUX
-    if (_fd >= 0 && _method == method_linux) {
+    if (_fd >= 0 && (_method == method_linux || _method == method_ring)) {
 	if (_was_promisc >= 0)
 	    set_promiscuous(_fd, _ifname, _was_promisc);
 	close(_fd);
     }
+    _linux_batch.cleanup();
 #endif
 #if FROMDEVICE_ALLOW_PCAP
     if (_pcap)
@@ -420,7 +584,7 @@ FromDevice::cleanup(CleanupStage stage)
 #endif
 }
 
-#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_XDP
 void
 FromDevice::emit_packet(WritablePacket *p, int extra_len, const Timestamp &ts)
 {
@@ -461,25 +625,97 @@ FromDevice_get_packet(u_char* clientdata,
 CLICK_DECLS
 #endif
 
+#if FROMDEVICE_ALLOW_RING
+int
+FromDevice::ring_dispatch()
+{
+    // Count skipped frames towards the burst so a ring full of outbound
+    // packets cannot keep us here.
+    int n = 0;
+    for (int i = 0; i < _burst; ++i) {
+	int pkttype, extra_len;
+	uint16_t protocol;
+	WritablePacket *p = _ring->rx_packet(pkttype, protocol, extra_len, _timestamp);
+	if (!p)
+	    break;
+	if ((pkttype == PACKET_OUTGOING && !_outbound)
+	    || (_protocol != 0 && _protocol != protocol)) {
+	    p->kill();
+	    continue;
+	}
+	if (p->length() > (uint32_t) _snaplen) {
+	    extra_len += p->length() - _snaplen;
+	    p->take(p->length() - _snaplen);
+	}
+	p->set_packet_type_anno((Packet::PacketType) pkttype);
+	p->set_mac_header(p->data());
+	SET_EXTRA_LENGTH_ANNO(p, extra_len);
+	++n;
+	if (!_force_ip || fake_pcap_force_ip(p, _datalink))
+	    output(0).push(p);
+	else
+	    checked_output_push(1, p);
+    }
+    _count += n;
+    return n;
+}
+#endif
+
+#if FROMDEVICE_ALLOW_NETMAP
+int
+FromDevice::netmap_dispatch(NetmapInfo &ni)
+{
+    int n = 0;
+    while (n < _burst) {
+	// with TIMESTAMP, the rings were set up with NR_TIMESTAMP, and
+	// rx_packet() stamps each packet with its ring's sync time
+	WritablePacket *p = ni.rx_packet(_headroom, _netmap_zerocopy, _timestamp);
+	if (!p)
+	    break;
+	++n;
+	emit_packet(p, 0, p->timestamp_anno());
+    }
+    _count += n;
+    return n;
+}
+#endif
+
+#if FROMDEVICE_ALLOW_XDP
+int
+FromDevice::xdp_dispatch()
+{
+    Timestamp now;
+    if (_timestamp)
+	now.assign_now();
+    int n = 0;
+    while (n < _burst) {
+	WritablePacket *p = _xdp->rx_packet();
+	if (!p)
+	    break;
+	++n;
+	emit_packet(p, 0, now);
+    }
+    _xdp->refill();
+    _count += n;
+    return n;
+}
+#endif
 
 void
-FromDevice::selected(int, int)
+FromDevice::selected(int fd, int)
 {
     // netmap and pcap are essentially the same code, different
     // dispatch function. This code is also in run_task()
     // with fast_reschedule()
 #if FROMDEVICE_ALLOW_NETMAP
     if (_method == method_netmap) {
-	// Read and push() at most one burst of packets.
-	int r = _netmap.dispatch(_burst,
-		reinterpret_cast<nm_cb_t>(FromDevice_get_packet), (u_char *) this);
-	if (r > 0) {
-	    _count += r;
-	    _task.reschedule();
-	} else if (r < 0 && ++_pcap_complaints < 5)
-	    ErrorHandler::default_handler()->error("%p{element}: %s",
-			this, "nm_dispatch failed");
+	// Read and push() at most one burst of packets from the ready port.
+	for (NetmapInfo *ni = _netmap.begin(); ni != _netmap.end(); ++ni)
+	    if (ni->fd == fd && netmap_dispatch(*ni) > 0)
+		_task.reschedule();
     }
+#else
+    (void) fd;
 #endif
 #if FROMDEVICE_ALLOW_PCAP
     if (_method == method_pcap) {
@@ -492,53 +728,76 @@ FromDevice::selected(int, int)
 	    ErrorHandler::default_handler()->error("%p{element}: %s", this, pcap_geterr(_pcap));
     }
 #endif
+#if FROMDEVICE_ALLOW_RING
+    if (_method == method_ring && ring_dispatch() > 0)
+	_task.reschedule();
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    if (_method == method_xdp && xdp_dispatch() > 0)
+	_task.reschedule();
+#endif
 #if FROMDEVICE_ALLOW_LINUX
-    int nlinux = 0;
-    while (_method == method_linux && nlinux < _burst) {
-	struct sockaddr_ll sa;
-	socklen_t fromlen = sizeof(sa);
-	WritablePacket *p = Packet::make(_headroom, 0, _snaplen, 0);
-	int len = recvfrom(_fd, p->data(), p->length(), MSG_TRUNC, (sockaddr *)&sa, &fromlen);
-	if (len > 0 && (sa.sll_pkttype != PACKET_OUTGOING || _outbound)
-            && (_protocol == 0 || _protocol == sa.sll_protocol)) {
-	    if (len > _snaplen) {
-		assert(p->length() == (uint32_t)_snaplen);
-		SET_EXTRA_LENGTH_ANNO(p, len - _snaplen);
-	    } else
-		p->take(_snaplen - len);
-	    p->set_packet_type_anno((Packet::PacketType)sa.sll_pkttype);
-	    p->timestamp_anno().set_timeval_ioctl(_fd, SIOCGSTAMP);
+    if (_method == method_linux) {
+	int n = _linux_batch.recv(_fd, MSG_TRUNC);
+	if (n < 0 && errno != EAGAIN)
+	    click_chatter("FromDevice(%s): recvmmsg: %s", _ifname.c_str(), strerror(errno));
+	for (int i = 0; i < n; ++i) {
+	    const sockaddr_ll *sa = reinterpret_cast<const sockaddr_ll *>(_linux_batch.name(i));
+	    WritablePacket *p = _linux_batch.take(i, _snaplen);
+	    if ((sa->sll_pkttype == PACKET_OUTGOING && !_outbound)
+		|| (_protocol != 0 && _protocol != sa->sll_protocol)) {
+		p->kill();
+		continue;
+	    }
+	    p->set_packet_type_anno((Packet::PacketType)sa->sll_pkttype);
+	    if (_timestamp)
+		_linux_batch.timestamp(i, p->timestamp_anno());
 	    p->set_mac_header(p->data());
-	    ++nlinux;
 	    ++_count;
 	    if (!_force_ip || fake_pcap_force_ip(p, _datalink))
 		output(0).push(p);
 	    else
 		checked_output_push(1, p);
-	} else {
-	    p->kill();
-	    if (len <= 0 && errno != EAGAIN)
-		click_chatter("FromDevice(%s): recvfrom: %s", _ifname.c_str(), strerror(errno));
-	    break;
 	}
     }
 #endif
 }
 
-#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_RING || FROMDEVICE_ALLOW_XDP
 bool
 FromDevice::run_task(Task *)
 {
     // Read and push() at most one burst of packets.
     int r = 0;
+# if FROMDEVICE_ALLOW_RING
+    if (_method == method_ring) {
+	if (ring_dispatch() > 0) {
+	    _task.fast_reschedule();
+	    return true;
+	} else
+	    return false;
+    }
+# endif
+# if FROMDEVICE_ALLOW_XDP
+    if (_method == method_xdp) {
+	if (xdp_dispatch() > 0) {
+	    _task.fast_reschedule();
+	    return true;
+	} else
+	    return false;
+    }
+# endif
 # if FROMDEVICE_ALLOW_NETMAP
     if (_method == method_netmap) {
-	// Read and push() at most one burst of packets.
-	r = _netmap.dispatch(_burst,
-		reinterpret_cast<nm_cb_t>(FromDevice_get_packet), (u_char *) this);
-	if (r < 0 && ++_pcap_complaints < 5)
-	    ErrorHandler::default_handler()->error("%p{element}: %s",
-			this, "nm_dispatch failed");
+	// Read and push() at most one burst of packets from each port.
+	int n = 0;
+	for (NetmapInfo *ni = _netmap.begin(); ni != _netmap.end(); ++ni)
+	    n += netmap_dispatch(*ni);
+	if (n > 0) {
+	    _task.fast_reschedule();
+	    return true;
+	} else
+	    return false;
     }
 # endif
 # if FROMDEVICE_ALLOW_PCAP
@@ -565,6 +824,19 @@ FromDevice::kernel_drops(bool& known, int& max_drops) const
     // but for now, we just give up.
 #endif
     known = false, max_drops = -1;
+#if FROMDEVICE_ALLOW_RING
+    if (_method == method_ring && _ring) {
+	_ring->update_stats();
+	known = true, max_drops = _ring->drops();
+    }
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    if (_method == method_xdp && _xdp) {
+	uint64_t dropped, ring_full, tx_invalid;
+	_xdp->stats(dropped, ring_full, tx_invalid);
+	known = true, max_drops = dropped + ring_full;
+    }
+#endif
 #if FROMDEVICE_ALLOW_PCAP
     if (_method == method_pcap) {
 	struct pcap_stat stats;
@@ -590,6 +862,15 @@ FromDevice::read_handler(Element* e, void *thunk)
 	    return "??";
     } else if (thunk == (void *) 1)
 	return String(fake_pcap_unparse_dlt(fd->_datalink));
+#if FROMDEVICE_ALLOW_RING
+    else if (thunk == (void *) 3) {
+	if (!fd->_ring)
+	    return "??";
+	fd->_ring->update_stats();
+	return String(fd->_ring->freezes());
+    } else if (thunk == (void *) 4)
+	return fd->_ring ? String(fd->_ring->rx_stalls()) : String("??");
+#endif
     else
 	return String(fd->_count);
 }
@@ -608,9 +889,15 @@ FromDevice::add_handlers()
     add_read_handler("kernel_drops", read_handler, 0);
     add_read_handler("encap", read_handler, 1);
     add_read_handler("count", read_handler, 2);
+#if FROMDEVICE_ALLOW_RING
+    if (_method == method_ring) {
+	add_read_handler("ring_full", read_handler, 3);
+	add_read_handler("ring_stalls", read_handler, 4);
+    }
+#endif
     add_write_handler("reset_counts", write_handler, 0, Handler::BUTTON);
 }
 
 CLICK_ENDDECLS
-ELEMENT_REQUIRES(userlevel FakePcap KernelFilter NetmapInfo)
+ELEMENT_REQUIRES(userlevel FakePcap KernelFilter NetmapInfo PacketRing XDPSocket SocketBatch)
 EXPORT_ELEMENT(FromDevice)
@@ -5,6 +5,11 @@
 
 #ifdef __linux__
 # define FROMDEVICE_ALLOW_LINUX 1
+# define FROMDEVICE_ALLOW_RING 1
+# define FROMDEVICE_ALLOW_XDP 1
+# include "elements/userlevel/packetring.hh"
+# include "elements/userlevel/socketbatch.hh"
+# include "elements/userlevel/xdpsocket.hh"
 #endif
 
 #if HAVE_PCAP
@@ -24,7 +29,7 @@ void FromDevice_get_packet(u_char*, const struct pcap_pkthdr*, const u_char*);
 # include "elements/userlevel/netmapinfo.hh"
 #endif
 
-#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP
+#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_RING || FROMDEVICE_ALLOW_XDP
 # include <click/task.hh>
 #endif
 
@@ -93,8 +98,38 @@ but the IP header annotation has been set appropriately.) Default is false.
 =item METHOD
 
 Word.  Defines the capture method FromDevice will use to read packets from the
-device.  Linux targets generally support PCAP and LINUX; other targets support
-only PCAP.  Defaults to PCAP.
+device.  Linux targets generally support PCAP, LINUX, RING, and XDP; other
+targets support only PCAP.  Defaults to PCAP.
+
+METHOD RING reads packets from a memory-mapped PACKET_MMAP receive ring
+(TPACKET_V3) shared with the kernel.  Packets are not copied: each emitted
+packet points into the ring, and a ring block is returned to the kernel once
+every packet in it has been killed.  Holding received packets for a long
+time, for instance in a large Queue, therefore stalls the ring and causes
+drops; see the C<ring_full> handler.  Ring packets have no headroom, so
+HEADROOM is ignored and elements that push headers will copy the packet.
+
+METHOD XDP reads packets from an AF_XDP socket bound to one receive queue
+of the device (see QUEUE).  FromDevice loads a small XDP program that
+redirects that queue's packets to the socket; packets on other queues go to
+the kernel as usual, and the program is removed when the last XDP
+FromDevice on the device exits.  Packets live in the socket's UMEM frames
+and are not copied, so as with METHOD RING, holding many packets starves
+reception.  The device driver copies packets into the UMEM unless it
+supports zero-copy AF_XDP.  METHOD XDP ignores PROMISC, SNAPLEN, OUTBOUND,
+PROTOCOL, and the packets' kernel timestamps; if TIMESTAMP is true, packets
+are stamped with the current time.  Kernels before 5.11 charge the XDP
+program's map to the locked-memory limit; if loading fails for that reason,
+FromDevice raises the process's RLIMIT_MEMLOCK to unlimited and tries again.
+Run Click with a large enough C<ulimit -l> to avoid this.
+
+METHOD NETMAP, available when Click is built with netmap, reads packets from
+the netmap rings of DEVNAME, which should be a netmap port name such as
+C<netmap:eth0>.  FromDevice binds all of the port's receive rings, or only
+those chosen with QUEUE and N_QUEUES.  Packets are copied out of the rings
+unless ZEROCOPY is true.  If TIMESTAMP is true, the rings are opened with
+NR_TIMESTAMP, and each packet is stamped with the time the kernel last
+synchronized its ring, so packets read in one burst share a timestamp.
 
 =item BPF_FILTER
 
@@ -116,21 +151,98 @@ false.
 =item PROTOCOL
 
 Integer. If set and nonzero, then only emit packets with this link-level
-protocol. Only affects METHOD LINUX. Default is 0.
+protocol. Only affects METHOD LINUX and RING. Default is 0.
 
 =item HEADROOM
 
 Integer. Amount of bytes of headroom to leave before the packet data. Defaults
 to roughly 28.
 
+=item ALIGNMENT
+
+Specifies the alignment of emitted packet data, in the form "MODULUS
+OFFSET", such as "4 0".  FromDevice increases HEADROOM as needed so that
+packet data starts OFFSET bytes past a MODULUS-byte boundary, and the
+click-align tool uses the argument in its calculations.  The default
+ALIGNMENT is "4 2", which puts the IP header of an Ethernet frame on a
+4-byte boundary; it is not applied to an explicit HEADROOM.  Packets read
+with METHOD RING are placed by the kernel, which aligns Ethernet frames as
+"4 2", so METHOD RING rejects any other ALIGNMENT.  Zero-copy METHOD NETMAP
+packets start at the beginning of a netmap buffer, so that method rejects an
+ALIGNMENT with a nonzero OFFSET; give it ALIGNMENT "4 0" so click-align
+knows where its packets start.
+
 =item BURST
 
-Integer. Maximum number of packets to read per scheduling. Defaults to 1.
+Integer. Maximum number of packets to read per scheduling. METHOD LINUX
+reads the whole burst with one recvmmsg system call. Defaults to 1.
 
 =item TIMESTAMP
 
 Boolean. If false, then do not timestamp packets. Defaults to true.
 
+=item RING_BLOCK_SIZE
+
+Unsigned.  Size of each receive ring block in bytes; must be a power of two
+and at least a page.  Only affects METHOD RING.  Defaults to 1048576.
+
+=item RING_BLOCKS
+
+Unsigned.  Number of receive ring blocks.  Only affects METHOD RING.
+Defaults to 64.
+
+=item QUEUE
+
+Unsigned.  The device receive queue to read.  Only affects METHOD XDP and
+NETMAP.  For a multi-queue device, use one FromDevice per queue, each on its
+own thread (see StaticThreadSched).  Default is 0 for METHOD XDP; METHOD
+NETMAP reads all rings by default.
+
+=item N_QUEUES
+
+Unsigned.  With METHOD NETMAP, read the N_QUEUES rings starting at QUEUE,
+each through its own netmap port.  All of them are served by FromDevice's
+thread.  Default is 1.
+
+=item XDP_MODE
+
+Word.  How to attach the XDP program: NATIVE (in the driver), SKB (generic,
+after the kernel has built a socket buffer; works on any device), or AUTO
+(NATIVE if the driver supports it, otherwise SKB).  Default is AUTO.
+
+=item ZEROCOPY
+
+Boolean.  With METHOD XDP: if true, fail unless the driver supports
+zero-copy AF_XDP; if false, always use copy mode.  By default, zero-copy
+mode is used when available.
+
+With METHOD NETMAP: if true, swap each received buffer out of its ring for
+a spare netmap buffer instead of copying the packet.  Such packets have no
+headroom.  A ToDevice with METHOD NETMAP and no outputs sends them by
+swapping the buffer into its transmit ring, so forwarding between ports
+that share netmap memory copies no packet data.  Default is false.
+
+=item XDP_FRAMES
+
+Unsigned.  Number of UMEM frames (2048 bytes each); must be a power of two.
+Half of them are handed to the kernel for receiving.  Default is 4096.
+
+=item FANOUT
+
+Unsigned.  If set, join the device's socket to this PACKET_FANOUT group
+(0-65535), so that the kernel spreads received packets over every socket in
+the group.  Several FromDevice elements with the same DEVNAME and FANOUT,
+each running on its own thread, then receive packets in parallel.  Only
+affects METHOD LINUX and RING.
+
+=item FANOUT_MODE
+
+Word.  How the kernel picks a socket in the FANOUT group: HASH (by flow
+hash, so each flow stays on one socket), LB (round robin), CPU (by receiving
+CPU), ROLLOVER (fill one socket before moving to the next), or QUEUE (by
+device receive queue).  Every member of a group must use the same mode.
+Default is HASH.
+
 =back
 
 =e
@@ -156,6 +268,18 @@ constraints, before FromDevice could get them. This may be an integer; the
 notation C<"<I<d>">, meaning at most C<I<d>> drops; or C<"??">, meaning the
 number of drops is not known.
 
+=h ring_full read-only
+
+Returns the number of times the receive ring filled up because no block was
+free.  Only available for METHOD RING.
+
+=h ring_stalls read-only
+
+Returns the number of times reception stopped because the next ring block
+was still held by packets from its previous pass, for example packets waiting
+in a Queue.  Reception resumes once those packets are freed.  Only available
+for METHOD RING.
+
 =h encap read-only
 
 Returns a string indicating the encapsulation type on this link. Can be
@@ -201,10 +325,14 @@ class FromDevice : public Element { public:
 #endif
 
 #if FROMDEVICE_ALLOW_NETMAP
-    const NetmapInfo *netmap() const { return _method == method_netmap ? &_netmap : 0; }
+    const Vector<NetmapInfo> *netmap() const { return _method == method_netmap ? &_netmap : 0; }
+    int netmap_queue() const		{ return _netmap_queue; }
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    XDPSocket *xdp() const		{ return _xdp; }
 #endif
 
-#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP
+#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_RING || FROMDEVICE_ALLOW_XDP
     bool run_task(Task *task);
 #endif
 
@@ -215,13 +343,29 @@ class FromDevice : public Element { public:
 #if FROMDEVICE_ALLOW_LINUX || FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP
     int _fd;
 #endif
-#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP
+#if FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_RING || FROMDEVICE_ALLOW_XDP
     Task _task;
 #endif
 #if FROMDEVICE_ALLOW_LINUX
-    unsigned char *_linux_packetbuf;
+    SocketRecvBatch _linux_batch;
+    int _fanout;
+    String _fanout_mode;
+#endif
+#if FROMDEVICE_ALLOW_RING
+    PacketRing *_ring;
+    uint32_t _ring_block_size;
+    uint32_t _ring_blocks;
+    int ring_dispatch();
+#endif
+#if FROMDEVICE_ALLOW_XDP
+    XDPSocket *_xdp;
+    int _xdp_queue;
+    int _xdp_mode;
+    int _xdp_copy;
+    uint32_t _xdp_frames;
+    int xdp_dispatch();
 #endif
-#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP
+#if FROMDEVICE_ALLOW_PCAP || FROMDEVICE_ALLOW_NETMAP || FROMDEVICE_ALLOW_XDP
     void emit_packet(WritablePacket *p, int extra_len, const Timestamp &ts);
 #endif
 #if FROMDEVICE_ALLOW_PCAP
@@ -234,8 +378,12 @@ class FromDevice : public Element { public:
     }
 #endif
 #if FROMDEVICE_ALLOW_NETMAP
-    NetmapInfo _netmap;
-    int netmap_dispatch();
+    Vector<NetmapInfo> _netmap;
+    int _netmap_queue;
+    int _netmap_nqueues;
+    bool _netmap_zerocopy;
+    enum { netmap_extra_bufs = 4096 };
+    int netmap_dispatch(NetmapInfo &ni);
 #endif
 
     bool _force_ip;
@@ -258,7 +406,8 @@ class FromDevice : public Element { public:
     int _snaplen;
     uint16_t _protocol;
     unsigned _headroom;
-    enum { method_default, method_netmap, method_pcap, method_linux };
+    enum { method_default, method_netmap, method_pcap, method_linux,
+	   method_ring, method_xdp };
     int _method;
 #if FROMDEVICE_ALLOW_PCAP
     String _bpf_filter;
@@ -47,7 +47,8 @@ CLICK_DECLS
 	( (((y)&0xff)<<8) | ((u_short)((y)&0xff00)>>8) )
 
 FromDump::FromDump()
-    : _packet(0), _end_h(0), _count(0), _timer(this), _task(this)
+    : _packet(0), _pcapng(false), _pcapng_pending(false), _end_h(0),
+      _count(0), _timer(this), _task(this)
 {
 }
 
@@ -86,6 +87,7 @@ FromDump::configure(Vector<String> &conf, ErrorHandler *errh)
     bool per_node = false;
 #endif
     _packet_filepos = 0;
+    _interface_anno = -1;
 
     if (_ff.configure_keywords(conf, this, errh) < 0)
 	return -1;
@@ -106,6 +108,7 @@ FromDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("PER_NODE", per_node)
 #endif
 	.read("FILEPOS", _packet_filepos)
+	.read("INTERFACE_ANNO", AnnoArg(1), _interface_anno)
 	.complete() < 0)
 	return -1;
 
@@ -226,23 +229,47 @@ FromDump::initialize(ErrorHandler *errh)
     if (!fh)
 	return _ff.error(errh, "not a tcpdump file (too short)");
 
-    if (fh->magic == FAKE_PCAP_MAGIC || fh->magic == FAKE_MODIFIED_PCAP_MAGIC)
-	_swapped = false;
-    else {
-	swap_file_header(fh, &swapped_fh);
-	_swapped = true;
-	fh = &swapped_fh;
+    if (fh->magic == FAKE_PCAPNG_SHB) {
+	// pcap-ng: read the section header and any interface blocks that
+	// immediately follow it
+	_pcapng = true;
+	_extra_pkthdr_crap = 0;
+	if (read_pcapng_section(reinterpret_cast<const uint8_t *>(fh), errh) < 0)
+	    return -1;
+	fake_pcapng_block_header swapped_bh;
+	const fake_pcapng_block_header *bh;
+	while ((bh = reinterpret_cast<const fake_pcapng_block_header *>(_ff.get_aligned(sizeof(*bh), &swapped_bh)))) {
+	    uint32_t type = bh->type, length = bh->length;
+	    if (_swapped)
+		type = SWAPLONG(type), length = SWAPLONG(length);
+	    if (type != FAKE_PCAPNG_IDB) {
+		_pcapng_pending = true;
+		_pending_type = type;
+		_pending_length = length;
+		break;
+	    } else if (read_pcapng_interface(length, errh) < 0)
+		return -1;
+	}
+	_linktype = (_if_linktype.size() ? _if_linktype[0] : FAKE_DLT_NONE);
+    } else {
+	if (fh->magic == FAKE_PCAP_MAGIC || fh->magic == FAKE_MODIFIED_PCAP_MAGIC)
+	    _swapped = false;
+	else {
+	    swap_file_header(fh, &swapped_fh);
+	    _swapped = true;
+	    fh = &swapped_fh;
+	}
+	if (fh->magic != FAKE_PCAP_MAGIC && fh->magic != FAKE_MODIFIED_PCAP_MAGIC)
+	    return _ff.error(errh, "not a tcpdump file (bad magic number)");
+	// compensate for extra crap appended to packet headers
+	_extra_pkthdr_crap = (fh->magic == FAKE_PCAP_MAGIC ? 0 : sizeof(fake_modified_pcap_pkthdr) - sizeof(fake_pcap_pkthdr));
+
+	if (fh->version_major != FAKE_PCAP_VERSION_MAJOR)
+	    return _ff.error(errh, "unknown major version %d", fh->version_major);
+	_minor_version = fh->version_minor;
+	// map possible host link types to global link types
+	_linktype = fake_pcap_canonical_dlt(fh->linktype, true);
     }
-    if (fh->magic != FAKE_PCAP_MAGIC && fh->magic != FAKE_MODIFIED_PCAP_MAGIC)
-	return _ff.error(errh, "not a tcpdump file (bad magic number)");
-    // compensate for extra crap appended to packet headers
-    _extra_pkthdr_crap = (fh->magic == FAKE_PCAP_MAGIC ? 0 : sizeof(fake_modified_pcap_pkthdr) - sizeof(fake_pcap_pkthdr));
-
-    if (fh->version_major != FAKE_PCAP_VERSION_MAJOR)
-	return _ff.error(errh, "unknown major version %d", fh->version_major);
-    _minor_version = fh->version_minor;
-    // map possible host link types to global link types
-    _linktype = fake_pcap_canonical_dlt(fh->linktype, true);
 
     // if forcing IP packets, check datalink type to ensure we understand it
     if (_force_ip) {
@@ -256,6 +283,7 @@ FromDump::initialize(ErrorHandler *errh)
     if (_packet_filepos != 0) {
 	int result = _ff.seek(_packet_filepos, errh);
 	_packet_filepos = 0;
+	_pcapng_pending = false;
 	return result;
     } else
 	return 0;
@@ -274,6 +302,13 @@ FromDump::take_state(Element *e, ErrorHandler *errh)
     _swapped = o->_swapped;
     _extra_pkthdr_crap = o->_extra_pkthdr_crap;
     _minor_version = o->_minor_version;
+    _pcapng = o->_pcapng;
+    _pcapng_pending = o->_pcapng_pending;
+    _pending_type = o->_pending_type;
+    _pending_length = o->_pending_length;
+    _if_linktype = o->_if_linktype;
+    _if_tsresol = o->_if_tsresol;
+    _annos = o->_annos;
 
     _linktype = o->_linktype;
     if (_linktype == FAKE_DLT_RAW)
@@ -320,6 +355,257 @@ FromDump::prepare_times(const Timestamp &ts)
     _have_any_times = true;
 }
 
+static Timestamp
+pcapng_timestamp(uint64_t t, uint8_t tsresol)
+{
+    uint64_t sec, subsec;
+    if (tsresol & 0x80) {
+	// binary resolution: 2^-tsresol seconds
+	int shift = tsresol & 0x7F;
+	if (shift >= 64)
+	    return Timestamp();
+	sec = t >> shift;
+	uint64_t frac = t & ((((uint64_t) 1) << shift) - 1);
+	if (shift > 32) {
+	    frac >>= shift - 32;
+	    shift = 32;
+	}
+	subsec = (frac * Timestamp::subsec_per_sec) >> shift;
+    } else {
+	// decimal resolution: 10^-tsresol seconds
+	uint64_t units = 1;
+	for (int i = 0; i < tsresol && i < 19; ++i)
+	    units *= 10;
+	sec = t / units;
+	subsec = t % units;
+	if (units >= (uint64_t) Timestamp::subsec_per_sec)
+	    subsec /= units / Timestamp::subsec_per_sec;
+	else
+	    subsec *= Timestamp::subsec_per_sec / units;
+    }
+    return Timestamp((uint32_t) sec, (uint32_t) subsec);
+}
+
+int
+FromDump::read_pcapng_section(const uint8_t *data, ErrorHandler *errh)
+{
+    fake_pcapng_block_header bh;
+    fake_pcapng_section_header sh;
+    memcpy(&bh, data, sizeof(bh));
+    memcpy(&sh, data + sizeof(bh), sizeof(sh));
+
+    if (sh.byte_order_magic == FAKE_PCAPNG_BYTE_ORDER_MAGIC)
+	_swapped = false;
+    else if (sh.byte_order_magic == SWAPLONG(FAKE_PCAPNG_BYTE_ORDER_MAGIC)) {
+	_swapped = true;
+	bh.length = SWAPLONG(bh.length);
+	sh.version_major = SWAPSHORT(sh.version_major);
+    } else
+	return _ff.error(errh, "not a pcap-ng file (bad byte order magic)");
+    if (sh.version_major != FAKE_PCAPNG_VERSION_MAJOR)
+	return _ff.error(errh, "unknown pcap-ng major version %d", sh.version_major);
+
+    uint32_t hlen = sizeof(bh) + sizeof(sh) + 4;
+    if (bh.length < hlen || (bh.length & 3))
+	return _ff.error(errh, "bad pcap-ng section header");
+
+    // each section has its own interfaces and annotations
+    _if_linktype.clear();
+    _if_tsresol.clear();
+    _annos.clear();
+    if (!read_pcapng_options(FAKE_PCAPNG_SHB, bh.length - hlen, 0, errh))
+	return _ff.error(errh, "pcap-ng file truncated");
+    _ff.shift_pos(4);
+    return 0;
+}
+
+int
+FromDump::read_pcapng_interface(uint32_t length, ErrorHandler *errh)
+{
+    fake_pcapng_interface_description swapped_id;
+    const fake_pcapng_interface_description *id;
+    uint32_t hlen = sizeof(fake_pcapng_block_header) + sizeof(*id) + 4;
+    if (length < hlen || (length & 3))
+	return _ff.error(errh, "bad pcap-ng interface block");
+    if (!(id = reinterpret_cast<const fake_pcapng_interface_description *>(_ff.get_aligned(sizeof(*id), &swapped_id))))
+	return _ff.error(errh, "pcap-ng file truncated");
+
+    int linktype = (_swapped ? SWAPSHORT(id->linktype) : id->linktype);
+    _if_linktype.push_back(fake_pcap_canonical_dlt(linktype, true));
+    _if_tsresol.push_back(6);	// microseconds unless told otherwise
+    if (!read_pcapng_options(FAKE_PCAPNG_IDB, length - hlen, 0, errh))
+	return _ff.error(errh, "pcap-ng file truncated");
+    _ff.shift_pos(4);
+    return 0;
+}
+
+bool
+FromDump::read_pcapng_options(uint32_t block_type, uint32_t length, Packet *p, ErrorHandler *errh)
+{
+    if (length == 0)
+	return true;
+    uint8_t buf[512];
+    String str;
+    const uint8_t *data;
+    if (length <= sizeof(buf))
+	data = _ff.get_unaligned(length, buf, errh);
+    else if ((str = _ff.get_string(length, errh)).length() == (int) length)
+	data = reinterpret_cast<const uint8_t *>(str.data());
+    else
+	data = 0;
+    if (!data)
+	return false;
+
+    const uint8_t *end = data + length;
+    while (data + sizeof(fake_pcapng_option_header) <= end) {
+	fake_pcapng_option_header oh;
+	memcpy(&oh, data, sizeof(oh));
+	if (_swapped)
+	    oh.code = SWAPSHORT(oh.code), oh.length = SWAPSHORT(oh.length);
+	data += sizeof(oh);
+	if (oh.code == FAKE_PCAPNG_OPT_ENDOFOPT || data + oh.length > end)
+	    break;
+
+	uint32_t pen = 0;
+	if ((oh.code == FAKE_PCAPNG_OPT_CUSTOM_STRING
+	     || oh.code == FAKE_PCAPNG_OPT_CUSTOM_BINARY) && oh.length >= 4) {
+	    memcpy(&pen, data, 4);
+	    if (_swapped)
+		pen = SWAPLONG(pen);
+	}
+
+	if (block_type == FAKE_PCAPNG_IDB && oh.code == FAKE_PCAPNG_OPT_IF_TSRESOL
+	    && oh.length >= 1)
+	    _if_tsresol.back() = data[0];
+	else if (block_type == FAKE_PCAPNG_SHB && pen == FAKE_PCAPNG_CLICK_PEN
+		 && oh.code == FAKE_PCAPNG_OPT_CUSTOM_STRING) {
+	    // "annotations NAME..." names the annotations stored per packet
+	    Vector<String> words;
+	    cp_spacevec(String(data + 4, oh.length - 4), words);
+	    for (int i = 1; words.size() && words[0] == "annotations" && i < words.size(); ++i) {
+		int anno;
+		if (!AnnoArg(0).parse(words[i], anno, this)
+		    || ANNOTATIONINFO_SIZE(anno) == 0) {
+		    _ff.warning(errh, "unknown annotation %<%s%>, ignoring stored annotations", words[i].c_str());
+		    _annos.clear();
+		    break;
+		}
+		_annos.push_back(anno);
+	    }
+	} else if (block_type == FAKE_PCAPNG_EPB && pen == FAKE_PCAPNG_CLICK_PEN
+		   && oh.code == FAKE_PCAPNG_OPT_CUSTOM_BINARY && p) {
+	    const uint8_t *x = data + 4, *xend = data + oh.length;
+	    for (int *a = _annos.begin(); a != _annos.end(); ++a) {
+		int size = ANNOTATIONINFO_SIZE(*a);
+		if (x + size > xend)
+		    break;
+		memcpy(p->anno_u8() + ANNOTATIONINFO_OFFSET(*a), x, size);
+		x += size;
+	    }
+	}
+
+	data += (oh.length + 3) & ~3;
+    }
+    return true;
+}
+
+bool
+FromDump::read_pcapng_packet_header(Timestamp &ts, int &len, int &caplen, int &skiplen, ErrorHandler *errh)
+{
+    fake_pcapng_block_header swapped_bh;
+    const fake_pcapng_block_header *bh;
+    uint32_t type, length;
+    const uint32_t epb_hlen = sizeof(*bh) + sizeof(fake_pcapng_enhanced_packet);
+
+    while (1) {
+	if (_pcapng_pending) {
+	    type = _pending_type;
+	    length = _pending_length;
+	    _pcapng_pending = false;
+	} else if ((bh = reinterpret_cast<const fake_pcapng_block_header *>(_ff.get_aligned(sizeof(*bh), &swapped_bh)))) {
+	    type = bh->type;
+	    length = bh->length;
+	    if (_swapped)
+		type = SWAPLONG(type), length = SWAPLONG(length);
+	} else
+	    return false;
+
+	if (type == FAKE_PCAPNG_SHB) {
+	    // new section, possibly with a different byte order
+	    fake_pcapng_block_header raw_bh;
+	    raw_bh.type = type;
+	    raw_bh.length = (_swapped ? SWAPLONG(length) : length);
+	    uint8_t data[sizeof(raw_bh) + sizeof(fake_pcapng_section_header)];
+	    const uint8_t *sh = _ff.get_unaligned(sizeof(fake_pcapng_section_header), data + sizeof(raw_bh), errh);
+	    if (!sh)
+		return false;
+	    memcpy(data, &raw_bh, sizeof(raw_bh));
+	    memmove(data + sizeof(raw_bh), sh, sizeof(fake_pcapng_section_header));
+	    if (read_pcapng_section(data, errh) < 0)
+		return false;
+	    continue;
+	} else if (length < sizeof(*bh) + 4 || (length & 3)) {
+	    _ff.error(errh, "bad pcap-ng block; giving up");
+	    return false;
+	}
+
+	if (type == FAKE_PCAPNG_EPB && length >= epb_hlen + 4) {
+	    fake_pcapng_enhanced_packet swapped_ep;
+	    const fake_pcapng_enhanced_packet *ep;
+	    if (!(ep = reinterpret_cast<const fake_pcapng_enhanced_packet *>(_ff.get_aligned(sizeof(*ep), &swapped_ep))))
+		return false;
+	    uint32_t ifid = ep->interface_id, thigh = ep->timestamp_high,
+		tlow = ep->timestamp_low;
+	    caplen = ep->caplen;
+	    len = ep->len;
+	    if (_swapped) {
+		ifid = SWAPLONG(ifid);
+		thigh = SWAPLONG(thigh);
+		tlow = SWAPLONG(tlow);
+		caplen = SWAPLONG(caplen);
+		len = SWAPLONG(len);
+	    }
+	    if (ifid >= (uint32_t) _if_linktype.size() || caplen < 0
+		|| (uint32_t) caplen > length - epb_hlen - 4) {
+		_ff.error(errh, "bad pcap-ng packet block; giving up");
+		return false;
+	    }
+	    _interface = ifid;
+	    ts = pcapng_timestamp(((uint64_t) thigh << 32) | tlow, _if_tsresol[ifid]);
+	    skiplen = length - epb_hlen - caplen;
+	} else if (type == FAKE_PCAPNG_SPB && length >= sizeof(*bh) + 8) {
+	    uint32_t swapped_len;
+	    const uint32_t *lenp;
+	    if (!(lenp = reinterpret_cast<const uint32_t *>(_ff.get_aligned(4, &swapped_len))))
+		return false;
+	    len = (_swapped ? SWAPLONG(*lenp) : *lenp);
+	    if (_if_linktype.size() == 0 || len < 0) {
+		_ff.error(errh, "bad pcap-ng packet block; giving up");
+		return false;
+	    }
+	    // simple packets have no timestamp
+	    _interface = 0;
+	    ts = Timestamp();
+	    caplen = length - sizeof(*bh) - 8;
+	    if (caplen > len)
+		caplen = len;
+	    skiplen = length - sizeof(*bh) - 4 - caplen;
+	} else if (type == FAKE_PCAPNG_IDB) {
+	    if (read_pcapng_interface(length, errh) < 0)
+		return false;
+	    continue;
+	} else {
+	    _ff.shift_pos(length - sizeof(*bh));
+	    continue;
+	}
+
+	_linktype = _if_linktype[_interface];
+	if (caplen > len)
+	    len = caplen;
+	return true;
+    }
+}
+
 bool
 FromDump::read_packet(ErrorHandler *errh)
 {
@@ -333,6 +619,14 @@ FromDump::read_packet(ErrorHandler *errh)
     // record file position
     _packet_filepos = _ff.file_pos();
 
+    if (_pcapng) {
+	if (_pcapng_pending)
+	    _packet_filepos -= sizeof(fake_pcapng_block_header);
+	if (!read_pcapng_packet_header(ts, len, caplen, skiplen, errh))
+	    return false;
+	goto check_caplen;
+    }
+
     // read the packet header
     if (!(ph = reinterpret_cast<const fake_pcap_pkthdr *>(_ff.get_aligned(sizeof(*ph), &swapped_ph))))
 	return false;
@@ -340,6 +634,8 @@ FromDump::read_packet(ErrorHandler *errh)
 	swap_packet_header(ph, &swapped_ph);
 	ph = &swapped_ph;
     }
+    ts = fake_bpf_timeval_union::make_timestamp(&ph->ts);
+    _interface = 0;
 
     // may need to swap 'caplen' and 'len' fields at or before version 2.3
     if (_minor_version > 3 || (_minor_version == 3 && ph->caplen <= ph->len)) {
@@ -350,12 +646,15 @@ FromDump::read_packet(ErrorHandler *errh)
 	caplen = ph->len;
     }
 
+  check_caplen:
+
     // check for errors
     // 3.Jul.2002 -- Angelos Stavrou discovered that tcptrace-generated
     // tcpdump files store an incorrect caplen. It's only off by one. Tcptrace
     // should be fixed, but we hack around the problem here, as does
-    // tcpdump itself.
-    if (caplen > 65535) {
+    // tcpdump itself.  (A pcap-ng block's length already bounds its caplen,
+    // which may exceed 64KB.)
+    if (!_pcapng && caplen > 65535) {
 	_ff.error(errh, "bad packet header; giving up");
 	return false;
     } else if (caplen > len) {
@@ -368,7 +667,6 @@ FromDump::read_packet(ErrorHandler *errh)
 
     // check times
   check_times:
-    ts = fake_bpf_timeval_union::make_timestamp(&ph->ts);
     if (!_have_any_times)
 	prepare_times(ts);
     if (_have_first_time) {
@@ -401,7 +699,19 @@ FromDump::read_packet(ErrorHandler *errh)
     if (!p)
 	return false;
     SET_EXTRA_LENGTH_ANNO(p, len - caplen);
-    _ff.shift_pos(skiplen);
+    if (_pcapng) {
+	// padding, options, and trailing block length
+	int pad = (4 - (caplen & 3)) & 3;
+	_ff.shift_pos(pad);
+	if (!read_pcapng_options(FAKE_PCAPNG_EPB, skiplen - pad - 4, p, errh)) {
+	    p->kill();
+	    return false;
+	}
+	_ff.shift_pos(4);
+    } else
+	_ff.shift_pos(skiplen);
+    if (_interface_anno >= 0)
+	p->set_anno_u8(_interface_anno, _interface);
 
     p->set_mac_header(p->data());
     _packet = p;
@@ -12,7 +12,7 @@ class HandlerCall;
 /*
 =c
 
-FromDump(FILENAME [, I<keywords> STOP, TIMING, SAMPLE, FORCE_IP, START, START_AFTER, END, END_AFTER, INTERVAL, END_CALL, FILEPOS, MMAP])
+FromDump(FILENAME [, I<keywords> STOP, TIMING, SAMPLE, FORCE_IP, START, START_AFTER, END, END_AFTER, INTERVAL, END_CALL, FILEPOS, MMAP, INTERFACE_ANNO])
 
 =s traces
 
@@ -27,6 +27,12 @@ more packets.
 FromDump also transparently reads gzip- and bzip2-compressed tcpdump files, if
 you have zcat(1) and bzcat(1) installed.
 
+FromDump reads pcap-ng files as well as classic pcap files.  Enhanced and
+simple packet blocks are emitted; other blocks are skipped.  Timestamps are
+converted from each interface's resolution.  If the file was written by
+ToDump with the ANNOTATIONS keyword, FromDump restores those annotations on
+each packet.
+
 Keyword arguments are:
 
 =over 8
@@ -108,6 +114,12 @@ This can result in slightly better performance on some machines. FromDump's
 regular file discipline is pretty optimized, so the difference is often small
 in practice. Default is true on most operating systems, but false on Linux.
 
+=item INTERFACE_ANNO
+
+Annotation name.  If given, then FromDump stores each packet's pcap-ng
+interface number in this one-byte annotation, such as C<PAINT>.  Packets from
+classic pcap files get interface number 0.
+
 =back
 
 You can supply at most one of START and START_AFTER, and at most one of END,
@@ -148,7 +160,8 @@ Value is a Boolean.
 
 =h encap read-only
 
-Returns the file's encapsulation type.
+Returns the file's encapsulation type.  For pcap-ng files, this is the
+encapsulation type of the most recent packet's interface.
 
 =h filename read-only
 
@@ -227,12 +240,23 @@ class FromDump : public Element { public:
     bool _first_time_relative : 1;
     bool _last_time_relative : 1;
     bool _last_time_interval : 1;
+    bool _pcapng : 1;
+    bool _pcapng_pending : 1;
     bool _active;
     unsigned _extra_pkthdr_crap;
     unsigned _sampling_prob;
     int _minor_version;
     int _linktype;
 
+    // pcap-ng state
+    uint32_t _pending_type;	// block header read ahead by initialize()
+    uint32_t _pending_length;
+    Vector<int> _if_linktype;
+    Vector<uint8_t> _if_tsresol;
+    Vector<int> _annos;
+    int _interface;		// interface of current packet
+    int _interface_anno;
+
     Timestamp _first_time;
     Timestamp _last_time;
     HandlerCall *_end_h;
@@ -252,6 +276,10 @@ class FromDump : public Element { public:
     off_t _packet_filepos;
 
     bool read_packet(ErrorHandler *);
+    int read_pcapng_section(const uint8_t *data, ErrorHandler *);
+    int read_pcapng_interface(uint32_t length, ErrorHandler *);
+    bool read_pcapng_options(uint32_t block_type, uint32_t length, Packet *, ErrorHandler *);
+    bool read_pcapng_packet_header(Timestamp &, int &len, int &caplen, int &skiplen, ErrorHandler *);
 
     void prepare_times(const Timestamp &);
     bool check_timing(Packet *p);
@@ -40,7 +40,7 @@
 CLICK_DECLS
 
 FromHost::FromHost()
-    : _fd(-1), _task(this)
+    : _fd(-1), _spare(0), _count(0), _task(this)
 {
 #if HAVE_IP6
     _prefix6 = 0;
@@ -54,9 +54,9 @@ FromHost::~FromHost()
 int
 FromHost::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-    _headroom = Packet::default_headroom;
-    _headroom += (4 - (_headroom + 2) % 4) % 4; // default 4/2 alignment
+    _headroom = Packet::aligned_headroom(Packet::default_headroom, 4, 2);
     _mtu_out = DEFAULT_MTU;
+    _burst = 32;
 
     if (Args(conf, this, errh)
 	.read_mp("DEVNAME", _dev_name)
@@ -69,6 +69,7 @@ FromHost::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("ETHER", _macaddr)
 	.read("HEADROOM", _headroom)
 	.read("MTU", _mtu_out)
+	.read("BURST", _burst)
 	.complete() < 0)
 	return -1;
 
@@ -78,6 +79,8 @@ FromHost::configure(Vector<String> &conf, ErrorHandler *errh)
 	return errh->error("must specify device name");
     if (_headroom > 8192)
 	return errh->error("HEADROOM too large");
+    if (_burst < 1)
+	return errh->error("BURST must be >= 1");
     return 0;
 }
 
@@ -215,6 +218,8 @@ FromHost::cleanup(CleanupStage)
 	close(_fd);
 	remove_select(_fd, SELECT_READ);
     }
+    if (_spare)
+	_spare->kill();
 }
 
 void
@@ -223,14 +228,24 @@ FromHost::selected(int fd, int)
     if (fd != _fd)
 	return;
 
-    WritablePacket *p = Packet::make(_headroom, 0, _mtu_in, 0);
-    if (!p) {
-	click_chatter("out of memory!");
-	return;
-    }
+    Timestamp now = Timestamp::now();
+    for (unsigned n = 0; n < _burst && _nonfull_signal; ++n) {
+	WritablePacket *p = _spare;
+	_spare = 0;
+	if (!p && !(p = Packet::make(_headroom, 0, _mtu_in, 0))) {
+	    click_chatter("out of memory!");
+	    return;
+	}
+
+	int cc = read(_fd, p->data(), _mtu_in);
+	if (cc <= 0) {
+	    // keep the buffer for next time
+	    _spare = p;
+	    if (cc < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+		perror("FromHost read");
+	    break;
+	}
 
-    int cc = read(_fd, p->data(), _mtu_in);
-    if (cc > 0) {
 	p->take(_mtu_in - cc);
 	// 2-byte padding followed by an Ethernet type
 	p->pull(4);
@@ -238,19 +253,13 @@ FromHost::selected(int fd, int)
 	const click_ip *ip = reinterpret_cast<const click_ip *>(p->data() + sizeof(click_ether));
 	p->set_dst_ip_anno(IPAddress(ip->ip_dst));
 	p->set_ip_header(ip, ip->ip_hl << 2);
-	p->timestamp_anno().assign_now();
+	p->set_timestamp_anno(now);
+	++_count;
 	output(0).push(p);
-    } else {
-	p->kill();
-	perror("FromHost read");
     }
 
-    if (!_nonfull_signal) {
+    if (!_nonfull_signal)
 	remove_select(_fd, SELECT_READ);
-	return;
-    }
-
-
 }
 
 bool
@@ -276,6 +285,7 @@ FromHost::add_handlers()
 {
     add_data_handlers("dev_name", Handler::OP_READ, &_dev_name);
     add_read_handler("signal", read_param, 0);
+    add_data_handlers("count", Handler::OP_READ, &_count);
 }
 
 CLICK_ENDDECLS
@@ -16,7 +16,7 @@ CLICK_DECLS
  *
  * =c
  *
- * FromHost(DEVNAME [, DST] [, I<keywords> GATEWAY, HEADROOM, ...])
+ * FromHost(DEVNAME [, DST] [, I<keywords> GATEWAY, HEADROOM, BURST, ...])
  *
  * =s comm
  *
@@ -57,6 +57,12 @@ CLICK_DECLS
  * not specified, in which case the fake device's address is whatever the
  * kernel chooses.
  *
+ * =item BURST
+ *
+ * Integer. The maximum number of packets FromHost reads from the device each
+ * time it becomes readable. Reading stops early when the device is empty or
+ * the downstream full signal turns off. Default is 32.
+ *
  * =item DST6
  *
  * IPv6 prefix.  If specified, FromHost runs ifconfig(8) to set the
@@ -83,9 +89,17 @@ CLICK_DECLS
  * An error like "open /dev/net/tun: No such file or directory" usually means
  * that you have not enabled tunnel support in your kernel.
  *
+ * =n
+ *
+ * FromHost keeps the buffer of an unsuccessful read for the next one, so a
+ * wakeup that finds the device empty allocates nothing.
+ *
  * =h dev_name read-only
  * Returns the name of the device that this element is using.
  *
+ * =h count read-only
+ * Returns the number of packets read from the device.
+ *
  * =a
  *
  * ToHost.u, ifconfig(8)
@@ -139,6 +153,9 @@ class FromHost : public Element { public:
 #endif
 
     unsigned _headroom;
+    unsigned _burst;
+    WritablePacket *_spare;		// buffer for the next read
+    unsigned long long _count;
     Task _task;
     NotifierSignal _nonfull_signal;
 
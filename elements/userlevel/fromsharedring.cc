@@ -0,0 +1,124 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * fromsharedring.{cc,hh} -- element reads packets from a shared memory ring
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fromsharedring.hh"
+#include "sharedring.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/standard/scheduleinfo.hh>
+CLICK_DECLS
+
+FromSharedRing::FromSharedRing()
+    : _sleep(0), _idle(0), _sr(0), _task(this), _timer(&_task), _count(0)
+{
+}
+
+FromSharedRing::~FromSharedRing()
+{
+}
+
+int
+FromSharedRing::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _ring = 0;
+    _burst = 32;
+    _max_sleep = 10000;
+    _nrings = _capacity = _nbufs = _buf_size = 0;
+    if (Args(conf, this, errh)
+	.read_mp("FILENAME", FilenameArg(), _filename)
+	.read_p("RING", _ring)
+	.read("BURST", _burst)
+	.read("MAX_SLEEP", SecondsArg(6), _max_sleep)
+	.read("RINGS", _nrings)
+	.read("CAPACITY", _capacity)
+	.read("BUFFERS", _nbufs)
+	.read("BUFFER_SIZE", _buf_size)
+	.complete() < 0)
+	return -1;
+    if (_burst == 0)
+	return errh->error("BURST must be positive");
+    return 0;
+}
+
+int
+FromSharedRing::initialize(ErrorHandler *errh)
+{
+    if (!(_sr = SharedRing::open(_filename, _nrings, _capacity, _nbufs, _buf_size, errh)))
+	return -1;
+    if (_ring >= _sr->nrings())
+	return errh->error("%s has only %u rings", _filename.c_str(), _sr->nrings());
+    ScheduleInfo::initialize_task(this, &_task, true, errh);
+    _timer.initialize(this);
+    return 0;
+}
+
+void
+FromSharedRing::cleanup(CleanupStage)
+{
+    if (_sr)
+	_sr->close();
+    _sr = 0;
+}
+
+bool
+FromSharedRing::run_task(Task *)
+{
+    unsigned n;
+    for (n = 0; n < _burst; ++n) {
+	WritablePacket *p = _sr->rx_packet(_ring);
+	if (!p)
+	    break;
+	output(0).push(p);
+    }
+    _count += n;
+    if (n > 0 || !_max_sleep) {
+	_idle = 0;
+	_sleep = 0;
+	_task.fast_reschedule();
+    } else if (++_idle < idle_polls)
+	_task.fast_reschedule();
+    else {
+	// an idle ring: back off exponentially, up to MAX_SLEEP; timers are
+	// only good to about a millisecond, so start there
+	_sleep = (_sleep ? _sleep * 2 : 1000);
+	if (_sleep > _max_sleep)
+	    _sleep = _max_sleep;
+	_timer.schedule_after(Timestamp::make_usec(_sleep));
+    }
+    return n > 0;
+}
+
+String
+FromSharedRing::read_handler(Element *e, void *thunk)
+{
+    FromSharedRing *fsr = static_cast<FromSharedRing *>(e);
+    if (thunk)
+	return String(fsr->_sr ? fsr->_sr->free_buffers() : 0);
+    else
+	return String(fsr->_count);
+}
+
+void
+FromSharedRing::add_handlers()
+{
+    add_task_handlers(&_task);
+    add_read_handler("count", read_handler, 0);
+    add_read_handler("free_buffers", read_handler, 1);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel SharedRing)
+EXPORT_ELEMENT(FromSharedRing)
@@ -0,0 +1,143 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_FROMSHAREDRING_HH
+#define CLICK_FROMSHAREDRING_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/timer.hh>
+CLICK_DECLS
+class SharedRing;
+
+/*
+=c
+
+FromSharedRing(FILENAME [, RING, I<keywords> BURST, MAX_SLEEP, RINGS, CAPACITY, BUFFERS, BUFFER_SIZE])
+
+=s comm
+
+reads packets from a shared memory ring
+
+=d
+
+Reads packets that another Click process (or another element in this
+router) sent with ToSharedRing, and pushes them out its output.  FILENAME
+names the shared memory file, usually in /dev/shm; RING is the ring within
+it to read, and defaults to 0.
+
+Packets are not copied: each emitted packet points into the file's buffer
+pool, and its buffer returns to the pool when the packet is killed.  A
+packet sent to a ToSharedRing on the same file is passed on by descriptor,
+so a chain of Click processes that share one file forwards packets without
+copying them.  Holding many packets for a long time exhausts the pool.
+
+FromSharedRing polls its ring, like PollDevice.  While packets arrive it
+polls continuously.  Once the ring has stayed empty for a while, it sleeps
+between polls, starting at 1ms and doubling up to MAX_SLEEP, so an idle
+ring does not keep its thread busy; the first packet after a sleep may wait
+that long.
+
+The first element to open FILENAME creates it using the RINGS, CAPACITY,
+BUFFERS, and BUFFER_SIZE keywords.  Later opens, by any process, use the
+file's own layout, and fail if a keyword they give does not match it.
+Remove the file to change the layout, or after a process using it crashes,
+since buffers held by a crashed process are lost.
+
+Keyword arguments are:
+
+=over 8
+
+=item BURST
+
+Integer.  The maximum number of packets to emit per scheduling.  Defaults
+to 32.
+
+=item MAX_SLEEP
+
+Time.  The longest sleep between polls of an idle ring.  0 means poll
+continuously.  Timers wake slightly early and poll until they expire, so
+each sleep costs about a millisecond of CPU time; short sleeps save little.
+Defaults to 10ms.
+
+=item RINGS
+
+Integer.  The number of rings in a new file.  Defaults to 2.
+
+=item CAPACITY
+
+Integer.  The number of descriptors in each ring of a new file; must be a
+power of 2.  Defaults to 1024.
+
+=item BUFFERS
+
+Integer.  The number of packet buffers in a new file, shared by all its
+rings.  At most 65534.  Defaults to 4096.
+
+=item BUFFER_SIZE
+
+Integer.  The size of each packet buffer in a new file, headroom included.
+Defaults to 2048.
+
+=back
+
+=e
+
+A two-process service chain.  The first process:
+
+  FromDevice(eth0) -> ToSharedRing(/dev/shm/chain, 0);
+  FromSharedRing(/dev/shm/chain, 1) -> Queue -> ToDevice(eth1);
+
+The second process, a middlebox between them:
+
+  FromSharedRing(/dev/shm/chain, 0) -> ... -> ToSharedRing(/dev/shm/chain, 1);
+
+=h count read-only
+
+Returns the number of packets received.
+
+=h free_buffers read-only
+
+Returns the number of free buffers in the file's pool.
+
+=a ToSharedRing, PollDevice */
+
+class FromSharedRing : public Element { public:
+
+    FromSharedRing() CLICK_COLD;
+    ~FromSharedRing() CLICK_COLD;
+
+    const char *class_name() const	{ return "FromSharedRing"; }
+    const char *port_count() const	{ return PORTS_0_1; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    bool run_task(Task *);
+
+  private:
+
+    enum { idle_polls = 64 };		// empty polls before sleeping
+
+    String _filename;
+    unsigned _ring;
+    unsigned _burst;
+    uint32_t _max_sleep;		// in microseconds
+    uint32_t _sleep;
+    unsigned _idle;
+    unsigned _nrings;
+    unsigned _capacity;
+    unsigned _nbufs;
+    unsigned _buf_size;
+
+    SharedRing *_sr;
+    Task _task;
+    Timer _timer;
+    click_uint_large_t _count;
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
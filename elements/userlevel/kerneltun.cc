@@ -20,15 +20,21 @@
 #include <click/config.h>
 #include "kerneltun.hh"
 #include "fakepcap.hh"
+#include "uringio.hh"
 #include <click/error.hh>
 #include <click/bitvector.hh>
 #include <click/args.hh>
 #include <click/straccum.hh>
 #include <click/glue.hh>
+#include <click/packet_anno.hh>
+#include <click/master.hh>
+#include <click/multithread.hh>
 #include <clicknet/ether.h>
+#include <clicknet/tcp.h>
 #include <click/standard/scheduleinfo.hh>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 #include <sys/ioctl.h>
 #include <arpa/inet.h>
 
@@ -55,6 +61,25 @@
 #if HAVE_NET_IF_TAP_H
 # include <net/if_tap.h>
 #endif
+#if KERNELTUN_LINUX
+// <linux/virtio_net.h> is not valid C++
+struct click_virtio_net_hdr {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+    uint16_t num_buffers;	// present in 12-byte headers only
+};
+# define VIRTIO_NET_HDR_F_NEEDS_CSUM	1
+# define VIRTIO_NET_HDR_F_DATA_VALID	2
+# define VIRTIO_NET_HDR_GSO_NONE	0
+# ifndef TUN_F_USO4
+#  define TUN_F_USO4 0x20
+#  define TUN_F_USO6 0x40
+# endif
+#endif
 
 #if defined(__NetBSD__)
 # include <sys/param.h>
@@ -70,7 +95,7 @@ CLICK_DECLS
 KernelTun::KernelTun()
     : _fd(-1), _tap(false), _task(this), _ignore_q_errs(false),
       _printed_write_err(false), _printed_read_err(false),
-      _selected_calls(0), _packets(0)
+      _vnet_hdr(false), _gso(true), _io_uring(false), _vnet_hdr_len(0)
 {
 }
 
@@ -91,11 +116,11 @@ int
 KernelTun::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     _gw = IPAddress();
-    _headroom = Packet::default_headroom;
+    _headroom = Packet::aligned_headroom(Packet::default_headroom, 4, 0);
     _adjust_headroom = false;
-    _headroom += (4 - _headroom % 4) % 4; // default 4/0 alignment
     _mtu_out = DEFAULT_MTU;
     _burst = 1;
+    _nqueues = 1;
     if (Args(conf, this, errh)
 	.read_mp("ADDR", IPPrefixArg(), _near, _mask)
 	.read_p("GATEWAY", _gw)
@@ -108,6 +133,10 @@ KernelTun::configure(Vector<String> &conf, ErrorHandler *errh)
 #if KERNELTUN_LINUX
 	.read("DEV_NAME", Args::deprecated, _dev_name)
 	.read("DEVNAME", _dev_name)
+	.read("VNET_HDR", _vnet_hdr)
+	.read("GSO", _gso)
+	.read("QUEUES", _nqueues)
+	.read("IO_URING", _io_uring)
 #endif
 	.complete() < 0)
 	return -1;
@@ -116,17 +145,23 @@ KernelTun::configure(Vector<String> &conf, ErrorHandler *errh)
 	return errh->error("bad GATEWAY");
     if (_burst < 1)
 	return errh->error("BURST must be >= 1");
+    if (_nqueues < 1)
+	return errh->error("QUEUES must be >= 1");
     if (_mtu_out < (int) sizeof(click_ip))
 	return errh->error("MTU must be greater than %d", sizeof(click_ip));
     if (_headroom > 8192)
 	return errh->error("HEADROOM too big");
+#if !HAVE_ALLOW_IO_URING
+    if (_io_uring)
+	return errh->error("IO_URING requires Click configured with --enable-io-uring");
+#endif
     _adjust_headroom = !_adjust_headroom;
     return 0;
 }
 
 #if KERNELTUN_LINUX
 int
-KernelTun::try_linux_universal()
+KernelTun::open_linux_queue()
 {
     int fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
     if (fd < 0)
@@ -135,20 +170,66 @@ KernelTun::try_linux_universal()
     struct ifreq ifr;
     memset(&ifr, 0, sizeof(ifr));
     ifr.ifr_flags = (_tap ? IFF_TAP : IFF_TUN);
+    if (_vnet_hdr)
+	ifr.ifr_flags |= IFF_VNET_HDR;
+    if (_nqueues > 1)
+	ifr.ifr_flags |= IFF_MULTI_QUEUE;
     if (_dev_name)
 	// Setting ifr_name allows us to select an arbitrary interface name.
 	strncpy(ifr.ifr_name, _dev_name.c_str(), sizeof(ifr.ifr_name));
     int err = ioctl(fd, TUNSETIFF, (void *)&ifr);
     if (err < 0) {
+	err = -errno;
 	close(fd);
-	return -errno;
+	return err;
     }
 
     _dev_name = ifr.ifr_name;
-    _fd = fd;
+    Queue q;
+    q.fd = fd;
+    q.thread = 0;
+    q.gso_buf = 0;
+    q.uring = 0;
+    q.selected_calls = q.packets = 0;
+    _queues.push_back(q);
+    return 0;
+}
+
+int
+KernelTun::try_linux_universal()
+{
+    // Every queue after the first attaches to the device the first created.
+    int err;
+    while (_queues.size() < _nqueues)
+	if ((err = open_linux_queue()) < 0) {
+	    for (int i = 0; i < _queues.size(); ++i)
+		close(_queues[i].fd);
+	    _queues.clear();
+	    return err;
+	}
+
+    _fd = _queues[0].fd;
     _type = LINUX_UNIVERSAL;
     return 0;
 }
+
+int
+KernelTun::setup_vnet_hdr(ErrorHandler *errh)
+{
+    // A 12-byte header keeps the packet data aligned as without one.
+    _vnet_hdr_len = sizeof(struct click_virtio_net_hdr);
+    if (ioctl(_fd, TUNSETVNETHDRSZ, &_vnet_hdr_len) != 0)
+	return errh->error("TUNSETVNETHDRSZ failed: %s", strerror(errno));
+
+    unsigned offload = TUN_F_CSUM;
+    if (_gso)
+	offload |= TUN_F_TSO4 | TUN_F_TSO6 | TUN_F_TSO_ECN;
+    // UDP segmentation offload is new; retry without it
+    if ((!_gso || ioctl(_fd, TUNSETOFFLOAD, offload | TUN_F_USO4 | TUN_F_USO6) != 0)
+	&& ioctl(_fd, TUNSETOFFLOAD, offload) != 0)
+	return errh->error("TUNSETOFFLOAD failed: %s", strerror(errno));
+    return 0;
+}
 #endif
 
 int
@@ -161,6 +242,13 @@ KernelTun::try_tun(const String &dev_name, ErrorHandler *)
 
     _dev_name = dev_name;
     _fd = fd;
+    Queue q;
+    q.fd = fd;
+    q.thread = 0;
+    q.gso_buf = 0;
+    q.uring = 0;
+    q.selected_calls = q.packets = 0;
+    _queues.push_back(q);
     return 0;
 }
 
@@ -180,6 +268,16 @@ KernelTun::alloc_tun(ErrorHandler *errh)
     String saved_device, saved_message;
     StringAccum tried;
 
+    if (_nqueues > 1 || _vnet_hdr) {
+#if KERNELTUN_LINUX
+	if ((error = try_linux_universal()) >= 0)
+	    return error;
+	return errh->error("/dev/net/tun: %s%s", strerror(-error), _nqueues > 1 && error == -EINVAL ? "\n(Perhaps the device exists without multiqueue support.)" : "");
+#else
+	return errh->error("VNET_HDR and QUEUES require the Linux Universal TUN/TAP driver");
+#endif
+    }
+
 #if KERNELTUN_LINUX
     if ((error = try_linux_universal()) >= 0)
 	return error;
@@ -410,6 +508,11 @@ KernelTun::setup_tun(ErrorHandler *errh)
     }
 #endif
 
+#if KERNELTUN_LINUX
+    if (_vnet_hdr && setup_vnet_hdr(errh) < 0)
+	return -1;
+#endif
+
 #if defined(TUNSIFHEAD) || defined(__FreeBSD__)
     // Each read/write prefixed with a 32-bit address family,
     // just as in OpenBSD.
@@ -454,6 +557,12 @@ KernelTun::setup_tun(ErrorHandler *errh)
 	_mtu_in = _mtu_out + 4; // + 0?
     else /* _type == LINUX_ETHERTAP */
 	_mtu_in = _mtu_out + 16;
+    // unsegmented packets can be as big as IP allows; the part past the
+    // MTU is read into a separate buffer, so small packets stay small
+    _gso_in = 0;
+    if (_vnet_hdr && _gso && _mtu_in < 65535 + 18)
+	_gso_in = 65535 + 18 - _mtu_in;
+    _mtu_in += _vnet_hdr_len;
 
     return 0;
 }
@@ -471,39 +580,153 @@ KernelTun::initialize(ErrorHandler *errh)
     }
     if (_adjust_headroom) {
 	if (_tap && _type == LINUX_UNIVERSAL)
-	    _headroom += (4 - (_headroom + 2) % 4) % 4; // default 4/2 alignment
+	    _headroom = Packet::aligned_headroom(_headroom, 4, 2);
 	else
-	    _headroom += (4 - _headroom % 4) % 4; // default 4/0 alignment
+	    _headroom = Packet::aligned_headroom(_headroom, 4, 0);
+    }
+
+    // Spread queues across threads, starting with the home thread.  Each
+    // thread sends on the queue it reads, or shares one if it reads none.
+    int nthreads = master()->nthreads();
+    _thread_queue.assign(nthreads, 0);
+    for (int t = 0; t < nthreads; ++t)
+	_thread_queue[t] = t % _queues.size();
+    for (int i = 0; i < _queues.size(); ++i) {
+	Queue &q = _queues[i];
+	q.thread = (home_thread()->thread_id() + i) % nthreads;
+	if (i < nthreads)
+	    _thread_queue[q.thread] = i;
+#if HAVE_ALLOW_IO_URING
+	if (_io_uring) {
+	    if (_type != LINUX_UNIVERSAL)
+		return errh->error("IO_URING requires the Linux Universal TUN/TAP driver");
+	    // reads land in one buffer, so it must hold a whole GSO packet
+	    if (!(q.uring = URingIO::open(q.fd, _burst, _burst, _headroom + _mtu_in + _gso_in, _headroom, errh)))
+		return -1;
+	    master()->thread(q.thread)->select_set().add_select(q.uring->rx_fd(), this, SELECT_READ);
+	    continue;
+	}
+#endif
+	master()->thread(q.thread)->select_set().add_select(q.fd, this, SELECT_READ);
+	if (_gso_in && !(q.gso_buf = new unsigned char[_gso_in]))
+	    return errh->error("out of memory");
     }
-    add_select(_fd, SELECT_READ);
     return 0;
 }
 
 void
 KernelTun::cleanup(CleanupStage)
 {
-    if (_fd >= 0) {
-	if (_type != LINUX_UNIVERSAL && _type != NETBSD_TAP)
-	    updown(0, ~0, ErrorHandler::default_handler());
-	close(_fd);
-	remove_select(_fd, SELECT_READ);
+    if (_fd >= 0 && _type != LINUX_UNIVERSAL && _type != NETBSD_TAP)
+	updown(0, ~0, ErrorHandler::default_handler());
+    for (int i = 0; i < _queues.size(); ++i) {
+	Queue &q = _queues[i];
+#if HAVE_ALLOW_IO_URING
+	if (q.uring) {
+	    master()->thread(q.thread)->select_set().remove_select(q.uring->rx_fd(), this, SELECT_READ);
+	    q.uring->close();
+	}
+#endif
+	close(q.fd);
+	master()->thread(q.thread)->select_set().remove_select(q.fd, this, SELECT_READ);
+	delete[] q.gso_buf;
     }
+    _queues.clear();
+    _fd = -1;
 }
 
 void
 KernelTun::selected(int fd, int)
 {
     Timestamp now = Timestamp::now();
-    if (fd != _fd)
+    Queue *q = _queues.begin();
+#if HAVE_ALLOW_IO_URING
+    while (q != _queues.end() && q->fd != fd
+	   && !(q->uring && q->uring->rx_fd() == fd))
+	++q;
+#else
+    while (q != _queues.end() && q->fd != fd)
+	++q;
+#endif
+    if (q == _queues.end())
 	return;
-    ++_selected_calls;
+    ++q->selected_calls;
+#if HAVE_ALLOW_IO_URING
+    if (q->uring) {
+	// take every completed read, then post the buffers that came back
+	WritablePacket *p;
+	int cc;
+	while ((cc = q->uring->rx_packet(p)) > 0)
+	    received(*q, p, now);
+	if (cc != -EAGAIN && (!_ignore_q_errs || !_printed_read_err || cc != -ENOBUFS)) {
+	    _printed_read_err = true;
+	    click_chatter("KernelTun read: %s", strerror(cc ? -cc : EPIPE));
+	}
+	q->uring->refill();
+	return;
+    }
+#endif
     unsigned n = _burst;
-    while (n > 0 && one_selected(now))
+    while (n > 0 && one_selected(*q, now))
 	--n;
 }
 
+#if KERNELTUN_LINUX
+static void
+vnet_hdr_to_anno(Packet *p, const struct click_virtio_net_hdr &vh, int base)
+{
+    SET_OFFLOAD_FLAGS_ANNO(p, vh.flags & (VIRTIO_NET_HDR_F_NEEDS_CSUM | VIRTIO_NET_HDR_F_DATA_VALID));
+    SET_GSO_TYPE_ANNO(p, vh.gso_type);
+    SET_GSO_SIZE_ANNO(p, vh.gso_type != VIRTIO_NET_HDR_GSO_NONE ? vh.gso_size : 0);
+    if (vh.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+	SET_CSUM_START_ANNO(p, vh.csum_start - base);
+	SET_CSUM_OFFSET_ANNO(p, vh.csum_offset);
+    } else {
+	SET_CSUM_START_ANNO(p, 0);
+	SET_CSUM_OFFSET_ANNO(p, 0);
+    }
+}
+
+static void
+anno_to_vnet_hdr(const Packet *p, int base, struct click_virtio_net_hdr &vh)
+{
+    memset(&vh, 0, sizeof(vh));
+    int flags = OFFLOAD_FLAGS_ANNO(p);
+    if (flags & OFFLOAD_NEEDS_CSUM) {
+	int start = base + CSUM_START_ANNO(p), offset = CSUM_OFFSET_ANNO(p);
+	// ignore annotations that cannot describe this packet
+	if (start + offset + 2 > (int) p->length())
+	    return;
+	vh.flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+	vh.csum_start = start;
+	vh.csum_offset = offset;
+	int gso_type = GSO_TYPE_ANNO(p);
+	if (gso_type != GSO_NONE && GSO_SIZE_ANNO(p)) {
+	    vh.gso_type = gso_type;
+	    vh.gso_size = GSO_SIZE_ANNO(p);
+	    if ((gso_type & ~GSO_ECN) == GSO_TCPV4 || (gso_type & ~GSO_ECN) == GSO_TCPV6) {
+		if (start + (int) sizeof(click_tcp) <= (int) p->length())
+		    vh.hdr_len = start + (reinterpret_cast<const click_tcp *>(p->data() + start)->th_off << 2);
+	    } else
+		vh.hdr_len = start + 8;
+	}
+    } else
+	vh.flags = flags & OFFLOAD_CSUM_VALID;
+}
+
+static int
+ether_header_length(const Packet *p)
+{
+    const click_ether *e = reinterpret_cast<const click_ether *>(p->data());
+    if (p->length() >= sizeof(click_ether_vlan)
+	&& e->ether_type == htons(ETHERTYPE_8021Q))
+	return sizeof(click_ether_vlan);
+    return sizeof(click_ether);
+}
+#endif
+
 bool
-KernelTun::one_selected(const Timestamp &now)
+KernelTun::one_selected(Queue &q, const Timestamp &now)
 {
     WritablePacket *p = Packet::make(_headroom, 0, _mtu_in, 0);
     if (!p) {
@@ -511,54 +734,33 @@ KernelTun::one_selected(const Timestamp &now)
 	return false;
     }
 
-    int cc = read(_fd, p->data(), _mtu_in);
-    if (cc > 0) {
-	++_packets;
-	p->take(_mtu_in - cc);
-	bool ok = false;
-
-	if (_tap) {
-	    if (_type == LINUX_UNIVERSAL)
-		// 2-byte padding, 2-byte Ethernet type, then Ethernet header
-		p->pull(4);
-	    else if (_type == LINUX_ETHERTAP)
-		// 2-byte padding, then Ethernet header
-		p->pull(2);
-	    ok = true;
-	} else if (_type == LINUX_UNIVERSAL) {
-	    // 2-byte padding followed by an Ethernet type
-	    uint16_t etype = *(uint16_t *)(p->data() + 2);
-	    p->pull(4);
-	    if (etype != htons(ETHERTYPE_IP) && etype != htons(ETHERTYPE_IP6))
-		checked_output_push(1, p->clone());
-	    else
-		ok = fake_pcap_force_ip(p, FAKE_DLT_RAW);
-	} else if (_type == BSD_TUN) {
-	    // 4-byte address family followed by IP header
-	    int af = ntohl(*(unsigned *)p->data());
-	    p->pull(4);
-	    if (af != AF_INET && af != AF_INET6) {
-		click_chatter("KernelTun(%s): don't know AF %d", _dev_name.c_str(), af);
-		checked_output_push(1, p->clone());
-	    } else
-		ok = fake_pcap_force_ip(p, FAKE_DLT_RAW);
-	} else if (_type == OSX_TUN || _type == NETBSD_TUN) {
-	    ok = fake_pcap_force_ip(p, FAKE_DLT_RAW);
-	} else { /* _type == LINUX_ETHERTAP */
-	    // 2-byte padding followed by a mostly-useless Ethernet header
-	    uint16_t etype = *(uint16_t *)(p->data() + 14);
-	    p->pull(16);
-	    if (etype != htons(ETHERTYPE_IP) && etype != htons(ETHERTYPE_IP6))
-		checked_output_push(1, p->clone());
-	    else
-		ok = fake_pcap_force_ip(p, FAKE_DLT_RAW);
+    int cc;
+    if (q.gso_buf) {
+	struct iovec iov[2];
+	iov[0].iov_base = p->data();
+	iov[0].iov_len = _mtu_in;
+	iov[1].iov_base = q.gso_buf;
+	iov[1].iov_len = _gso_in;
+	cc = readv(q.fd, iov, 2);
+    } else
+	cc = read(q.fd, p->data(), _mtu_in);
+    if (cc > _mtu_in) {
+	// a large GSO packet: copy it into a packet of its own size
+	WritablePacket *big = Packet::make(_headroom, 0, cc, 0);
+	if (big) {
+	    memcpy(big->data(), p->data(), _mtu_in);
+	    memcpy(big->data() + _mtu_in, q.gso_buf, cc - _mtu_in);
 	}
-
-	if (ok) {
-	    p->set_timestamp_anno(now);
-	    output(0).push(p);
-	} else
-	    checked_output_push(1, p);
+	p->kill();
+	if (!(p = big)) {
+	    click_chatter("out of memory!");
+	    return false;
+	}
+    }
+    if (cc > 0) {
+	if (cc < _mtu_in)
+	    p->take(_mtu_in - cc);
+	received(q, p, now);
 	return true;
     } else {
 	p->kill();
@@ -571,20 +773,127 @@ KernelTun::one_selected(const Timestamp &now)
     }
 }
 
+void
+KernelTun::received(Queue &q, WritablePacket *p, const Timestamp &now)
+{
+    ++q.packets;
+    bool ok = false;
+#if KERNELTUN_LINUX
+    // the virtio-net header follows the 4-byte packet information
+    struct click_virtio_net_hdr vh;
+    if (_vnet_hdr_len) {
+	memcpy(&vh, p->data() + 4, _vnet_hdr_len);
+	p->pull(_vnet_hdr_len);
+	memmove(p->data(), p->data() - _vnet_hdr_len, 4);
+    }
+#endif
+
+    if (_tap) {
+	if (_type == LINUX_UNIVERSAL)
+	    // 2-byte padding, 2-byte Ethernet type, then Ethernet header
+	    p->pull(4);
+	else if (_type == LINUX_ETHERTAP)
+	    // 2-byte padding, then Ethernet header
+	    p->pull(2);
+	ok = true;
+    } else if (_type == LINUX_UNIVERSAL) {
+	// 2-byte padding followed by an Ethernet type
+	uint16_t etype = *(uint16_t *)(p->data() + 2);
+	p->pull(4);
+	if (etype != htons(ETHERTYPE_IP) && etype != htons(ETHERTYPE_IP6))
+	    checked_output_push(1, p->clone());
+	else
+	    ok = fake_pcap_force_ip(p, FAKE_DLT_RAW);
+    } else if (_type == BSD_TUN) {
+	// 4-byte address family followed by IP header
+	int af = ntohl(*(unsigned *)p->data());
+	p->pull(4);
+	if (af != AF_INET && af != AF_INET6) {
+	    click_chatter("KernelTun(%s): don't know AF %d", _dev_name.c_str(), af);
+	    checked_output_push(1, p->clone());
+	} else
+	    ok = fake_pcap_force_ip(p, FAKE_DLT_RAW);
+    } else if (_type == OSX_TUN || _type == NETBSD_TUN) {
+	ok = fake_pcap_force_ip(p, FAKE_DLT_RAW);
+    } else { /* _type == LINUX_ETHERTAP */
+	// 2-byte padding followed by a mostly-useless Ethernet header
+	uint16_t etype = *(uint16_t *)(p->data() + 14);
+	p->pull(16);
+	if (etype != htons(ETHERTYPE_IP) && etype != htons(ETHERTYPE_IP6))
+	    checked_output_push(1, p->clone());
+	else
+	    ok = fake_pcap_force_ip(p, FAKE_DLT_RAW);
+    }
+
+#if KERNELTUN_LINUX
+    if (_vnet_hdr_len)
+	vnet_hdr_to_anno(p, vh, _tap ? ether_header_length(p) : 0);
+#endif
+
+    if (ok) {
+	p->set_timestamp_anno(now);
+	output(0).push(p);
+    } else
+	checked_output_push(1, p);
+}
+
 bool
 KernelTun::run_task(Task *)
 {
-    Packet *p = input(0).pull();
-    if (p)
-	push(0, p);
+    // with IO_URING, a burst of pulled packets costs one system call
+    unsigned n = 0, burst = (_io_uring ? _burst : 1);
+    while (n < burst) {
+	Packet *p = input(0).pull();
+	if (!p)
+	    break;
+	send(p);
+	++n;
+    }
+    if (n)
+	flush(send_queue());
     else if (!_signal)
 	return false;
     _task.fast_reschedule();
-    return p != 0;
+    return n != 0;
 }
 
 void
 KernelTun::push(int, Packet *p)
+{
+    send(p);
+    flush(send_queue());
+}
+
+KernelTun::Queue *
+KernelTun::send_queue()
+{
+    // each thread sends on its own queue, if it has one
+    int t = click_current_thread_index();
+    if (_queues.size() > 1 && t < _thread_queue.size())
+	return &_queues[_thread_queue[t]];
+    return &_queues[0];
+}
+
+void
+KernelTun::flush(Queue *q)
+{
+#if HAVE_ALLOW_IO_URING
+    if (q->uring) {
+	int e = q->uring->flush();
+	if (e >= 0)
+	    e = q->uring->tx_error();
+	if (e < 0 && (e != -ENOBUFS || !_ignore_q_errs || !_printed_write_err)) {
+	    _printed_write_err = true;
+	    click_chatter("%s(%s): write failed: %s", class_name(), _dev_name.c_str(), strerror(-e));
+	}
+    }
+#else
+    (void) q;
+#endif
+}
+
+void
+KernelTun::send(Packet *p)
 {
     const click_ip *iph = 0;
     int check_length;
@@ -616,13 +925,39 @@ KernelTun::push(int, Packet *p)
 	check_length = p->length();
     }
 
-    // check MTU
+#if KERNELTUN_LINUX
+    struct click_virtio_net_hdr vh;
+    if (_vnet_hdr_len) {
+	int base = 0;
+	if (_tap)
+	    base = (p->has_network_header() ? p->network_header_offset() : ether_header_length(p));
+	anno_to_vnet_hdr(p, base, vh);
+    }
+
+    // check MTU; the kernel segments packets sent with a GSO header
+    if (check_length > _mtu_out
+	&& !(_vnet_hdr_len && vh.gso_type != VIRTIO_NET_HDR_GSO_NONE)) {
+#else
     if (check_length > _mtu_out) {
+#endif
 	click_chatter("%s(%s): packet larger than MTU (%d)", class_name(), _dev_name.c_str(), _mtu_out);
 	goto kill;
     }
 
     WritablePacket *q;
+#if KERNELTUN_LINUX
+    if (_vnet_hdr_len) {
+	// 4-byte packet information, then the virtio-net header
+	uint16_t pi = (_tap ? ((const click_ether *) p->data())->ether_type
+		       : (iph->ip_v == 4 ? htons(ETHERTYPE_IP) : htons(ETHERTYPE_IP6)));
+	if ((q = p->push(4 + _vnet_hdr_len))) {
+	    ((uint16_t *) q->data())[0] = 0;
+	    ((uint16_t *) q->data())[1] = pi;
+	    memcpy(q->data() + 4, &vh, _vnet_hdr_len);
+	}
+	p = q;
+    } else
+#endif
     if (_tap) {
 	if (_type == LINUX_UNIVERSAL) {
 	    // 2-byte padding, 2-byte Ethernet type, then Ethernet header
@@ -663,7 +998,22 @@ KernelTun::push(int, Packet *p)
     }
 
     if (p) {
-	int w = write(_fd, p->data(), p->length());
+	Queue *sq = send_queue();
+#if HAVE_ALLOW_IO_URING
+	if (sq->uring) {
+	    // if every buffer is in flight, wait for one to come back
+	    int r = sq->uring->tx_packet(p);
+	    if (r == -EAGAIN && (r = sq->uring->flush(true)) >= 0)
+		r = sq->uring->tx_packet(p);
+	    if (r < 0 && (!_ignore_q_errs || !_printed_write_err)) {
+		_printed_write_err = true;
+		click_chatter("%s(%s): write failed: %s", class_name(), _dev_name.c_str(), strerror(-r));
+	    }
+	    p->kill();
+	    return;
+	}
+#endif
+	int w = write(sq->fd, p->data(), p->length());
 	if (w != (int) p->length() && (errno != ENOBUFS || !_ignore_q_errs || !_printed_write_err)) {
 	    _printed_write_err = true;
 	    click_chatter("%s(%s): write failed: %s", class_name(), _dev_name.c_str(), strerror(errno));
@@ -673,16 +1023,26 @@ KernelTun::push(int, Packet *p)
 	click_chatter("%s(%s): out of memory", class_name(), _dev_name.c_str());
 }
 
+String
+KernelTun::read_handler(Element *e, void *thunk)
+{
+    KernelTun *kt = static_cast<KernelTun *>(e);
+    click_uint_large_t n = 0;
+    for (Queue *q = kt->_queues.begin(); q != kt->_queues.end(); ++q)
+	n += (thunk ? q->packets : q->selected_calls);
+    return String(n);
+}
+
 void
 KernelTun::add_handlers()
 {
     if (input_is_pull(0))
 	add_task_handlers(&_task);
     add_data_handlers("dev_name", Handler::OP_READ, &_dev_name);
-    add_data_handlers("selected_calls", Handler::OP_READ, &_selected_calls);
-    add_data_handlers("packets", Handler::OP_READ, &_packets);
+    add_read_handler("selected_calls", read_handler, 0);
+    add_read_handler("packets", read_handler, 1);
 }
 
 CLICK_ENDDECLS
-ELEMENT_REQUIRES(userlevel FakePcap)
+ELEMENT_REQUIRES(userlevel FakePcap URingIO)
 EXPORT_ELEMENT(KernelTun)
@@ -5,12 +5,15 @@
 #include <click/etheraddress.hh>
 #include <click/task.hh>
 #include <click/notifier.hh>
+#include <click/vector.hh>
 CLICK_DECLS
+class URingIO;
 
 /*
 =c
 
-KernelTun(ADDR/MASK [, GATEWAY, I<keywords> HEADROOM, ETHER, MTU, IGNORE_QUEUE_OVERFLOWS])
+KernelTun(ADDR/MASK [, GATEWAY, I<keywords> HEADROOM, ETHER, MTU, IGNORE_QUEUE_OVERFLOWS,
+                      VNET_HDR, GSO, QUEUES])
 
 =s comm
 
@@ -73,6 +76,50 @@ String. If specified, try to alloc a tun device with name DEVNAME.
 Otherwise, we'll just take the first virtual device we find. This option
 only works with the Linux Universal TUN/TAP driver.
 
+=item VNET_HDR
+
+Boolean. If true, exchange a virtio-net header with the kernel along with
+each packet, so that checksum computation and segmentation can be left to
+whoever handles the packet last. The header's contents are carried in the
+offload annotations (OFFLOAD_FLAGS, GSO_TYPE, GSO_SIZE, CSUM_START and
+CSUM_OFFSET). A packet emitted with the OFFLOAD_NEEDS_CSUM flag has a
+partial transport checksum, and a packet with a GSO_TYPE may be much larger
+than the MTU; elements that check or modify transport headers will not
+expect either. Packets pushed to KernelTun with these annotations are
+checksummed and segmented by the kernel. The offload annotations share
+their bytes with PERFCTR and, on 64-bit hosts, IPSEC_SA_DATA_REFERENCE, so
+those annotations cannot be used on the same packets; AnnotationInfo's
+CHECK_OVERLAP can verify this for a configuration's own annotations. Only
+works with the Linux Universal TUN/TAP driver. Default is false.
+
+=item GSO
+
+Boolean. If true, and VNET_HDR is true, ask the kernel to pass up
+unsegmented TCP (and, where supported, UDP) packets of up to 64 kilobytes.
+If false, packets received from the kernel are segmented, but may still have
+partial checksums. Default is true.
+
+=item QUEUES
+
+Integer. The number of queues to open on a multi-queue device. Each queue has
+its own file descriptor, and the kernel spreads packets across queues by
+flow. In a multithreaded Click, queue I<i> is read by the I<i>th thread
+after KernelTun's home thread, and each thread sends packets on its own
+queue, so the elements downstream of KernelTun must be thread safe. Only
+works with the Linux Universal TUN/TAP driver. Default is 1.
+
+=item IO_URING
+
+Boolean. If true, read and write each queue through io_uring with
+registered buffers rather than with read() and write() calls. Up to BURST
+reads per queue stay posted in the kernel, and each received packet uses
+its read buffer without copying; a killed packet's buffer is posted again
+after the next burst. When KernelTun's input is pull, up to BURST pulled
+packets are copied into registered buffers and sent with one system call.
+With GSO, every buffer is large enough for an unsegmented packet. Only
+works with the Linux Universal TUN/TAP driver, and in a Click configured
+with --enable-io-uring. Default is false.
+
 =back
 
 =n
@@ -133,8 +180,21 @@ class KernelTun : public Element { public:
     enum Type { LINUX_UNIVERSAL, LINUX_ETHERTAP, BSD_TUN, BSD_TAP, OSX_TUN,
 		NETBSD_TUN, NETBSD_TAP };
 
-    int _fd;
+    struct Queue {
+	int fd;
+	int thread;
+	unsigned char *gso_buf;	// receives the tail of large GSO packets
+	URingIO *uring;		// completion-based I/O, if IO_URING
+	click_uint_large_t selected_calls;
+	click_uint_large_t packets;
+    };
+
+    int _fd;			// == _queues[0].fd
+    Vector<Queue> _queues;
+    Vector<int> _thread_queue;
+    int _nqueues;
     int _mtu_in;
+    int _gso_in;		// size of each Queue's gso_buf
     int _mtu_out;
     Type _type;
     bool _tap;
@@ -152,18 +212,26 @@ class KernelTun : public Element { public:
     bool _printed_write_err;
     bool _printed_read_err;
     bool _adjust_headroom;
-
-    click_uint_large_t _selected_calls;
-    click_uint_large_t _packets;
+    bool _vnet_hdr;
+    bool _gso;
+    bool _io_uring;
+    int _vnet_hdr_len;
 
 #if HAVE_LINUX_IF_TUN_H
     int try_linux_universal();
+    int open_linux_queue();
+    int setup_vnet_hdr(ErrorHandler *);
 #endif
     int try_tun(const String &, ErrorHandler *);
     int alloc_tun(ErrorHandler *);
     int setup_tun(ErrorHandler *);
     int updown(IPAddress, IPAddress, ErrorHandler *);
-    bool one_selected(const Timestamp &now);
+    bool one_selected(Queue &q, const Timestamp &now);
+    void received(Queue &q, WritablePacket *p, const Timestamp &now);
+    Queue *send_queue();
+    void send(Packet *p);
+    void flush(Queue *q);
+    static String read_handler(Element *, void *) CLICK_COLD;
 
     friend class KernelTap;
 
@@ -0,0 +1,361 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * metricsexporter.{cc,hh} -- element serves handler values as OpenMetrics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "metricsexporter.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/handler.hh>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+CLICK_DECLS
+
+MetricsExporter::MetricsExporter()
+    : _socket_fd(-1), _scrapes(0), _timer(this)
+{
+}
+
+MetricsExporter::~MetricsExporter()
+{
+}
+
+int
+MetricsExporter::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String port, globs = "*.count";
+    _prefix = "click_";
+    _interval = Timestamp(1);
+    _localhost = true;
+    if (Args(conf, this, errh)
+	.read_mp("PORT", WordArg(), port)
+	.read("HANDLERS", AnyArg(), globs)
+	.read("INTERVAL", _interval)
+	.read("PREFIX", _prefix)
+	.read("LOCALHOST", _localhost)
+	.complete() < 0)
+	return -1;
+
+    _port_search = (port && port.back() == '+');
+    if (_port_search)
+	port = port.substring(0, -1);
+    if (!IPPortArg(IP_PROTO_TCP).parse(port, _port, this))
+	return errh->error("PORT requires TCP port");
+
+    _globs.clear();
+    cp_spacevec(cp_unquote(globs), _globs);
+    if (!_globs.size())
+	return errh->error("no HANDLERS");
+    for (const char *s = _prefix.begin(); s != _prefix.end(); ++s)
+	if (!isalnum((unsigned char) *s) && *s != '_' && *s != ':')
+	    return errh->error("bad PREFIX");
+    return 0;
+}
+
+static String
+metric_name(const String &hname)
+{
+    StringAccum sa;
+    for (const char *s = hname.begin(); s != hname.end(); ++s)
+	sa << (isalnum((unsigned char) *s) || *s == '_' ? *s : '_');
+    return sa.take_string();
+}
+
+void
+MetricsExporter::collect_metrics()
+{
+    _metrics.clear();
+    Vector<int> hindexes;
+    for (int ei = 0; ei < router()->nelements(); ++ei) {
+	Element *e = router()->element(ei);
+	if (e == this)
+	    continue;
+	hindexes.clear();
+	Router::element_hindexes(e, hindexes);
+	for (int *hi = hindexes.begin(); hi != hindexes.end(); ++hi) {
+	    const Handler *h = Router::handler(router(), *hi);
+	    if (!h->read_visible())
+		continue;
+	    String full = e->name() + "." + h->name();
+	    for (String *g = _globs.begin(); g != _globs.end(); ++g)
+		if (full.glob_match(*g)) {
+		    metric m;
+		    m.e = e;
+		    m.hindex = *hi;
+		    m.name = metric_name(h->name());
+		    _metrics.push_back(m);
+		    break;
+		}
+	}
+    }
+
+    // group samples of one metric together; keep element order within
+    for (int i = 1; i < _metrics.size(); ++i) {
+	metric m = _metrics[i];
+	int j = i;
+	for (; j > 0 && String::compare(_metrics[j - 1].name, m.name) > 0; --j)
+	    _metrics[j] = _metrics[j - 1];
+	_metrics[j] = m;
+    }
+}
+
+int
+MetricsExporter::initialize(ErrorHandler *errh)
+{
+    collect_metrics();
+    if (!_metrics.size())
+	errh->warning("no handlers match HANDLERS");
+
+    _socket_fd = socket(PF_INET, SOCK_STREAM, 0);
+    if (_socket_fd < 0)
+	return errh->error("socket: %s", strerror(errno));
+    int sockopt = 1;
+    if (setsockopt(_socket_fd, SOL_SOCKET, SO_REUSEADDR, (void *)&sockopt, sizeof(sockopt)) < 0)
+	errh->warning("setsockopt: %s", strerror(errno));
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(_localhost ? INADDR_LOOPBACK : INADDR_ANY);
+    for (int tries = 0; ; ++tries) {
+	sa.sin_port = htons(_port);
+	if (bind(_socket_fd, (struct sockaddr *)&sa, sizeof(sa)) >= 0)
+	    break;
+	if (!_port_search || tries > 10 || _port >= 65534)
+	    return errh->error("bind: %s", strerror(errno));
+	++_port;
+    }
+    if (listen(_socket_fd, 8) < 0)
+	return errh->error("listen: %s", strerror(errno));
+    fcntl(_socket_fd, F_SETFL, O_NONBLOCK);
+    fcntl(_socket_fd, F_SETFD, FD_CLOEXEC);
+    add_select(_socket_fd, SELECT_READ);
+
+    // other elements may not be initialized yet; take the first snapshot
+    // once the router runs
+    _values.assign(_metrics.size(), String());
+    _timer.initialize(this);
+    if (_interval)
+	_timer.schedule_now();
+    return 0;
+}
+
+void
+MetricsExporter::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _conns.size(); ++i) {
+	close(_conns[i]->fd);
+	delete _conns[i];
+    }
+    _conns.clear();
+    if (_socket_fd >= 0) {
+	// shut down the listening socket in case we forked
+	shutdown(_socket_fd, SHUT_RDWR);
+	close(_socket_fd);
+	_socket_fd = -1;
+    }
+}
+
+void
+MetricsExporter::snapshot()
+{
+    // one pass over the handlers; formatting waits for a scrape
+    _values.resize(_metrics.size());
+    for (int i = 0; i < _metrics.size(); ++i)
+	_values[i] = Router::handler(router(), _metrics[i].hindex)->call_read(_metrics[i].e);
+    _rendered = String();
+}
+
+void
+MetricsExporter::run_timer(Timer *)
+{
+    snapshot();
+    _timer.reschedule_after(_interval);
+}
+
+static bool
+metric_value(const String &value, String &out)
+{
+    String v = cp_uncomment(value);
+    double d;
+    bool b;
+    if (DoubleArg().parse(v, d))
+	out = v;
+    else if (BoolArg().parse(v, b))
+	out = String(b ? "1" : "0");
+    else
+	return false;
+    return true;
+}
+
+const String &
+MetricsExporter::render()
+{
+    if (_rendered)
+	return _rendered;
+    StringAccum sa;
+    String value, family;
+    for (int i = 0; i < _metrics.size(); ++i) {
+	const metric &m = _metrics[i];
+	if (!metric_value(_values[i], value))
+	    continue;
+	if (m.name != family) {
+	    family = m.name;
+	    sa << "# TYPE " << _prefix << family << " unknown\n";
+	}
+	sa << _prefix << m.name << "{element=\"";
+	String ename = m.e->name();
+	for (const char *s = ename.begin(); s != ename.end(); ++s)
+	    if (*s == '\\' || *s == '\"')
+		sa << '\\' << *s;
+	    else
+		sa << *s;
+	sa << "\"} " << value << '\n';
+    }
+    sa << "# EOF\n";
+    _rendered = sa.take_string();
+    return _rendered;
+}
+
+void
+MetricsExporter::serve(connection *conn)
+{
+    // parse "METHOD PATH VERSION" from the request line
+    String in = conn->in.take_string();
+    int eol = in.find_left('\n');
+    Vector<String> words;
+    cp_spacevec(in.substring(0, eol), words);
+
+    String status, type = "text/plain; charset=utf-8", body;
+    if (words.size() < 2 || (words[0] != "GET" && words[0] != "HEAD"))
+	status = "405 Method Not Allowed";
+    else if (words[1] != "/metrics" && words[1] != "/") {
+	status = "404 Not Found";
+	body = "Not found\n";
+    } else {
+	if (!_interval)
+	    snapshot();
+	status = "200 OK";
+	type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+	body = render();
+	++_scrapes;
+    }
+
+    StringAccum sa;
+    sa << "HTTP/1.0 " << status << "\r\n"
+       << "Content-Type: " << type << "\r\n"
+       << "Content-Length: " << body.length() << "\r\n"
+       << "Connection: close\r\n\r\n";
+    if (words.size() < 1 || words[0] != "HEAD")
+	sa << body;
+    conn->out = sa.take_string();
+    conn->outpos = 0;
+}
+
+void
+MetricsExporter::close_connection(int i)
+{
+    remove_select(_conns[i]->fd, SELECT_READ | SELECT_WRITE);
+    close(_conns[i]->fd);
+    delete _conns[i];
+    _conns[i] = _conns.back();
+    _conns.pop_back();
+}
+
+void
+MetricsExporter::selected(int fd, int)
+{
+    if (fd == _socket_fd) {
+	int new_fd;
+	while ((new_fd = accept(_socket_fd, 0, 0)) >= 0) {
+	    fcntl(new_fd, F_SETFL, O_NONBLOCK);
+	    fcntl(new_fd, F_SETFD, FD_CLOEXEC);
+	    add_select(new_fd, SELECT_READ);
+	    _conns.push_back(new connection(new_fd));
+	}
+	if (errno != EAGAIN && errno != EWOULDBLOCK)
+	    click_chatter("%s: accept: %s", declaration().c_str(), strerror(errno));
+	return;
+    }
+
+    int i = 0;
+    while (i < _conns.size() && _conns[i]->fd != fd)
+	++i;
+    if (i == _conns.size())
+	return;
+    connection *conn = _conns[i];
+
+    if (conn->outpos < 0) {
+	// collect the request headers
+	char *buf = conn->in.reserve(2048);
+	ssize_t r = buf ? read(fd, buf, 2048) : -1;
+	if (r > 0)
+	    conn->in.adjust_length(r);
+	else if (r == 0 || (errno != EAGAIN && errno != EINTR)) {
+	    close_connection(i);
+	    return;
+	}
+	String in(conn->in.data(), conn->in.length());
+	if (in.find_left("\r\n\r\n") < 0 && in.find_left("\n\n") < 0) {
+	    if (in.length() > max_request)
+		close_connection(i);
+	    return;
+	}
+	serve(conn);
+	remove_select(fd, SELECT_READ);
+    }
+
+    while (conn->outpos < conn->out.length()) {
+	ssize_t w = write(fd, conn->out.data() + conn->outpos, conn->out.length() - conn->outpos);
+	if (w > 0)
+	    conn->outpos += w;
+	else if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+	    add_select(fd, SELECT_WRITE);
+	    return;
+	} else if (w < 0 && errno != EINTR)
+	    break;
+    }
+    close_connection(i);
+}
+
+String
+MetricsExporter::read_handler(Element *e, void *thunk)
+{
+    MetricsExporter *me = static_cast<MetricsExporter *>(e);
+    switch ((intptr_t) thunk) {
+    case 0:
+	if (!me->_interval)
+	    me->snapshot();
+	return me->render();
+    case 1:
+	return String(me->_port);
+    default:
+	return String(me->_scrapes);
+    }
+}
+
+void
+MetricsExporter::add_handlers()
+{
+    add_read_handler("metrics", read_handler, 0);
+    add_read_handler("port", read_handler, 1);
+    add_read_handler("scrapes", read_handler, 2);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(MetricsExporter)
@@ -0,0 +1,157 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_METRICSEXPORTER_HH
+#define CLICK_METRICSEXPORTER_HH
+#include <click/element.hh>
+#include <click/timer.hh>
+#include <click/timestamp.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+/*
+=c
+
+MetricsExporter(PORT [, I<keywords HANDLERS, INTERVAL, PREFIX, LOCALHOST>])
+
+=s control
+
+serves handler values as OpenMetrics text over HTTP
+
+=d
+
+Listens on TCP port PORT and answers HTTP GET requests for C</metrics> with
+the values of selected read handlers, in the OpenMetrics text format used by
+Prometheus and compatible monitoring systems. PORT may end in "+", as with
+ControlSocket: MetricsExporter then tries successive ports until one is free.
+The C<port> handler reports the port actually used.
+
+HANDLERS is a space-separated list of shell-style globs matched against
+"ELEMENT.HANDLER" names, such as "C<*.count>", which matches every element's
+count handler, or "C<in/q.drops>". Every read handler whose name matches at
+least one glob is exported, writable or not, except MetricsExporter's own
+handlers. The set is fixed at initialization.
+
+Every INTERVAL, MetricsExporter reads all exported handlers in one pass on
+its home thread and saves the results as a snapshot. A scrape renders the
+latest snapshot; it does not call handlers itself, so scrapes cost the
+router's threads nothing however often they arrive, and every value in one
+response was read at the same moment. The rendered text is cached until the
+next snapshot. If INTERVAL is 0, each scrape takes a fresh snapshot instead.
+
+Each handler becomes a sample of the metric named PREFIX followed by the
+handler name (with characters OpenMetrics does not allow replaced by
+underscores), labeled with the element name:
+
+   click_count{element="c0"} 1000
+
+Handler values that are not numbers are skipped. Metrics are declared with
+type "unknown".
+
+Keyword arguments are:
+
+=over 8
+
+=item HANDLERS
+
+String. Handler globs. Default is "C<*.count>".
+
+=item INTERVAL
+
+Time. The snapshot interval. Default is 1s.
+
+=item PREFIX
+
+String. Prefix for metric names. Default is "C<click_>".
+
+=item LOCALHOST
+
+Boolean. If true, accept connections only from the local host. Default is
+true.
+
+=back
+
+=h metrics read-only
+
+Returns the text a scrape would receive.
+
+=h port read-only
+
+Returns the TCP port MetricsExporter listens on.
+
+=h scrapes read-only
+
+Returns the number of scrapes served.
+
+=e
+
+  c0 :: Counter;  c1 :: Counter;
+  MetricsExporter(9100, HANDLERS "*.count *.byte_count");
+
+=a
+
+ControlSocket */
+
+class MetricsExporter : public Element { public:
+
+    MetricsExporter() CLICK_COLD;
+    ~MetricsExporter() CLICK_COLD;
+
+    const char *class_name() const	{ return "MetricsExporter"; }
+
+    int configure_phase() const		{ return CONFIGURE_PHASE_INFO; }
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage stage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void run_timer(Timer *t);
+    void selected(int fd, int mask);
+
+  private:
+
+    struct metric {
+	Element *e;
+	int hindex;			// handler pointers can move
+	String name;			// metric name, without PREFIX
+    };
+
+    struct connection {
+	int fd;
+	StringAccum in;
+	String out;
+	int outpos;
+	connection(int fd_)
+	    : fd(fd_), outpos(-1) {
+	}
+    };
+
+    Vector<String> _globs;
+    String _prefix;
+    Timestamp _interval;
+    bool _localhost;
+    uint16_t _port;
+    bool _port_search;
+
+    int _socket_fd;
+    Vector<connection *> _conns;
+
+    Vector<metric> _metrics;		// sorted by name
+    Vector<String> _values;		// latest snapshot
+    String _rendered;			// _values rendered, or empty
+    uint32_t _scrapes;
+
+    Timer _timer;
+
+    enum { max_request = 8192 };
+
+    void collect_metrics();
+    void snapshot();
+    const String &render();
+    void serve(connection *conn);
+    void close_connection(int i);
+
+    static String read_handler(Element *e, void *thunk) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -21,6 +21,8 @@
 #if HAVE_NET_NETMAP_H
 #define NETMAP_WITH_LIBS
 #include "netmapinfo.hh"
+#include <click/vector.hh>
+#include <click/atomic.hh>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <click/sync.hh>
@@ -29,44 +31,112 @@
 CLICK_DECLS
 
 /*
- * keep a list of netmap ports so matching the name we
- * can recycle the regions
+ * keep a list of netmap memory regions, so ports in the same region
+ * share one mapping and one queue of spare buffers
  */
+namespace {
+struct NetmapMemImpl : public NetmapInfo::Mem {
+    struct nm_desc anchor;	// parent for nm_open(); owns the mapping
+    uint16_t memid;
+    atomic_uint32_t refs;	// open ports plus zero-copy Packets
+};
+}
 static Spinlock netmap_memory_lock;
-//static struct NetmapInfo *netmap_ports;
+static Vector<NetmapMemImpl *> netmap_mems;
+
+static void
+netmap_mem_unref(NetmapInfo::Mem *m)
+{
+    NetmapMemImpl *mi = static_cast<NetmapMemImpl *>(m);
+    if (mi->refs.dec_and_test()) {
+	netmap_memory_lock.acquire();
+	for (int i = 0; i < netmap_mems.size(); ++i)
+	    if (netmap_mems[i] == mi) {
+		netmap_mems[i] = netmap_mems.back();
+		netmap_mems.pop_back();
+		break;
+	    }
+	netmap_memory_lock.release();
+	munmap(mi->base, mi->anchor.memsize);
+	delete mi;
+    }
+}
 
 int
-NetmapInfo::open(const String &ifname,
-		       bool always_error, ErrorHandler *errh)
+NetmapInfo::open(const String &ifname, int queue, unsigned extra,
+		 bool always_error, ErrorHandler *errh)
 {
-    click_chatter("%s ifname %s\n", __FUNCTION__, ifname.c_str());
     ErrorHandler *initial_errh = always_error ? errh : ErrorHandler::silent_handler();
+    String name = ifname;
+    if (queue >= 0)
+	name += "-" + String(queue);
+
+    struct nmreq req;
+    memset(&req, 0, sizeof(req));
+    req.nr_arg3 = extra;
 
     netmap_memory_lock.acquire();
-    // for the time being, just a new block
-    do {
-	desc = nm_open(ifname.c_str(), NULL, 0, NULL);
+    // Offer the first region's mapping; nm_open maps the region itself
+    // if the port uses another one, and then we retry with that region's.
+    NetmapMemImpl *m = netmap_mems.size() ? netmap_mems[0] : 0;
+    for (int tries = 0; tries < 2; ++tries) {
+	desc = nm_open(name.c_str(), &req, NM_OPEN_ARG3 | (m ? NM_OPEN_NO_MMAP : 0),
+		       m ? &m->anchor : NULL);
 	if (desc == NULL) {
-	    initial_errh->error("nm_open(%s): %s", ifname.c_str(), strerror(errno));
+	    initial_errh->error("nm_open(%s): %s", name.c_str(), strerror(errno));
+	    break;
+	}
+	if (m && desc->mem == m->base)
 	    break;
+	m = 0;
+	for (int i = 0; i < netmap_mems.size(); ++i)
+	    if (netmap_mems[i]->memid == desc->req.nr_arg2)
+		m = netmap_mems[i];
+	if (!m || tries == 1)
+	    break;
+	nm_close(desc);
+	desc = NULL;
+    }
+
+    if (desc && (!m || desc->mem != m->base)) {
+	// a new region: this port's mapping becomes the shared one
+	m = new NetmapMemImpl;
+	memcpy(&m->anchor, desc, sizeof(struct nm_desc));
+	m->anchor.self = &m->anchor;
+	m->base = desc->mem;
+	m->memid = desc->req.nr_arg2;
+	m->refs = 0;
+	m->bufq.init(const_cast<void *>(desc->buf_start),
+		     const_cast<void *>(desc->buf_end),
+		     desc->some_ring->nr_buf_size);
+	netmap_mems.push_back(m);
+    }
+
+    if (desc) {
+	// the region, not the port, unmaps the memory
+	desc->done_mmap = 0;
+	mem = m;
+	++m->refs;
+	m->lock.acquire();
+	// collect the extra buffers, linked through their first word
+	extra_bufs = 0;
+	const struct netmap_ring *ring = desc->some_ring;
+	for (uint32_t idx = desc->nifp->ni_bufs_head; idx; ++extra_bufs) {
+	    uint32_t next = *reinterpret_cast<uint32_t *>(NETMAP_BUF(ring, idx));
+	    m->bufq.insert(idx);
+	    idx = next;
 	}
-	click_chatter("%s %s memsize %d mem %p buf_start %p buf_end %p",
-		__FUNCTION__, desc->req.nr_name,
-		desc->memsize, desc->mem, desc->buf_start, desc->buf_end);
-	bufq.init(desc->buf_start, desc->buf_end,
-		desc->some_ring->nr_buf_size);
-	/* eventually try to match the region */
-	destructor_arg = this;
-	click_chatter("private mapping for %s\n", ifname.c_str());
-    } while (0);
+	desc->nifp->ni_bufs_head = 0;
+	m->lock.release();
+    }
     netmap_memory_lock.release();
-    return desc ? desc->fd : -1;
+    fd = desc ? desc->fd : -1;
+    return fd;
 }
 
 void
 NetmapInfo::initialize_rings_rx(int timestamp)
 {
-    click_chatter("%s timestamp %d\n", __FUNCTION__, timestamp);
     if (timestamp >= 0) {
 	int flags = (timestamp > 0 ? NR_TIMESTAMP : 0);
 	for (unsigned i = desc->first_rx_ring; i <= desc->last_rx_ring; ++i)
@@ -77,7 +147,6 @@ NetmapInfo::initialize_rings_rx(int timestamp)
 void
 NetmapInfo::initialize_rings_tx()
 {
-    click_chatter("%s\n", __FUNCTION__);
 }
 
 int
@@ -86,61 +155,128 @@ NetmapInfo::dispatch(int count, nm_cb_t cb, u_char *arg)
 	return nm_dispatch(desc, count, cb, arg);
 }
 
-bool
-NetmapInfo::send_packet(Packet *p, int noutputs)
+WritablePacket *
+NetmapInfo::rx_packet(unsigned headroom, bool zerocopy, bool timestamp)
 {
-	int ret = nm_inject(desc, p->data(), p->length());
-	if (0) click_chatter("%s buf %p size %d returns %d\n",
-		__FUNCTION__, p->data(), p->length(), ret);
-	return ret > 0 ? 0 : -1;
-#if 0
-    // we can do a smart nm_inject
-    for (unsigned ri = desc->first_tx_ring; ri <= desc->last_tx_ring; ++ri) {
-        struct netmap_ring *ring = NETMAP_TXRING(desc->nifp, ri);
-        if (nm_ring_empty(ring))
-            continue;
-        unsigned cur = ring->cur;
-        unsigned buf_idx = ring->slot[cur].buf_idx;
-        if (buf_idx < 2)
-            continue;
-        unsigned char *buf = (unsigned char *) NETMAP_BUF(ring, buf_idx);
-        uint32_t p_length = p->length();
-        if (NetmapInfo::is_netmap_buffer(p)
-            && !p->shared()
-	    && p->buffer() == p->data()
-            && (char *)p->buffer() >= desc->buf_start
-	    && (char *)p->buffer() < desc->buf_end
-            && noutputs == 0) {
-            // put the original buffer in the freelist
-            NetmapInfo::buffer_destructor(buf, 0, (void *)this);
-            // now enqueue
-            ring->slot[cur].buf_idx = NETMAP_BUF_IDX(ring, (char *) p->buffer());
-            ring->slot[cur].flags |= NS_BUF_CHANGED;
-            // and make sure nobody uses this packet
-            p->reset_buffer();
-        } else
-            memcpy(buf, p->data(), p_length);
-        ring->slot[cur].len = p_length;
-        __asm__ volatile("" : : : "memory");
-        ring->head = ring->cur = nm_ring_next(ring, cur);
-        return 0;
+    for (int n = desc->last_rx_ring - desc->first_rx_ring + 1; n > 0; --n) {
+	struct netmap_ring *ring = NETMAP_RXRING(desc->nifp, desc->cur_rx_ring);
+	if (nm_ring_empty(ring)) {
+	    if (++desc->cur_rx_ring > desc->last_rx_ring)
+		desc->cur_rx_ring = desc->first_rx_ring;
+	    continue;
+	}
+
+	unsigned cur = ring->cur;
+	struct netmap_slot *slot = &ring->slot[cur];
+	unsigned char *buf = reinterpret_cast<unsigned char *>(NETMAP_BUF(ring, slot->buf_idx));
+	unsigned spare = 0;
+	if (zerocopy) {
+	    mem->lock.acquire();
+	    spare = mem->bufq.extract();
+	    mem->lock.release();
+	}
+
+	WritablePacket *p;
+	if (spare && (p = Packet::make(buf, ring->nr_buf_size, buffer_destructor, mem))) {
+	    // give the ring a spare buffer in exchange for this one
+	    ++static_cast<NetmapMemImpl *>(mem)->refs;
+	    p->take(ring->nr_buf_size - slot->len);
+	    slot->buf_idx = spare;
+	    slot->flags |= NS_BUF_CHANGED;
+	} else {
+	    if (spare) {
+		mem->lock.acquire();
+		mem->bufq.insert(spare);
+		mem->lock.release();
+	    }
+	    p = Packet::make(headroom, buf, slot->len, 0);
+	}
+	ring->head = ring->cur = nm_ring_next(ring, cur);
+	if (p && timestamp)
+	    p->timestamp_anno() = Timestamp(ring->ts);
+	return p;
     }
-    errno = ENOBUFS;
-    return -1;
-#endif
+    return 0;
 }
+
+int
+NetmapInfo::tx_packet(Packet *p, bool zerocopy)
+{
+    for (int n = desc->last_tx_ring - desc->first_tx_ring + 1; n > 0; --n) {
+	struct netmap_ring *ring = NETMAP_TXRING(desc->nifp, desc->cur_tx_ring);
+	if (nm_ring_empty(ring)) {
+	    if (++desc->cur_tx_ring > desc->last_tx_ring)
+		desc->cur_tx_ring = desc->first_tx_ring;
+	    continue;
+	}
+	if (p->length() > ring->nr_buf_size)
+	    return -EMSGSIZE;
+
+	unsigned cur = ring->cur;
+	struct netmap_slot *slot = &ring->slot[cur];
+	if (zerocopy && is_netmap_buffer(p) && !p->shared()
+	    && p->data() == p->buffer() && mem->bufq.contains_p(p->buffer())) {
+	    // put the slot's buffer in the spare queue, then send p's
+	    unsigned char *old = reinterpret_cast<unsigned char *>(NETMAP_BUF(ring, slot->buf_idx));
+	    slot->buf_idx = NETMAP_BUF_IDX(ring, reinterpret_cast<const char *>(p->buffer()));
+	    slot->flags |= NS_BUF_CHANGED;
+	    slot->len = p->length();
+	    buffer_destructor(old, 0, mem);
+	    p->reset_buffer();
+	} else {
+	    memcpy(NETMAP_BUF(ring, slot->buf_idx), p->data(), p->length());
+	    slot->len = p->length();
+	}
+	ring->head = ring->cur = nm_ring_next(ring, cur);
+	return 0;
+    }
+    return -EAGAIN;
+}
+
+int
+NetmapInfo::flush()
+{
+    if (ioctl(desc->fd, NIOCTXSYNC, NULL) < 0)
+	return -errno;
+    return 0;
+}
+
 void
-NetmapInfo::close(int fd)
+NetmapInfo::buffer_destructor(unsigned char *buf, size_t, void *arg)
+{
+    Mem *m = reinterpret_cast<Mem *>(arg);
+    m->lock.acquire();
+    m->bufq.insert_p(buf);
+    m->lock.release();
+    netmap_mem_unref(m);
+}
+
+void
+NetmapInfo::close(int)
 {
-    click_chatter("fd %d interface %s\n",
-	fd, desc->req.nr_name);
     netmap_memory_lock.acquire();
-    // unlink from the list ?
+    // return as many spare buffers as we were given
+    mem->lock.acquire();
+    const struct netmap_ring *ring = desc->some_ring;
+    uint32_t head = 0;
+    for (unsigned i = 0; i < extra_bufs; ++i) {
+	uint32_t idx = mem->bufq.extract();
+	if (!idx)
+	    break;
+	*reinterpret_cast<uint32_t *>(NETMAP_BUF(ring, idx)) = head;
+	head = idx;
+    }
+    desc->nifp->ni_bufs_head = head;
+    mem->lock.release();
     nm_close(desc);
     desc = 0;
+    fd = -1;
     netmap_memory_lock.release();
+    netmap_mem_unref(mem);
+    mem = 0;
 }
 
 CLICK_ENDDECLS
 #endif
+ELEMENT_REQUIRES(userlevel)
 ELEMENT_PROVIDES(NetmapInfo)
@@ -14,9 +14,10 @@ typedef void (*nm_cb_t)(u_char *, const struct nm_pkthdr *, const u_char *d);
 
 #include <click/packet.hh>
 #include <click/error.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 
-/* a queue of netmap buffers, by index */ 
+/* a queue of netmap buffers, by index */
 class NetmapBufQ {
     unsigned char *buf_start;	/* base address */
     unsigned int buf_size;
@@ -62,9 +63,13 @@ class NetmapBufQ {
 	unsigned int idx = extract();
 	return (idx == 0) ? 0 : buf_start + idx * buf_size;
     }
+    inline unsigned int size() const {
+	return count;
+    }
+    inline bool contains_p(const unsigned char *p) const {
+	return p >= buf_start && p < buf_end;
+    }
     inline int init (void *beg, void *end, uint32_t _size) {
-	click_chatter("Initializing NetmapBufQ %p size %d mem %p %p\n",
-		this, _size, beg, end);
 	head = tail = max_index = 0;
 	count = 0;
 	buf_size = 0;
@@ -84,63 +89,77 @@ class NetmapBufQ {
     }
 };
 
-/* a netmap port as returned by nm_open */
+/* a netmap port as returned by nm_open, bound to all of a device's rings
+ * or to one of them.
+ *
+ * Ports that share a netmap memory region also share one mapping of it,
+ * and one queue of spare buffers filled with the extra buffers each port
+ * asks for.  With spare buffers, rx_packet() can swap a received buffer
+ * out of its ring instead of copying it, and tx_packet() can swap a packet
+ * that lives in the region into a transmit ring; forwarding between two
+ * ports of the same region then never copies packet data.
+ *
+ * NetmapInfo is a handle: copies refer to the same port, and only one of
+ * them should close() it. */
 class NetmapInfo { public:
 
-	struct nm_desc *desc;
-	class NetmapInfo *parent;	/* same pool */
-	class NetmapBufQ bufq;		/* free buffer queue */
+	struct Mem {
+	    void *base;			/* mapping, shared by ports */
+	    NetmapBufQ bufq;		/* spare buffers */
+	    Spinlock lock;
+	};
 
-	// to recycle buffers,
-	// nmr.arg3 is the number of extra buffers
-	// nifp->ni_bufs_head is the index of the first buffer.
-	unsigned int active_users; // we do not close until done.
+	struct nm_desc *desc;
+	int fd;
+	Mem *mem;
+	unsigned extra_bufs;	/* spare buffers this port contributed */
 
-	NetmapInfo *destructor_arg;	// either this or parent's main_mem
+	NetmapInfo()
+	    : desc(0), fd(-1), mem(0), extra_bufs(0) {
+	}
 
-	int open(const String &ifname,
+	// Open @a ifname, or only its ring @a queue if @a queue >= 0, and
+	// ask for @a extra_bufs spare buffers.
+	int open(const String &ifname, int queue, unsigned extra_bufs,
 		 bool always_error, ErrorHandler *errh);
 	void initialize_rings_rx(int timestamp);
 	void initialize_rings_tx();
 	void close(int fd);
+
+	// Return the next received packet, or null if every ring is empty.
+	// If @a zerocopy and a spare buffer is available, the packet points
+	// into the region and has no headroom; otherwise the data is copied
+	// after @a headroom bytes.
+	WritablePacket *rx_packet(unsigned headroom, bool zerocopy,
+				  bool timestamp);
+
+	// Queue @a p for transmission.  If @a zerocopy, swap @a p's buffer
+	// into the ring when it lives in this port's region; @a p is then
+	// left without data.  Returns 0 or -EAGAIN if every ring is full.
+	int tx_packet(Packet *p, bool zerocopy);
+	int flush();
+
 	// send a packet, possibly using zerocopy if noutputs == 0
 	// and other conditions apply
-        bool send_packet(Packet *p, int noutputs);
+	int send_packet(Packet *p, int noutputs) {
+	    return tx_packet(p, noutputs == 0);
+	}
 
 	int dispatch(int burst, nm_cb_t cb, u_char *arg);
 
-#if 0
-	// XXX return a buffer to the ring
-	bool refill(struct netmap_ring *ring) {
-	    if (buffers) {
-		unsigned char *buf = buffers;
-		buffers = *reinterpret_cast<unsigned char **>(buffers);
-		unsigned res1idx = ring->head;
-		ring->slot[res1idx].buf_idx = NETMAP_BUF_IDX(ring, (char *) buf);
-		ring->slot[res1idx].flags |= NS_BUF_CHANGED;
-		ring->head = nm_ring_next(ring, res1idx);
-		return true;
-	    } else
-		return false;
+	unsigned spare_buffers() const {
+	    return mem ? mem->bufq.size() : 0;
 	}
-#endif
 
     static bool is_netmap_buffer(Packet *p) {
 	return p->buffer_destructor() == buffer_destructor;
     }
 
     /*
-     * the destructor appends the buffer to the freelist in the ring,
+     * the destructor appends the buffer to the freelist in the region,
      * using the first field as pointer.
      */
-    static void buffer_destructor(unsigned char *buf, size_t, void *arg) {
-	NetmapInfo *x = reinterpret_cast<NetmapInfo *>(arg);
-	click_chatter("%s ni %p buf %p\n", __FUNCTION__,
-		x, buf);
-	if (x->bufq.insert_p(buf)) {
-		// XXX error
-	}
-    }
+    static void buffer_destructor(unsigned char *buf, size_t, void *arg);
 };
 
 CLICK_ENDDECLS
@@ -0,0 +1,380 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * packetring.{cc,hh} -- library for Linux PACKET_MMAP rings
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#if defined(__linux__)
+#include "packetring.hh"
+#include <click/error.hh>
+#include <click/machine.hh>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/if_packet.h>
+CLICK_DECLS
+
+#if defined(TPACKET3_HDRLEN) && defined(PACKET_FANOUT)
+
+PacketRing::PacketRing(int fd, bool tx)
+    : _fd(fd), _tx(tx), _map(0), _map_size(0), _cur(0), _pkt(0),
+      _pkts_left(0), _rx_stalled(false), _block_refs(0), _drops(0),
+      _freezes(0), _rx_stalls(0), _tx_rejects(0)
+{
+    _refs = 1;
+}
+
+PacketRing::~PacketRing()
+{
+    if (_map)
+	munmap(_map, _map_size);
+    delete[] _block_refs;
+}
+
+int
+PacketRing::map(ErrorHandler *errh)
+{
+    _map_size = (size_t) _block_size * _nblocks;
+    void *m = mmap(0, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED | MAP_POPULATE, _fd, 0);
+    if (m == MAP_FAILED)
+	// MAP_LOCKED may fail under RLIMIT_MEMLOCK; try without
+	m = mmap(0, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (m == MAP_FAILED) {
+	_map = 0;
+	return errh->error("mmap: %s", strerror(errno));
+    }
+    _map = reinterpret_cast<unsigned char *>(m);
+    return 0;
+}
+
+PacketRing *
+PacketRing::open_rx(int fd, unsigned block_size, unsigned nblocks,
+		    ErrorHandler *errh)
+{
+    unsigned pagesize = getpagesize();
+    if (block_size < pagesize || (block_size & (block_size - 1))) {
+	errh->error("ring block size must be a power of 2 of at least %u", pagesize);
+	return 0;
+    }
+
+    int version = TPACKET_V3;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+	errh->error("PACKET_VERSION: %s", strerror(errno));
+	return 0;
+    }
+
+    // frame size and count only need to be consistent for TPACKET_V3
+    tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = block_size;
+    req.tp_block_nr = nblocks;
+    req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+    req.tp_frame_nr = (block_size / req.tp_frame_size) * nblocks;
+    req.tp_retire_blk_tov = 1;	// ms before a partly filled block is returned
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+	errh->error("PACKET_RX_RING: %s", strerror(errno));
+	return 0;
+    }
+
+    PacketRing *r = new PacketRing(fd, false);
+    r->_block_size = block_size;
+    r->_nblocks = nblocks;
+    r->_frame_size = req.tp_frame_size;
+    r->_nframes = req.tp_frame_nr;
+    r->_block_refs = new atomic_uint32_t[nblocks];
+    for (unsigned i = 0; i < nblocks; ++i)
+	r->_block_refs[i] = 0;
+    if (r->map(errh) < 0) {
+	delete r;
+	return 0;
+    }
+    return r;
+}
+
+PacketRing *
+PacketRing::open_tx(int fd, unsigned frame_size, unsigned nframes,
+		    ErrorHandler *errh)
+{
+    unsigned pagesize = getpagesize();
+    if (frame_size < TPACKET2_HDRLEN + 64 || (frame_size & (frame_size - 1))) {
+	errh->error("ring frame size must be a power of 2 of at least %u", (unsigned) (TPACKET2_HDRLEN + 64));
+	return 0;
+    }
+
+    int version = TPACKET_V2;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+	errh->error("PACKET_VERSION: %s", strerror(errno));
+	return 0;
+    }
+
+    tpacket_req req;
+    req.tp_frame_size = frame_size;
+    req.tp_block_size = (frame_size > pagesize ? frame_size : pagesize);
+    unsigned per_block = req.tp_block_size / frame_size;
+    req.tp_block_nr = (nframes + per_block - 1) / per_block;
+    req.tp_frame_nr = req.tp_block_nr * per_block;
+    if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+	errh->error("PACKET_TX_RING: %s", strerror(errno));
+	return 0;
+    }
+
+    PacketRing *r = new PacketRing(fd, true);
+    r->_block_size = req.tp_block_size;
+    r->_nblocks = req.tp_block_nr;
+    r->_frame_size = frame_size;
+    r->_nframes = req.tp_frame_nr;
+    if (r->map(errh) < 0) {
+	delete r;
+	return 0;
+    }
+    return r;
+}
+
+int
+PacketRing::set_fanout(int fd, int group, const String &mode, ErrorHandler *errh)
+{
+    int type;
+    if (mode == "HASH")
+	type = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+    else if (mode == "LB")
+	type = PACKET_FANOUT_LB;
+    else if (mode == "CPU")
+	type = PACKET_FANOUT_CPU;
+#ifdef PACKET_FANOUT_ROLLOVER
+    else if (mode == "ROLLOVER")
+	type = PACKET_FANOUT_ROLLOVER;
+#endif
+#ifdef PACKET_FANOUT_QM
+    else if (mode == "QUEUE")
+	type = PACKET_FANOUT_QM;
+#endif
+    else
+	return errh->error("bad FANOUT_MODE");
+    int arg = (group & 0xFFFF) | (type << 16);
+    if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0)
+	return errh->error("PACKET_FANOUT: %s", strerror(errno));
+    return 0;
+}
+
+void
+PacketRing::close()
+{
+    // The mapping outlives the socket until all packets are gone.
+    if (!_tx && _pkts_left) {
+	_pkts_left = 0;
+	if (_block_refs[_cur].dec_and_test())
+	    release_block(_cur);
+    }
+    unref();
+}
+
+inline void
+PacketRing::unref()
+{
+    if (_refs.dec_and_test())
+	delete this;
+}
+
+void
+PacketRing::release_block(unsigned block)
+{
+    tpacket_block_desc *bd = reinterpret_cast<tpacket_block_desc *>(_map + (size_t) block * _block_size);
+    click_fence();
+    bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    unref();
+}
+
+void
+PacketRing::buffer_destructor(unsigned char *buf, size_t, void *arg)
+{
+    PacketRing *r = reinterpret_cast<PacketRing *>(arg);
+    unsigned block = (buf - r->_map) / r->_block_size;
+    if (r->_block_refs[block].dec_and_test())
+	r->release_block(block);
+}
+
+WritablePacket *
+PacketRing::rx_packet(int &pkttype, uint16_t &protocol, int &extra_len,
+		      bool timestamp)
+{
+    if (!_pkts_left) {
+	// Packets from this block's last pass are still alive, so the
+	// kernel has not refilled it; reading it again would deliver stale
+	// frames.  The kernel fills blocks in order, so wait.
+	if (_block_refs[_cur] != 0) {
+	    if (!_rx_stalled) {
+		_rx_stalled = true;
+		++_rx_stalls;
+	    }
+	    return 0;
+	}
+	_rx_stalled = false;
+	tpacket_block_desc *bd = reinterpret_cast<tpacket_block_desc *>(_map + (size_t) _cur * _block_size);
+	if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+	    return 0;
+	click_fence();
+	if (bd->hdr.bh1.num_pkts == 0) {
+	    bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+	    _cur = (_cur + 1 == _nblocks ? 0 : _cur + 1);
+	    return 0;
+	}
+	// hold the block while reading it
+	++_refs;
+	_block_refs[_cur] = 1;
+	_pkts_left = bd->hdr.bh1.num_pkts;
+	_pkt = reinterpret_cast<unsigned char *>(bd) + bd->hdr.bh1.offset_to_first_pkt;
+    }
+
+    tpacket3_hdr *h = reinterpret_cast<tpacket3_hdr *>(_pkt);
+    const sockaddr_ll *sll = reinterpret_cast<const sockaddr_ll *>(_pkt + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+    pkttype = sll->sll_pkttype;
+    protocol = sll->sll_protocol;
+
+    unsigned block = _cur;
+    ++_block_refs[block];
+    WritablePacket *p = Packet::make(_pkt + h->tp_mac, h->tp_snaplen, buffer_destructor, this);
+    if (p) {
+	if (timestamp)
+	    p->timestamp_anno().assign(h->tp_sec, h->tp_nsec / (1000000000 / Timestamp::subsec_per_sec));
+	extra_len = h->tp_len - h->tp_snaplen;
+    } else
+	--_block_refs[block];
+
+    // advance, dropping our hold on the block at its end
+    if (--_pkts_left)
+	_pkt += h->tp_next_offset;
+    else {
+	_cur = (_cur + 1 == _nblocks ? 0 : _cur + 1);
+	if (_block_refs[block].dec_and_test())
+	    release_block(block);
+    }
+    return p;
+}
+
+int
+PacketRing::tx_packet(const Packet *p)
+{
+    unsigned char *frame = _map + (size_t) (_cur / (_block_size / _frame_size)) * _block_size
+	+ (size_t) (_cur % (_block_size / _frame_size)) * _frame_size;
+    tpacket2_hdr *h = reinterpret_cast<tpacket2_hdr *>(frame);
+    if (h->tp_status == TP_STATUS_WRONG_FORMAT) {
+	++_tx_rejects;
+	h->tp_status = TP_STATUS_AVAILABLE;
+    } else if (h->tp_status != TP_STATUS_AVAILABLE)
+	return -EAGAIN;
+
+    unsigned off = TPACKET2_HDRLEN - sizeof(sockaddr_ll);
+    if (p->length() > _frame_size - off)
+	return -EMSGSIZE;
+    memcpy(frame + off, p->data(), p->length());
+    h->tp_len = p->length();
+    click_fence();
+    h->tp_status = TP_STATUS_SEND_REQUEST;
+    _cur = (_cur + 1 == _nframes ? 0 : _cur + 1);
+    return 0;
+}
+
+int
+PacketRing::flush()
+{
+    if (send(_fd, 0, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS)
+	return -errno;
+    return 0;
+}
+
+void
+PacketRing::update_stats()
+{
+    if (_tx) {
+	tpacket_stats st;
+	socklen_t len = sizeof(st);
+	if (getsockopt(_fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0)
+	    _drops += st.tp_drops;
+    } else {
+	tpacket_stats_v3 st;
+	socklen_t len = sizeof(st);
+	if (getsockopt(_fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) {
+	    _drops += st.tp_drops;
+	    _freezes += st.tp_freeze_q_cnt;
+	}
+    }
+}
+
+#else /* !TPACKET3_HDRLEN */
+
+// Rings cannot be opened, so the remaining methods are never called.
+
+PacketRing::~PacketRing()
+{
+}
+
+void
+PacketRing::close()
+{
+}
+
+WritablePacket *
+PacketRing::rx_packet(int &, uint16_t &, int &, bool)
+{
+    return 0;
+}
+
+int
+PacketRing::tx_packet(const Packet *)
+{
+    return -EAGAIN;
+}
+
+int
+PacketRing::flush()
+{
+    return 0;
+}
+
+void
+PacketRing::update_stats()
+{
+}
+
+void
+PacketRing::buffer_destructor(unsigned char *, size_t, void *)
+{
+}
+
+PacketRing *
+PacketRing::open_rx(int, unsigned, unsigned, ErrorHandler *errh)
+{
+    errh->error("TPACKET_V3 rings not supported on this system");
+    return 0;
+}
+
+PacketRing *
+PacketRing::open_tx(int, unsigned, unsigned, ErrorHandler *errh)
+{
+    errh->error("TPACKET_V2 rings not supported on this system");
+    return 0;
+}
+
+int
+PacketRing::set_fanout(int, int, const String &, ErrorHandler *errh)
+{
+    return errh->error("PACKET_FANOUT not supported on this system");
+}
+
+#endif
+
+CLICK_ENDDECLS
+#endif
+ELEMENT_REQUIRES(userlevel)
+ELEMENT_PROVIDES(PacketRing)
@@ -0,0 +1,93 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_PACKETRING_HH
+#define CLICK_PACKETRING_HH 1
+#if defined(__linux__)
+#include <click/packet.hh>
+#include <click/atomic.hh>
+CLICK_DECLS
+class ErrorHandler;
+
+/* A memory-mapped PACKET_MMAP ring on a Linux packet socket.
+ *
+ * Receive rings use TPACKET_V3: the kernel fills whole blocks of frames, and
+ * rx_packet() wraps each frame in a Packet without copying.  A block goes
+ * back to the kernel once every Packet pointing into it has been killed, so
+ * holding received packets for a long time stalls the ring.
+ *
+ * Transmit rings use TPACKET_V2: tx_packet() copies a packet into the next
+ * free frame, and flush() asks the kernel to send all queued frames.
+ *
+ * A socket can have one ring version only, so RX and TX rings need separate
+ * sockets.  The caller owns the socket, and should call close() before
+ * closing it; the mapping stays alive until the last Packet is killed. */
+class PacketRing { public:
+
+    static PacketRing *open_rx(int fd, unsigned block_size, unsigned nblocks,
+			       ErrorHandler *errh);
+    static PacketRing *open_tx(int fd, unsigned frame_size, unsigned nframes,
+			       ErrorHandler *errh);
+    void close();
+
+    static int set_fanout(int fd, int group, const String &mode,
+			  ErrorHandler *errh);
+
+    // Return the next received packet, or null if the ring is empty.  Sets
+    // @a pkttype and @a protocol (network byte order) from the frame's link
+    // address, and @a extra_len to the length not captured; sets the
+    // timestamp annotation if @a timestamp.
+    WritablePacket *rx_packet(int &pkttype, uint16_t &protocol, int &extra_len,
+			      bool timestamp);
+
+    // Queue @a p for transmission.  Returns 0, -EAGAIN if the ring is full,
+    // or -EMSGSIZE if @a p does not fit in a frame.
+    int tx_packet(const Packet *p);
+    int flush();
+
+    // Read and accumulate the kernel's ring statistics.
+    void update_stats();
+    uint64_t drops() const		{ return _drops; }
+    uint64_t freezes() const		{ return _freezes; }
+    uint64_t rx_stalls() const		{ return _rx_stalls; }
+    uint64_t tx_rejects() const		{ return _tx_rejects; }
+
+    static bool is_ring_buffer(Packet *p) {
+	return p->buffer_destructor() == buffer_destructor;
+    }
+
+  private:
+
+    int _fd;
+    bool _tx;
+    unsigned char *_map;
+    size_t _map_size;
+    unsigned _block_size;
+    unsigned _nblocks;
+    unsigned _frame_size;
+    unsigned _nframes;
+
+    // receive state
+    unsigned _cur;			// current block or frame
+    unsigned char *_pkt;		// next frame in current block
+    unsigned _pkts_left;
+    bool _rx_stalled;			// next block is still held by packets
+    atomic_uint32_t *_block_refs;	// Packets in each user-owned block,
+					// plus one while it is being read
+    atomic_uint32_t _refs;		// user-owned blocks, plus one until close
+
+    uint64_t _drops;
+    uint64_t _freezes;
+    uint64_t _rx_stalls;		// times reception waited on a held block
+    uint64_t _tx_rejects;		// frames the kernel found malformed
+
+    PacketRing(int fd, bool tx);
+    ~PacketRing();
+    int map(ErrorHandler *errh);
+    void release_block(unsigned block);
+    void unref();
+    static void buffer_destructor(unsigned char *buf, size_t, void *arg);
+
+};
+
+CLICK_ENDDECLS
+#endif
+#endif
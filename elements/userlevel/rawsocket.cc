@@ -48,7 +48,7 @@ CLICK_DECLS
 RawSocket::RawSocket()
   : _task(this), _timer(this),
     _fd(-1), _port_register_socket(-1), _port(0), _snaplen(2048),
-    _headroom(Packet::default_headroom), _rq(0), _wq(0)
+    _headroom(Packet::default_headroom), _rq(0), _wq(0), _burst(1)
 {
 }
 
@@ -69,8 +69,11 @@ RawSocket::configure(Vector<String> &conf, ErrorHandler *errh)
     args.read_p("PORT", _port);
   if (args.read("SNAPLEN", _snaplen)
       .read("HEADROOM", _headroom)
+      .read("BURST", _burst)
       .complete() < 0)
     return -1;
+  if (_burst <= 0)
+    return errh->error("BURST out of range");
 
   return 0;
 }
@@ -141,6 +144,23 @@ RawSocket::initialize(ErrorHandler *errh)
   if (setsockopt(_fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one)) < 0)
     return initialize_socket_error(errh, "SO_BROADCAST");
 
+  if (_burst > 1) {
+    // with recvmmsg, timestamps come as control messages
+    unsigned controllen = 0;
+#if defined(SO_TIMESTAMPNS)
+    one = 1;
+    if (setsockopt(_fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) == 0)
+      controllen = CMSG_SPACE(sizeof(struct timespec));
+#elif defined(SO_TIMESTAMP)
+    one = 1;
+    if (setsockopt(_fd, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one)) == 0)
+      controllen = CMSG_SPACE(sizeof(struct timeval));
+#endif
+    if (_rbatch.initialize(_burst, _headroom, _snaplen, false, controllen) < 0
+	|| _wbatch.initialize(_burst) < 0)
+      return errh->error("out of memory");
+  }
+
   if (noutputs())
     add_select(_fd, SELECT_READ);
 
@@ -160,6 +180,8 @@ RawSocket::cleanup(CleanupStage)
     _rq->kill();
   if (_wq)
     _wq->kill();
+  _rbatch.cleanup();
+  _wbatch.cleanup();
   if (_fd >= 0) {
     close(_fd);
     remove_select(_fd, SELECT_READ | SELECT_WRITE);
@@ -167,12 +189,80 @@ RawSocket::cleanup(CleanupStage)
   }
 }
 
+void
+RawSocket::selected_batch()
+{
+  ErrorHandler *errh = ErrorHandler::default_handler();
+
+  if (noutputs()) {
+    int n = _rbatch.recv(_fd, MSG_TRUNC);
+    if (n < 0 && errno != EAGAIN && errno != EINTR)
+      errh->error("recvmmsg: %s", strerror(errno));
+    for (int i = 0; i < n; ++i) {
+      WritablePacket *p = _rbatch.take(i, _snaplen);
+      if (!_rbatch.timestamp(i, p->timestamp_anno()))
+	p->timestamp_anno().assign_now();
+      if (fake_pcap_force_ip(p, FAKE_DLT_RAW))
+	output(0).push(p);
+      else
+	p->kill();
+    }
+  }
+
+  if (ninputs()) {
+    while (Packet *p = (_wbatch.full() ? 0 : input(0).pull())) {
+      // cast to int so very large plen is interpreted as negative
+      if ((int)p->length() < (int)sizeof(click_ip)) {
+	errh->error("runt IP packet (%d bytes)", p->length());
+	p->kill();
+	continue;
+      }
+      struct sockaddr_in sin;
+      memset(&sin, 0, sizeof(sin));
+      sin.sin_family = PF_INET;
+      sin.sin_addr = reinterpret_cast<const click_ip *>(p->data())->ip_dst;
+      _wbatch.push_back(p, (const struct sockaddr *)&sin, sizeof(sin));
+    }
+
+    while (!_wbatch.empty()) {
+      int r = _wbatch.send(_fd);
+      if (r > 0) {
+	while (r-- > 0)
+	  _wbatch.pop_front()->kill();
+	_backoff = 0;
+      } else if (r == -ENOBUFS || r == -EAGAIN) {
+	// socket queue full, try again later
+	remove_select(_fd, SELECT_WRITE);
+	_events &= ~SELECT_WRITE;
+	_backoff = (!_backoff) ? 1 : _backoff*2;
+	_timer.schedule_after(Timestamp::make_usec(_backoff));
+	return;
+      } else if (r != -EINTR) {
+	// unexpected error: drop packet
+	errh->error("sendmmsg: %s", strerror(-r));
+	_wbatch.pop_front()->kill();
+      }
+    }
+
+    // nothing to write, wait for upstream signal
+    if (!_signal && (_events & SELECT_WRITE)) {
+      remove_select(_fd, SELECT_WRITE);
+      _events &= ~SELECT_WRITE;
+    }
+  }
+}
+
 void
 RawSocket::selected(int fd, int)
 {
   ErrorHandler *errh = ErrorHandler::default_handler();
   int len;
 
+  if (_burst > 1) {
+    selected_batch();
+    return;
+  }
+
   if (noutputs()) {
     // read data from socket
     if (!_rq)
@@ -266,7 +356,7 @@ RawSocket::selected(int fd, int)
 void
 RawSocket::run_timer(Timer *)
 {
-  if ((_wq || _signal) && !(_events & SELECT_WRITE) && _fd >= 0) {
+  if ((_wq || !_wbatch.empty() || _signal) && !(_events & SELECT_WRITE) && _fd >= 0) {
     add_select(_fd, SELECT_WRITE);
     _events |= SELECT_WRITE;
     selected(_fd, 0);
@@ -276,7 +366,7 @@ RawSocket::run_timer(Timer *)
 bool
 RawSocket::run_task(Task *)
 {
-  if (!_wq && !(_events & SELECT_WRITE) && _fd >= 0) {
+  if (!_wq && _wbatch.empty() && !(_events & SELECT_WRITE) && _fd >= 0) {
     add_select(_fd, SELECT_WRITE);
     _events |= SELECT_WRITE;
     selected(_fd, 0);
@@ -292,5 +382,5 @@ RawSocket::add_handlers()
 }
 
 CLICK_ENDDECLS
-ELEMENT_REQUIRES(userlevel linux)
+ELEMENT_REQUIRES(userlevel linux SocketBatch)
 EXPORT_ELEMENT(RawSocket)
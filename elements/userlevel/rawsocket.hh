@@ -5,6 +5,7 @@
 #include <click/task.hh>
 #include <click/timer.hh>
 #include <click/notifier.hh>
+#include "elements/userlevel/socketbatch.hh"
 CLICK_DECLS
 
 /*
@@ -47,6 +48,12 @@ by this element. This could be useful for encapsulation protocols
 which add headers to the packet, and can avoid expensive push
 operations later in the packet's life.
 
+=item BURST
+
+Unsigned integer. Maximum number of packets to receive, or pulled packets
+to send, with one system call (recvmmsg or sendmmsg where available).
+Default is 1.
+
 =back
 
 =e
@@ -92,8 +99,12 @@ private:
   int _backoff;			// backoff timer for when sendto() blocks
   Packet *_wq;			// queue to store pulled packet for when sendto() blocks
   int _events;			// keeps track of the events for which select() is waiting
+  int _burst;			// packets per system call
+  SocketRecvBatch _rbatch;
+  SocketSendBatch _wbatch;
 
   int initialize_socket_error(ErrorHandler *, const char *);
+  void selected_batch();
 
 };
 
@@ -0,0 +1,373 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * sharedring.{cc,hh} -- packet rings in shared memory
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "sharedring.hh"
+#include <click/glue.hh>
+#include <click/error.hh>
+#include <click/vector.hh>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+CLICK_DECLS
+
+/* The other side of a ring is another process, so fences and the free
+ * list's compare-and-swap must be real even in a single-threaded Click. */
+static inline void
+shared_fence()
+{
+    __sync_synchronize();
+}
+
+enum {
+    shared_magic = 0x436C5352,		// "ClSR"
+    shared_version = 1,
+    shared_nil = 0xFFFF,		// empty free list
+    shared_align = 64
+};
+
+struct SharedRing::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nrings;
+    uint32_t ring_size;			// descriptors per ring, a power of 2
+    uint32_t nbufs;
+    uint32_t buf_size;
+    uint32_t ring_offset;
+    uint32_t ring_stride;
+    uint32_t next_offset;
+    uint32_t buf_offset;
+    volatile uint32_t free_top;		// (tag << 16) | first free buffer
+    volatile uint32_t nfree;
+};
+
+namespace {
+struct SharedDesc {
+    uint32_t buf;
+    uint32_t off;
+    uint32_t len;
+    uint32_t reserved;
+};
+}
+
+struct SharedRing::Ring {
+    volatile uint32_t head;		// written by the producer
+    char pad0[shared_align - sizeof(uint32_t)];
+    volatile uint32_t tail;		// written by the consumer
+    char pad1[shared_align - sizeof(uint32_t)];
+    SharedDesc desc[1];
+};
+
+static inline size_t
+align_up(size_t x, size_t a)
+{
+    return (x + a - 1) & ~(a - 1);
+}
+
+static Vector<SharedRing *> shared_rings;
+
+SharedRing::SharedRing(const String &filename)
+    : _filename(filename), _map(0), _map_size(0), _hdr(0), _next(0),
+      _bufs(0), _bufs_end(0), _users(1)
+{
+    _refs = 1;
+}
+
+SharedRing::~SharedRing()
+{
+    if (_map)
+	munmap(_map, _map_size);
+}
+
+inline SharedRing::Ring *
+SharedRing::ring(unsigned i) const
+{
+    return reinterpret_cast<Ring *>(_map + _hdr->ring_offset + (size_t) i * _hdr->ring_stride);
+}
+
+unsigned
+SharedRing::nrings() const
+{
+    return _hdr->nrings;
+}
+
+unsigned
+SharedRing::buffer_size() const
+{
+    return _hdr->buf_size;
+}
+
+unsigned
+SharedRing::free_buffers() const
+{
+    return _hdr->nfree;
+}
+
+int
+SharedRing::setup(unsigned nrings, unsigned ring_size, unsigned nbufs,
+		  unsigned buf_size, ErrorHandler *errh)
+{
+    if (!nrings)
+	nrings = default_nrings;
+    if (!ring_size)
+	ring_size = default_ring_size;
+    if (!nbufs)
+	nbufs = default_nbufs;
+    if (!buf_size)
+	buf_size = default_buf_size;
+    if (nrings == 0 || ring_size < 2 || (ring_size & (ring_size - 1)))
+	return errh->error("bad ring configuration");
+    if (nbufs == 0 || nbufs >= shared_nil)
+	return errh->error("BUFFERS must be between 1 and %u", shared_nil - 1);
+    buf_size = align_up(buf_size, shared_align);
+
+    int fd = ::open(_filename.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+	return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+    // serialize formatting with other processes opening the file
+    flock(fd, LOCK_EX);
+
+    struct stat st;
+    bool create = (fstat(fd, &st) == 0 && st.st_size == 0);
+    Header h;
+    memset(&h, 0, sizeof(h));
+    if (create) {
+	h.nrings = nrings;
+	h.ring_size = ring_size;
+	h.nbufs = nbufs;
+	h.buf_size = buf_size;
+	h.ring_offset = align_up(sizeof(Header), shared_align);
+	h.ring_stride = align_up(offsetof(Ring, desc) + ring_size * sizeof(SharedDesc), shared_align);
+	h.next_offset = h.ring_offset + nrings * h.ring_stride;
+	h.buf_offset = align_up(h.next_offset + nbufs * sizeof(uint32_t), 4096);
+	_map_size = h.buf_offset + (size_t) nbufs * buf_size;
+	if (ftruncate(fd, _map_size) < 0) {
+	    errh->error("%s: %s", _filename.c_str(), strerror(errno));
+	    goto out;
+	}
+    } else if (st.st_size < (off_t) sizeof(Header)
+	       || pread(fd, &h, sizeof(h), 0) != (ssize_t) sizeof(h)
+	       || h.magic != shared_magic || h.version != shared_version) {
+	errh->error("%s: not a shared ring file", _filename.c_str());
+	goto out;
+    } else
+	_map_size = st.st_size;
+
+    {
+	void *m = mmap(0, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (m == MAP_FAILED) {
+	    errh->error("mmap: %s", strerror(errno));
+	    goto out;
+	}
+	_map = reinterpret_cast<unsigned char *>(m);
+    }
+    _hdr = reinterpret_cast<Header *>(_map);
+    if (create) {
+	// every buffer starts on the free list; the file is zero-filled
+	memcpy(_hdr, &h, sizeof(h));
+	_next = reinterpret_cast<uint32_t *>(_map + h.next_offset);
+	for (unsigned i = 0; i < nbufs; ++i)
+	    _next[i] = (i + 1 < nbufs ? i + 1 : (unsigned) shared_nil);
+	_hdr->free_top = 0;
+	_hdr->nfree = nbufs;
+	shared_fence();
+	_hdr->magic = shared_magic;
+	_hdr->version = shared_version;
+    } else if ((size_t) h.buf_offset + (size_t) h.nbufs * h.buf_size > _map_size
+	       || h.ring_offset + (size_t) h.nrings * h.ring_stride > h.next_offset) {
+	errh->error("%s: shared ring file is truncated", _filename.c_str());
+	goto out;
+    }
+    _next = reinterpret_cast<uint32_t *>(_map + _hdr->next_offset);
+    _bufs = _map + _hdr->buf_offset;
+    _bufs_end = _bufs + (size_t) _hdr->nbufs * _hdr->buf_size;
+
+  out:
+    flock(fd, LOCK_UN);
+    ::close(fd);
+    return _bufs ? 0 : -1;
+}
+
+int
+SharedRing::check_layout(unsigned nrings, unsigned ring_size, unsigned nbufs,
+			 unsigned buf_size, ErrorHandler *errh) const
+{
+    static const char * const names[] = {
+	"RINGS", "CAPACITY", "BUFFERS", "BUFFER_SIZE"
+    };
+    unsigned want[] = { nrings, ring_size, nbufs, buf_size };
+    unsigned have[] = { _hdr->nrings, _hdr->ring_size, _hdr->nbufs, _hdr->buf_size };
+    // the file stores BUFFER_SIZE rounded up
+    if (want[3])
+	want[3] = align_up(want[3], shared_align);
+    int before = errh->nerrors();
+    for (int i = 0; i < 4; ++i)
+	if (want[i] && want[i] != have[i])
+	    errh->error("%s: %s is %u, not %u", _filename.c_str(), names[i], have[i], want[i]);
+    return errh->nerrors() == before ? 0 : -1;
+}
+
+SharedRing *
+SharedRing::open(const String &filename, unsigned nrings, unsigned ring_size,
+		 unsigned nbufs, unsigned buf_size, ErrorHandler *errh)
+{
+    for (int i = 0; i < shared_rings.size(); ++i)
+	if (shared_rings[i]->_filename == filename) {
+	    SharedRing *s = shared_rings[i];
+	    if (s->check_layout(nrings, ring_size, nbufs, buf_size, errh) < 0)
+		return 0;
+	    ++s->_users;
+	    return s;
+	}
+    SharedRing *s = new SharedRing(filename);
+    if (s->setup(nrings, ring_size, nbufs, buf_size, errh) < 0
+	|| s->check_layout(nrings, ring_size, nbufs, buf_size, errh) < 0) {
+	delete s;
+	return 0;
+    }
+    shared_rings.push_back(s);
+    return s;
+}
+
+void
+SharedRing::close()
+{
+    if (--_users == 0) {
+	for (int i = 0; i < shared_rings.size(); ++i)
+	    if (shared_rings[i] == this) {
+		shared_rings[i] = shared_rings.back();
+		shared_rings.pop_back();
+		break;
+	    }
+	unref();
+    }
+}
+
+inline void
+SharedRing::unref()
+{
+    if (_refs.dec_and_test())
+	delete this;
+}
+
+int
+SharedRing::alloc_buffer()
+{
+    while (1) {
+	uint32_t top = _hdr->free_top;
+	uint32_t idx = top & 0xFFFF;
+	if (idx == shared_nil)
+	    return -1;
+	// the tag in the high bits keeps a stale _next[idx] from winning
+	uint32_t ntop = ((top + 0x10000) & 0xFFFF0000) | _next[idx];
+	if (__sync_val_compare_and_swap(&_hdr->free_top, top, ntop) == top) {
+	    __sync_fetch_and_sub(&_hdr->nfree, 1);
+	    return idx;
+	}
+    }
+}
+
+void
+SharedRing::free_buffer(unsigned idx)
+{
+    uint32_t top;
+    do {
+	top = _hdr->free_top;
+	_next[idx] = top & 0xFFFF;
+    } while (__sync_val_compare_and_swap(&_hdr->free_top, top, ((top + 0x10000) & 0xFFFF0000) | idx) != top);
+    __sync_fetch_and_add(&_hdr->nfree, 1);
+}
+
+void
+SharedRing::buffer_destructor(unsigned char *buf, size_t, void *arg)
+{
+    SharedRing *s = reinterpret_cast<SharedRing *>(arg);
+    s->free_buffer((buf - s->_bufs) / s->_hdr->buf_size);
+    s->unref();
+}
+
+WritablePacket *
+SharedRing::rx_packet(unsigned i)
+{
+    Ring *r = ring(i);
+    uint32_t tail = r->tail;
+    uint32_t buf_size = _hdr->buf_size;
+    while (tail != r->head) {
+	shared_fence();
+	const SharedDesc &d = r->desc[tail & (_hdr->ring_size - 1)];
+	uint32_t idx = d.buf, off = d.off, len = d.len;
+	if (idx >= _hdr->nbufs || off > buf_size || len > buf_size - off) {
+	    // a confused producer; skip the descriptor
+	    r->tail = ++tail;
+	    continue;
+	}
+	WritablePacket *p = Packet::make(_bufs + (size_t) idx * buf_size, buf_size, buffer_destructor, this);
+	if (!p)
+	    return 0;
+	++_refs;
+	p->pull(off);
+	p->take(buf_size - off - len);
+	shared_fence();
+	r->tail = tail + 1;
+	return p;
+    }
+    return 0;
+}
+
+int
+SharedRing::tx_packet(unsigned i, Packet *p, unsigned headroom)
+{
+    Ring *r = ring(i);
+    uint32_t head = r->head;
+    if (head - r->tail >= _hdr->ring_size)
+	return -EAGAIN;
+    SharedDesc &d = r->desc[head & (_hdr->ring_size - 1)];
+    uint32_t buf_size = _hdr->buf_size;
+
+    if (is_shared_buffer(p) && !p->shared()) {
+	// pass the buffer itself on
+	d.buf = (p->buffer() - _bufs) / buf_size;
+	d.off = p->data() - (_bufs + (size_t) d.buf * buf_size);
+	d.len = p->length();
+	p->reset_buffer();
+	p->kill();
+	unref();
+    } else {
+	if (p->length() > buf_size)
+	    return -EMSGSIZE;
+	int idx = alloc_buffer();
+	if (idx < 0)
+	    return -EAGAIN;
+	// keep the data's alignment, so an aligned IP header stays aligned
+	uint32_t off = Packet::aligned_headroom(headroom, 8, reinterpret_cast<uintptr_t>(p->data()) & 7);
+	if (off > buf_size - p->length())
+	    off = buf_size - p->length();
+	memcpy(_bufs + (size_t) idx * buf_size + off, p->data(), p->length());
+	d.buf = idx;
+	d.off = off;
+	d.len = p->length();
+	p->kill();
+    }
+    shared_fence();
+    r->head = head + 1;
+    return 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+ELEMENT_PROVIDES(SharedRing)
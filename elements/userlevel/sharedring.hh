@@ -0,0 +1,93 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_SHAREDRING_HH
+#define CLICK_SHAREDRING_HH 1
+#include <click/packet.hh>
+#include <click/string.hh>
+#include <click/atomic.hh>
+CLICK_DECLS
+class ErrorHandler;
+
+/* A set of packet rings in a shared memory file, for passing packets
+ * between Click processes on one host.
+ *
+ * The file holds a pool of fixed-size packet buffers and one or more
+ * single-producer, single-consumer descriptor rings.  A descriptor names a
+ * buffer and the packet's offset and length within it; the rings and the
+ * pool's free list are lock-free, so no system calls are made once the file
+ * is mapped.
+ *
+ * rx_packet() wraps a received buffer in a Packet without copying; the
+ * buffer returns to the pool when the Packet is killed.  tx_packet() sends
+ * such a Packet by passing its descriptor on, and copies any other packet
+ * into a free buffer.  A process that forwards between two rings of the same
+ * file therefore never copies packet data.
+ *
+ * Every element that names the same file in one process shares one
+ * SharedRing; the mapping stays alive until the last Packet is killed. */
+class SharedRing { public:
+
+    enum {
+	default_nrings = 2, default_ring_size = 1024,
+	default_nbufs = 4096, default_buf_size = 2048
+    };
+
+    // Map @a filename, creating and formatting it with @a nrings rings of
+    // @a ring_size descriptors and @a nbufs buffers of @a buf_size bytes if
+    // it does not exist.  A zero argument means its default when creating
+    // and any value otherwise; a nonzero argument that differs from an
+    // existing file's layout is an error.
+    static SharedRing *open(const String &filename, unsigned nrings,
+			    unsigned ring_size, unsigned nbufs,
+			    unsigned buf_size, ErrorHandler *errh);
+    void close();
+
+    const String &filename() const	{ return _filename; }
+    unsigned nrings() const;
+    unsigned buffer_size() const;
+    unsigned free_buffers() const;
+
+    // Return the next packet on ring @a ring, or null if it is empty.
+    WritablePacket *rx_packet(unsigned ring);
+
+    // Send @a p on ring @a ring, consuming it.  Returns 0, -EAGAIN if the
+    // ring is full or no buffer is free, or -EMSGSIZE if @a p does not fit
+    // in a buffer; on error, @a p is not consumed.
+    int tx_packet(unsigned ring, Packet *p, unsigned headroom);
+
+    bool is_shared_buffer(Packet *p) const {
+	return p->buffer_destructor() == buffer_destructor
+	    && p->buffer() >= _bufs && p->buffer() < _bufs_end;
+    }
+
+    struct Header;
+    struct Ring;
+
+  private:
+
+    String _filename;
+    unsigned char *_map;
+    size_t _map_size;
+    Header *_hdr;
+    uint32_t *_next;			// free list links, one per buffer
+    unsigned char *_bufs;
+    unsigned char *_bufs_end;
+    int _users;				// elements using this SharedRing
+    atomic_uint32_t _refs;		// Packets in the pool, plus one until
+					// the last close
+
+    SharedRing(const String &filename);
+    ~SharedRing();
+    int setup(unsigned nrings, unsigned ring_size, unsigned nbufs,
+	      unsigned buf_size, ErrorHandler *errh);
+    int check_layout(unsigned nrings, unsigned ring_size, unsigned nbufs,
+		     unsigned buf_size, ErrorHandler *errh) const;
+    inline Ring *ring(unsigned i) const;
+    int alloc_buffer();
+    void free_buffer(unsigned idx);
+    void unref();
+    static void buffer_destructor(unsigned char *buf, size_t, void *arg);
+
+};
+
+CLICK_ENDDECLS
+#endif
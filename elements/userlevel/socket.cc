@@ -30,8 +30,10 @@
 #include <sys/un.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <fcntl.h>
 #include "socket.hh"
+#include "uringio.hh"
 
 #ifdef HAVE_PROPER
 #include <proper/prop.h>
@@ -44,7 +46,8 @@ Socket::Socket()
     _fd(-1), _active(-1), _rq(0), _wq(0),
     _local_port(0), _local_pathname(""),
     _timestamp(true), _sndbuf(-1), _rcvbuf(-1),
-    _snaplen(2048), _headroom(Packet::default_headroom), _nodelay(1),
+    _snaplen(2048), _headroom(Packet::default_headroom), _burst(1),
+    _gso(false), _gro(false), _io_uring(false), _uring(0), _nodelay(1),
     _verbose(false), _client(false), _proper(false), _allow(0), _deny(0)
 {
 }
@@ -68,6 +71,10 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
   if (args.read("VERBOSE", _verbose)
       .read("SNAPLEN", _snaplen)
       .read("HEADROOM", _headroom)
+      .read("BURST", _burst)
+      .read("GSO", _gso)
+      .read("GRO", _gro)
+      .read("IO_URING", _io_uring)
       .read("TIMESTAMP", _timestamp)
       .read("RCVBUF", _rcvbuf)
       .read("SNDBUF", _sndbuf)
@@ -119,6 +126,25 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
   else
     return errh->error("unknown socket type `%s'", socktype.c_str());
 
+  if (_burst <= 0)
+    return errh->error("BURST out of range");
+  if ((_gso || _gro) && _protocol != IPPROTO_UDP)
+    return errh->error("GSO and GRO require a UDP socket");
+#if !defined(__linux__)
+  if (_gso || _gro)
+    return errh->error("GSO and GRO not supported on this platform");
+#endif
+  if (_io_uring) {
+#if !HAVE_ALLOW_IO_URING
+    return errh->error("IO_URING requires Click configured with --enable-io-uring");
+#endif
+    if (_gso || _gro)
+      return errh->error("IO_URING cannot be combined with GSO or GRO");
+    // io_uring writes have no destination address
+    if (_socktype == SOCK_DGRAM && (!_client || (_family == AF_INET && !_remote_ip)))
+      return errh->error("IO_URING datagram sockets must be clients with a nonzero address");
+  }
+
   return 0;
 }
 
@@ -189,6 +215,26 @@ Socket::initialize(ErrorHandler *errh)
     if (setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &_rcvbuf, sizeof(_rcvbuf)) < 0)
       return initialize_socket_error(errh, "setsockopt(SO_RCVBUF)");
 
+#if defined(__linux__)
+  // receive coalesced datagrams
+  if (_gro) {
+# ifndef UDP_GRO
+#  define UDP_GRO 104
+# endif
+    int one = 1;
+    if (setsockopt(_fd, IPPROTO_UDP, UDP_GRO, &one, sizeof(one)) < 0)
+      return initialize_socket_error(errh, "setsockopt(UDP_GRO)");
+  }
+#endif
+
+  if (batched()) {
+    // a coalesced datagram can be as large as a UDP packet gets
+    unsigned bufsize = _gro ? 65535 : _snaplen;
+    if (_rbatch.initialize(_burst, _headroom, bufsize, !_client, _gro ? CMSG_SPACE(sizeof(int)) : 0) < 0
+	|| _wbatch.initialize(_burst) < 0)
+      return errh->error("out of memory");
+  }
+
   // if a server, then the first arguments should be interpreted as
   // the address/port/file to bind() to, not to connect() to
   if (!_client) {
@@ -219,6 +265,9 @@ Socket::initialize(ErrorHandler *errh)
 	return initialize_socket_error(errh, "connect");
       if (_verbose)
 	click_chatter("%s: opened connection %d to %s:%d", declaration().c_str(), _fd, IPAddress(_remote.in.sin_addr).unparse().c_str(), ntohs(_remote.in.sin_port));
+    } else if (_io_uring) {
+      if (connect(_fd, (struct sockaddr *)&_remote, _remote_len) < 0)
+	return initialize_socket_error(errh, "connect");
     }
     _active = _fd;
   } else {
@@ -241,21 +290,49 @@ Socket::initialize(ErrorHandler *errh)
   fcntl(_fd, F_SETFL, O_NONBLOCK);
   fcntl(_fd, F_SETFD, FD_CLOEXEC);
 
-  if (noutputs())
+  if (_io_uring && _active >= 0) {
+    if (open_uring(errh) < 0)
+      return -1;
+  } else if (noutputs())
     add_select(_fd, SELECT_READ);
 
   if (ninputs() && input_is_pull(0)) {
     ScheduleInfo::join_scheduler(this, &_task, errh);
     _signal = Notifier::upstream_empty_signal(this, 0, &_task);
-    add_select(_fd, SELECT_WRITE);
+    if (!_io_uring)
+      add_select(_fd, SELECT_WRITE);
   }
 
   return 0;
 }
 
+int
+Socket::open_uring(ErrorHandler *errh)
+{
+#if HAVE_ALLOW_IO_URING
+  // several reads or writes in flight could reorder a stream's data
+  unsigned n = (_socktype == SOCK_STREAM ? 1 : _burst);
+  _uring = URingIO::open(_active, noutputs() ? n : 0, ninputs() ? n : 0,
+			 _headroom + _snaplen, _headroom, errh);
+  if (!_uring)
+    return -1;
+  if (noutputs())
+    add_select(_uring->rx_fd(), SELECT_READ);
+  return 0;
+#else
+  return errh->error("io_uring not supported");
+#endif
+}
+
 void
 Socket::cleanup(CleanupStage)
 {
+#if HAVE_ALLOW_IO_URING
+  if (_uring) {
+    _uring->close();
+    _uring = 0;
+  }
+#endif
   if (_active >= 0 && _active != _fd) {
     close(_active);
     _active = -1;
@@ -264,6 +341,8 @@ Socket::cleanup(CleanupStage)
     _rq->kill();
   if (_wq)
     _wq->kill();
+  _rbatch.cleanup();
+  _wbatch.cleanup();
   if (_fd >= 0) {
     // shut down the listening socket in case we forked
 #ifdef SHUT_RDWR
@@ -295,6 +374,16 @@ void
 Socket::close_active(void)
 {
   if (_active >= 0) {
+#if HAVE_ALLOW_IO_URING
+    if (_uring) {
+      if (_uring->rx_fd() >= 0)
+	remove_select(_uring->rx_fd(), SELECT_READ);
+      if (_uring->tx_fd() >= 0)
+	remove_select(_uring->tx_fd(), SELECT_READ);
+      _uring->close();
+      _uring = 0;
+    }
+#endif
     remove_select(_active, SELECT_READ | SELECT_WRITE);
     close(_active);
     if (_verbose)
@@ -343,59 +432,73 @@ Socket::selected(int fd, int)
       fcntl(_active, F_SETFL, O_NONBLOCK);
       fcntl(_active, F_SETFD, FD_CLOEXEC);
 
-      add_select(_active, SELECT_READ | SELECT_WRITE);
+      if (!_io_uring)
+	add_select(_active, SELECT_READ | SELECT_WRITE);
+      else if (open_uring(ErrorHandler::default_handler()) < 0) {
+	close_active();
+	return;
+      }
     }
 
     // read data from socket
-    if (!_rq)
-      _rq = Packet::make(_headroom, 0, _snaplen, 0);
-    if (_rq) {
-      if (_socktype == SOCK_STREAM)
-	len = read(_active, _rq->data(), _rq->length());
-      else if (_client)
-	len = recv(_active, _rq->data(), _rq->length(), MSG_TRUNC);
-      else {
-	// datagram server, find out who we are talking to
-	len = recvfrom(_active, _rq->data(), _rq->length(), MSG_TRUNC, (struct sockaddr *)&from, &from_len);
-
-	if (_family == AF_INET && !allowed(IPAddress(from.in.sin_addr))) {
-	  if (_verbose)
-	    click_chatter("%s: dropped datagram from %s:%d", declaration().c_str(),
-			  IPAddress(from.in.sin_addr).unparse().c_str(), ntohs(from.in.sin_port));
-	  len = -1;
-	  errno = EAGAIN;
-	} else if (len > 0) {
-	  memcpy(&_remote, &from, from_len);
-	  _remote_len = from_len;
+    if (_io_uring) {
+#if HAVE_ALLOW_IO_URING
+      if (_uring && fd == _uring->rx_fd())
+	receive_uring();
+#endif
+    } else if (batched())
+      receive_batch();
+    else {
+      if (!_rq)
+	_rq = Packet::make(_headroom, 0, _snaplen, 0);
+      if (_rq) {
+	if (_socktype == SOCK_STREAM)
+	  len = read(_active, _rq->data(), _rq->length());
+	else if (_client)
+	  len = recv(_active, _rq->data(), _rq->length(), MSG_TRUNC);
+	else {
+	  // datagram server, find out who we are talking to
+	  len = recvfrom(_active, _rq->data(), _rq->length(), MSG_TRUNC, (struct sockaddr *)&from, &from_len);
+
+	  if (_family == AF_INET && !allowed(IPAddress(from.in.sin_addr))) {
+	    if (_verbose)
+	      click_chatter("%s: dropped datagram from %s:%d", declaration().c_str(),
+			    IPAddress(from.in.sin_addr).unparse().c_str(), ntohs(from.in.sin_port));
+	    len = -1;
+	    errno = EAGAIN;
+	  } else if (len > 0) {
+	    memcpy(&_remote, &from, from_len);
+	    _remote_len = from_len;
+	  }
 	}
-      }
 
-      // this segment OK
-      if (len > 0) {
-	if (len > _snaplen) {
-	  // truncate packet to max length (should never happen)
-	  assert(_rq->length() == (uint32_t)_snaplen);
-	  SET_EXTRA_LENGTH_ANNO(_rq, len - _snaplen);
-	} else {
-	  // trim packet to actual length
-	  _rq->take(_snaplen - len);
+	// this segment OK
+	if (len > 0) {
+	  if (len > _snaplen) {
+	    // truncate packet to max length (should never happen)
+	    assert(_rq->length() == (uint32_t)_snaplen);
+	    SET_EXTRA_LENGTH_ANNO(_rq, len - _snaplen);
+	  } else {
+	    // trim packet to actual length
+	    _rq->take(_snaplen - len);
+	  }
+
+	  // set timestamp
+	  if (_timestamp)
+	    _rq->timestamp_anno().assign_now();
+
+	  // push packet
+	  output(0).push(_rq);
+	  _rq = 0;
 	}
 
-	// set timestamp
-	if (_timestamp)
-	  _rq->timestamp_anno().assign_now();
-
-	// push packet
-	output(0).push(_rq);
-	_rq = 0;
-      }
-
-      // connection terminated or fatal error
-      else if (len == 0 || errno != EAGAIN) {
-	if (errno != EAGAIN && _verbose)
-	  click_chatter("%s: %s", declaration().c_str(), strerror(errno));
-	close_active();
-	return;
+	// connection terminated or fatal error
+	else if (len == 0 || errno != EAGAIN) {
+	  if (errno != EAGAIN && _verbose)
+	    click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+	  close_active();
+	  return;
+	}
       }
     }
   }
@@ -404,6 +507,86 @@ Socket::selected(int fd, int)
     run_task(0);
 }
 
+inline void
+Socket::push_received(WritablePacket *p)
+{
+  if (_timestamp)
+    p->timestamp_anno().assign_now();
+  output(0).push(p);
+}
+
+void
+Socket::receive_batch()
+{
+  int n = _rbatch.recv(_active, MSG_TRUNC);
+  if (n < 0) {
+    if (errno != EAGAIN && errno != EINTR) {
+      if (_verbose)
+	click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+      close_active();
+    }
+    return;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    if (!_client) {
+      // datagram server, find out who we are talking to
+      const struct sockaddr_in *from = reinterpret_cast<const struct sockaddr_in *>(_rbatch.name(i));
+      if (_family == AF_INET && !allowed(IPAddress(from->sin_addr))) {
+	if (_verbose)
+	  click_chatter("%s: dropped datagram from %s:%d", declaration().c_str(),
+			IPAddress(from->sin_addr).unparse().c_str(), ntohs(from->sin_port));
+	continue;
+      }
+      memcpy(&_remote, _rbatch.name(i), _rbatch.namelen(i));
+      _remote_len = _rbatch.namelen(i);
+    }
+    if (_gro) {
+      // Copy each datagram out of a coalesced buffer, so no packet holds
+      // on to 64KB; the buffer stays in its slot for the next recv().
+      unsigned len = _rbatch.length(i), seg = _rbatch.gro_size(i), off = 0;
+      if (len > 65535)
+	len = 65535;
+      do {
+	unsigned seglen = (seg && len - off > seg ? seg : len - off);
+	unsigned caplen = (seglen > (unsigned) _snaplen ? _snaplen : seglen);
+	if (WritablePacket *p = _rbatch.copy(i, off, caplen)) {
+	  if (caplen < seglen)
+	    SET_EXTRA_LENGTH_ANNO(p, seglen - caplen);
+	  push_received(p);
+	}
+	off += seglen;
+      } while (off < len);
+    } else
+      push_received(_rbatch.take(i, _snaplen));
+  }
+}
+
+void
+Socket::receive_uring()
+{
+#if HAVE_ALLOW_IO_URING
+  WritablePacket *p;
+  int len;
+  while ((len = _uring->rx_packet(p)) > 0) {
+    push_received(p);
+    if (!_uring)
+      return;
+  }
+
+  // connection terminated or fatal error
+  if (len != -EAGAIN) {
+    if (len < 0 && _verbose)
+      click_chatter("%s: %s", declaration().c_str(), strerror(-len));
+    close_active();
+    return;
+  }
+
+  // post the buffers of killed packets for the next reads
+  _uring->refill();
+#endif
+}
+
 int
 Socket::write_packet(Packet *p)
 {
@@ -457,6 +640,30 @@ Socket::push(int, Packet *p)
   fd_set fds;
   int err;
 
+#if HAVE_ALLOW_IO_URING
+  if (_uring) {
+    // block until a write buffer is free
+    while ((err = _uring->tx_packet(p)) == -EAGAIN
+	   && ((err = _uring->flush(true)) >= 0 || err == -EINTR))
+      /* nothing */;
+    p->kill();
+    if (err == -EMSGSIZE) {
+      if (_verbose)
+	click_chatter("%s: %s, dropping packet", declaration().c_str(), strerror(-err));
+      err = 0;
+    }
+    if (err >= 0 && (err = _uring->flush()) >= 0)
+      err = _uring->tx_error();
+    if (err < 0) {
+      // connection probably terminated or other fatal error
+      if (_verbose)
+	click_chatter("%s: %s", declaration().c_str(), strerror(-err));
+      close_active();
+    }
+    return;
+  }
+#endif
+
   if (_active >= 0) {
     // block
     do {
@@ -481,12 +688,100 @@ Socket::push(int, Packet *p)
     p->kill();
 }
 
+bool
+Socket::run_task_batch()
+{
+  bool any = false;
+  int r = 0;
+
+  // fill the batch, then write as much of it as we can
+  while (Packet *p = (_wbatch.full() ? 0 : input(0).pull())) {
+    any = true;
+    // as in write_packet(), a 0.0.0.0 client sends to the destination
+    // IP annotation
+    if (!IPAddress(_remote_ip) && _client && _family == AF_INET)
+      _remote.in.sin_addr = p->dst_ip_anno();
+    _wbatch.push_back(p, (struct sockaddr *)&_remote, _remote_len);
+  }
+  while (!_wbatch.empty()) {
+    r = _wbatch.send(_active, _gso);
+    if (r > 0) {
+      any = true;
+      while (r-- > 0)
+	_wbatch.pop_front()->kill();
+    } else if (r == -ENOBUFS || r == -EAGAIN)
+      break;
+    else if (r != -EINTR) {
+      // connection probably terminated or other fatal error
+      if (_verbose)
+	click_chatter("%s: %s", declaration().c_str(), strerror(-r));
+      _wbatch.pop_front()->kill();
+      close_active();
+      return any;
+    }
+  }
+
+  if (!_wbatch.empty())
+    // send the rest when the socket becomes available
+    add_select(_active, SELECT_WRITE);
+  else if (_signal)
+    _task.reschedule();
+  else
+    remove_select(_active, SELECT_WRITE);
+  return any;
+}
+
+bool
+Socket::run_task_uring()
+{
+  bool any = false;
+#if HAVE_ALLOW_IO_URING
+  int err = 0;
+  // copy packets into free buffers, then submit them all at once
+  while (Packet *p = _wq ? _wq : input(0).pull()) {
+    _wq = 0;
+    if ((err = _uring->tx_packet(p)) == -EAGAIN) {
+      _wq = p;
+      break;
+    }
+    any = true;
+    if (err < 0 && _verbose)
+      click_chatter("%s: %s, dropping packet", declaration().c_str(), strerror(-err));
+    p->kill();
+  }
+  if ((err = _uring->flush()) >= 0)
+    err = _uring->tx_error();
+  if (err < 0) {
+    // connection probably terminated or other fatal error
+    if (_verbose)
+      click_chatter("%s: %s", declaration().c_str(), strerror(-err));
+    close_active();
+    return any;
+  }
+
+  if (_wq)
+    // send the rest when a write completes
+    add_select(_uring->tx_fd(), SELECT_READ);
+  else {
+    remove_select(_uring->tx_fd(), SELECT_READ);
+    if (_signal)
+      _task.reschedule();
+  }
+#endif
+  return any;
+}
+
 bool
 Socket::run_task(Task *)
 {
   assert(ninputs() && input_is_pull(0));
   bool any = false;
 
+  if (_uring)
+    return run_task_uring();
+  if (batched() && _active >= 0)
+    return run_task_batch();
+
   if (_active >= 0) {
     Packet *p = 0;
     int err = 0;
@@ -526,5 +821,5 @@ Socket::add_handlers()
 }
 
 CLICK_ENDDECLS
-ELEMENT_REQUIRES(userlevel IPRouteTable)
+ELEMENT_REQUIRES(userlevel IPRouteTable SocketBatch URingIO)
 EXPORT_ELEMENT(Socket)
@@ -6,8 +6,10 @@
 #include <click/task.hh>
 #include <click/notifier.hh>
 #include "../ip/iproutetable.hh"
+#include "elements/userlevel/socketbatch.hh"
 #include <sys/un.h>
 CLICK_DECLS
+class URingIO;
 
 /*
 =c
@@ -141,6 +143,45 @@ Boolean. PlanetLab specific. If true and Click has been configured
 
 Integer. Per-packet headroom. Defaults to 28.
 
+=item BURST
+
+Integer. Applies to datagram sockets only. Maximum number of datagrams to
+receive, or pulled packets to send, with one system call (recvmmsg or
+sendmmsg where available). Packets pushed to Socket are always sent one at
+a time. Default is 1.
+
+=item GSO
+
+Boolean. Applies to UDP sockets on Linux only. If true, consecutive pulled
+packets with the same destination and length are handed to the kernel as
+one UDP segmentation offload (UDP_SEGMENT) message, which the kernel or the
+network card splits into datagrams. Most useful with a large BURST.
+Default is false.
+
+=item GRO
+
+Boolean. Applies to UDP sockets on Linux only. If true, enable UDP receive
+offload (UDP_GRO): the kernel may deliver several datagrams from the same
+flow as one large buffer, which Socket splits back into one packet per
+datagram. Each datagram is copied into a packet of its own size, and the
+receive buffer is reused. As without GRO, a datagram longer than SNAPLEN is
+truncated, the rest counted in the extra length annotation. Default is
+false.
+
+=item IO_URING
+
+Boolean. If true, read and write the connected socket through io_uring with
+registered buffers of HEADROOM + SNAPLEN bytes, rather than with read() and
+write() calls. Received packets use their read buffers without copying. A
+datagram socket keeps up to BURST reads posted in the kernel, and copies up
+to BURST pulled packets into buffers to send with one system call; a stream
+socket uses one buffer each way, so its data stays in order. Packets longer
+than SNAPLEN are dropped rather than sent, and datagrams longer than SNAPLEN
+are truncated without setting the extra length annotation. A datagram Socket
+with IO_URING must be a client with a nonzero address, and connect()s to it.
+Cannot be combined with GSO or GRO. Only works in a Click configured with
+--enable-io-uring. Default is false.
+
 =back
 
 =e
@@ -212,6 +253,8 @@ private:
   NotifierSignal _signal;	// packet is available to pull()
   WritablePacket *_rq;		// queue to receive pulled packets
   Packet *_wq;			// queue to store pulled packet for when sendto() blocks
+  SocketRecvBatch _rbatch;	// datagrams received with one system call
+  SocketSendBatch _wbatch;	// pulled datagrams waiting to be sent
 
   int _family;			// AF_INET or AF_UNIX
   int _socktype;		// SOCK_STREAM or SOCK_DGRAM
@@ -228,6 +271,11 @@ private:
   int _rcvbuf;			// maximum socket receive buffer in bytes
   int _snaplen;			// maximum received packet length
   unsigned _headroom;
+  int _burst;			// datagrams per system call
+  bool _gso;			// use UDP_SEGMENT when sending
+  bool _gro;			// use UDP_GRO when receiving
+  bool _io_uring;		// use io_uring for connected sockets
+  URingIO *_uring;		// completion-based I/O on _active
   int _nodelay;			// disable Nagle algorithm
   bool _verbose;		// be verbose
   bool _client;			// client or server
@@ -236,6 +284,13 @@ private:
   IPRouteTable *_deny;		// lookup table of bad hosts
 
   int initialize_socket_error(ErrorHandler *, const char *);
+  bool batched() const		{ return _socktype == SOCK_DGRAM && !_io_uring && (_burst > 1 || _gso || _gro); }
+  void receive_batch();
+  bool run_task_batch();
+  int open_uring(ErrorHandler *);
+  void receive_uring();
+  bool run_task_uring();
+  inline void push_received(WritablePacket *p);
 
 };
 
@@ -0,0 +1,328 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * socketbatch.{cc,hh} -- batched datagram socket I/O
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "socketbatch.hh"
+#include <click/glue.hh>
+#include <click/packet_anno.hh>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <errno.h>
+#if defined(__linux__)
+# ifndef SOL_UDP
+#  define SOL_UDP 17
+# endif
+# ifndef UDP_SEGMENT
+#  define UDP_SEGMENT 103
+# endif
+# ifndef UDP_GRO
+#  define UDP_GRO 104
+# endif
+#endif
+CLICK_DECLS
+
+SocketRecvBatch::SocketRecvBatch()
+    : _burst(0), _p(0), _msgs(0), _iov(0), _names(0), _control(0)
+{
+}
+
+SocketRecvBatch::~SocketRecvBatch()
+{
+    cleanup();
+}
+
+int
+SocketRecvBatch::initialize(int burst, unsigned headroom, unsigned bufsize,
+			    bool names, unsigned controllen)
+{
+    cleanup();
+    _burst = burst;
+    _headroom = headroom;
+    _bufsize = bufsize;
+    _want_names = names;
+    _controllen = controllen;
+    _p = new WritablePacket *[burst];
+    _msgs = new click_mmsghdr[burst];
+    _iov = new struct iovec[burst];
+    _names = names ? new struct sockaddr_storage[burst] : 0;
+    _control = controllen ? new char[burst * controllen] : 0;
+    if (!_p || !_msgs || !_iov || (names && !_names)
+	|| (controllen && !_control)) {
+	cleanup();
+	return -ENOMEM;
+    }
+    for (int i = 0; i < burst; ++i)
+	_p[i] = 0;
+    return 0;
+}
+
+void
+SocketRecvBatch::cleanup()
+{
+    if (_p)
+	for (int i = 0; i < _burst; ++i)
+	    if (_p[i])
+		_p[i]->kill();
+    delete[] _p;
+    delete[] _msgs;
+    delete[] _iov;
+    delete[] _names;
+    delete[] _control;
+    _p = 0;
+    _msgs = 0;
+    _iov = 0;
+    _names = 0;
+    _control = 0;
+    _burst = 0;
+}
+
+int
+SocketRecvBatch::recv(int fd, int flags)
+{
+    int n;
+    for (n = 0; n < _burst; ++n) {
+	if (!_p[n] && !(_p[n] = Packet::make(_headroom, 0, _bufsize, 0)))
+	    break;
+	_iov[n].iov_base = _p[n]->data();
+	_iov[n].iov_len = _bufsize;
+	struct msghdr &h = _msgs[n].msg_hdr;
+	h.msg_name = _want_names ? &_names[n] : 0;
+	h.msg_namelen = _want_names ? sizeof(_names[n]) : 0;
+	h.msg_iov = &_iov[n];
+	h.msg_iovlen = 1;
+	h.msg_control = _controllen ? _control + n * _controllen : 0;
+	h.msg_controllen = _controllen;
+	h.msg_flags = 0;
+    }
+    if (n == 0) {
+	errno = ENOMEM;
+	return -1;
+    }
+
+#if CLICK_HAVE_MMSG
+    return recvmmsg(fd, _msgs, n, flags | MSG_DONTWAIT, 0);
+#else
+    int r;
+    for (r = 0; r < n; ++r) {
+	ssize_t len = recvmsg(fd, &_msgs[r].msg_hdr, flags | MSG_DONTWAIT);
+	if (len < 0)
+	    break;
+	_msgs[r].msg_len = len;
+    }
+    return r ? r : -1;
+#endif
+}
+
+WritablePacket *
+SocketRecvBatch::take(int i, unsigned snaplen)
+{
+    WritablePacket *p = _p[i];
+    _p[i] = 0;
+    unsigned len = _msgs[i].msg_len;
+    unsigned have = (len < _bufsize ? len : _bufsize);
+    if (have > snaplen)
+	have = snaplen;
+    p->take(_bufsize - have);
+    if (len > have)
+	SET_EXTRA_LENGTH_ANNO(p, len - have);
+    return p;
+}
+
+bool
+SocketRecvBatch::timestamp(int i, Timestamp &ts) const
+{
+    struct msghdr *h = const_cast<struct msghdr *>(&_msgs[i].msg_hdr);
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(h); c; c = CMSG_NXTHDR(h, c)) {
+	if (c->cmsg_level != SOL_SOCKET)
+	    continue;
+#ifdef SCM_TIMESTAMPNS
+	if (c->cmsg_type == SCM_TIMESTAMPNS) {
+	    const struct timespec *tv = reinterpret_cast<const struct timespec *>(CMSG_DATA(c));
+	    ts = Timestamp::make_nsec(tv->tv_sec, tv->tv_nsec);
+	    return true;
+	}
+#endif
+#ifdef SCM_TIMESTAMP
+	if (c->cmsg_type == SCM_TIMESTAMP) {
+	    const struct timeval *tv = reinterpret_cast<const struct timeval *>(CMSG_DATA(c));
+	    ts = Timestamp::make_usec(tv->tv_sec, tv->tv_usec);
+	    return true;
+	}
+#endif
+    }
+    return false;
+}
+
+unsigned
+SocketRecvBatch::gro_size(int i) const
+{
+#if defined(__linux__)
+    struct msghdr *h = const_cast<struct msghdr *>(&_msgs[i].msg_hdr);
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(h); c; c = CMSG_NXTHDR(h, c))
+	if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+	    int size;
+	    memcpy(&size, CMSG_DATA(c), sizeof(size));
+	    return size;
+	}
+#else
+    (void) i;
+#endif
+    return 0;
+}
+
+
+SocketSendBatch::SocketSendBatch()
+    : _burst(0), _head(0), _tail(0), _slots(0), _msgs(0), _iov(0),
+      _control(0), _msg_npackets(0)
+{
+}
+
+SocketSendBatch::~SocketSendBatch()
+{
+    cleanup();
+}
+
+int
+SocketSendBatch::initialize(int burst)
+{
+    cleanup();
+    _burst = burst;
+    _slots = new Slot[burst];
+    _msgs = new click_mmsghdr[burst];
+    _iov = new struct iovec[burst];
+    _control = new char[burst * CMSG_SPACE(sizeof(uint16_t))];
+    _msg_npackets = new int[burst];
+    if (!_slots || !_msgs || !_iov || !_control || !_msg_npackets) {
+	cleanup();
+	return -ENOMEM;
+    }
+    return 0;
+}
+
+void
+SocketSendBatch::cleanup()
+{
+    while (!empty())
+	pop_front()->kill();
+    delete[] _slots;
+    delete[] _msgs;
+    delete[] _iov;
+    delete[] _control;
+    delete[] _msg_npackets;
+    _slots = 0;
+    _msgs = 0;
+    _iov = 0;
+    _control = 0;
+    _msg_npackets = 0;
+    _burst = _head = _tail = 0;
+}
+
+void
+SocketSendBatch::push_back(Packet *p, const struct sockaddr *name,
+			   socklen_t namelen)
+{
+    if (_tail == _burst && _head > 0) {
+	memmove(_slots, _slots + _head, (_tail - _head) * sizeof(Slot));
+	_tail -= _head;
+	_head = 0;
+    }
+    assert(_tail < _burst);
+    Slot &s = _slots[_tail++];
+    s.p = p;
+    s.namelen = namelen;
+    if (namelen)
+	memcpy(&s.name, name, namelen);
+}
+
+Packet *
+SocketSendBatch::pop_front()
+{
+    Packet *p = _slots[_head++].p;
+    if (_head == _tail)
+	_head = _tail = 0;
+    return p;
+}
+
+inline bool
+SocketSendBatch::same_name(const Slot &a, const Slot &b) const
+{
+    return a.namelen == b.namelen
+	&& memcmp(&a.name, &b.name, a.namelen) == 0;
+}
+
+int
+SocketSendBatch::send(int fd, bool gso)
+{
+    int nmsg = 0;
+    for (int i = _head; i < _tail; ++nmsg) {
+	Slot &s = _slots[i];
+	struct msghdr &h = _msgs[nmsg].msg_hdr;
+	memset(&h, 0, sizeof(h));
+	h.msg_name = s.namelen ? &s.name : 0;
+	h.msg_namelen = s.namelen;
+	h.msg_iov = &_iov[i - _head];
+	int k = 0;
+	unsigned seg = s.p->length(), total = 0;
+	do {
+	    Packet *p = _slots[i + k].p;
+	    _iov[i - _head + k].iov_base = const_cast<unsigned char *>(p->data());
+	    _iov[i - _head + k].iov_len = p->length();
+	    total += p->length();
+	    ++k;
+	    // every segment but the last must have the first one's length
+	    if (p->length() != seg)
+		break;
+	} while (gso && i + k < _tail && k < 64
+		 && same_name(s, _slots[i + k])
+		 && _slots[i + k].p->length() <= seg
+		 && total + _slots[i + k].p->length() <= 65000);
+	h.msg_iovlen = k;
+#if defined(__linux__)
+	if (k > 1) {
+	    h.msg_control = _control + nmsg * CMSG_SPACE(sizeof(uint16_t));
+	    h.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+	    struct cmsghdr *c = CMSG_FIRSTHDR(&h);
+	    c->cmsg_level = SOL_UDP;
+	    c->cmsg_type = UDP_SEGMENT;
+	    c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	    uint16_t seg16 = seg;
+	    memcpy(CMSG_DATA(c), &seg16, sizeof(seg16));
+	}
+#endif
+	_msg_npackets[nmsg] = k;
+	i += k;
+    }
+
+    int r;
+#if CLICK_HAVE_MMSG
+    r = sendmmsg(fd, _msgs, nmsg, MSG_DONTWAIT);
+#else
+    for (r = 0; r < nmsg; ++r)
+	if (sendmsg(fd, &_msgs[r].msg_hdr, MSG_DONTWAIT) < 0)
+	    break;
+    if (r == 0)
+	r = -1;
+#endif
+    if (r < 0)
+	return -errno;
+    int npackets = 0;
+    for (int m = 0; m < r; ++m)
+	npackets += _msg_npackets[m];
+    return npackets;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+ELEMENT_PROVIDES(SocketBatch)
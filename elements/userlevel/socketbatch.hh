@@ -0,0 +1,135 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_SOCKETBATCH_HH
+#define CLICK_SOCKETBATCH_HH 1
+#include <click/packet.hh>
+#include <click/timestamp.hh>
+#include <sys/types.h>
+#include <sys/socket.h>
+CLICK_DECLS
+
+/* Batched datagram I/O.  On Linux, a whole burst is read with one
+ * recvmmsg() or written with one sendmmsg(); elsewhere, the batch is handled
+ * with one recvmsg() or sendmsg() per packet, so elements can use these
+ * classes unconditionally.
+ *
+ * SocketRecvBatch keeps a preallocated Packet for every slot.  After recv()
+ * returns n, take(0) ... take(n-1) hand the received packets to the caller;
+ * the next recv() replaces the taken Packets.  copy() instead copies data
+ * out, leaving the slot's Packet to be reused.
+ *
+ * SocketSendBatch is a queue of packets waiting to be sent, each with an
+ * optional destination address.  send() writes as many as the socket
+ * accepts and leaves the rest queued; the caller disposes of sent packets
+ * with pop_front(). */
+
+#if defined(__linux__)
+# define CLICK_HAVE_MMSG 1
+typedef struct mmsghdr click_mmsghdr;
+#else
+struct click_mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned msg_len;
+};
+#endif
+
+class SocketRecvBatch { public:
+
+    SocketRecvBatch();
+    ~SocketRecvBatch();
+
+    // Allocate @a burst slots of @a bufsize bytes after @a headroom.  If
+    // @a names, record each datagram's source address; @a controllen
+    // bytes of ancillary data are available per slot.
+    int initialize(int burst, unsigned headroom, unsigned bufsize,
+		   bool names, unsigned controllen);
+    void cleanup();
+
+    int burst() const			{ return _burst; }
+
+    // Receive up to burst() datagrams without blocking.  Returns the number
+    // received, or -1 with errno set.
+    int recv(int fd, int flags = 0);
+
+    // Return received packet @a i, trimmed to its length (at most
+    // @a snaplen, the rest being counted in the extra length annotation).
+    WritablePacket *take(int i, unsigned snaplen);
+    // Return a new packet holding @a len bytes of received packet @a i,
+    // starting at @a offset.  The received packet stays in its slot.
+    WritablePacket *copy(int i, unsigned offset, unsigned len) const {
+	return Packet::make(_headroom, _p[i]->data() + offset, len, 0);
+    }
+
+    unsigned length(int i) const	{ return _msgs[i].msg_len; }
+    const struct sockaddr *name(int i) const {
+	return reinterpret_cast<const struct sockaddr *>(&_names[i]);
+    }
+    socklen_t namelen(int i) const	{ return _msgs[i].msg_hdr.msg_namelen; }
+    struct msghdr *hdr(int i)		{ return &_msgs[i].msg_hdr; }
+
+    // Set @a ts from a SO_TIMESTAMP or SO_TIMESTAMPNS control message.
+    bool timestamp(int i, Timestamp &ts) const;
+    // Return the segment size from a UDP_GRO control message, or 0.
+    unsigned gro_size(int i) const;
+
+  private:
+
+    int _burst;
+    unsigned _headroom;
+    unsigned _bufsize;
+    unsigned _controllen;
+    bool _want_names;
+    WritablePacket **_p;
+    click_mmsghdr *_msgs;
+    struct iovec *_iov;
+    struct sockaddr_storage *_names;
+    char *_control;
+
+};
+
+class SocketSendBatch { public:
+
+    SocketSendBatch();
+    ~SocketSendBatch();
+
+    int initialize(int burst);
+    void cleanup();
+
+    bool empty() const			{ return _head == _tail; }
+    bool full() const			{ return _tail - _head == _burst; }
+    int size() const			{ return _tail - _head; }
+    Packet *front() const		{ return _slots[_head].p; }
+
+    void push_back(Packet *p, const struct sockaddr *name = 0,
+		   socklen_t namelen = 0);
+    Packet *pop_front();
+
+    // Send queued packets without blocking.  Returns the number of packets
+    // at the front that were sent, which the caller should pop_front(), or
+    // -errno if the first packet could not be sent.  If @a gso, runs of
+    // UDP packets with the same destination and length are sent as one
+    // UDP_SEGMENT message.
+    int send(int fd, bool gso = false);
+
+  private:
+
+    struct Slot {
+	Packet *p;
+	socklen_t namelen;
+	struct sockaddr_storage name;
+    };
+
+    int _burst;
+    int _head;
+    int _tail;
+    Slot *_slots;
+    click_mmsghdr *_msgs;
+    struct iovec *_iov;
+    char *_control;
+    int *_msg_npackets;
+
+    inline bool same_name(const Slot &a, const Slot &b) const;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -71,6 +71,13 @@ ToDevice::ToDevice()
     _fd = -1;
     _my_fd = false;
 #endif
+#if TODEVICE_ALLOW_RING
+    _ring = 0;
+#endif
+#if TODEVICE_ALLOW_XDP
+    _xdp = 0;
+    _my_xdp = false;
+#endif
 }
 
 ToDevice::~ToDevice()
@@ -82,11 +89,17 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     String method;
     _burst = 1;
+    uint32_t ring_frames = 256, ring_frame_size = 2048, queue = 0, nqueues = 1;
+    bool has_queue;
     if (Args(conf, this, errh)
 	.read_mp("DEVNAME", _ifname)
 	.read("DEBUG", _debug)
 	.read("METHOD", WordArg(), method)
 	.read("BURST", _burst)
+	.read("RING_FRAMES", ring_frames)
+	.read("RING_FRAME_SIZE", ring_frame_size)
+	.read("QUEUE", queue).read_status(has_queue)
+	.read("N_QUEUES", nqueues)
 	.complete() < 0)
 	return -1;
     if (!_ifname)
@@ -109,6 +122,14 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     else if (method == "LINUX")
 	_method = method_linux;
 #endif
+#if TODEVICE_ALLOW_RING
+    else if (method == "RING")
+	_method = method_ring;
+#endif
+#if TODEVICE_ALLOW_XDP
+    else if (method == "XDP")
+	_method = method_xdp;
+#endif
 #if TODEVICE_ALLOW_DEVBPF
     else if (method == "DEVBPF")
 	_method = method_devbpf;
@@ -124,6 +145,22 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     else
 	return errh->error("bad METHOD");
 
+#if TODEVICE_ALLOW_RING
+    if (ring_frames == 0)
+	return errh->error("RING_FRAMES out of range");
+    _ring_frames = ring_frames;
+    _ring_frame_size = ring_frame_size;
+#endif
+#if TODEVICE_ALLOW_XDP
+    _xdp_queue = queue;
+#endif
+#if TODEVICE_ALLOW_NETMAP
+    if (nqueues == 0 || (nqueues > 1 && !has_queue))
+	return errh->error("N_QUEUES requires QUEUE");
+    _netmap_queue = has_queue ? (int) queue : -1;
+    _netmap_nqueues = (has_queue ? nqueues : 1);
+    _netmap_cur = 0;
+#endif
     return 0;
 }
 
@@ -157,26 +194,47 @@ ToDevice::initialize(ErrorHandler *errh)
 #if FROMDEVICE_ALLOW_LINUX && TODEVICE_ALLOW_LINUX
 	if (fd->linux_fd() >= 0)
 	    _method = method_linux;
+#endif
+#if FROMDEVICE_ALLOW_XDP && TODEVICE_ALLOW_XDP
+	if (fd->xdp() && (int) _xdp_queue == fd->xdp()->queue())
+	    _method = method_xdp;
 #endif
     }
 
 #if TODEVICE_ALLOW_NETMAP
     // first choice is netmap by default
     if (_method == method_default || _method == method_netmap) {
-	if (fd && fd->netmap()) { // fromdevice already open, reuse
+	if (fd && fd->netmap() && fd->netmap_queue() == _netmap_queue
+	    && fd->netmap()->size() == _netmap_nqueues) {
+	    // fromdevice already open on the same rings, reuse
 	    _fd = fd->fd();
 	    _netmap = *fd->netmap();
 	} else {
-	    _fd = _netmap.open(_ifname, _method == method_netmap, errh);
-	    if (_fd >= 0) {
+	    _netmap.resize(_netmap_nqueues);
+	    for (int i = 0; i < _netmap_nqueues; ++i) {
+		int nfd = _netmap[i].open(_ifname, _netmap_queue < 0 ? -1 : _netmap_queue + i,
+					  0, _method == method_netmap, errh);
+		if (nfd < 0) {
+		    while (--i >= 0) {
+			remove_select(_netmap[i].fd, SELECT_READ);
+			_netmap[i].close(_netmap[i].fd);
+		    }
+		    _netmap.clear();
+		    if (_method == method_netmap)
+			return -1; // fail
+		    break;
+		}
+		add_select(nfd, SELECT_READ); // NB NOT writable!
+	    }
+	    if (_netmap.size()) {
+		_fd = _netmap[0].fd;
 		_my_fd = true;
-		add_select(_fd, SELECT_READ); // NB NOT writable!
-	    } else if (_method == method_netmap)
-		return -1; // fail
+	    }
 	}
 	if (_fd >= 0) {
 	    _method = method_netmap;
-	    _netmap.initialize_rings_tx(); // no-op
+	    for (int i = 0; i < _netmap.size(); ++i)
+		_netmap[i].initialize_rings_tx(); // no-op
 	}
     }
 #endif
@@ -232,10 +290,42 @@ ToDevice::initialize(ErrorHandler *errh)
 		return -1;
 	    _my_fd = true;
 	}
+	if (_burst > 1 && _linux_batch.initialize(_burst) < 0)
+	    return errh->error("out of memory");
 	_method = method_linux;
     }
 #endif
 
+#if TODEVICE_ALLOW_RING
+    if (_method == method_ring) {
+	// a socket has one ring version, so never share FromDevice's
+	_fd = FromDevice::open_packet_socket(_ifname, errh);
+	if (_fd < 0)
+	    return -1;
+	_my_fd = true;
+	PrefixErrorHandler perrh(errh, _ifname + ": ");
+	if (!(_ring = PacketRing::open_tx(_fd, _ring_frame_size, _ring_frames, &perrh)))
+	    return -1;
+    }
+#endif
+
+#if TODEVICE_ALLOW_XDP
+    if (_method == method_xdp) {
+	// a queue can have only one socket, so share FromDevice's
+	if (fd && fd->xdp() && (int) _xdp_queue == fd->xdp()->queue())
+	    _xdp = fd->xdp();
+	else {
+	    PrefixErrorHandler perrh(errh, _ifname + ": ");
+	    _xdp = XDPSocket::open(_ifname, _xdp_queue, false, XDPSocket::mode_auto,
+				   XDPSocket::copy_auto, 4096, 0, &perrh);
+	    if (!_xdp)
+		return -1;
+	    _my_xdp = true;
+	}
+	_fd = _xdp->fd();
+    }
+#endif
+
 #if TODEVICE_ALLOW_PCAPFD
     if (_method == method_default || _method == method_pcapfd) {
 	FromDevice *fd = find_fromdevice();
@@ -268,10 +358,27 @@ ToDevice::cleanup(CleanupStage)
 #endif
 #if TODEVICE_ALLOW_NETMAP
     if (_fd >= 0 && _my_fd && _method == method_netmap) {
-	_netmap.close(_fd); // XXX _fd is not really needed
+	for (int i = 0; i < _netmap.size(); ++i) {
+	    remove_select(_netmap[i].fd, SELECT_READ | SELECT_WRITE);
+	    _netmap[i].close(_netmap[i].fd);
+	}
+	_netmap.clear();
 	_fd = -1;
     }
 #endif
+#if TODEVICE_ALLOW_RING
+    if (_ring)
+	_ring->close();
+    _ring = 0;
+#endif
+#if TODEVICE_ALLOW_XDP
+    if (_xdp && _my_xdp)
+	_xdp->close();
+    _xdp = 0;
+#endif
+#if TODEVICE_ALLOW_LINUX
+    _linux_batch.cleanup();
+#endif
 #if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD || TODEVICE_ALLOW_NETMAP
     if (_fd >= 0 && _my_fd)
 	close(_fd);
@@ -298,11 +405,17 @@ ToDevice::send_packet(Packet *p)
 
 #if TODEVICE_ALLOW_NETMAP
     if (_method == method_netmap) {
-	if (_netmap.send_packet(p, noutputs())) { // fail
-	    errno = ENOBUFS;
+	// try each bound port in turn, starting with the last that had room
+	r = -EAGAIN;
+	for (int i = 0; i < _netmap.size() && r == -EAGAIN; ++i) {
+	    r = _netmap[_netmap_cur].send_packet(p, noutputs());
+	    if (r == -EAGAIN && ++_netmap_cur == _netmap.size())
+		_netmap_cur = 0;
+	}
+	if (r < 0) {
+	    errno = -r;
 	    r = -1;
-	} else
-	    r = 0;
+	}
     }
 #endif
 
@@ -321,6 +434,22 @@ ToDevice::send_packet(Packet *p)
 	r = send(_fd, p->data(), p->length(), 0);
 #endif
 
+#if TODEVICE_ALLOW_RING
+    if (_method == method_ring)
+	if ((r = _ring->tx_packet(p)) < 0) {
+	    errno = -r;
+	    r = -1;
+	}
+#endif
+
+#if TODEVICE_ALLOW_XDP
+    if (_method == method_xdp)
+	if ((r = _xdp->tx_packet(p)) < 0) {
+	    errno = -r;
+	    r = -1;
+	}
+#endif
+
 #if TODEVICE_ALLOW_DEVBPF
     if (_method == method_devbpf)
 	if (write(_fd, p->data(), p->length()) != (ssize_t) p->length())
@@ -339,9 +468,67 @@ ToDevice::send_packet(Packet *p)
 	return errno ? -errno : -EINVAL;
 }
 
+void
+ToDevice::backoff()
+{
+    if (!_backoff) {
+	_backoff = 1;
+	add_select(_fd, SELECT_WRITE);
+    } else {
+	_timer.schedule_after(Timestamp::make_usec(_backoff));
+	if (_backoff < 256)
+	    _backoff *= 2;
+	if (_debug) {
+	    Timestamp now = Timestamp::now();
+	    click_chatter("%p{element} backing off for %d at %p{timestamp}\n", this, _backoff, &now);
+	}
+    }
+}
+
+#if TODEVICE_ALLOW_LINUX
+bool
+ToDevice::run_task_linux()
+{
+    // pull a burst, then send it with one system call
+    int count = 0;
+    while (!_linux_batch.full()) {
+	++_pulls;
+	Packet *p = input(0).pull();
+	if (!p)
+	    break;
+	_linux_batch.push_back(p);
+    }
+
+    while (!_linux_batch.empty()) {
+	int r = _linux_batch.send(_fd);
+	if (r > 0) {
+	    _backoff = 0;
+	    count += r;
+	    while (r-- > 0)
+		checked_output_push(0, _linux_batch.pop_front());
+	} else if (r == -ENOBUFS || r == -EAGAIN) {
+	    backoff();
+	    return count > 0;
+	} else {
+	    click_chatter("ToDevice(%s): %s", _ifname.c_str(), strerror(-r));
+	    checked_output_push(1, _linux_batch.pop_front());
+	}
+    }
+
+    if (_signal)
+	_task.fast_reschedule();
+    return count > 0;
+}
+#endif
+
 bool
 ToDevice::run_task(Task *)
 {
+#if TODEVICE_ALLOW_LINUX
+    if (_method == method_linux && _burst > 1)
+	return run_task_linux();
+#endif
+
     Packet *p = _q;
     _q = 0;
     int count = 0, r = 0;
@@ -361,22 +548,32 @@ ToDevice::run_task(Task *)
 	    break;
     } while (count < _burst);
 
+#if TODEVICE_ALLOW_RING || TODEVICE_ALLOW_XDP || TODEVICE_ALLOW_NETMAP
+    // queued ring frames go out together
+    if (count > 0 || r == -EAGAIN) {
+	int fr = 0;
+# if TODEVICE_ALLOW_NETMAP
+	if (_method == method_netmap)
+	    for (int i = 0; i < _netmap.size() && fr >= 0; ++i)
+		fr = _netmap[i].flush();
+# endif
+# if TODEVICE_ALLOW_RING
+	if (_method == method_ring)
+	    fr = _ring->flush();
+# endif
+# if TODEVICE_ALLOW_XDP
+	if (_method == method_xdp)
+	    fr = _xdp->flush();
+# endif
+	if (fr < 0)
+	    click_chatter("ToDevice(%s): %s", _ifname.c_str(), strerror(-fr));
+    }
+#endif
+
     if (r == -ENOBUFS || r == -EAGAIN) {
 	assert(!_q);
 	_q = p;
-
-	if (!_backoff) {
-	    _backoff = 1;
-	    add_select(_fd, SELECT_WRITE);
-	} else {
-	    _timer.schedule_after(Timestamp::make_usec(_backoff));
-	    if (_backoff < 256)
-		_backoff *= 2;
-	    if (_debug) {
-		Timestamp now = Timestamp::now();
-		click_chatter("%p{element} backing off for %d at %p{timestamp}\n", this, _backoff, &now);
-	    }
-	}
+	backoff();
 	return count > 0;
     } else if (r < 0) {
 	click_chatter("ToDevice(%s): %s", _ifname.c_str(), strerror(-r));
@@ -409,6 +606,10 @@ ToDevice::read_param(Element *e, void *thunk)
 	return String(td->_pulls);
     case h_q:
 	return String((bool) td->_q);
+#if TODEVICE_ALLOW_RING
+    case h_ring_rejects:
+	return td->_ring ? String(td->_ring->tx_rejects()) : String("??");
+#endif
     default:
 	return String();
     }
@@ -441,8 +642,12 @@ ToDevice::add_handlers()
     add_read_handler("signal", read_param, h_signal);
     add_read_handler("q", read_param, h_q);
     add_write_handler("debug", write_param, h_debug);
+#if TODEVICE_ALLOW_RING
+    if (_method == method_ring)
+	add_read_handler("ring_rejects", read_param, h_ring_rejects);
+#endif
 }
 
 CLICK_ENDDECLS
-ELEMENT_REQUIRES(FromDevice userlevel)
+ELEMENT_REQUIRES(FromDevice PacketRing XDPSocket SocketBatch userlevel)
 EXPORT_ELEMENT(ToDevice)
@@ -28,16 +28,54 @@ CLICK_DECLS
  *
  * =item BURST
  *
- * Integer. Maximum number of packets to pull per scheduling. Defaults to 1.
+ * Integer. Maximum number of packets to pull per scheduling. METHOD LINUX
+ * sends the whole burst with one sendmmsg system call. Defaults to 1.
  *
  * =item METHOD
  *
  * Word. Defines the method ToDevice will use to write packets to the
- * device. Linux targets generally support PCAP and LINUX; other targets
- * support PCAP or, occasionally, other methods. Defaults to the method
+ * device. Linux targets generally support PCAP, LINUX, RING, and XDP; other
+ * targets support PCAP or, occasionally, other methods. Defaults to the method
  * specified for a matching L<FromDevice(n)>, or the first supported
  * method among NETMAP, PCAP, DEVBPF, LINUX and PCAPFD otherwise.
  *
+ * METHOD RING copies packets into a memory-mapped PACKET_MMAP transmit ring
+ * (TPACKET_V2) and hands the kernel a whole burst with one system call.  It
+ * uses its own packet socket, even if a FromDevice reads the same device.
+ *
+ * METHOD NETMAP, available when Click is built with netmap, sends packets on
+ * the netmap rings of a port such as C<netmap:eth0>; see QUEUE and N_QUEUES.
+ * If a FromDevice with METHOD NETMAP reads the same rings, ToDevice shares
+ * its ports. Packets received by such a FromDevice with ZEROCOPY true are
+ * sent without copying when ToDevice has no outputs: the packet's buffer is
+ * swapped into the transmit ring.
+ *
+ * METHOD XDP sends packets through an AF_XDP socket bound to one device queue
+ * (see QUEUE), copying each packet into a UMEM frame.  If a FromDevice with
+ * METHOD XDP reads the same device and queue, ToDevice shares its socket;
+ * otherwise it opens a send-only socket.
+ *
+ * =item QUEUE
+ *
+ * Unsigned. The device queue to send on. Only affects METHOD XDP and NETMAP.
+ * Defaults to 0 for METHOD XDP; METHOD NETMAP sends on all rings by default.
+ *
+ * =item N_QUEUES
+ *
+ * Unsigned. With METHOD NETMAP, send on the N_QUEUES rings starting at QUEUE,
+ * moving to the next ring when one is full. Defaults to 1.
+ *
+ * =item RING_FRAMES
+ *
+ * Unsigned. Number of frames in the transmit ring. Only affects METHOD RING.
+ * Defaults to 256.
+ *
+ * =item RING_FRAME_SIZE
+ *
+ * Unsigned. Size of each transmit ring frame in bytes; must be a power of
+ * two. Longer packets cannot be sent and are pushed out output 1. Only
+ * affects METHOD RING. Defaults to 2048.
+ *
  * =item DEBUG
  *
  * Boolean.  If true, print out debug messages.
@@ -62,12 +100,23 @@ CLICK_DECLS
  * KernelTun lets you send IP packets to the host kernel's IP processing code,
  * sort of like the kernel module's ToHost element.
  *
+ * =h ring_rejects read-only
+ *
+ * Returns the number of frames the kernel rejected as malformed.  Only
+ * available for METHOD RING.
+ *
  * =a
  * FromDevice.u, FromDump, ToDump, KernelTun, ToDevice(n) */
 
 #if defined(__linux__)
 # define TODEVICE_ALLOW_LINUX 1
 #endif
+#if FROMDEVICE_ALLOW_RING
+# define TODEVICE_ALLOW_RING 1
+#endif
+#if FROMDEVICE_ALLOW_XDP
+# define TODEVICE_ALLOW_XDP 1
+#endif
 #if HAVE_PCAP && (HAVE_PCAP_INJECT || HAVE_PCAP_SENDPACKET)
 extern "C" {
 # include <pcap.h>
@@ -118,9 +167,26 @@ class ToDevice : public Element { public:
     int _fd;
 #endif
 #if TODEVICE_ALLOW_NETMAP
-    NetmapInfo _netmap;
+    Vector<NetmapInfo> _netmap;
+    int _netmap_queue;
+    int _netmap_nqueues;
+    int _netmap_cur;
 #endif
-    enum { method_default, method_netmap, method_linux, method_pcap, method_devbpf, method_pcapfd };
+#if TODEVICE_ALLOW_LINUX
+    SocketSendBatch _linux_batch;
+#endif
+#if TODEVICE_ALLOW_RING
+    PacketRing *_ring;
+    uint32_t _ring_frames;
+    uint32_t _ring_frame_size;
+#endif
+#if TODEVICE_ALLOW_XDP
+    XDPSocket *_xdp;
+    bool _my_xdp;
+    uint32_t _xdp_queue;
+#endif
+
+    enum { method_default, method_netmap, method_linux, method_pcap, method_devbpf, method_pcapfd, method_ring, method_xdp };
     int _method;
     NotifierSignal _signal;
 
@@ -137,9 +203,13 @@ class ToDevice : public Element { public:
     int _backoff;
     int _pulls;
 
-    enum { h_debug, h_signal, h_pulls, h_q };
+    enum { h_debug, h_signal, h_pulls, h_q, h_ring_rejects };
     FromDevice *find_fromdevice() const;
     int send_packet(Packet *p);
+    void backoff();
+#if TODEVICE_ALLOW_LINUX
+    bool run_task_linux();
+#endif
     static int write_param(const String &in_s, Element *e, void *vparam, ErrorHandler *errh) CLICK_COLD;
     static String read_param(Element *e, void *thunk) CLICK_COLD;
 
@@ -31,10 +31,11 @@
 #include <click/packet_anno.hh>
 #include "fakepcap.hh"
 #include <click/userutils.hh>
+#include <click/straccum.hh>
 CLICK_DECLS
 
 ToDump::ToDump()
-    : _fp(0), _count(0), _task(this), _use_encap_from(0)
+    : _fp(0), _next_input(0), _count(0), _task(this), _use_encap_from(0)
 {
 }
 
@@ -47,6 +48,8 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     String encap_type;
     String use_encap_from;
+    String format = "pcap";
+    String annotations;
     _snaplen = 2000;
     _extra_length = true;
     _unbuffered = false;
@@ -61,6 +64,8 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("USE_ENCAP_FROM", AnyArg(), use_encap_from)
 	.read("EXTRA_LENGTH", _extra_length)
 	.read("UNBUFFERED", _unbuffered)
+	.read("FORMAT", WordArg(), format)
+	.read("ANNOTATIONS", AnyArg(), annotations)
 #if CLICK_NS
 	.read("PER_NODE", per_node)
 #endif
@@ -70,6 +75,38 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
     if (_snaplen == 0)
 	_snaplen = 0xFFFFFFFFU;
 
+    if (format == "pcap")
+	_pcapng = false;
+    else if (format == "pcapng")
+	_pcapng = true;
+    else
+	return errh->error("bad FORMAT");
+    if (!_pcapng && ninputs() > 1)
+	return errh->error("multiple inputs require %<FORMAT pcapng%>");
+    if (!_pcapng && annotations)
+	return errh->error("ANNOTATIONS requires %<FORMAT pcapng%>");
+
+    Vector<String> words;
+    cp_spacevec(annotations, words);
+    _annos.clear();
+    _anno_names = String();
+    _anno_length = 0;
+    for (String *w = words.begin(); w != words.end(); ++w) {
+	int anno;
+	if (!AnnoArg(0).parse(*w, anno, this))
+	    return errh->error("bad annotation %<%s%>", w->c_str());
+	if (ANNOTATIONINFO_SIZE(anno) == 0)
+	    return errh->error("annotation %<%s%> has no fixed size", w->c_str());
+	if (find(_annos.begin(), _annos.end(), anno) != _annos.end())
+	    return errh->error("annotation %<%s%> listed twice", w->c_str());
+	_annos.push_back(anno);
+	_anno_names += " " + *w;
+	_anno_length += ANNOTATIONINFO_SIZE(anno);
+    }
+    // write_pcapng_packet's option buffer holds at most anno_size bytes
+    if (_anno_length > Packet::anno_size)
+	return errh->error("ANNOTATIONS too long");
+
     if (use_encap_from && encap_type)
 	return errh->error("specify at most one of 'ENCAP' and 'USE_ENCAP_FROM'");
     else if (use_encap_from) {
@@ -124,11 +161,15 @@ ToDump::initialize(ErrorHandler *errh)
 		return errh->error("%<%p{element}%> has no %<encap%> read handler", _use_encap_from[i]);
 	    encap_types.push_back(cp_uncomment(h->call_read(_use_encap_from[i])));
 	}
-	// parse encap types
+	// parse encap types; pcap-ng may have one per input
+	bool per_input = _pcapng && encap_types.size() == ninputs();
+	_linktypes.clear();
 	for (int i = 0; i < encap_types.size(); i++) {
 	    int et = fake_pcap_parse_dlt(encap_types[i]);
 	    if (et < 0)
 		return errh->error("%<%p{element}.encap%> did not return a valid encapsulation type", _use_encap_from[i]);
+	    else if (per_input)
+		_linktypes.push_back(et);
 	    else if (_linktype >= 0 && et != _linktype) {
 		errh->error("source encapsulation types disagree:");
 		for (int j = 0; j < encap_types.size(); j++)
@@ -137,7 +178,11 @@ ToDump::initialize(ErrorHandler *errh)
 	    } else
 		_linktype = et;
 	}
+	if (per_input)
+	    _linktype = _linktypes[0];
     }
+    if (_pcapng && _linktypes.empty())
+	_linktypes.assign(ninputs(), _linktype);
 
     // skip initialization if we're hotswapping later
     if (!hotswap_element()) {
@@ -159,26 +204,34 @@ ToDump::initialize(ErrorHandler *errh)
 	if (_unbuffered)
 	    setvbuf(_fp, (char *) 0, _IONBF, 0);
 
-	struct fake_pcap_file_header h;
+	if (_pcapng) {
+	    if (write_pcapng_header(errh) < 0)
+		return -1;
+	} else {
+	    struct fake_pcap_file_header h;
 
-	h.magic = FAKE_PCAP_MAGIC;
-	h.version_major = FAKE_PCAP_VERSION_MAJOR;
-	h.version_minor = FAKE_PCAP_VERSION_MINOR;
+	    h.magic = FAKE_PCAP_MAGIC;
+	    h.version_major = FAKE_PCAP_VERSION_MAJOR;
+	    h.version_minor = FAKE_PCAP_VERSION_MINOR;
 
-	h.thiszone = 0;		// timestamps are in GMT
-	h.sigfigs = 0;		// XXX accuracy of timestamps?
-	h.snaplen = _snaplen;
-	h.linktype = _linktype;
+	    h.thiszone = 0;		// timestamps are in GMT
+	    h.sigfigs = 0;		// XXX accuracy of timestamps?
+	    h.snaplen = _snaplen;
+	    h.linktype = _linktype;
 
-	size_t wrote_header = fwrite(&h, sizeof(h), 1, _fp);
-	if (wrote_header != 1)
-	    return errh->error("%s: unable to write file header", _filename.c_str());
+	    size_t wrote_header = fwrite(&h, sizeof(h), 1, _fp);
+	    if (wrote_header != 1)
+		return errh->error("%s: unable to write file header", _filename.c_str());
+	}
     }
 
     if (input_is_pull(0) && noutputs() == 0) {
 	ScheduleInfo::join_scheduler(this, &_task, errh);
 	_signal = Notifier::upstream_empty_signal(this, 0, &_task);
-    }
+	for (int i = 1; i < ninputs(); i++)
+	    _signal += Notifier::upstream_empty_signal(this, i, &_task);
+    } else if (input_is_pull(0) && ninputs() > 1)
+	return errh->error("pull ToDump with an output must have one input");
     _active = true;
     return 0;
 }
@@ -199,9 +252,144 @@ ToDump::cleanup(CleanupStage)
     _fp = 0;
 }
 
+static void
+append_pcapng_option(StringAccum &sa, int code, const void *data, int len)
+{
+    fake_pcapng_option_header oh;
+    oh.code = code;
+    oh.length = len;
+    sa.append(reinterpret_cast<const char *>(&oh), sizeof(oh));
+    sa.append(reinterpret_cast<const char *>(data), len);
+    sa.append_fill(0, (4 - (len & 3)) & 3);
+}
+
+static void
+append_pcapng_block(StringAccum &sa, uint32_t type, const StringAccum &body)
+{
+    fake_pcapng_block_header bh;
+    bh.type = type;
+    bh.length = sizeof(bh) + body.length() + 4;
+    sa.append(reinterpret_cast<const char *>(&bh), sizeof(bh));
+    sa.append(body.data(), body.length());
+    sa.append(reinterpret_cast<const char *>(&bh.length), 4);
+}
+
+int
+ToDump::write_pcapng_header(ErrorHandler *errh)
+{
+    StringAccum sa, body;
+    uint32_t pen = FAKE_PCAPNG_CLICK_PEN;
+
+    // section header, naming the recorded annotations
+    fake_pcapng_section_header sh;
+    sh.byte_order_magic = FAKE_PCAPNG_BYTE_ORDER_MAGIC;
+    sh.version_major = FAKE_PCAPNG_VERSION_MAJOR;
+    sh.version_minor = FAKE_PCAPNG_VERSION_MINOR;
+    sh.section_length[0] = sh.section_length[1] = 0xFFFFFFFFU;
+    body.append(reinterpret_cast<const char *>(&sh), sizeof(sh));
+    String userappl = "Click " CLICK_VERSION;
+    append_pcapng_option(body, FAKE_PCAPNG_OPT_SHB_USERAPPL, userappl.data(), userappl.length());
+    if (_annos.size()) {
+	String annos = String::make_uninitialized(4) + "annotations" + _anno_names;
+	memcpy(annos.mutable_data(), &pen, 4);
+	append_pcapng_option(body, FAKE_PCAPNG_OPT_CUSTOM_STRING, annos.data(), annos.length());
+    }
+    append_pcapng_option(body, FAKE_PCAPNG_OPT_ENDOFOPT, 0, 0);
+    append_pcapng_block(sa, FAKE_PCAPNG_SHB, body);
+
+    // one interface per input port
+    for (int i = 0; i < ninputs(); i++) {
+	body.clear();
+	fake_pcapng_interface_description id;
+	id.linktype = _linktypes[i];
+	id.reserved = 0;
+	id.snaplen = (_snaplen == 0xFFFFFFFFU ? 0 : _snaplen);
+	body.append(reinterpret_cast<const char *>(&id), sizeof(id));
+	if (_use_encap_from && _linktypes.size() > 1) {
+	    String name = _use_encap_from[i]->name();
+	    append_pcapng_option(body, FAKE_PCAPNG_OPT_IF_NAME, name.data(), name.length());
+	}
+	uint8_t tsresol = 9;	// nanoseconds
+	append_pcapng_option(body, FAKE_PCAPNG_OPT_IF_TSRESOL, &tsresol, 1);
+	append_pcapng_option(body, FAKE_PCAPNG_OPT_ENDOFOPT, 0, 0);
+	append_pcapng_block(sa, FAKE_PCAPNG_IDB, body);
+    }
+
+    if (fwrite(sa.data(), 1, sa.length(), _fp) != (size_t) sa.length())
+	return errh->error("%s: unable to write file header", _filename.c_str());
+    return 0;
+}
+
+void
+ToDump::write_pcapng_packet(Packet *p, int port)
+{
+    struct {
+	fake_pcapng_block_header bh;
+	fake_pcapng_enhanced_packet ep;
+    } h;
+    static const uint8_t zeros[4] = { 0, 0, 0, 0 };
+
+    Timestamp ts = p->timestamp_anno();
+    if (!ts)
+	ts = Timestamp::now();
+    uint64_t t = (uint64_t) ts.sec() * 1000000000 + ts.nsec();
+
+    unsigned to_write = p->length();
+    h.ep.interface_id = port;
+    h.ep.timestamp_high = t >> 32;
+    h.ep.timestamp_low = t;
+    h.ep.len = to_write + (_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
+    if (_snaplen && to_write > _snaplen)
+	to_write = _snaplen;
+    h.ep.caplen = to_write;
+    unsigned pad = (4 - (to_write & 3)) & 3;
+
+    // annotation option: header, enterprise number, annotation bytes,
+    // padding, end of options
+    uint8_t opt[sizeof(fake_pcapng_option_header) + 4 + Packet::anno_size + 3 + 4];
+    unsigned optlen = 0;
+    if (_anno_length) {
+	fake_pcapng_option_header oh;
+	oh.code = FAKE_PCAPNG_OPT_CUSTOM_BINARY;
+	oh.length = 4 + _anno_length;
+	uint32_t pen = FAKE_PCAPNG_CLICK_PEN;
+	memcpy(opt, &oh, sizeof(oh));
+	memcpy(opt + sizeof(oh), &pen, 4);
+	optlen = sizeof(oh) + 4;
+	for (int *a = _annos.begin(); a != _annos.end(); ++a) {
+	    memcpy(opt + optlen, p->anno_u8() + ANNOTATIONINFO_OFFSET(*a), ANNOTATIONINFO_SIZE(*a));
+	    optlen += ANNOTATIONINFO_SIZE(*a);
+	}
+	while (optlen & 3)
+	    opt[optlen++] = 0;
+	memset(opt + optlen, 0, 4);
+	optlen += 4;
+    }
+
+    h.bh.type = FAKE_PCAPNG_EPB;
+    h.bh.length = sizeof(h) + to_write + pad + optlen + 4;
+
+    if (fwrite(&h, sizeof(h), 1, _fp) == 0
+	|| (to_write > 0 && fwrite(p->data(), 1, to_write, _fp) == 0)
+	|| (pad > 0 && fwrite(zeros, 1, pad, _fp) == 0)
+	|| (optlen > 0 && fwrite(opt, 1, optlen, _fp) == 0)
+	|| fwrite(&h.bh.length, 4, 1, _fp) == 0) {
+	if (errno != EAGAIN) {
+	    _active = false;
+	    click_chatter("ToDump(%s): %s", _filename.c_str(), strerror(errno));
+	}
+    } else
+	_count++;
+}
+
 void
-ToDump::write_packet(Packet *p)
+ToDump::write_packet(Packet *p, int port)
 {
+    if (_pcapng) {
+	write_pcapng_packet(p, port);
+	return;
+    }
+
     struct fake_pcap_pkthdr ph;
 
     const Timestamp& ts = p->timestamp_anno();
@@ -232,10 +420,10 @@ ToDump::write_packet(Packet *p)
 }
 
 void
-ToDump::push(int, Packet *p)
+ToDump::push(int port, Packet *p)
 {
     if (_active)
-	write_packet(p);
+	write_packet(p, port);
     checked_output_push(0, p);
 }
 
@@ -244,7 +432,7 @@ ToDump::pull(int)
 {
     Packet *p = input(0).pull();
     if (_active && p)
-	write_packet(p);
+	write_packet(p, 0);
     return p;
 }
 
@@ -253,11 +441,17 @@ ToDump::run_task(Task *)
 {
     if (!_active)
 	return false;
-    Packet *p = input(0).pull();
-    if (p) {
-	write_packet(p);
+    Packet *p = 0;
+    for (int i = 0; i < ninputs() && !p; i++) {
+	int port = _next_input;
+	if (++_next_input == ninputs())
+	    _next_input = 0;
+	if ((p = input(port).pull()))
+	    write_packet(p, port);
+    }
+    if (p)
 	p->kill();
-    } else if (!_signal)
+    else if (!_signal)
 	return false;
     _task.fast_reschedule();
     return p != 0;
@@ -11,7 +11,7 @@ CLICK_DECLS
 /*
 =c
 
-ToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, USE_ENCAP_FROM, EXTRA_LENGTH])
+ToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, USE_ENCAP_FROM, EXTRA_LENGTH, FORMAT, ANNOTATIONS])
 
 =s traces
 
@@ -35,6 +35,14 @@ ToDump may have zero or one output. If it has an output, then it emits all
 received packets on that output. ToDump will schedule itself on the task list
 if it is used as a pull element with no outputs.
 
+With C<FORMAT pcapng>, ToDump writes a pcap-ng file instead.  Each input port
+is described by its own interface block, so ToDump may have more than one
+input, and a reader can tell which port each packet arrived on.  Timestamps
+are written with nanosecond resolution.  The ANNOTATIONS keyword additionally
+stores selected packet annotations with each packet, in a custom option that
+FromDump understands.  Pull inputs with more than one input port are only
+supported when ToDump has no output.
+
 Keyword arguments are:
 
 =over 8
@@ -55,11 +63,27 @@ arguments. If all the handlers agree, ToDump will use that encapsulation type;
 otherwise, it will report an error. You can specify at most one of ENCAP and
 USE_ENCAP_FROM. FromDump and FromDevice.u have `encap' handlers.
 
+With C<FORMAT pcapng>, if USE_ENCAP_FROM lists exactly one element per input
+port, then each interface block takes its encapsulation type and name from the
+corresponding element, and the encapsulation types need not agree.
+
 =item EXTRA_LENGTH
 
 Boolean. Set to true if you want ToDump to store any extra length as recorded
 in packets' extra length annotations. Default is true.
 
+=item FORMAT
+
+Either C<pcap> or C<pcapng>.  Default is C<pcap>.
+
+=item ANNOTATIONS
+
+Argument is a space-separated list of annotation names, such as C<PAINT> or
+C<AGGREGATE>.  With C<FORMAT pcapng>, ToDump stores these annotations with
+each packet; FromDump restores them.  Only valid with C<FORMAT pcapng>.  Each
+annotation may be listed once, and together they must fit in a packet's
+annotation area.
+
 =item UNBUFFERED
 
 Boolean. Set to true if you want ToDump to use unbuffered IO when saving data to
@@ -96,7 +120,7 @@ class ToDump : public Element { public:
     ~ToDump() CLICK_COLD;
 
     const char *class_name() const	{ return "ToDump"; }
-    const char *port_count() const	{ return "1/0-1"; }
+    const char *port_count() const	{ return "1-/0-1"; }
     const char *flags() const		{ return "S2"; }
 
     // configure after FromDevice and FromDump
@@ -121,6 +145,12 @@ class ToDump : public Element { public:
     bool _active;
     bool _extra_length;
     bool _unbuffered;
+    bool _pcapng;
+    Vector<int> _linktypes;	// per input, pcap-ng only
+    Vector<int> _annos;		// annotation infos, pcap-ng only
+    String _anno_names;
+    int _anno_length;
+    int _next_input;
 
 #if HAVE_INT64_TYPES
     typedef uint64_t counter_t;
@@ -135,7 +165,9 @@ class ToDump : public Element { public:
 
     static String read_handler(Element *, void *) CLICK_COLD;
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
-    void write_packet(Packet *);
+    int write_pcapng_header(ErrorHandler *);
+    void write_packet(Packet *, int port);
+    void write_pcapng_packet(Packet *, int port);
 
 };
 
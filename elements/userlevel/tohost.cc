@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 
 #include <net/if.h>
@@ -39,7 +40,7 @@
 CLICK_DECLS
 
 ToHost::ToHost()
-    : _fd(-1), _drops(0)
+    : _fd(-1), _drops(0), _printed_write_err(false)
 {
 }
 
@@ -83,22 +84,25 @@ ToHost::push(int, Packet *p)
 	return;
     }
 
-    // 2-byte padding followed by an Ethernet type
-    WritablePacket *q = p->push(4);
-    if (q) {
-	click_ether *e = (click_ether *) (p->data() + 4);
-	*(uint32_t *)(q->data()) = e->ether_type;
+    // 2-byte padding followed by an Ethernet type, gathered from a separate
+    // buffer so shared packets are written without a copy
+    const click_ether *e = reinterpret_cast<const click_ether *>(p->data());
+    uint16_t pi[2] = { 0, e->ether_type };
+    struct iovec iov[2];
+    iov[0].iov_base = pi;
+    iov[0].iov_len = sizeof(pi);
+    iov[1].iov_base = const_cast<unsigned char *>(p->data());
+    iov[1].iov_len = p->length();
 
-	int w = write(_fd, q->data(), q->length());
-	static bool _printed_write_err = false;
-	if (w != (int) q->length() && (errno != ENOBUFS || !_printed_write_err)) {
+    int w = writev(_fd, iov, 2);
+    if (w != (int) (p->length() + sizeof(pi))) {
+	++_drops;
+	if (errno != ENOBUFS || !_printed_write_err) {
 	    _printed_write_err = true;
-	    ++_drops;
 	    click_chatter("ToHost(%s): write failed: %s", _dev_name.c_str(), strerror(errno));
 	}
-	q->kill();
-    } else
-	click_chatter("%p{element}: out of memory", this);
+    }
+    p->kill();
 }
 
 void
@@ -29,14 +29,17 @@ CLICK_DECLS
  *
  * ToHost requires an initialized FromHost with the same DEVNAME.
  *
+ * ToHost gathers the packet information header and the packet data in a
+ * single writev(2), so packets are never copied or uniqueified on the way to
+ * the device, even when shared (for instance, after a Tee).
+ *
  * IPv4 packets should have a destination IP address corresponding
  * to DEVNAME, and a routable source address. Otherwise Linux will silently
  * drop the packets.
  *
  * =h drops read-only
  *
- * Reports the number of packets ToHost has dropped because they had a null
- * device annotation.
+ * Reports the number of packets ToHost has failed to write to the device.
  *
  * =a
  *
@@ -64,6 +67,7 @@ class ToHost : public Element { public:
 
     int _fd;
     int _drops;
+    bool _printed_write_err;
     String _dev_name;
 
 };
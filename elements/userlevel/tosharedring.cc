@@ -0,0 +1,102 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * tosharedring.{cc,hh} -- element sends packets through a shared memory ring
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "tosharedring.hh"
+#include "sharedring.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+ToSharedRing::ToSharedRing()
+    : _sr(0), _count(0), _drops(0)
+{
+}
+
+ToSharedRing::~ToSharedRing()
+{
+}
+
+int
+ToSharedRing::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _ring = 0;
+    _headroom = Packet::default_headroom;
+    _nrings = _capacity = _nbufs = _buf_size = 0;
+    return Args(conf, this, errh)
+	.read_mp("FILENAME", FilenameArg(), _filename)
+	.read_p("RING", _ring)
+	.read("HEADROOM", _headroom)
+	.read("RINGS", _nrings)
+	.read("CAPACITY", _capacity)
+	.read("BUFFERS", _nbufs)
+	.read("BUFFER_SIZE", _buf_size)
+	.complete();
+}
+
+int
+ToSharedRing::initialize(ErrorHandler *errh)
+{
+    if (!(_sr = SharedRing::open(_filename, _nrings, _capacity, _nbufs, _buf_size, errh)))
+	return -1;
+    if (_ring >= _sr->nrings())
+	return errh->error("%s has only %u rings", _filename.c_str(), _sr->nrings());
+    return 0;
+}
+
+void
+ToSharedRing::cleanup(CleanupStage)
+{
+    if (_sr)
+	_sr->close();
+    _sr = 0;
+}
+
+void
+ToSharedRing::push(int, Packet *p)
+{
+    if (_sr->tx_packet(_ring, p, _headroom) == 0)
+	++_count;
+    else {
+	++_drops;
+	checked_output_push(1, p);
+    }
+}
+
+String
+ToSharedRing::read_handler(Element *e, void *thunk)
+{
+    ToSharedRing *tsr = static_cast<ToSharedRing *>(e);
+    switch ((intptr_t) thunk) {
+    case 0:
+	return String(tsr->_count);
+    case 1:
+	return String(tsr->_drops);
+    default:
+	return String(tsr->_sr ? tsr->_sr->free_buffers() : 0);
+    }
+}
+
+void
+ToSharedRing::add_handlers()
+{
+    add_read_handler("count", read_handler, 0);
+    add_read_handler("drops", read_handler, 1);
+    add_read_handler("free_buffers", read_handler, 2);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel SharedRing)
+EXPORT_ELEMENT(ToSharedRing)
@@ -0,0 +1,100 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_TOSHAREDRING_HH
+#define CLICK_TOSHAREDRING_HH
+#include <click/element.hh>
+CLICK_DECLS
+class SharedRing;
+
+/*
+=c
+
+ToSharedRing(FILENAME [, RING, I<keywords> HEADROOM, RINGS, CAPACITY, BUFFERS, BUFFER_SIZE])
+
+=s comm
+
+sends packets through a shared memory ring
+
+=d
+
+Sends packets to a FromSharedRing in another Click process (or in this
+router) through ring RING of the shared memory file FILENAME.  RING
+defaults to 0.  Each ring has one sender and one receiver.
+
+A packet that FromSharedRing received from the same file is passed on by
+descriptor, without copying.  Any other packet is copied into a free buffer
+from the file's pool, leaving HEADROOM bytes in front of it.  The ring and
+pool are lock-free shared memory, so sending makes no system calls.
+
+If the ring is full or the pool is empty, the packet is emitted on output 1,
+if present, or dropped.  Place a Queue and an Unqueue in front of
+ToSharedRing to absorb bursts.
+
+The RINGS, CAPACITY, BUFFERS, and BUFFER_SIZE keywords set the layout of a
+new file, and must match an existing one, as for FromSharedRing.
+
+Keyword arguments are:
+
+=over 8
+
+=item HEADROOM
+
+Integer.  The headroom left in front of copied packets.  Defaults to
+Packet::default_headroom.  A copy keeps the original data's alignment
+modulo 8, so up to 7 bytes more headroom may be left.
+
+=item RINGS, CAPACITY, BUFFERS, BUFFER_SIZE
+
+See FromSharedRing.
+
+=back
+
+=h count read-only
+
+Returns the number of packets sent.
+
+=h drops read-only
+
+Returns the number of packets that could not be sent.
+
+=h free_buffers read-only
+
+Returns the number of free buffers in the file's pool.
+
+=a FromSharedRing */
+
+class ToSharedRing : public Element { public:
+
+    ToSharedRing() CLICK_COLD;
+    ~ToSharedRing() CLICK_COLD;
+
+    const char *class_name() const	{ return "ToSharedRing"; }
+    const char *port_count() const	{ return "1/0-1"; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+
+  private:
+
+    String _filename;
+    unsigned _ring;
+    unsigned _headroom;
+    unsigned _nrings;
+    unsigned _capacity;
+    unsigned _nbufs;
+    unsigned _buf_size;
+
+    SharedRing *_sr;
+    click_uint_large_t _count;
+    click_uint_large_t _drops;
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,362 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * uringio.{cc,hh} -- completion-based file descriptor I/O with io_uring
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#if HAVE_ALLOW_IO_URING && defined(__linux__)
+#include "uringio.hh"
+#include <click/error.hh>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+CLICK_DECLS
+
+URingIO::URingIO()
+    : _fd(-1), _buf(0), _buf_size(0), _nrx(0), _ntx(0), _free(0), _nfree(0),
+      _slots(0), _tx_free(0), _tx_nfree(0), _tx_error(0)
+{
+    memset(&_rx, 0, sizeof(_rx));
+    memset(&_tx, 0, sizeof(_tx));
+    _rx.fd = _tx.fd = -1;
+    _refs = 1;
+}
+
+URingIO::~URingIO()
+{
+    if (_buf)
+	munmap(_buf, _buf_size);
+    delete[] _free;
+    delete[] _slots;
+    delete[] _tx_free;
+}
+
+int
+URingIO::map_ring(Ring &r, unsigned entries, unsigned char *buf, size_t len,
+		  ErrorHandler *errh)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r.fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r.fd < 0) {
+	r.fd = -1;
+	return errh->error("io_uring_setup: %s", strerror(errno));
+    }
+    fcntl(r.fd, F_SETFD, FD_CLOEXEC);
+
+    r.sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r.cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP);
+    if (single && r.cq_map_size > r.sq_map_size)
+	r.sq_map_size = r.cq_map_size;
+    r.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *m = mmap(0, r.sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_SQ_RING);
+    r.sq_map = (m == MAP_FAILED ? 0 : m);
+    if (single)
+	r.cq_map = r.sq_map;
+    else if (r.sq_map) {
+	m = mmap(0, r.cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_CQ_RING);
+	r.cq_map = (m == MAP_FAILED ? 0 : m);
+    }
+    if (r.cq_map) {
+	m = mmap(0, r.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_SQES);
+	r.sqes = (m == MAP_FAILED ? 0 : reinterpret_cast<struct io_uring_sqe *>(m));
+    }
+    if (!r.sqes)
+	return errh->error("io_uring mmap: %s", strerror(errno));
+
+    char *sq = reinterpret_cast<char *>(r.sq_map);
+    char *cq = reinterpret_cast<char *>(r.cq_map);
+    r.sq_entries = p.sq_entries;
+    r.sq_mask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    r.sq_head = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    r.sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    r.sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    r.cq_mask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    r.cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    r.cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    r.cqes = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+
+    // the ring's buffers are one registered region, buf_index 0
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    if (syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+	return errh->error("io_uring_register: %s", strerror(errno));
+    return 0;
+}
+
+void
+URingIO::unmap_ring(Ring &r)
+{
+    if (r.sqes)
+	munmap(r.sqes, r.sqes_size);
+    if (r.cq_map && r.cq_map != r.sq_map)
+	munmap(r.cq_map, r.cq_map_size);
+    if (r.sq_map)
+	munmap(r.sq_map, r.sq_map_size);
+    if (r.fd >= 0)
+	::close(r.fd);
+    memset(&r, 0, sizeof(r));
+    r.fd = -1;
+}
+
+int
+URingIO::setup(int fd, unsigned nrx, unsigned ntx, unsigned bufsize,
+	       unsigned headroom, ErrorHandler *errh)
+{
+    if (headroom >= bufsize)
+	return errh->error("io_uring buffers too small");
+    _fd = fd;
+    _nrx = nrx;
+    _ntx = ntx;
+    _bufsize = bufsize;
+    _headroom = headroom;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    _buf_size = ((size_t) (nrx + ntx) * bufsize + page - 1) & ~(page - 1);
+    void *m = mmap(0, _buf_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (m == MAP_FAILED)
+	return errh->error("io_uring buffers: %s", strerror(errno));
+    _buf = reinterpret_cast<unsigned char *>(m);
+
+    if (nrx) {
+	if (map_ring(_rx, nrx, buffer(0), (size_t) nrx * bufsize, errh) < 0)
+	    return -1;
+	if (!(_free = new unsigned[nrx]))
+	    return errh->error("out of memory");
+	for (unsigned i = 0; i < nrx; ++i)
+	    _free[_nfree++] = i;
+	refill();
+    }
+    if (ntx) {
+	if (map_ring(_tx, ntx, buffer(nrx), (size_t) ntx * bufsize, errh) < 0)
+	    return -1;
+	if (!(_slots = new TxSlot[ntx]) || !(_tx_free = new unsigned[ntx]))
+	    return errh->error("out of memory");
+	for (unsigned i = 0; i < ntx; ++i)
+	    _tx_free[_tx_nfree++] = nrx + i;
+    }
+    return 0;
+}
+
+URingIO *
+URingIO::open(int fd, unsigned nrx, unsigned ntx, unsigned bufsize,
+	      unsigned headroom, ErrorHandler *errh)
+{
+    URingIO *u = new URingIO;
+    if (u->setup(fd, nrx, ntx, bufsize, headroom, errh) < 0) {
+	u->close();
+	return 0;
+    }
+    return u;
+}
+
+void
+URingIO::close()
+{
+    // closing a ring cancels its outstanding requests
+    unmap_ring(_rx);
+    unmap_ring(_tx);
+    _fd = -1;
+    // the buffers outlive the rings until all packets are gone
+    unref();
+}
+
+void
+URingIO::unref()
+{
+    if (_refs.dec_and_test())
+	delete this;
+}
+
+inline void
+URingIO::free_buffer(unsigned index)
+{
+    _free_lock.acquire();
+    _free[_nfree++] = index;
+    _free_lock.release();
+}
+
+void
+URingIO::buffer_destructor(unsigned char *buf, size_t, void *arg)
+{
+    URingIO *u = reinterpret_cast<URingIO *>(arg);
+    u->free_buffer((buf - u->_buf) / u->_bufsize);
+    u->unref();
+}
+
+void
+URingIO::queue(Ring &r, int opcode, unsigned index, unsigned char *data,
+	       unsigned len)
+{
+    // each buffer has at most one request, so the ring cannot overflow
+    unsigned tail = *r.sq_tail;
+    assert(tail - __atomic_load_n(r.sq_head, __ATOMIC_ACQUIRE) < r.sq_entries);
+    unsigned idx = tail & r.sq_mask;
+    struct io_uring_sqe *sqe = &r.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = _fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(data);
+    sqe->len = len;
+    sqe->buf_index = 0;
+    sqe->user_data = index;
+    r.sq_array[idx] = idx;
+    __atomic_store_n(r.sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int
+URingIO::enter(Ring &r, bool wait)
+{
+    unsigned to_submit = *r.sq_tail - __atomic_load_n(r.sq_head, __ATOMIC_ACQUIRE);
+    if (!to_submit && !wait)
+	return 0;
+    int x = syscall(__NR_io_uring_enter, r.fd, to_submit, wait ? 1 : 0,
+		    wait ? IORING_ENTER_GETEVENTS : 0, (void *) 0, 0);
+    return x < 0 ? -errno : 0;
+}
+
+int
+URingIO::rx_packet(WritablePacket *&p)
+{
+    p = 0;
+    if (_rx.fd < 0)
+	return -EAGAIN;
+    while (1) {
+	unsigned head = *_rx.cq_head;
+	if (head == __atomic_load_n(_rx.cq_tail, __ATOMIC_ACQUIRE))
+	    return -EAGAIN;
+	const struct io_uring_cqe *cqe = &_rx.cqes[head & _rx.cq_mask];
+	unsigned index = cqe->user_data;
+	int res = cqe->res;
+	__atomic_store_n(_rx.cq_head, head + 1, __ATOMIC_RELEASE);
+
+	if (res <= 0) {
+	    free_buffer(index);
+	    // the kernel retries reads that would block, but be safe
+	    if (res == -EAGAIN || res == -EINTR)
+		continue;
+	    return res;
+	}
+	unsigned char *buf = buffer(index);
+	if (!(p = Packet::make(buf, _bufsize, buffer_destructor, this))) {
+	    free_buffer(index);
+	    return -ENOMEM;
+	}
+	++_refs;
+	p->pull(_headroom);
+	p->take(_bufsize - _headroom - res);
+	return res;
+    }
+}
+
+void
+URingIO::refill()
+{
+    if (_rx.fd < 0)
+	return;
+    _free_lock.acquire();
+    unsigned n = _nfree;
+    while (_nfree) {
+	unsigned index = _free[--_nfree];
+	queue(_rx, IORING_OP_READ_FIXED, index, buffer(index) + _headroom,
+	      _bufsize - _headroom);
+    }
+    _free_lock.release();
+    if (n)
+	enter(_rx, false);
+}
+
+void
+URingIO::reap_tx()
+{
+    unsigned head = *_tx.cq_head;
+    unsigned tail = __atomic_load_n(_tx.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+	const struct io_uring_cqe *cqe = &_tx.cqes[head & _tx.cq_mask];
+	unsigned index = cqe->user_data;
+	int res = cqe->res;
+	TxSlot &s = _slots[index - _nrx];
+	if (res == -EAGAIN || res == -EINTR || res == -ENOBUFS)
+	    // try again at the next flush
+	    queue(_tx, IORING_OP_WRITE_FIXED, index, buffer(index) + s.off,
+		  s.len - s.off);
+	else if (res > 0 && s.off + res < s.len) {
+	    // short stream write: send the rest
+	    s.off += res;
+	    queue(_tx, IORING_OP_WRITE_FIXED, index, buffer(index) + s.off,
+		  s.len - s.off);
+	} else {
+	    if (res < 0)
+		_tx_error = res;
+	    _tx_free[_tx_nfree++] = index;
+	}
+    }
+    __atomic_store_n(_tx.cq_head, head, __ATOMIC_RELEASE);
+}
+
+int
+URingIO::tx_packet(const Packet *p)
+{
+    if (p->length() > _bufsize)
+	return -EMSGSIZE;
+    _tx_lock.acquire();
+    if (_tx.fd < 0 || (!_tx_nfree && (reap_tx(), !_tx_nfree))) {
+	_tx_lock.release();
+	return -EAGAIN;
+    }
+    unsigned index = _tx_free[--_tx_nfree];
+    TxSlot &s = _slots[index - _nrx];
+    s.off = 0;
+    s.len = p->length();
+    memcpy(buffer(index), p->data(), s.len);
+    queue(_tx, IORING_OP_WRITE_FIXED, index, buffer(index), s.len);
+    _tx_lock.release();
+    return 0;
+}
+
+int
+URingIO::flush(bool wait)
+{
+    if (_tx.fd < 0)
+	return 0;
+    _tx_lock.acquire();
+    int r = enter(_tx, false);
+    _tx_lock.release();
+    if (r >= 0 && wait) {
+	// the kernel serializes submission with waiting, so do not hold the
+	// lock while blocked
+	r = enter(_tx, true);
+    }
+    return r;
+}
+
+int
+URingIO::tx_error()
+{
+    _tx_lock.acquire();
+    int e = _tx_error;
+    _tx_error = 0;
+    _tx_lock.release();
+    return e;
+}
+
+CLICK_ENDDECLS
+#endif
+ELEMENT_REQUIRES(userlevel)
+ELEMENT_PROVIDES(URingIO)
@@ -0,0 +1,142 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_URINGIO_HH
+#define CLICK_URINGIO_HH 1
+#if HAVE_ALLOW_IO_URING && defined(__linux__)
+#include <click/packet.hh>
+#include <click/atomic.hh>
+#include <click/sync.hh>
+#include <linux/io_uring.h>
+CLICK_DECLS
+class ErrorHandler;
+
+/* Completion-based I/O on one file descriptor through io_uring.
+ *
+ * Each URingIO owns a region of fixed-size buffers registered with the
+ * kernel, and two rings: one reads into the first nrx buffers, the other
+ * writes from the remaining ntx.  Every free read buffer has an
+ * IORING_OP_READ_FIXED request outstanding; refill() hands buffers that
+ * have come back to the kernel with one system call.  tx_packet() copies a
+ * packet into a free write buffer and queues an IORING_OP_WRITE_FIXED
+ * request, and flush() submits everything queued with one system call.  A
+ * ring's fd becomes readable when it has completions, so callers select
+ * rx_fd() instead of the data fd, and tx_fd() while waiting for a write
+ * buffer.
+ *
+ * rx_packet() wraps each completed read buffer in a Packet without copying.
+ * A killed Packet's buffer returns to a free list, and from there to the
+ * kernel, so holding received packets for a long time starves reception.
+ * With several reads outstanding, a stream's data could be split across
+ * them in any order, so streams should be opened with one read and one
+ * write buffer; a short write is resubmitted from where it stopped.  One
+ * thread receives; any number may send.
+ *
+ * The caller owns nothing but the URingIO: close() closes the rings, which
+ * cancels outstanding requests, and the buffers stay alive until the last
+ * Packet is killed. */
+class URingIO { public:
+
+    // Open rings for @a fd with @a nrx read and @a ntx write buffers of
+    // @a bufsize bytes each.  Read data starts @a headroom bytes into a
+    // buffer.  Either count may be 0.
+    static URingIO *open(int fd, unsigned nrx, unsigned ntx, unsigned bufsize,
+			 unsigned headroom, ErrorHandler *errh);
+    void close();
+
+    int rx_fd() const			{ return _rx.fd; }
+    int tx_fd() const			{ return _tx.fd; }
+
+    // Return the length of the next completed read and set @a p to its
+    // packet; 0 at end of file; -errno for a failed read; or -EAGAIN if no
+    // read has completed.
+    int rx_packet(WritablePacket *&p);
+    // Post free buffers for reading.  Call after a burst of rx_packet()s.
+    void refill();
+
+    // Copy @a p into a free buffer and queue it for writing.  Returns 0,
+    // -EAGAIN if every write buffer is busy, or -EMSGSIZE if @a p does not
+    // fit in a buffer.
+    int tx_packet(const Packet *p);
+    // Submit queued writes.  If @a wait, first block until a write
+    // completes.  Returns 0 or -errno.
+    int flush(bool wait = false);
+    // Return and clear the error from the last failed write, or 0.
+    int tx_error();
+
+    static bool is_uring_buffer(Packet *p) {
+	return p->buffer_destructor() == buffer_destructor;
+    }
+
+    struct Ring {
+	int fd;
+	unsigned sq_entries;
+	unsigned sq_mask;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned cq_mask;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	struct io_uring_cqe *cqes;
+	void *sq_map;
+	void *cq_map;
+	size_t sq_map_size;
+	size_t cq_map_size;
+	size_t sqes_size;
+    };
+
+  private:
+
+    struct TxSlot {
+	unsigned off;		// bytes written so far
+	unsigned len;		// bytes to write
+    };
+
+    int _fd;
+    Ring _rx;
+    Ring _tx;
+
+    unsigned char *_buf;
+    size_t _buf_size;
+    unsigned _bufsize;
+    unsigned _headroom;
+    unsigned _nrx;
+    unsigned _ntx;
+
+    // read buffers owned by user space, not in the kernel or a Packet
+    unsigned *_free;
+    unsigned _nfree;
+    Spinlock _free_lock;
+
+    TxSlot *_slots;
+    unsigned *_tx_free;
+    unsigned _tx_nfree;
+    int _tx_error;
+    Spinlock _tx_lock;		// protects _tx, _slots, and _tx_free
+
+    atomic_uint32_t _refs;	// Packets pointing into the buffers, plus
+				// one until close
+
+    URingIO();
+    ~URingIO();
+    int setup(int fd, unsigned nrx, unsigned ntx, unsigned bufsize,
+	      unsigned headroom, ErrorHandler *errh);
+    int map_ring(Ring &r, unsigned entries, unsigned char *buf, size_t len,
+		 ErrorHandler *errh);
+    void unmap_ring(Ring &r);
+    void queue(Ring &r, int opcode, unsigned index, unsigned char *data,
+	       unsigned len);
+    int enter(Ring &r, bool wait);
+    void reap_tx();
+    inline unsigned char *buffer(unsigned index) const {
+	return _buf + (size_t) index * _bufsize;
+    }
+    inline void free_buffer(unsigned index);
+    void unref();
+    static void buffer_destructor(unsigned char *buf, size_t, void *arg);
+
+};
+
+CLICK_ENDDECLS
+#endif
+#endif
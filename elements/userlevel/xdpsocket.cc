@@ -0,0 +1,585 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * xdpsocket.{cc,hh} -- library for Linux AF_XDP sockets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#if defined(__linux__)
+#include "xdpsocket.hh"
+#include <click/error.hh>
+#include <click/machine.hh>
+#include <click/sync.hh>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <net/if.h>
+#include <unistd.h>
+#include <stddef.h>
+#if defined(__has_include)
+# if __has_include(<linux/if_xdp.h>)
+#  include <linux/if_xdp.h>
+#  include <linux/bpf.h>
+#  include <linux/if_link.h>
+# endif
+#endif
+CLICK_DECLS
+
+#if defined(XDP_USE_NEED_WAKEUP) && defined(XDP_FLAGS_SKB_MODE) && defined(__NR_bpf)
+
+#ifndef SOL_XDP
+# define SOL_XDP 283
+#endif
+#ifndef AF_XDP
+# define AF_XDP 44
+#endif
+
+/* The XDP program shared by every receiving socket on a device.  It looks
+ * up the packet's receive queue in an XSKMAP and redirects the packet to
+ * the socket found there, or passes it to the kernel if there is none:
+ *
+ *	r2 = ctx->rx_queue_index
+ *	r1 = xskmap
+ *	r3 = XDP_PASS
+ *	return bpf_redirect_map(r1, r2, r3)
+ */
+struct XDPSocket::Program {
+    int ifindex;
+    int prog_fd;
+    int map_fd;
+    int link_fd;
+    int refs;
+    Program *next;
+};
+
+enum { xskmap_size = 64 };
+static Spinlock xdp_program_lock;
+static XDPSocket::Program *xdp_programs;
+
+static int
+bpf_call(int cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static void
+xdp_program_put(XDPSocket::Program *p)
+{
+    xdp_program_lock.acquire();
+    if (--p->refs) {
+	xdp_program_lock.release();
+	return;
+    }
+    for (XDPSocket::Program **pp = &xdp_programs; *pp; pp = &(*pp)->next)
+	if (*pp == p) {
+	    *pp = p->next;
+	    break;
+	}
+    xdp_program_lock.release();
+    // closing the link detaches the program
+    if (p->link_fd >= 0)
+	::close(p->link_fd);
+    if (p->prog_fd >= 0)
+	::close(p->prog_fd);
+    if (p->map_fd >= 0)
+	::close(p->map_fd);
+    delete p;
+}
+
+static XDPSocket::Program *
+xdp_program_get(int ifindex, int xdp_mode, ErrorHandler *errh)
+{
+    // Hold the lock while loading, so another thread configuring the same
+    // device waits for this program rather than attaching a second one.
+    xdp_program_lock.acquire();
+    for (XDPSocket::Program *p = xdp_programs; p; p = p->next)
+	if (p->ifindex == ifindex) {
+	    ++p->refs;
+	    xdp_program_lock.release();
+	    return p;
+	}
+
+    XDPSocket::Program *p = new XDPSocket::Program;
+    p->ifindex = ifindex;
+    p->prog_fd = p->map_fd = p->link_fd = -1;
+    p->refs = 1;
+    p->next = xdp_programs;
+    xdp_programs = p;
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(int);
+    attr.max_entries = xskmap_size;
+    p->map_fd = bpf_call(BPF_MAP_CREATE, &attr);
+    if (p->map_fd < 0 && errno == EPERM) {
+	// kernels before 5.11 charge BPF maps to RLIMIT_MEMLOCK; this raises
+	// the limit for the whole process (see FromDevice.u's documentation)
+	struct rlimit rl = { RLIM_INFINITY, RLIM_INFINITY };
+	if (setrlimit(RLIMIT_MEMLOCK, &rl) == 0)
+	    p->map_fd = bpf_call(BPF_MAP_CREATE, &attr);
+    }
+    if (p->map_fd < 0) {
+	errh->error("XSKMAP: %s", strerror(errno));
+	goto error;
+    }
+
+    {
+	struct bpf_insn insns[] = {
+	    { BPF_LDX | BPF_MEM | BPF_W, 2, 1, offsetof(struct xdp_md, rx_queue_index), 0 },
+	    { BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, p->map_fd },
+	    { 0, 0, 0, 0, 0 },
+	    { BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS },
+	    { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map },
+	    { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 }
+	};
+	static const char license[] = "Dual BSD/GPL";
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns = (uintptr_t) insns;
+	attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+	attr.license = (uintptr_t) license;
+	attr.expected_attach_type = BPF_XDP;
+	p->prog_fd = bpf_call(BPF_PROG_LOAD, &attr);
+	if (p->prog_fd < 0) {
+	    errh->error("XDP program: %s", strerror(errno));
+	    goto error;
+	}
+    }
+
+    for (int mode = (xdp_mode == XDPSocket::mode_skb ? XDPSocket::mode_skb : XDPSocket::mode_native);
+	 p->link_fd < 0 && mode <= XDPSocket::mode_skb; ++mode) {
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd = p->prog_fd;
+	attr.link_create.target_ifindex = ifindex;
+	attr.link_create.attach_type = BPF_XDP;
+	attr.link_create.flags = (mode == XDPSocket::mode_native ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE);
+	p->link_fd = bpf_call(BPF_LINK_CREATE, &attr);
+	if (xdp_mode != XDPSocket::mode_auto)
+	    break;
+    }
+    if (p->link_fd < 0) {
+	errh->error("attaching XDP program: %s", strerror(errno));
+	goto error;
+    }
+    xdp_program_lock.release();
+    return p;
+
+  error:
+    // the lock is recursive
+    xdp_program_put(p);
+    xdp_program_lock.release();
+    return 0;
+}
+
+
+XDPSocket::XDPSocket()
+    : _fd(-1), _ifindex(0), _program(0), _queue(0), _zerocopy(false),
+      _need_wakeup(false), _umem(0), _umem_size(0), _frame_size(0),
+      _nframes(0), _tx_outstanding(0), _free(0), _nfree(0)
+{
+    memset(&_rx, 0, sizeof(_rx));
+    memset(&_fill, 0, sizeof(_fill));
+    memset(&_tx, 0, sizeof(_tx));
+    memset(&_comp, 0, sizeof(_comp));
+    _refs = 1;
+}
+
+XDPSocket::~XDPSocket()
+{
+    if (_umem)
+	munmap(_umem, _umem_size);
+    delete[] _free;
+}
+
+int
+XDPSocket::map_ring(Ring &r, uint64_t pgoff, const void *offsets,
+		    size_t desc_size, ErrorHandler *errh)
+{
+    const xdp_ring_offset *off = reinterpret_cast<const xdp_ring_offset *>(offsets);
+    r.map_size = off->desc + r.size * desc_size;
+    void *m = mmap(0, r.map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, pgoff);
+    if (m == MAP_FAILED) {
+	r.map = 0;
+	return errh->error("mmap ring: %s", strerror(errno));
+    }
+    unsigned char *base = reinterpret_cast<unsigned char *>(m);
+    r.map = m;
+    r.producer = reinterpret_cast<volatile uint32_t *>(base + off->producer);
+    r.consumer = reinterpret_cast<volatile uint32_t *>(base + off->consumer);
+    r.flags = reinterpret_cast<volatile uint32_t *>(base + off->flags);
+    r.descs = base + off->desc;
+    r.mask = r.size - 1;
+    return 0;
+}
+
+void
+XDPSocket::unmap_ring(Ring &r)
+{
+    if (r.map)
+	munmap(r.map, r.map_size);
+    r.map = 0;
+}
+
+int
+XDPSocket::setup(const String &ifname, int queue, bool rx, int xdp_mode,
+		 int copy_mode, unsigned nframes, unsigned headroom,
+		 ErrorHandler *errh)
+{
+    _frame_size = 2048;
+    _nframes = nframes;
+    _queue = queue;
+    if (nframes < 64 || (nframes & (nframes - 1)))
+	return errh->error("XDP frame count must be a power of 2 of at least 64");
+    if (headroom > _frame_size - XDP_PACKET_HEADROOM - 1024)
+	return errh->error("headroom too large for XDP frames");
+    if (queue < 0 || queue >= xskmap_size)
+	return errh->error("XDP queue out of range");
+    if (!(_ifindex = if_nametoindex(ifname.c_str())))
+	return errh->error("unknown device");
+
+    _fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (_fd < 0)
+	return errh->error("AF_XDP socket: %s", strerror(errno));
+
+    // register the UMEM
+    _umem_size = (size_t) _frame_size * _nframes;
+    void *m = mmap(0, _umem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED) {
+	_umem = 0;
+	return errh->error("UMEM: %s", strerror(errno));
+    }
+    _umem = reinterpret_cast<unsigned char *>(m);
+    xdp_umem_reg ureg;
+    memset(&ureg, 0, sizeof(ureg));
+    ureg.addr = (uintptr_t) _umem;
+    ureg.len = _umem_size;
+    ureg.chunk_size = _frame_size;
+    ureg.headroom = headroom;
+    if (setsockopt(_fd, SOL_XDP, XDP_UMEM_REG, &ureg, sizeof(ureg)) < 0)
+	return errh->error("XDP_UMEM_REG: %s", strerror(errno));
+
+    // half the frames may sit in the fill ring; the rest are for sending
+    // and for packets in flight
+    uint32_t rsize = _nframes / 2;
+    _rx.size = _fill.size = _tx.size = _comp.size = rsize;
+    if (setsockopt(_fd, SOL_XDP, XDP_UMEM_FILL_RING, &rsize, sizeof(rsize)) < 0
+	|| setsockopt(_fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &rsize, sizeof(rsize)) < 0
+	|| setsockopt(_fd, SOL_XDP, XDP_RX_RING, &rsize, sizeof(rsize)) < 0
+	|| setsockopt(_fd, SOL_XDP, XDP_TX_RING, &rsize, sizeof(rsize)) < 0)
+	return errh->error("XDP rings: %s", strerror(errno));
+
+    xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if (getsockopt(_fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0)
+	return errh->error("XDP_MMAP_OFFSETS: %s", strerror(errno));
+    if (map_ring(_rx, XDP_PGOFF_RX_RING, &off.rx, sizeof(xdp_desc), errh) < 0
+	|| map_ring(_tx, XDP_PGOFF_TX_RING, &off.tx, sizeof(xdp_desc), errh) < 0
+	|| map_ring(_fill, XDP_UMEM_PGOFF_FILL_RING, &off.fr, sizeof(uint64_t), errh) < 0
+	|| map_ring(_comp, XDP_UMEM_PGOFF_COMPLETION_RING, &off.cr, sizeof(uint64_t), errh) < 0)
+	return -1;
+
+    // every frame starts out free
+    _free = new uint64_t[_nframes];
+    for (unsigned i = 0; i < _nframes; ++i)
+	_free[i] = (uint64_t) (_nframes - 1 - i) * _frame_size;
+    _nfree = _nframes;
+    if (rx)
+	refill();
+
+    sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = _ifindex;
+    sxdp.sxdp_queue_id = queue;
+    sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP;
+    if (copy_mode == copy_force)
+	sxdp.sxdp_flags |= XDP_COPY;
+    else if (copy_mode == zerocopy_force)
+	sxdp.sxdp_flags |= XDP_ZEROCOPY;
+    if (bind(_fd, (struct sockaddr *) &sxdp, sizeof(sxdp)) < 0)
+	return errh->error("bind queue %d: %s", queue, strerror(errno));
+    _need_wakeup = true;
+
+    xdp_options opts;
+    optlen = sizeof(opts);
+    if (getsockopt(_fd, SOL_XDP, XDP_OPTIONS, &opts, &optlen) == 0)
+	_zerocopy = (opts.flags & XDP_OPTIONS_ZEROCOPY) != 0;
+
+    if (rx) {
+	if (!(_program = xdp_program_get(_ifindex, xdp_mode, errh)))
+	    return -1;
+	union bpf_attr attr;
+	uint32_t key = queue;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = _program->map_fd;
+	attr.key = (uintptr_t) &key;
+	attr.value = (uintptr_t) &_fd;
+	if (bpf_call(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+	    return errh->error("XSKMAP update: %s", strerror(errno));
+    }
+    return 0;
+}
+
+XDPSocket *
+XDPSocket::open(const String &ifname, int queue, bool rx, int xdp_mode,
+		int copy_mode, unsigned nframes, unsigned headroom,
+		ErrorHandler *errh)
+{
+    XDPSocket *x = new XDPSocket;
+    if (x->setup(ifname, queue, rx, xdp_mode, copy_mode, nframes, headroom, errh) < 0) {
+	x->close();
+	return 0;
+    }
+    return x;
+}
+
+void
+XDPSocket::close()
+{
+    if (_program) {
+	union bpf_attr attr;
+	uint32_t key = _queue;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = _program->map_fd;
+	attr.key = (uintptr_t) &key;
+	(void) bpf_call(BPF_MAP_DELETE_ELEM, &attr);
+	xdp_program_put(_program);
+	_program = 0;
+    }
+    unmap_ring(_rx);
+    unmap_ring(_fill);
+    unmap_ring(_tx);
+    unmap_ring(_comp);
+    if (_fd >= 0)
+	::close(_fd);
+    _fd = -1;
+    // the UMEM outlives the socket until all packets are gone
+    unref();
+}
+
+void
+XDPSocket::unref()
+{
+    if (_refs.dec_and_test())
+	delete this;
+}
+
+inline void
+XDPSocket::free_frame(uint64_t addr)
+{
+    _free_lock.acquire();
+    _free[_nfree++] = addr;
+    _free_lock.release();
+}
+
+void
+XDPSocket::buffer_destructor(unsigned char *buf, size_t, void *arg)
+{
+    XDPSocket *x = reinterpret_cast<XDPSocket *>(arg);
+    x->free_frame(buf - x->_umem);
+    x->unref();
+}
+
+WritablePacket *
+XDPSocket::rx_packet()
+{
+    if (_rx.cached == _rx.peer) {
+	_rx.peer = *_rx.producer;
+	click_fence();
+	if (_rx.cached == _rx.peer)
+	    return 0;
+    }
+
+    const xdp_desc &d = reinterpret_cast<xdp_desc *>(_rx.descs)[_rx.cached & _rx.mask];
+    uint64_t base = d.addr & ~(uint64_t) (_frame_size - 1);
+    uint32_t off = d.addr - base, len = d.len;
+    ++_rx.cached;
+
+    // the Packet covers the whole frame, so headroom and tailroom are usable
+    WritablePacket *p = Packet::make(_umem + base, _frame_size, buffer_destructor, this);
+    if (!p) {
+	free_frame(base);
+	return 0;
+    }
+    ++_refs;
+    p->pull(off);
+    p->take(_frame_size - off - len);
+    return p;
+}
+
+void
+XDPSocket::refill()
+{
+    // publish consumed RX descriptors
+    if (*_rx.consumer != _rx.cached) {
+	click_fence();
+	*_rx.consumer = _rx.cached;
+    }
+
+    uint32_t space = _fill.size - (_fill.cached - *_fill.consumer);
+    if (space) {
+	uint64_t *descs = reinterpret_cast<uint64_t *>(_fill.descs);
+	_free_lock.acquire();
+	for (; space && _nfree; --space, ++_fill.cached)
+	    descs[_fill.cached & _fill.mask] = _free[--_nfree];
+	_free_lock.release();
+	click_fence();
+	*_fill.producer = _fill.cached;
+    }
+
+    if (_need_wakeup && (*_fill.flags & XDP_RING_NEED_WAKEUP))
+	(void) recvfrom(_fd, 0, 0, MSG_DONTWAIT, 0, 0);
+}
+
+void
+XDPSocket::reclaim()
+{
+    uint32_t prod = *_comp.producer;
+    if (prod == _comp.cached)
+	return;
+    click_fence();
+    const uint64_t *descs = reinterpret_cast<const uint64_t *>(_comp.descs);
+    _free_lock.acquire();
+    for (; _comp.cached != prod; ++_comp.cached, --_tx_outstanding)
+	_free[_nfree++] = descs[_comp.cached & _comp.mask] & ~(uint64_t) (_frame_size - 1);
+    _free_lock.release();
+    click_fence();
+    *_comp.consumer = _comp.cached;
+}
+
+int
+XDPSocket::tx_packet(const Packet *p)
+{
+    if (p->length() > _frame_size)
+	return -EMSGSIZE;
+    if (_tx.cached - *_tx.consumer >= _tx.size)
+	return -EAGAIN;
+    if (!_nfree)
+	reclaim();
+
+    _free_lock.acquire();
+    if (!_nfree) {
+	_free_lock.release();
+	return -EAGAIN;
+    }
+    uint64_t addr = _free[--_nfree];
+    _free_lock.release();
+
+    memcpy(_umem + addr, p->data(), p->length());
+    xdp_desc &d = reinterpret_cast<xdp_desc *>(_tx.descs)[_tx.cached & _tx.mask];
+    d.addr = addr;
+    d.len = p->length();
+    d.options = 0;
+    ++_tx.cached;
+    ++_tx_outstanding;
+    return 0;
+}
+
+int
+XDPSocket::flush()
+{
+    if (*_tx.producer != _tx.cached) {
+	click_fence();
+	*_tx.producer = _tx.cached;
+    }
+    if (_tx_outstanding
+	&& (!_need_wakeup || (*_tx.flags & XDP_RING_NEED_WAKEUP))
+	&& sendto(_fd, 0, 0, MSG_DONTWAIT, 0, 0) < 0
+	&& errno != EAGAIN && errno != EBUSY && errno != ENOBUFS
+	&& errno != ENETDOWN)
+	return -errno;
+    reclaim();
+    return 0;
+}
+
+void
+XDPSocket::stats(uint64_t &rx_dropped, uint64_t &rx_ring_full,
+		 uint64_t &tx_invalid) const
+{
+    xdp_statistics st;
+    socklen_t optlen = sizeof(st);
+    memset(&st, 0, sizeof(st));
+    (void) getsockopt(_fd, SOL_XDP, XDP_STATISTICS, &st, &optlen);
+    rx_dropped = st.rx_dropped;
+    rx_ring_full = st.rx_ring_full;
+    tx_invalid = st.tx_invalid_descs;
+}
+
+#else /* !XDP_USE_NEED_WAKEUP */
+
+// Sockets cannot be opened, so the remaining methods are never called.
+
+struct XDPSocket::Program {
+};
+
+XDPSocket::~XDPSocket()
+{
+}
+
+XDPSocket *
+XDPSocket::open(const String &, int, bool, int, int, unsigned, unsigned,
+		ErrorHandler *errh)
+{
+    errh->error("AF_XDP not supported on this system");
+    return 0;
+}
+
+void
+XDPSocket::close()
+{
+}
+
+WritablePacket *
+XDPSocket::rx_packet()
+{
+    return 0;
+}
+
+void
+XDPSocket::refill()
+{
+}
+
+int
+XDPSocket::tx_packet(const Packet *)
+{
+    return -EAGAIN;
+}
+
+int
+XDPSocket::flush()
+{
+    return 0;
+}
+
+void
+XDPSocket::stats(uint64_t &rx_dropped, uint64_t &rx_ring_full,
+		 uint64_t &tx_invalid) const
+{
+    rx_dropped = rx_ring_full = tx_invalid = 0;
+}
+
+void
+XDPSocket::buffer_destructor(unsigned char *, size_t, void *)
+{
+}
+
+#endif
+
+CLICK_ENDDECLS
+#endif
+ELEMENT_REQUIRES(userlevel)
+ELEMENT_PROVIDES(XDPSocket)
@@ -0,0 +1,121 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_XDPSOCKET_HH
+#define CLICK_XDPSOCKET_HH 1
+#if defined(__linux__)
+#include <click/packet.hh>
+#include <click/atomic.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+class ErrorHandler;
+
+/* An AF_XDP socket bound to one receive queue of a Linux device.
+ *
+ * Each socket has its own UMEM, a region of fixed-size frames shared with
+ * the kernel, and four rings: RX and fill for receiving, TX and completion
+ * for sending.  The first socket opened on a device loads a small XDP
+ * program that redirects every queue with a bound socket to that socket;
+ * other queues' packets pass to the kernel as usual.
+ *
+ * rx_packet() wraps each received frame in a Packet without copying.  A
+ * killed Packet's frame returns to a free list, and from there to the fill
+ * ring, so holding received packets for a long time starves reception.
+ * tx_packet() copies a packet into a free frame and queues it; flush()
+ * kicks the kernel.  Receiving and sending may run on different threads.
+ *
+ * The caller owns nothing but the XDPSocket: close() detaches it, and the
+ * UMEM stays alive until the last Packet is killed. */
+class XDPSocket { public:
+
+    enum { mode_auto, mode_native, mode_skb };
+    enum { copy_auto, copy_force, zerocopy_force };
+
+    // Open a socket on @a ifname's @a queue.  If @a rx is false, the socket
+    // only sends, and no XDP program is loaded for it.
+    static XDPSocket *open(const String &ifname, int queue, bool rx,
+			   int xdp_mode, int copy_mode, unsigned nframes,
+			   unsigned headroom, ErrorHandler *errh);
+    void close();
+
+    int fd() const			{ return _fd; }
+    int queue() const			{ return _queue; }
+    bool zerocopy() const		{ return _zerocopy; }
+
+    // Return the next received packet, or null if the RX ring is empty.
+    WritablePacket *rx_packet();
+    // Return received frames to the kernel.  Call after a burst of
+    // rx_packet()s.
+    void refill();
+
+    // Queue @a p for transmission.  Returns 0, -EAGAIN if no frame or TX
+    // slot is free, or -EMSGSIZE if @a p does not fit in a frame.
+    int tx_packet(const Packet *p);
+    int flush();
+
+    void stats(uint64_t &rx_dropped, uint64_t &rx_ring_full,
+	       uint64_t &tx_invalid) const;
+
+    static bool is_xdp_buffer(Packet *p) {
+	return p->buffer_destructor() == buffer_destructor;
+    }
+
+    struct Program;		// XDP program shared by a device's sockets
+
+    struct Ring {
+	volatile uint32_t *producer;
+	volatile uint32_t *consumer;
+	volatile uint32_t *flags;
+	void *descs;
+	uint32_t mask;
+	uint32_t size;
+	uint32_t cached;	// our side's index, published on flush
+	uint32_t peer;		// last index read from the kernel's side
+	void *map;
+	size_t map_size;
+    };
+
+  private:
+
+    int _fd;
+    int _ifindex;
+    Program *_program;
+    int _queue;
+    bool _zerocopy;
+    bool _need_wakeup;
+
+    unsigned char *_umem;
+    size_t _umem_size;
+    unsigned _frame_size;
+    unsigned _nframes;
+
+    Ring _rx;
+    Ring _fill;
+    Ring _tx;
+    Ring _comp;
+    uint32_t _tx_outstanding;
+
+    // frames owned by user space, not in a ring or a Packet
+    uint64_t *_free;
+    unsigned _nfree;
+    Spinlock _free_lock;
+
+    atomic_uint32_t _refs;	// Packets pointing into the UMEM, plus one
+				// until close
+
+    XDPSocket();
+    ~XDPSocket();
+    int setup(const String &ifname, int queue, bool rx, int xdp_mode,
+	      int copy_mode, unsigned nframes, unsigned headroom,
+	      ErrorHandler *errh);
+    int map_ring(Ring &r, uint64_t pgoff, const void *offsets,
+		 size_t desc_size, ErrorHandler *errh);
+    void unmap_ring(Ring &r);
+    void reclaim();
+    inline void free_frame(uint64_t addr);
+    void unref();
+    static void buffer_destructor(unsigned char *buf, size_t, void *arg);
+
+};
+
+CLICK_ENDDECLS
+#endif
+#endif
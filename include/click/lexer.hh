@@ -103,6 +103,8 @@ class Lexer { public:
     bool ydone() const			{ return !_ps; }
     void ystep();
 
+    int load_image(const String &image);
+
     Router *create_router(Master *);
 
   private:
@@ -0,0 +1,118 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_MULTITHREAD_HH
+#define CLICK_MULTITHREAD_HH
+#include <click/glue.hh>
+#include <click/machine.hh>
+CLICK_DECLS
+
+/** @file <click/multithread.hh>
+ * @brief Support for per-thread element state.
+ */
+
+/** @brief Return a small integer identifying the current driver thread.
+ *
+ * In the Linux kernel module, this is the current CPU number.  At user level
+ * with multiple threads, it is the running RouterThread's ID (which requires
+ * compiler support for __thread).  Otherwise it is always 0.  The result is
+ * never negative. */
+inline int
+click_current_thread_index()
+{
+#if CLICK_LINUXMODULE
+    return smp_processor_id();
+#elif CLICK_USERLEVEL && HAVE_MULTITHREAD && HAVE___THREAD_STORAGE_CLASS
+    return click_current_thread_id >= 0 ? click_current_thread_id : 0;
+#else
+    return 0;
+#endif
+}
+
+/** @brief Return an upper bound on click_current_thread_index() values.
+ * @param nthreads number of router threads, as reported by Master::nthreads()
+ */
+inline int
+click_max_thread_index(int nthreads)
+{
+#if CLICK_LINUXMODULE
+    return num_possible_cpus() > nthreads ? num_possible_cpus() : nthreads;
+#else
+    return nthreads > 0 ? nthreads : 1;
+#endif
+}
+
+/** @class per_thread
+ * @brief Array of values, one per driver thread.
+ *
+ * Elements that count or summarize packets on several threads can keep one
+ * copy of their state per thread, avoiding locks and cache line bouncing in
+ * the fast path.  The get() method returns the current thread's copy.
+ * Readers typically iterate over all copies and merge them.
+ *
+ * A per_thread is empty until resize() is called, usually from an element's
+ * initialize() method:
+ *
+ * @code
+ * _state.resize(click_max_thread_index(master()->nthreads()));
+ * @endcode
+ *
+ * Each copy is padded to a cache line. */
+template <typename T>
+class per_thread { public:
+
+    per_thread()
+	: _v(0), _n(0) {
+    }
+    ~per_thread() {
+	delete[] _v;
+    }
+
+    /** @brief Resize to @a n default-constructed copies.
+     *
+     * Any previous values are discarded. */
+    void resize(int n) {
+	delete[] _v;
+	_n = n > 0 ? n : 1;
+	_v = new slot[_n];
+    }
+
+    /** @brief Return the number of copies. */
+    int size() const {
+	return _n;
+    }
+
+    /** @brief Return the current thread's copy. */
+    T *get() {
+	int i = click_current_thread_index();
+	return &_v[i < _n ? i : i % _n].v;
+    }
+    T *operator->() {
+	return get();
+    }
+    T &operator*() {
+	return *get();
+    }
+
+    /** @brief Return copy @a i. */
+    T &operator[](int i) {
+	return _v[i].v;
+    }
+    const T &operator[](int i) const {
+	return _v[i].v;
+    }
+
+  private:
+
+    struct slot {
+	T v CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+    };
+
+    slot *_v;
+    int _n;
+
+    per_thread(const per_thread<T> &);
+    per_thread<T> &operator=(const per_thread<T> &);
+
+};
+
+CLICK_ENDDECLS
+#endif
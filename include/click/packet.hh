@@ -53,6 +53,7 @@ class Packet { public:
 				uint32_t length, uint32_t tailroom) CLICK_WARN_UNUSED_RESULT;
     static inline WritablePacket *make(const void *data, uint32_t length) CLICK_WARN_UNUSED_RESULT;
     static inline WritablePacket *make(uint32_t length) CLICK_WARN_UNUSED_RESULT;
+    static inline uint32_t aligned_headroom(uint32_t headroom, int modulus, int offset);
 #if CLICK_LINUXMODULE
     static Packet *make(struct sk_buff *skb) CLICK_WARN_UNUSED_RESULT;
 #endif
@@ -1355,6 +1356,23 @@ Packet::make(uint32_t length)
     return make(default_headroom, (const unsigned char *) 0, length, 0);
 }
 
+/** @brief Return headroom that aligns new packet data.
+ * @param headroom minimum headroom
+ * @param modulus alignment modulus: 2, 4, or 8
+ * @param offset desired offset of packet data from a @a modulus-byte boundary
+ *
+ * Returns the smallest value no less than @a headroom that, passed to
+ * Packet::make(), leaves the new packet's data @a offset bytes past a
+ * @a modulus-byte boundary.  Packet buffers are at least 8-byte aligned.
+ * For instance, aligned_headroom(default_headroom, 4, 2) places the IP
+ * header of an Ethernet frame on a 4-byte boundary, so a downstream Align
+ * element passes the packet through unchanged. */
+inline uint32_t
+Packet::aligned_headroom(uint32_t headroom, int modulus, int offset)
+{
+    return headroom + ((offset - headroom) & (modulus - 1));
+}
+
 #if CLICK_LINUXMODULE
 /** @brief Change an sk_buff into a Packet (linuxmodule).
  * @param skb input sk_buff
@@ -134,4 +134,51 @@
 # endif
 #endif
 
+// bytes 40-47: checksum and segmentation offload state, with the meanings
+// of the corresponding virtio-net header fields.  CSUM_START is relative to
+// the network header.  These overlap PERFCTR and, on 64-bit hosts,
+// IPSEC_SA_DATA_REFERENCE: KernelTun with VNET_HDR sets them on every
+// packet it emits and reads them from every packet it sends, so do not use
+// those annotations on the same packets.
+#define OFFLOAD_ANNO_OFFSET		40
+#define OFFLOAD_ANNO_SIZE		8
+
+// byte 40
+#define OFFLOAD_FLAGS_ANNO_OFFSET	40
+#define OFFLOAD_FLAGS_ANNO_SIZE		1
+#define OFFLOAD_FLAGS_ANNO(p)		((p)->anno_u8(OFFLOAD_FLAGS_ANNO_OFFSET))
+#define SET_OFFLOAD_FLAGS_ANNO(p, v)	((p)->set_anno_u8(OFFLOAD_FLAGS_ANNO_OFFSET, (v)))
+#define OFFLOAD_NEEDS_CSUM		1	// transport checksum is partial
+#define OFFLOAD_CSUM_VALID		2	// transport checksum was verified
+
+// byte 41
+#define GSO_TYPE_ANNO_OFFSET		41
+#define GSO_TYPE_ANNO_SIZE		1
+#define GSO_TYPE_ANNO(p)		((p)->anno_u8(GSO_TYPE_ANNO_OFFSET))
+#define SET_GSO_TYPE_ANNO(p, v)		((p)->set_anno_u8(GSO_TYPE_ANNO_OFFSET, (v)))
+#define GSO_NONE			0
+#define GSO_TCPV4			1
+#define GSO_UDP				3	// IP fragmentation
+#define GSO_TCPV6			4
+#define GSO_UDP_L4			5
+#define GSO_ECN				0x80
+
+// bytes 42-43
+#define GSO_SIZE_ANNO_OFFSET		42
+#define GSO_SIZE_ANNO_SIZE		2
+#define GSO_SIZE_ANNO(p)		((p)->anno_u16(GSO_SIZE_ANNO_OFFSET))
+#define SET_GSO_SIZE_ANNO(p, v)		((p)->set_anno_u16(GSO_SIZE_ANNO_OFFSET, (v)))
+
+// bytes 44-45
+#define CSUM_START_ANNO_OFFSET		44
+#define CSUM_START_ANNO_SIZE		2
+#define CSUM_START_ANNO(p)		((p)->anno_u16(CSUM_START_ANNO_OFFSET))
+#define SET_CSUM_START_ANNO(p, v)	((p)->set_anno_u16(CSUM_START_ANNO_OFFSET, (v)))
+
+// bytes 46-47
+#define CSUM_OFFSET_ANNO_OFFSET		46
+#define CSUM_OFFSET_ANNO_SIZE		2
+#define CSUM_OFFSET_ANNO(p)		((p)->anno_u16(CSUM_OFFSET_ANNO_OFFSET))
+#define SET_CSUM_OFFSET_ANNO(p, v)	((p)->set_anno_u16(CSUM_OFFSET_ANNO_OFFSET, (v)))
+
 #endif
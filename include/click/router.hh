@@ -214,6 +214,8 @@ class Router { public:
   private:
 
     class RouterContextErrh;
+    class DeferredErrh;
+    struct ParallelConfigure;
 
     enum {
 	ROUTER_NEW, ROUTER_PRECONFIGURE, ROUTER_PREINITIALIZE,
@@ -330,6 +332,8 @@ class Router { public:
 
     // private handler methods
     void initialize_handlers(bool, bool);
+    int configure_element(int eindex, ErrorHandler *errh);
+    void configure_parallel(const Vector<int> &eindexes, Vector<int> &element_stage, ErrorHandler *errh);
     inline Handler* xhandler(int) const;
     int find_ehandler(int, const String&, bool allow_star) const;
     static inline Handler fetch_handler(const Element*, const String&);
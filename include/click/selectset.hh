@@ -28,6 +28,9 @@
 #  error "kqueue is not supported on this system, try --enable-select"
 # endif
 #endif
+#if HAVE_ALLOW_IO_URING && !defined(__linux__)
+# undef HAVE_ALLOW_IO_URING
+#endif
 CLICK_DECLS
 class Element;
 class Router;
@@ -59,8 +62,16 @@ class SelectSet { public:
 	Element *read;
 	Element *write;
 	int pollfd;
+#if HAVE_ALLOW_IO_URING
+	uint32_t uring_gen;	// generation of the armed poll request
+	bool uring_armed;
+	bool uring_dirty;	// must be rearmed before the next wait
+#endif
 	SelectorInfo()
 	    : read(0), write(0), pollfd(-1)
+#if HAVE_ALLOW_IO_URING
+	    , uring_gen(0), uring_armed(false), uring_dirty(false)
+#endif
 	{
 	}
     };
@@ -70,6 +81,10 @@ class SelectSet { public:
 #if HAVE_ALLOW_KQUEUE
     int _kqueue;
 #endif
+#if HAVE_ALLOW_IO_URING
+    struct IOUring;
+    IOUring *_uring;
+#endif
 #if !HAVE_ALLOW_POLL
     struct pollfd {
 	int fd;
@@ -93,6 +108,11 @@ class SelectSet { public:
 #if HAVE_ALLOW_KQUEUE
     void run_selects_kqueue(RouterThread *thread);
 #endif
+#if HAVE_ALLOW_IO_URING
+    void uring_mark(int fd);
+    void uring_submit_changes();
+    void run_selects_io_uring(RouterThread *thread);
+#endif
 #if HAVE_ALLOW_POLL
     void run_selects_poll(RouterThread *thread);
 #else
@@ -507,6 +507,7 @@ click_read_router(String filename, bool is_expr, ErrorHandler *errh, bool initia
 
     // find config string in archive
     Vector<ArchiveElement> archive;
+    ArchiveElement *image = 0;
     if (config_str.length() != 0 && config_str[0] == '!') {
 	ArchiveElement::parse(config_str, archive, errh);
 	if (ArchiveElement *ae = ArchiveElement::find(archive, "config"))
@@ -515,12 +516,15 @@ click_read_router(String filename, bool is_expr, ErrorHandler *errh, bool initia
 	    errh->error("%s: archive has no %<config%> section", filename.c_str());
 	    return 0;
 	}
+	image = ArchiveElement::find(archive, "image");
     }
 
-    // lex
+    // lex, or load a precompiled router image if there is one
     Lexer *l = click_lexer();
     RequireLexerExtra lextra(&archive);
     int cookie = l->begin_parse(config_str, filename, &lextra, errh);
+    if (image)
+	l->load_image(image->data);
     while (!l->ydone())
 	l->ystep();
     Router *router = l->create_router(master ? master : new Master(1));
@@ -1214,6 +1214,21 @@ Element::processing_vector(int* in_v, int* out_v, ErrorHandler* errh) const
  * RoundRobinSched has 0 inputs, are idle rather than busy, and waste no
  * CPU time.</dd>
  *
+ * <dt><tt>P</tt></dt> <dd>This element's configure() method is independent
+ * of other elements and may run on a worker thread, at the same time as the
+ * configure() methods of other <tt>P</tt>-flagged elements in the same
+ * configure phase.  Such a configure() method must not change state shared
+ * with other elements, and must report errors only to its ErrorHandler
+ * argument.  It may look up names with NameInfo::query() and
+ * NameInfo::revquery(), which serialize access to the name databases, but
+ * must not define names or call non-reentrant library functions, such as
+ * getservbyname(), directly.  The
+ * Router configures <tt>P</tt>-flagged elements after the other elements in
+ * their configure phase and waits for them before moving on, so their error
+ * messages follow those of the phase's other elements.  Elements with
+ * expensive configurations, such as large routing tables and packet
+ * filters, set this flag.  Multithreaded user-level drivers use it.</dd>
+ *
  * </dl>
  */
 const char*
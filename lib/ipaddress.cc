@@ -211,7 +211,15 @@ prefix_with_slash(const String &str, const char *slash,
 
     int l = -1;
     IPAddress mask;
-    if (IntArg(10).parse(str.substring(slash + 1, str.end()), l)
+    const char *end = str.end();
+    if (end - slash <= 3 && isdigit((unsigned char) slash[1])
+	&& (end - slash == 2 || isdigit((unsigned char) slash[2]))) {
+	// common case: a one- or two-digit prefix length
+	l = slash[1] - '0';
+	if (end - slash == 3)
+	    l = l * 10 + slash[2] - '0';
+    }
+    if ((l >= 0 || IntArg(10).parse(str.substring(slash + 1, end), l))
 	&& l >= 0 && l <= 32)
 	mask = IPAddress::make_prefix(l);
     else if (!IPAddressArg::parse(str.substring(slash + 1, str.end()), mask, args))
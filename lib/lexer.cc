@@ -37,6 +37,9 @@
 #if CLICK_USERLEVEL
 # include <click/userutils.hh>
 #endif
+#if !CLICK_LINUXMODULE && !CLICK_BSDMODULE
+# include <click/md5.h>
+#endif
 CLICK_DECLS
 
 #ifdef CLICK_LINUXMODULE
@@ -814,6 +817,16 @@ Lexer::FileState::next_lexeme(Lexer *lexer)
   return Lexeme(*s, _big_string.substring(s, s + 1));
 }
 
+static inline bool
+lex_config_special(unsigned char c)
+{
+  // characters lex_config must examine: "\n\r\"#'()/" and backslash
+  const uint64_t mask = (1ULL << '\n') | (1ULL << '\r') | (1ULL << '\"')
+    | (1ULL << '#') | (1ULL << '\'') | (1ULL << '(') | (1ULL << ')')
+    | (1ULL << '/');
+  return c < 64 ? (mask >> c) & 1 : c == '\\';
+}
+
 String
 Lexer::FileState::lex_config(Lexer *lexer)
 {
@@ -823,7 +836,9 @@ Lexer::FileState::lex_config(Lexer *lexer)
 
   String r;
   for (; s < _end; s++)
-    if (*s == '(')
+    if (!lex_config_special(*s))
+      /* ordinary character */;
+    else if (*s == '(')
       paren_depth++;
     else if (*s == ')') {
       paren_depth--;
@@ -1093,11 +1108,11 @@ Lexer::get_element(String name, int etype, const String &conf,
   assert(name && etype >= 0 && etype < _element_types.size());
 
   // if an element 'name' already exists return it
-  if (_c->_element_map[name] >= 0)
-    return _c->_element_map[name];
+  int &eid_ref = _c->_element_map[name];
+  if (eid_ref >= 0)
+    return eid_ref;
 
-  int eid = _c->_elements.size();
-  _c->_element_map.set(name, eid);
+  int eid = eid_ref = _c->_elements.size();
 
   // check 'name' for validity
   for (int i = 0; i < name.length(); i++) {
@@ -1386,7 +1401,7 @@ Lexer::yelement_config(ElementState *e, bool this_implicit)
     // configuration string
     Lexeme t = lex();
     if (t.is('(') && !this_implicit) {
-	if (_c->_element_map[e->name] >= 0)
+	if (_c->_element_map.get(e->name) >= 0)
 	    lerror("configuration string ignored on element reference");
 	e->configuration = lex_config();
 	expect(')');
@@ -1441,7 +1456,7 @@ Lexer::yelement_next()
     // add elements
     int *resp = _ps->elements.begin();
     while (ElementState *e = _ps->_head) {
-	if (e->type >= 0 || (*resp = _c->_element_map[e->name]) < 0) {
+	if (e->type >= 0 || (*resp = _c->_element_map.get(e->name)) < 0) {
 	    if (e->decl_type >= 0 && e->type >= 0)
 		_errh->lerror(Compound::landmark_string(e->filename, e->lineno), "class %<%s%> used as element name", e->name.c_str());
 	    else if (e->decl_type < 0 && e->type < 0) {
@@ -2083,6 +2098,132 @@ Lexer::ystep()
 }
 
 
+// ROUTER IMAGES
+//
+// A router image, written by "click-flatten --image", is a flattened
+// configuration with its elements and connections already resolved:
+//
+// %click-image 1 HASH
+// r TYPE VALUE				requirement
+// e CLASS NAME LANDMARK CONFIG		element, numbered from 0
+// c FROM FROMPORT TO TOPORT		connection, by element number
+//
+// HASH is the MD5 text digest of the configuration the image was made
+// from.  If the configuration has changed since, the image is ignored.
+// Strings are written as "LENGTH:BYTES", so configurations are used in
+// place without unquoting.  Records appear in that order, one per line.
+
+static const char *
+image_string(const String &image, const char *s, String &result)
+{
+    const char *end = image.end();
+    int len = 0;
+    const char *t = s;
+    for (; t < end && isdigit((unsigned char) *t) && len < 0x1000000; ++t)
+	len = len * 10 + *t - '0';
+    if (t == s || t >= end || *t != ':' || len > end - t - 1)
+	return 0;
+    result = image.substring(t + 1, t + 1 + len);
+    t += 1 + len;
+    return (t < end && (*t == ' ' || *t == '\n') ? t + 1 : 0);
+}
+
+static const char *
+image_int(const char *s, const char *end, int &result)
+{
+    const char *t = s;
+    for (result = 0; t < end && isdigit((unsigned char) *t) && result < 0x1000000; ++t)
+	result = result * 10 + *t - '0';
+    return (t != s && t < end && (*t == ' ' || *t == '\n') ? t + 1 : 0);
+}
+
+int
+Lexer::load_image(const String &image)
+{
+    assert(_ps && _ps->_type == ParseState::t_file && !_c->_elements.size());
+    String image_landmark = _file._filename + ": image";
+    const char *s = image.begin(), *end = image.end();
+#if CLICK_LINUXMODULE || CLICK_BSDMODULE
+    s = 0;			// no MD5 to check the image against
+#else
+    if (end - s < 15 || memcmp(s, "%click-image 1 ", 15) != 0)
+	s = 0;
+    else {
+	const char *hash = s + 15;
+	s = find(hash, end, '\n');
+	md5_state_t pms;
+	char buf[MD5_TEXT_DIGEST_MAX_SIZE];
+	md5_init(&pms);
+	md5_append(&pms, (const md5_byte_t *) _file._big_string.data(), _file._big_string.length());
+	int buflen = md5_finish_text(&pms, buf, 0);
+	md5_free(&pms);
+	if (s == end || s - hash != buflen || memcmp(hash, buf, buflen) != 0) {
+	    _errh->lwarning(image_landmark, "router image does not match configuration, parsing configuration");
+	    return -1;
+	}
+	++s;
+    }
+#endif
+    if (!s) {
+	_errh->lwarning(image_landmark, "router image format not understood, parsing configuration");
+	return -1;
+    }
+
+    String type, value, conf, landmark;
+    int nelements = 0;
+    while (s && s < end) {
+	char kind = *s;
+	if (s + 1 >= end || s[1] != ' ')
+	    s = 0;
+	else if (kind == 'r') {
+	    if ((s = image_string(image, s + 2, type))
+		&& (s = image_string(image, s, value))) {
+		if (type.equals("compact_config", 14))
+		    _compact_config = true;
+		if (_lextra)
+		    _lextra->require(type, value, _errh);
+		_requirements.push_back(type);
+		_requirements.push_back(value);
+	    }
+	} else if (kind == 'e') {
+	    if ((s = image_string(image, s + 2, type))
+		&& (s = image_string(image, s, value))
+		&& (s = image_string(image, s, landmark))
+		&& (s = image_string(image, s, conf))) {
+		int etype = element_type(type);
+		if (etype < 0) {
+		    _errh->lerror(landmark, "unknown element class %<%s%>", type.c_str());
+		    etype = force_element_type(type, false);
+		}
+		if (_compact_config)
+		    conf = conf.compact();
+		if (!value || get_element(value, etype, conf, landmark) != nelements)
+		    s = 0;
+		++nelements;
+	    }
+	} else if (kind == 'c') {
+	    int from, fromport, to, toport;
+	    if ((s = image_int(s + 2, end, from))
+		&& (s = image_int(s, end, fromport))
+		&& (s = image_int(s, end, to))
+		&& (s = image_int(s, end, toport))) {
+		if (from < nelements && to < nelements)
+		    _c->connect(from, fromport, to, toport);
+		else
+		    s = 0;
+	    }
+	} else
+	    s = 0;
+    }
+
+    if (!s)
+	_errh->lerror(image_landmark, "malformed router image");
+    delete _ps;
+    _ps = 0;
+    return 0;
+}
+
+
 // COMPLETION
 
 void
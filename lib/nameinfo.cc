@@ -24,6 +24,7 @@
 #include <click/router.hh>
 #include <click/error.hh>
 #include <click/packet_anno.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 
 /** @file nameinfo.hh
@@ -106,10 +107,17 @@ CLICK_DECLS
 
 static NameInfo *the_name_info;
 
+// Databases may change on lookup (DynamicNameDB sorts lazily, and
+// ServicesNameDB reads its file on first use), and elements with the P flag
+// query them from several threads at once, so lookups are serialized.
+static Spinlock query_lock;
+
 #define MKAI(n) MAKE_ANNOTATIONINFO(n ## _ANNO_OFFSET, n ## _ANNO_SIZE)
 
 static const StaticNameDB::Entry annotation_entries[] = {
     { "AGGREGATE", MKAI(AGGREGATE) },
+    { "CSUM_OFFSET", MKAI(CSUM_OFFSET) },
+    { "CSUM_START", MKAI(CSUM_START) },
     { "DST_IP", MKAI(DST_IP) },
     { "DST_IP6", MKAI(DST_IP6) },
     { "EXTRA_LENGTH", MKAI(EXTRA_LENGTH) },
@@ -118,6 +126,8 @@ static const StaticNameDB::Entry annotation_entries[] = {
     { "FIX_IP_SRC", MKAI(FIX_IP_SRC) },
     { "FWD_RATE", MKAI(FWD_RATE) },
     { "GRID_ROUTE_CB", MKAI(GRID_ROUTE_CB) },
+    { "GSO_SIZE", MKAI(GSO_SIZE) },
+    { "GSO_TYPE", MKAI(GSO_TYPE) },
     { "ICMP_PARAMPROB", MKAI(ICMP_PARAMPROB) },
     { "IPREASSEMBLER", MKAI(IPREASSEMBLER) },
 #ifdef IPSEC_SA_DATA_REFERENCE_ANNO_OFFSET
@@ -125,6 +135,8 @@ static const StaticNameDB::Entry annotation_entries[] = {
 #endif
     { "IPSEC_SPI", MKAI(IPSEC_SPI) },
     { "MISC_IP", MKAI(MISC_IP) },
+    { "OFFLOAD", MKAI(OFFLOAD) },
+    { "OFFLOAD_FLAGS", MKAI(OFFLOAD_FLAGS) },
     { "PACKET_NUMBER", MKAI(PACKET_NUMBER) },
     { "PAINT", MKAI(PAINT) },
 #if HAVE_INT64_TYPES
@@ -496,17 +508,18 @@ NameInfo::uninstalldb(NameDB *db)
 bool
 NameInfo::query(uint32_t type, const Element *e, const String &name, void *value, size_t vsize)
 {
-    while (1) {
+    query_lock.acquire();
+    bool found = false;
+    while (!found) {
 	NameDB *db = getdb(type, e, vsize, false);
-	while (db) {
-	    if (db->query(name, value, vsize))
-		return true;
-	    db = db->context_parent();
-	}
+	for (; db && !found; db = db->context_parent())
+	    found = db->query(name, value, vsize);
 	if (!e)
-	    return false;
+	    break;
 	e = 0;
     }
+    query_lock.release();
+    return found;
 }
 
 bool
@@ -524,17 +537,18 @@ NameInfo::query_int(uint32_t type, const Element *e, const String &name, uint32_
 String
 NameInfo::revquery(uint32_t type, const Element *e, const void *value, size_t vsize)
 {
-    while (1) {
+    query_lock.acquire();
+    String s;
+    while (!s) {
 	NameDB *db = getdb(type, e, vsize, false);
-	while (db) {
-	    if (String s = db->revquery(value, vsize))
-		return s;
-	    db = db->context_parent();
-	}
+	for (; db && !s; db = db->context_parent())
+	    s = db->revquery(value, vsize);
 	if (!e)
-	    return String();
+	    break;
 	e = 0;
     }
+    query_lock.release();
+    return s;
 }
 
 
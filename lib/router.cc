@@ -47,6 +47,9 @@
 #if CLICK_USERLEVEL || CLICK_MINIOS
 # include <unistd.h>
 #endif
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+# include <pthread.h>
+#endif
 #if CLICK_NS
 # include "../elements/ns/fromsimdevice.hh"
 #endif
@@ -1046,6 +1049,32 @@ class Router::RouterContextErrh : public ContextErrorHandler { public:
 
 };
 
+/* Collects the messages from an element configured on a worker thread, so
+   they can be reported in order once the thread is done. */
+class Router::DeferredErrh : public ErrorHandler { public:
+
+    void *emit(const String &str, void *user_data, bool more) {
+	_sa << str;
+	if (more)
+	    _sa << '\n';
+	else
+	    _messages.push_back(_sa.take_string());
+	return user_data;
+    }
+
+    void replay(ErrorHandler *errh) {
+	for (int i = 0; i < _messages.size(); ++i)
+	    errh->xmessage(_messages[i]);
+	_messages.clear();
+    }
+
+  private:
+
+    StringAccum _sa;
+    Vector<String> _messages;
+
+};
+
 static int
 configure_order_compar(const void *athunk, const void *bthunk, void *copthunk)
 {
@@ -1083,6 +1112,94 @@ Router::initialize_handlers(bool defaults, bool specifics)
 	    _elements[i]->add_handlers();
 }
 
+int
+Router::configure_element(int i, ErrorHandler *errh)
+{
+    RouterContextErrh cerrh(errh, "While configuring", element(i));
+    assert(!cerrh.nerrors());
+    Vector<String> conf;
+    cp_argvec(_element_configurations[i], conf);
+    int r = _elements[i]->configure(conf, &cerrh);
+    if (r >= 0)
+	return Element::CLEANUP_CONFIGURED;
+    if (!cerrh.nerrors()) {
+	if (r == -ENOMEM)
+	    cerrh.error("out of memory");
+	else
+	    cerrh.error("unspecified error");
+    }
+    return Element::CLEANUP_CONFIGURE_FAILED;
+}
+
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+struct Router::ParallelConfigure {
+    Router *router;
+    const Vector<int> *eindexes;
+    Vector<int> *element_stage;
+    DeferredErrh *errhs;
+    atomic_uint32_t next;
+    static void *run(void *thunk);
+};
+
+void *
+Router::ParallelConfigure::run(void *thunk)
+{
+    ParallelConfigure *pc = static_cast<ParallelConfigure *>(thunk);
+    uint32_t j;
+    while ((j = pc->next.fetch_and_add(1)) < (uint32_t) pc->eindexes->size()) {
+	int i = (*pc->eindexes)[j];
+	(*pc->element_stage)[i] = pc->router->configure_element(i, &pc->errhs[j]);
+    }
+    return 0;
+}
+#endif
+
+/* Configure the P-flagged elements in 'eindexes', which share a configure
+   phase, at the same time.  A fixed pool of workers, one per CPU or router
+   thread, takes elements from a shared counter; the calling thread is one
+   of the workers.  Errors are reported in configure order once every
+   element is done, so they follow the errors of the phase's other
+   elements. */
+void
+Router::configure_parallel(const Vector<int> &eindexes,
+			   Vector<int> &element_stage, ErrorHandler *errh)
+{
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+    int nworkers = master()->nthreads();
+# ifdef _SC_NPROCESSORS_ONLN
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus > nworkers)
+	nworkers = ncpus;
+# endif
+    if (nworkers > eindexes.size())
+	nworkers = eindexes.size();
+    if (nworkers > 1) {
+	Vector<DeferredErrh> errhs(eindexes.size(), DeferredErrh());
+	ParallelConfigure pc;
+	pc.router = this;
+	pc.eindexes = &eindexes;
+	pc.element_stage = &element_stage;
+	pc.errhs = errhs.begin();
+	pc.next = 0;
+	Vector<pthread_t> threads;
+	for (int w = 1; w < nworkers; ++w) {
+	    pthread_t thread;
+	    if (pthread_create(&thread, 0, ParallelConfigure::run, &pc) != 0)
+		break;
+	    threads.push_back(thread);
+	}
+	ParallelConfigure::run(&pc);
+	for (int w = 0; w < threads.size(); ++w)
+	    pthread_join(threads[w], 0);
+	for (int j = 0; j < eindexes.size(); ++j)
+	    errhs[j].replay(errh);
+	return;
+    }
+#endif
+    for (int j = 0; j < eindexes.size(); ++j)
+	element_stage[eindexes[j]] = configure_element(eindexes[j], errh);
+}
+
 int
 Router::initialize(ErrorHandler *errh)
 {
@@ -1105,8 +1222,8 @@ Router::initialize(ErrorHandler *errh)
 
     // set up configuration order
     _element_configure_order.assign(nelements(), 0);
+    Vector<int> configure_phase(nelements(), 0);
     if (_element_configure_order.size()) {
-	Vector<int> configure_phase(nelements(), 0);
 	for (int i = 0; i < _elements.size(); i++) {
 	    configure_phase[i] = _elements[i]->configure_phase();
 	    _element_configure_order[i] = i;
@@ -1135,33 +1252,34 @@ Router::initialize(ErrorHandler *errh)
     char dmalloc_buf[12];
 #endif
 
-    // Configure all elements in configure order. Remember the ones that failed
+    // Configure all elements in configure order. Remember the ones that
+    // failed. Elements with the P flag are configured together, in parallel
+    // where possible, after the other elements in their configure phase;
+    // their errors are reported after the other elements' errors.
     if (all_ok) {
-	Vector<String> conf;
+	Vector<int> parallel;
 	// Set the random seed to a "truly random" value by default.
 	click_random_srandom();
 	for (int ord = 0; ord < _elements.size(); ord++) {
-	    int i = _element_configure_order[ord], r;
+	    int i = _element_configure_order[ord];
 #if CLICK_DMALLOC
 	    sprintf(dmalloc_buf, "c%d  ", i);
 	    CLICK_DMALLOC_REG(dmalloc_buf);
 #endif
-	    RouterContextErrh cerrh(errh, "While configuring", element(i));
-	    assert(!cerrh.nerrors());
-	    conf.clear();
-	    cp_argvec(_element_configurations[i], conf);
-	    if ((r = _elements[i]->configure(conf, &cerrh)) < 0) {
-		element_stage[i] = Element::CLEANUP_CONFIGURE_FAILED;
-		all_ok = false;
-		if (!cerrh.nerrors()) {
-		    if (r == -ENOMEM)
-			cerrh.error("out of memory");
-		    else
-			cerrh.error("unspecified error");
-		}
-	    } else
-		element_stage[i] = Element::CLEANUP_CONFIGURED;
+	    if (_elements[i]->flag_value('P') > 0)
+		parallel.push_back(i);
+	    else
+		element_stage[i] = configure_element(i, errh);
+	    if (parallel.size()
+		&& (ord + 1 == _elements.size()
+		    || configure_phase[_element_configure_order[ord + 1]] != configure_phase[i])) {
+		configure_parallel(parallel, element_stage, errh);
+		parallel.clear();
+	    }
 	}
+	for (int i = 0; i < _elements.size(); i++)
+	    if (element_stage[i] != Element::CLEANUP_CONFIGURED)
+		all_ok = false;
     }
 
 #if CLICK_DMALLOC
@@ -33,6 +33,11 @@
 #  define EV_SET_UDATA_CAST	/* nothing */
 # endif
 #endif
+#if HAVE_ALLOW_IO_URING
+# include <linux/io_uring.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+#endif
 CLICK_DECLS
 
 namespace {
@@ -40,8 +45,162 @@ enum { SELECT_READ = Element::SELECT_READ, SELECT_WRITE = Element::SELECT_WRITE
 #if !HAVE_ALLOW_POLL
 enum { POLLIN = Element::SELECT_READ, POLLOUT = Element::SELECT_WRITE };
 #endif
+#if HAVE_ALLOW_IO_URING
+// Linux poll bits, whatever POLLIN and POLLOUT mean here
+enum { uring_pollin = 0x001, uring_pollout = 0x004 };
+#endif
+}
+
+#if HAVE_ALLOW_IO_URING
+/* An io_uring used as a readiness notifier.  Each selected fd has one
+ * outstanding one-shot poll request, whose user_data holds the fd and a
+ * generation number.  A request that fires, or whose fd's events change, is
+ * replaced with a new one before the next wait; the replacements are
+ * submitted by the same io_uring_enter() call that waits, so a wait costs one
+ * system call however many fds became ready.  One-shot requests check
+ * readiness when armed, which keeps poll()'s level-triggered behavior for
+ * elements that do not drain their fds.  The ring only replaces poll():
+ * elements still read and write their fds themselves from selected(), or,
+ * like Socket and KernelTun with IO_URING, through rings of their own. */
+struct SelectSet::IOUring {
+    int fd;
+    unsigned sq_entries;
+    unsigned sq_mask;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned cq_mask;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    void *cq_map;
+    size_t sq_map_size;
+    size_t cq_map_size;
+    size_t sqes_size;
+    Vector<int> dirty;			// fds to rearm
+
+    enum { remove_user_data = ~(uint64_t) 0 };
+
+    IOUring()
+	: fd(-1), sqes(0), sq_map(0), cq_map(0) {
+    }
+    ~IOUring();
+    static IOUring *make(unsigned entries);
+
+    bool queue(int opcode, uint64_t user_data, uint64_t addr, unsigned events);
+    int enter(bool wait, const Timestamp *timeout);
+};
+
+SelectSet::IOUring *
+SelectSet::IOUring::make(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0)
+	return 0;
+    IOUring *u = new IOUring;
+    u->fd = fd;
+    // waiting with a timeout needs IORING_ENTER_EXT_ARG (Linux 5.11)
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+	delete u;
+	return 0;
+    }
+
+    u->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP);
+    if (single && u->cq_map_size > u->sq_map_size)
+	u->sq_map_size = u->cq_map_size;
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *m = mmap(0, u->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    u->sq_map = (m == MAP_FAILED ? 0 : m);
+    if (single)
+	u->cq_map = u->sq_map;
+    else if (u->sq_map) {
+	m = mmap(0, u->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	u->cq_map = (m == MAP_FAILED ? 0 : m);
+    }
+    if (u->cq_map) {
+	m = mmap(0, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	u->sqes = (m == MAP_FAILED ? 0 : reinterpret_cast<struct io_uring_sqe *>(m));
+    }
+    if (!u->sqes) {
+	delete u;
+	return 0;
+    }
+
+    char *sq = reinterpret_cast<char *>(u->sq_map);
+    char *cq = reinterpret_cast<char *>(u->cq_map);
+    u->sq_entries = p.sq_entries;
+    u->sq_mask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    u->sq_head = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    u->sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    u->sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    u->cq_mask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    u->cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    u->cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    u->cqes = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+    return u;
+}
+
+SelectSet::IOUring::~IOUring()
+{
+    if (sqes)
+	munmap(sqes, sqes_size);
+    if (cq_map && cq_map != sq_map)
+	munmap(cq_map, cq_map_size);
+    if (sq_map)
+	munmap(sq_map, sq_map_size);
+    if (fd >= 0)
+	close(fd);
+}
+
+bool
+SelectSet::IOUring::queue(int opcode, uint64_t user_data, uint64_t addr,
+			  unsigned events)
+{
+    unsigned tail = *sq_tail;
+    if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries) {
+	enter(false, 0);
+	if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries)
+	    return false;
+    }
+    unsigned idx = tail & sq_mask;
+    struct io_uring_sqe *sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = (opcode == IORING_OP_POLL_ADD ? (int) (uint32_t) user_data : -1);
+    sqe->addr = addr;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+    sq_array[idx] = idx;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
 }
 
+int
+SelectSet::IOUring::enter(bool wait, const Timestamp *timeout)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout) {
+	struct timespec t = timeout->timespec();
+	ts.tv_sec = t.tv_sec;
+	ts.tv_nsec = t.tv_nsec;
+	arg.ts = reinterpret_cast<uintptr_t>(&ts);
+    }
+    unsigned to_submit = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    int r = syscall(__NR_io_uring_enter, fd, to_submit, wait ? 1 : 0,
+		    IORING_ENTER_EXT_ARG | (wait ? IORING_ENTER_GETEVENTS : 0),
+		    &arg, sizeof(arg));
+    return r < 0 ? -errno : r;
+}
+#endif
+
 SelectSet::SelectSet()
 {
     _wake_pipe_pending = false;
@@ -58,6 +217,10 @@ SelectSet::SelectSet()
 # endif
 #endif
 
+#if HAVE_ALLOW_IO_URING
+    _uring = IOUring::make(256);
+#endif
+
 #if !HAVE_ALLOW_POLL
     FD_ZERO(&_read_select_fd_set);
     FD_ZERO(&_write_select_fd_set);
@@ -85,6 +248,9 @@ SelectSet::~SelectSet()
 #if HAVE_ALLOW_KQUEUE
     if (_kqueue >= 0)
 	close(_kqueue);
+#endif
+#if HAVE_ALLOW_IO_URING
+    delete _uring;
 #endif
     if (_wake_pipe[0] >= 0) {
 	close(_wake_pipe[0]);
@@ -189,6 +355,10 @@ SelectSet::register_select(int fd, bool add_read, bool add_write)
     }
 #endif
 
+#if HAVE_ALLOW_IO_URING
+    uring_mark(fd);
+#endif
+
     // ensure the element selector exists
     if (fd >= _selinfo.size())
 	_selinfo.resize(fd + 1);
@@ -257,6 +427,9 @@ SelectSet::remove_pollfd(int pi, int event)
 	_selinfo[fd].read = 0;
     else
 	_selinfo[fd].write = 0;
+#if HAVE_ALLOW_IO_URING
+    uring_mark(fd);
+#endif
 
 #if HAVE_ALLOW_KQUEUE
     // remove event from kqueue
@@ -424,6 +597,105 @@ SelectSet::run_selects_kqueue(RouterThread *thread)
 }
 #endif /* HAVE_ALLOW_KQUEUE */
 
+#if HAVE_ALLOW_IO_URING
+void
+SelectSet::uring_mark(int fd)
+{
+    if (_uring && !_selinfo[fd].uring_dirty) {
+	_selinfo[fd].uring_dirty = true;
+	_uring->dirty.push_back(fd);
+    }
+}
+
+void
+SelectSet::uring_submit_changes()
+{
+    // Replace the poll request of every changed or fired fd.  Even an fd
+    // whose events did not change is replaced, since it may have been
+    // closed and reopened.
+    int n = 0;
+    for (; n < _uring->dirty.size(); ++n) {
+	int fd = _uring->dirty[n];
+	SelectorInfo &si = _selinfo[fd];
+	uint64_t user_data = ((uint64_t) si.uring_gen << 32) | (uint32_t) fd;
+	if (si.uring_armed
+	    && !_uring->queue(IORING_OP_POLL_REMOVE, IOUring::remove_user_data, user_data, 0))
+	    break;
+	si.uring_armed = false;
+	int events = (si.pollfd >= 0 ? _pollfds[si.pollfd].events : 0);
+	if (events) {
+	    user_data = ((uint64_t) (si.uring_gen + 1) << 32) | (uint32_t) fd;
+	    if (!_uring->queue(IORING_OP_POLL_ADD, user_data, 0,
+			       (events & POLLIN ? uring_pollin : 0)
+			       | (events & POLLOUT ? uring_pollout : 0)))
+		break;
+	    ++si.uring_gen;
+	    si.uring_armed = true;
+	}
+	si.uring_dirty = false;
+    }
+    // the submission queue filled up: leave the rest for the next wait
+    _uring->dirty.erase(_uring->dirty.begin(), _uring->dirty.begin() + n);
+}
+
+void
+SelectSet::run_selects_io_uring(RouterThread *thread)
+{
+    uring_submit_changes();
+# if HAVE_MULTITHREAD
+    click_fence();
+    _select_lock.release();
+# endif
+
+    // Decide how long to wait.
+    Timestamp t;
+    int delay_type = thread->timer_set().next_timer_delay(thread->active(), t);
+    thread->set_thread_state_for_blocking(delay_type);
+
+    int r = _uring->enter(delay_type != 0, delay_type > 0 ? &t : 0);
+
+    if (post_select(thread, true))
+	return;
+
+    thread->set_thread_state(RouterThread::S_RUNSELECT);
+    if (r < 0 && r != -EINTR && r != -ETIME && r != -EAGAIN && r != -EBUSY)
+	click_chatter("io_uring_enter: %s", strerror(-r));
+
+    // Reap completions in batches.  Beware: calling 'selected()' might
+    // change _selinfo, so look everything up again for each completion.
+    struct io_uring_cqe cqe[64];
+    int n;
+    do {
+	unsigned head = *_uring->cq_head;
+	unsigned tail = __atomic_load_n(_uring->cq_tail, __ATOMIC_ACQUIRE);
+	for (n = 0; n < 64 && head != tail; ++n, ++head)
+	    cqe[n] = _uring->cqes[head & _uring->cq_mask];
+	__atomic_store_n(_uring->cq_head, head, __ATOMIC_RELEASE);
+
+	for (int i = 0; i < n; ++i) {
+	    if (cqe[i].user_data == (uint64_t) IOUring::remove_user_data)
+		continue;
+	    int fd = (int) (uint32_t) cqe[i].user_data;
+	    uint32_t gen = cqe[i].user_data >> 32;
+	    if ((unsigned) fd >= (unsigned) _selinfo.size()
+		|| !_selinfo[fd].uring_armed || _selinfo[fd].uring_gen != gen
+		|| cqe[i].res == -ECANCELED)
+		continue;
+	    // one-shot request fired; rearm before the next wait
+	    _selinfo[fd].uring_armed = false;
+	    uring_mark(fd);
+	    int res = cqe[i].res, mask;
+	    if (res < 0)
+		mask = Element::SELECT_READ | Element::SELECT_WRITE;
+	    else
+		mask = (res & ~uring_pollout ? Element::SELECT_READ : 0)
+		    + (res & ~uring_pollin ? Element::SELECT_WRITE : 0);
+	    call_selected(fd, mask);
+	}
+    } while (n == 64);
+}
+#endif /* HAVE_ALLOW_IO_URING */
+
 #if HAVE_ALLOW_POLL
 void
 SelectSet::run_selects_poll(RouterThread *thread)
@@ -571,6 +843,12 @@ SelectSet::run_selects(RouterThread *thread)
 
     // Call the relevant selector implementation.
     do {
+#if HAVE_ALLOW_IO_URING
+	if (_uring) {
+	    run_selects_io_uring(thread);
+	    break;
+	}
+#endif
 #if HAVE_ALLOW_KQUEUE
 	if (_kqueue >= 0) {
 	    run_selects_kqueue(thread);
@@ -56,6 +56,7 @@ extern "C"{
 #include <mini-os/xenbus.h>
 #include <mini-os/shutdown.h>
 #include <mini-os/sched.h>
+#include <mini-os/time.h>
 }
 
 void *__dso_handle = NULL;
@@ -65,6 +66,13 @@ void *__dso_handle = NULL;
 	printf("[%s:%d] " fmt "\n", \
 		__FUNCTION__, __LINE__, ##__VA_ARGS__)
 
+/* milliseconds elapsed since 'start', for boot time reports */
+static inline unsigned long
+elapsed_ms(s_time_t start)
+{
+	return (NOW() - start) / 1000000;
+}
+
 /**
  * xenstore helpers
  */
@@ -141,6 +149,7 @@ void
 router_thread(void *thread_data)
 {
 	u_int *rid = (u_int*) thread_data;
+	s_time_t start = NOW();
 	String *config = read_config(*rid);
 	struct router_instance *ri = &router_list[*rid];
 
@@ -152,6 +161,7 @@ router_thread(void *thread_data)
 	}
 
 	ri->r->activate(errh);
+	LOG("Router %u ready in %lu ms", *rid, elapsed_ms(start));
 
 	ri->r->use();
 
@@ -330,9 +340,11 @@ on_router(char *key, void *data)
 int main(int argc, char **argv)
 {
 	size_t len = sizeof(struct xenstore_dev);
+	s_time_t start = NOW();
 
 	click_static_initialize();
 	errh = ErrorHandler::default_handler();
+	LOG("Click initialized in %lu ms", elapsed_ms(start));
 
 	xsdev = (struct xenstore_dev*) malloc(len);
 	memset(xsdev, 0, len);
@@ -32,6 +32,7 @@
 #include <click/archive.hh>
 #include "specializer.hh"
 #include "signature.hh"
+#include "constants.hh"
 #include <click/clp.h>
 #include <click/driver.hh>
 #include <stdio.h>
@@ -53,13 +54,18 @@
 #define DEVIRTUALIZE_OPT	311
 #define INSTRS_OPT		312
 #define REVERSE_OPT		313
+#define FUSE_OPT		314
+#define STATIC_OPT		315
+#define CONSTANTS_OPT		316
 
 static const Clp_Option options[] = {
   { "clickpath", 'C', CLICKPATH_OPT, Clp_ValString, 0 },
   { "config", 'c', CONFIG_OPT, 0, Clp_Negate },
+  { "constants", 0, CONSTANTS_OPT, 0, Clp_Negate },
   { "devirtualize", 0, DEVIRTUALIZE_OPT, Clp_ValString, Clp_Negate },
   { "expression", 'e', EXPRESSION_OPT, Clp_ValString, 0 },
   { "file", 'f', ROUTER_OPT, Clp_ValString, 0 },
+  { "fuse", 'F', FUSE_OPT, 0, Clp_Negate },
   { "help", 0, HELP_OPT, 0, 0 },
   { 0, 'n', NO_DEVIRTUALIZE_OPT, Clp_ValString, 0 },
   { "kernel", 'k', KERNEL_OPT, 0, Clp_Negate }, // DEPRECATED
@@ -68,6 +74,7 @@ static const Clp_Option options[] = {
   { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
   { "reverse", 'r', REVERSE_OPT, 0, Clp_Negate },
   { "source", 's', SOURCE_OPT, 0, Clp_Negate },
+  { "static", 0, STATIC_OPT, 0, Clp_Negate },
   { "userlevel", 'u', USERLEVEL_OPT, 0, Clp_Negate },
   { "version", 'v', VERSION_OPT, 0, 0 }
 };
@@ -210,6 +217,11 @@ Options:\n\
   -s, --source                 Write source code only.\n\
   -c, --config                 Write new configuration only.\n\
   -r, --reverse                Reverse devirtualization.\n\
+  -F, --fuse                   Inline linear push chains into their sources.\n\
+      --constants              Compile simple element configurations into\n\
+                               the specialized code.\n\
+      --static                 Generate code for click-mkmindriver to link\n\
+                               into a driver, not a loadable package.\n\
   -n, --no-devirtualize CLASS  Don't devirtualize element class CLASS.\n\
   -i, --instructions FILE      Read devirtualization instructions from FILE.\n\
   -C, --clickpath PATH         Use PATH for CLICKPATH.\n\
@@ -241,6 +253,9 @@ main(int argc, char **argv)
   int compile_kernel = 0;
   int compile_user = 0;
   int reverse = 0;
+  int fuse = 0;
+  int static_link = 0;
+  int constants = 0;
   Vector<const char *> instruction_files;
   HashTable<String, int> specializing;
 
@@ -324,6 +339,18 @@ particular purpose.\n");
       reverse = !clp->negated;
       break;
 
+     case FUSE_OPT:
+      fuse = !clp->negated;
+      break;
+
+     case STATIC_OPT:
+      static_link = !clp->negated;
+      break;
+
+     case CONSTANTS_OPT:
+      constants = !clp->negated;
+      break;
+
      bad_option:
      case Clp_BadOption:
       short_usage();
@@ -337,7 +364,7 @@ particular purpose.\n");
   }
 
  done:
-  if (config_only)
+  if (config_only || static_link)
     compile_kernel = compile_user = 0;
 
   // read router
@@ -415,11 +442,21 @@ particular purpose.\n");
   }
 
   // analyze signatures to determine specialization
+  if (constants)
+    for (int i = 0; i < router->nelements(); i++) {
+      BakedConstants bc;
+      if (bake_constants(router->element(i), String(), bc))
+	sigs.specialize_configuration(i);
+    }
   sigs.analyze(full_elementmap);
 
   // initialize specializer
   Specializer specializer(router, full_elementmap);
   specializer.specialize(sigs, errh);
+  if (fuse)
+    specializer.fuse_push_chains();
+  if (constants)
+    specializer.bake_constants();
 
   // quit early if nothing was done
   if (specializer.nspecials() == 0) {
@@ -442,7 +479,9 @@ particular purpose.\n");
       md5_free(&pms);
       package_name = "clickdv_" + String(buf, buflen);
   }
-  router->add_requirement("package", package_name);
+  // a statically linked driver has the classes built in
+  if (!static_link)
+    router->add_requirement("package", package_name);
 
   // output
   StringAccum header, source;
@@ -451,7 +490,11 @@ particular purpose.\n");
 	 << "#define CLICK_" << package_name << "_HH\n"
 	 << "#include <click/package.hh>\n#include <click/element.hh>\n";
 
-  specializer.output_package(package_name, suffix, source, errh);
+  if (static_link)
+    // the driver's element list registers the classes
+    source << "#include <click/config.h>\n#include \"" << package_name << suffix << ".hh\"\n";
+  else
+    specializer.output_package(package_name, suffix, source, errh);
   specializer.output(header, source);
 
   header << "#endif\n";
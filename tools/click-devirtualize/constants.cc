@@ -0,0 +1,124 @@
+/*
+ * constants.{cc,hh} -- compile element configurations into specialized code
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+
+#include "constants.hh"
+#include "routert.hh"
+#include "cxxclass.hh"
+#include <click/args.hh>
+#include <click/confparse.hh>
+#include <click/etheraddress.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <clicknet/ether.h>
+#include <arpa/inet.h>
+
+void
+BakedConstants::add(const String &member, const String &value)
+{
+  patterns.push_back(compile_pattern(member));
+  values.push_back(value);
+}
+
+// Each function below mirrors its element's configure method, but parses
+// silently: a configuration it cannot fully understand at compile time,
+// such as an AddressInfo name, is simply left to the running element.
+
+static bool
+bake_nbytes(Vector<String> &conf, const String &, BakedConstants &bc)
+{
+  // Strip, Unstrip
+  unsigned nbytes;
+  if (Args(conf, ErrorHandler::silent_handler())
+      .read_mp("LENGTH", nbytes)
+      .complete() < 0)
+    return false;
+  bc.add("_nbytes", String(nbytes) + "U");
+  return true;
+}
+
+static bool
+bake_etherencap(Vector<String> &conf, const String &cxx_name,
+		BakedConstants &bc)
+{
+  uint16_t ether_type;
+  click_ether ethh;
+  if (Args(conf, ErrorHandler::silent_handler())
+      .read_mp("ETHERTYPE", ether_type)
+      .read_mp("SRC", EtherAddressArg(), ethh.ether_shost)
+      .read_mp("DST", EtherAddressArg(), ethh.ether_dhost)
+      .complete() < 0)
+    return false;
+  ethh.ether_type = htons(ether_type);
+
+  // The compiler turns a copy from a file-scope byte array into immediate
+  // stores, so prepending the header becomes a fixed 14-byte store.
+  const unsigned char *data = reinterpret_cast<const unsigned char *>(&ethh);
+  StringAccum sa;
+  sa << "static const unsigned char " << cxx_name << "_ethh[14] = {";
+  for (int i = 0; i < 14; i++)
+    sa.snprintf(8, (i ? ", 0x%02X" : " 0x%02X"), data[i]);
+  sa << " };\n";
+  bc.declarations = sa.take_string();
+  bc.add("&_ethh", cxx_name + "_ethh");
+  return true;
+}
+
+static bool
+bake_checkipheader(Vector<String> &conf, const String &, BakedConstants &bc)
+{
+  unsigned offset = 0;
+  bool checksum = true;
+  String ignored;
+  if (Args(ErrorHandler::silent_handler()).bind(conf)
+      .read("INTERFACES", AnyArg(), ignored)
+      .read("BADSRC", AnyArg(), ignored)
+      .read("GOODDST", AnyArg(), ignored)
+      .read("OFFSET", offset)
+      .read("VERBOSE", AnyArg(), ignored)
+      .read("DETAILS", AnyArg(), ignored)
+      .read("CHECKSUM", checksum)
+      .consume() < 0)
+    return false;
+  // the old positional form, "BADSRC, OFFSET", is left alone
+  if (conf.size() > 1
+      || (conf.size() == 1 && !IntArg().parse(conf[0], offset)))
+    return false;
+  bc.add("_offset", String(offset) + "U");
+  bc.add("_checksum", checksum ? "true" : "false");
+  return true;
+}
+
+static const struct {
+  const char *click_name;
+  bool (*bake)(Vector<String> &, const String &, BakedConstants &);
+} bakers[] = {
+  { "CheckIPHeader", bake_checkipheader },
+  { "EtherEncap", bake_etherencap },
+  { "Strip", bake_nbytes },
+  { "Unstrip", bake_nbytes }
+};
+
+bool
+bake_constants(const ElementT *e, const String &cxx_name, BakedConstants &bc)
+{
+  for (size_t i = 0; i < sizeof(bakers) / sizeof(bakers[0]); i++)
+    if (e->type_name() == bakers[i].click_name) {
+      Vector<String> conf;
+      cp_argvec(e->configuration(), conf);
+      return bakers[i].bake(conf, cxx_name, bc);
+    }
+  return false;
+}
@@ -0,0 +1,28 @@
+#ifndef CLICK_DEVIRTUALIZE_CONSTANTS_HH
+#define CLICK_DEVIRTUALIZE_CONSTANTS_HH
+#include <click/string.hh>
+#include <click/vector.hh>
+class ElementT;
+
+/* The configuration of some element classes sets members that stay fixed
+ * while the router runs.  A specialized class for such an element can
+ * compile those members in as constants: each member expression matching
+ * a pattern is replaced by a C++ constant expression, which may refer to
+ * file-scope constants in 'declarations'.  Those names start with the
+ * specialized class's name. */
+struct BakedConstants {
+
+  Vector<String> patterns;
+  Vector<String> values;
+  String declarations;
+
+  void add(const String &member, const String &value);
+
+};
+
+// Returns true and fills in BC if E's class and configuration can be
+// compiled into the specialized class CXX_NAME.
+bool bake_constants(const ElementT *e, const String &cxx_name,
+		    BakedConstants &bc);
+
+#endif
@@ -152,15 +152,18 @@ CxxFunction::find_expr(const String &pattern, int *pos1, int *pos2,
     }
 
     if (ppos >= plen) {
-      // check that this pattern match didn't occur after some evil qualifier,
-      // namely '.', '::', or '->'
+      // check that this pattern match didn't start in the middle of a
+      // name, or occur after some evil qualifier, namely '.', '::', or '->'
       int p = tpos1 - 1;
+      bool midname = (p >= 0 && (isalnum((unsigned char) ps[0]) || ps[0] == '_')
+		      && (isalnum((unsigned char) ts[p]) || ts[p] == '_'));
       while (p >= 0 && isspace((unsigned char) ts[p]))
 	p--;
-      if (p < 0
-	  || (ts[p] != '.'
-	      && (p == 0 || ts[p-1] != ':' || ts[p] != ':')
-	      && (p == 0 || ts[p-1] != '-' || ts[p] != '>'))) {
+      if (!midname
+	  && (p < 0
+	      || (ts[p] != '.'
+		  && (p == 0 || ts[p-1] != ':' || ts[p] != ':')
+		  && (p == 0 || ts[p-1] != '-' || ts[p] != '>')))) {
 	*pos1 = tpos1;
 	*pos2 = tpos;
 	return true;
@@ -38,6 +38,7 @@ class CxxFunction {
   const String &clean_body() const	{ return _clean_body; }
 
   void set_body(const String &b)	{ _body = b; _clean_body = String(); }
+  void set_ret_type(const String &t)	{ _ret_type = t; }
   void kill()				{ _alive = false; }
   void unkill()				{ _alive = true; }
 
@@ -28,10 +28,20 @@
 // determine an element's signature
 
 Signatures::Signatures(const RouterT *router)
-  : _router(router), _sigid(router->nelements(), 1)
+  : _router(router), _sigid(router->nelements(), 1),
+    _by_config(router->nelements(), 0)
 {
 }
 
+bool
+Signatures::same_configuration(int eid1, int eid2) const
+{
+  if (_by_config[eid1] != _by_config[eid2])
+    return false;
+  return !_by_config[eid1]
+    || _router->element(eid1)->configuration() == _router->element(eid2)->configuration();
+}
+
 void
 Signatures::create_phase_0(const ProcessingT &pt)
 {
@@ -46,7 +56,8 @@ Signatures::create_phase_0(const ProcessingT &pt)
       continue;
     ElementClassT *ec = _router->etype(i);
     for (int j = 0; j < _sigs.size(); j++)
-      if (sig_eclass[j] == ec && pt.same_processing(i, _sigs[j]._eid)) {
+      if (sig_eclass[j] == ec && pt.same_processing(i, _sigs[j]._eid)
+	  && same_configuration(i, _sigs[j]._eid)) {
 	_sigid[i] = j;
 	goto found_sigid;
       }
@@ -189,6 +200,14 @@ Signatures::specialize_class(const String &eclass_name, bool doit)
     _sigid[x->eindex()] = (doit ? 1 : SIG_NOT_SPECIAL);
 }
 
+void
+Signatures::specialize_configuration(int eid)
+{
+  // the specialized class will compile in this element's configuration,
+  // so only elements with the same configuration can share it
+  _by_config[eid] = 1;
+}
+
 void
 Signatures::analyze(ElementMap &em)
 {
@@ -25,6 +25,7 @@ class Signatures { public:
   Signatures(const RouterT *);
 
   void specialize_class(const String &, bool);
+  void specialize_configuration(int eid);
 
   void analyze(ElementMap &);
 
@@ -37,7 +38,9 @@ class Signatures { public:
 
   Vector<int> _sigid;
   Vector<SignatureNode> _sigs;
+  Vector<int> _by_config;
 
+  bool same_configuration(int, int) const;
   void create_phase_0(const ProcessingT &);
   void check_port_numbers(int eid, const ProcessingT &);
   bool next_phase(int phase, int eid, Vector<int> &, const ProcessingT &);
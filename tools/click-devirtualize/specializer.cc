@@ -26,6 +26,7 @@
 #include "elementmap.hh"
 #include <click/straccum.hh>
 #include "signature.hh"
+#include "constants.hh"
 #include <ctype.h>
 
 Specializer::Specializer(RouterT *router, const ElementMap &em)
@@ -439,6 +440,128 @@ Specializer::specialize(const Signatures &sigs, ErrorHandler *errh)
       create_connector_methods(_specials[s]);
 }
 
+int
+Specializer::fuse_push_chains()
+{
+  // A specialized class entered by exactly one connection, from another
+  // specialized class, has a single direct call site.  Forcing its push
+  // inline there costs no code size, and turns each linear run of such
+  // elements into one function: the push (or run_task) at the head of the
+  // chain.  Virtual calls still use the out-of-line copy.
+  Vector<int> nin(_specials.size(), 0);
+  Vector<int> nspecial_in(_specials.size(), 0);
+  Vector<int> pred(_specials.size(), -1);
+  for (RouterT::conn_iterator it = _router->begin_connections();
+       it != _router->end_connections(); ++it) {
+    int from = _specialize[it->from_eindex()], to = _specialize[it->to_eindex()];
+    nin[to]++;
+    if (_specials[from].special())
+      nspecial_in[to]++;
+    pred[to] = from;
+  }
+
+  Vector<int> fuse(_specials.size(), 0);
+  for (int s = 0; s < _specials.size(); s++)
+    fuse[s] = (_specials[s].special() && nin[s] == 1 && nspecial_in[s] == 1);
+
+  // Inlining every push around a cycle would never end, so leave one class
+  // on each cycle out of line.  Each candidate has a single predecessor;
+  // a walk that comes back to its start has found a cycle.
+  for (int s = 0; s < _specials.size(); s++)
+    if (fuse[s]) {
+      int t = pred[s];
+      for (int n = 0; t != s && fuse[t] && n < _specials.size(); n++)
+	t = pred[t];
+      if (t == s)
+	fuse[s] = 0;
+    }
+
+  int nfused = 0;
+  for (int s = 0; s < _specials.size(); s++) {
+    SpecializedClass &spc = _specials[s];
+    if (!spc.special())
+      continue;
+    // the connectors are the links of every chain
+    bool fused = false;
+    for (int i = 0; i < spc.cxxc->nfunctions(); i++) {
+      CxxFunction &fn = spc.cxxc->function(i);
+      if (!fn.alive() || fn.in_header())
+	continue;
+      if (fn.name() == "output_push" || fn.name() == "output_push_checked"
+	  || (fuse[s] && (fn.name() == "push" || fn.name() == "smaction"))) {
+	String ret_type = fn.ret_type();
+	if (ret_type.substring(0, 7) == "inline ")
+	  ret_type = ret_type.substring(7);
+	fn.set_ret_type("CLICK_ALWAYS_INLINE inline " + ret_type);
+	fused |= (fn.name() == "push");
+      }
+    }
+    nfused += fused;
+  }
+  return nfused;
+}
+
+static bool
+uses_any(const CxxFunction &fn, const Vector<String> &patterns)
+{
+  for (int i = 0; i < patterns.size(); i++)
+    if (fn.find_expr(patterns[i]))
+      return true;
+  return false;
+}
+
+int
+Specializer::bake_constants()
+{
+  // Signatures::specialize_configuration keeps elements with different
+  // configurations apart, so each class's configuration is its first
+  // element's.  The constants cannot change at run time, so the class
+  // refuses live reconfiguration, which also disables the write handlers
+  // that would have changed them.
+  int nbaked = 0;
+  for (int s = 0; s < _specials.size(); s++) {
+    SpecializedClass &spc = _specials[s];
+    BakedConstants bc;
+    if (!spc.special()
+	|| !::bake_constants(_router->element(spc.eindex), spc.cxx_name, bc))
+      continue;
+
+    // bring in the helpers, like EtherEncap::smaction, that specialized
+    // functions call and that use the constants
+    CxxClass *old_cxxc = _cxxinfo.find_class(etype_info(spc.eindex).cxx_name);
+    for (bool added = true; added; ) {
+      added = false;
+      for (int i = 0; i < old_cxxc->nfunctions(); i++) {
+	const CxxFunction &old_fn = old_cxxc->function(i);
+	if (spc.cxxc->find(old_fn.name()) || !uses_any(old_fn, bc.patterns))
+	  continue;
+	String call_pat = compile_pattern(old_fn.name() + "(");
+	bool called = false;
+	for (int j = 0; j < spc.cxxc->nfunctions() && !called; j++)
+	  called = (spc.cxxc->function(j).alive()
+		    && spc.cxxc->function(j).find_expr(call_pat));
+	if (called) {
+	  spc.cxxc->defun(old_fn);
+	  added = true;
+	}
+      }
+    }
+
+    for (int i = 0; i < spc.cxxc->nfunctions(); i++) {
+      CxxFunction &fn = spc.cxxc->function(i);
+      if (fn.alive())
+	for (int j = 0; j < bc.patterns.size(); j++)
+	  while (fn.replace_expr(bc.patterns[j], bc.values[j])) ;
+    }
+    spc.declarations = bc.declarations;
+    spc.cxxc->defun
+      (CxxFunction("can_live_reconfigure", true, "bool", "() const",
+		   " return false; ", ""));
+    nbaked++;
+  }
+  return nbaked;
+}
+
 void
 Specializer::fix_elements()
 {
@@ -548,8 +671,10 @@ Specializer::output(StringAccum& out_header, StringAccum& out)
       ElementTypeInfo &eti = etype_info(spc.eindex);
       if (eti.found_header_file)
 	out_header << "#include \"" << eti.found_header_file << "\"\n";
-      if (spc.special())
+      if (spc.special()) {
+	out_header << spc.declarations;
 	spc.cxxc->header_text(out_header);
+      }
     }
   }
 
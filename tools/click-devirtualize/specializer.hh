@@ -30,6 +30,7 @@ struct SpecializedClass {
   String cxx_name;
   CxxClass *cxxc;
   int eindex;
+  String declarations;
 
   SpecializedClass() : cxxc(0), eindex(-3)	{ }
   bool special() const				{ return cxxc != 0; }
@@ -47,6 +48,8 @@ class Specializer { public:
 		     const String &header_file, const String &source_dir);
 
   void specialize(const Signatures &, ErrorHandler *);
+  int fuse_push_chains();
+  int bake_constants();
   void fix_elements();
 
   int nspecials() const				{ return _specials.size(); }
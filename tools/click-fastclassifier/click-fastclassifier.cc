@@ -59,6 +59,7 @@
 #define COMPILE_OPT		312
 #define QUIET_OPT		313
 #define VERBOSE_OPT		314
+#define STATIC_OPT		315
 
 static const Clp_Option options[] = {
   { "classes", 0, COMPILE_OPT, 0, Clp_Negate },
@@ -73,6 +74,7 @@ static const Clp_Option options[] = {
   { "quiet", 'q', QUIET_OPT, 0, Clp_Negate },
   { "reverse", 'r', REVERSE_OPT, 0, Clp_Negate },
   { "source", 's', SOURCE_OPT, 0, Clp_Negate },
+  { "static", 0, STATIC_OPT, 0, Clp_Negate },
   { "user", 'u', USERLEVEL_OPT, 0, 0 },
   { "verbose", 'V', VERBOSE_OPT, 0, Clp_Negate },
   { "version", 'v', VERSION_OPT, 0, 0 }
@@ -110,6 +112,9 @@ Options:\n\
       --no-classes              Do not generate FastClassifier elements.\n\
   -k, --kernel                  Compile into Linux kernel binary package.\n\
   -u, --user                    Compile into user-level binary package.\n\
+      --static                  Generate code for click-mkmindriver or a\n\
+                                ClickOS build to link into a driver, not a\n\
+                                loadable package.\n\
   -s, --source                  Write source code only.\n\
   -c, --config                  Write new configuration only.\n\
   -r, --reverse                 Reverse transformation.\n\
@@ -691,7 +696,7 @@ output_classifier_program(int which,
 static void
 compile_classifiers(RouterT *r, const String &package_name,
 		    RouterT *nr, Vector<ElementT *> &classifiers,
-		    int compile_drivers, ErrorHandler *errh)
+		    int compile_drivers, bool static_link, ErrorHandler *errh)
 {
     // create C++ files
     StringAccum header, source, source_body;
@@ -702,8 +707,9 @@ compile_classifiers(RouterT *r, const String &package_name,
     // analyze Classifiers into programs
     analyze_classifiers(nr, classifiers, errh);
 
-    // add requirement
-    r->add_requirement("package", package_name);
+    // add requirement; a statically linked driver has the classes built in
+    if (!static_link)
+	r->add_requirement("package", package_name);
 
     // write Classifier programs
     for (int i = 0; i < all_programs.size(); i++)
@@ -721,7 +727,10 @@ compile_classifiers(RouterT *r, const String &package_name,
     // write final text
     header << "#endif\n";
     source << "/** click-compile: -w */\n";
-    {
+    if (static_link)
+	// the driver's element list registers the classes
+	source << "#include <click/config.h>\n#include \"" << package_name << ".hh\"\n";
+    else {
 	StringAccum elem2package, cmd_sa;
 	int nclasses = gen_cxxclass_names.size();
 	for (int i = 0; i < nclasses; i++)
@@ -730,6 +739,9 @@ compile_classifiers(RouterT *r, const String &package_name,
 	source << shell_command_output_string(cmd_sa.take_string(), elem2package.take_string(), errh);
     }
     source << "CLICK_DECLS\n" << source_body << "CLICK_ENDDECLS\n";
+    if (static_link)
+	for (int i = 0; i < gen_cxxclass_names.size(); i++)
+	    source << "EXPORT_ELEMENT(" << gen_cxxclass_names[i] << '-' << gen_eclass_names[i] << ")\n";
 
     // add source files to archive
     {
@@ -871,6 +883,7 @@ main(int argc, char **argv)
   bool config_only = false;
   bool reverse = false;
   bool file_is_expr = false;
+  bool static_link = false;
 
   while (1) {
     int opt = Clp_Next(clp);
@@ -941,6 +954,10 @@ particular purpose.\n");
       config_only = !clp->negated;
       break;
 
+     case STATIC_OPT:
+      static_link = !clp->negated;
+      break;
+
      case KERNEL_OPT:
       compile_drivers |= 1 << Driver::LINUXMODULE;
       break;
@@ -982,7 +999,7 @@ particular purpose.\n");
     r->flatten(errh);
   if (!r || errh->nerrors() > 0)
     exit(1);
-  if (source_only || config_only)
+  if (source_only || config_only || static_link)
     compile_drivers = 0;
 
   // open output file
@@ -1050,7 +1067,7 @@ particular purpose.\n");
   }
 
   if (do_compile)
-    compile_classifiers(r, package_name, classprogr, classifiers, compile_drivers, errh);
+    compile_classifiers(r, package_name, classprogr, classifiers, compile_drivers, static_link, errh);
 
   // write output
   if (source_only) {
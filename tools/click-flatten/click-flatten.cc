@@ -21,6 +21,10 @@
 #include <click/error.hh>
 #include <click/driver.hh>
 #include <click/confparse.hh>
+#include <click/straccum.hh>
+#include <click/archive.hh>
+#include <click/userutils.hh>
+#include <click/md5.h>
 #include "lexert.hh"
 #include "routert.hh"
 #include "toolutils.hh"
@@ -42,6 +46,7 @@
 #define DECLARATIONS_OPT	309
 #define CONFIG_OPT		310
 #define EXPAND_VARS_OPT		311
+#define IMAGE_OPT		312
 
 static const Clp_Option options[] = {
   { "classes", 'c', CLASSES_OPT, 0, 0 },
@@ -54,6 +59,7 @@ static const Clp_Option options[] = {
   { "expression", 'e', EXPRESSION_OPT, Clp_ValString, 0 },
   { "file", 'f', ROUTER_OPT, Clp_ValString, 0 },
   { "help", 0, HELP_OPT, 0, 0 },
+  { "image", 0, IMAGE_OPT, 0, 0 },
   { "names", 'n', ELEMENTS_OPT, 0, 0 },
   { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
   { "version", 'v', VERSION_OPT, 0, 0 },
@@ -87,6 +93,7 @@ Options:\n\
   -e, --expression EXPR     Use EXPR as router configuration.\n\
       --config              Output configuration only (not an archive).\n\
       --expand-vars         Expand global variables.\n\
+      --image               Output an archive with a precompiled router image.\n\
   -o, --output FILE         Write output configuration to FILE.\n\
   -C, --clickpath PATH      Use PATH for CLICKPATH.\n\
       --help                Print this message and exit.\n\
@@ -104,6 +111,76 @@ extern "C" {
   }
 }
 
+static void
+image_string(StringAccum &sa, const String &s)
+{
+  sa << s.length() << ':' << s;
+}
+
+static String
+router_image(RouterT *r, const String &config)
+{
+  // see "ROUTER IMAGES" in lib/lexer.cc for the format
+  StringAccum sa;
+  md5_state_t pms;
+  char buf[MD5_TEXT_DIGEST_MAX_SIZE];
+  md5_init(&pms);
+  md5_append(&pms, (const md5_byte_t *) config.data(), config.length());
+  int buflen = md5_finish_text(&pms, buf, 0);
+  md5_free(&pms);
+  sa << "%click-image 1 ";
+  sa.append(buf, buflen);
+  sa << '\n';
+  const Vector<String> &req = r->requirements();
+  for (int i = 0; i + 1 < req.size(); i += 2) {
+    sa << "r ";
+    image_string(sa, req[i]);
+    sa << ' ';
+    image_string(sa, req[i+1]);
+    sa << '\n';
+  }
+
+  Vector<int> number(r->nelements(), -1);
+  int n = 0;
+  for (RouterT::iterator x = r->begin_elements(); x; x++) {
+    number[x->eindex()] = n++;
+    sa << "e ";
+    image_string(sa, x->type_name());
+    sa << ' ';
+    image_string(sa, x->name());
+    sa << ' ';
+    image_string(sa, x->landmark());
+    sa << ' ';
+    image_string(sa, x->configuration());
+    sa << '\n';
+  }
+
+  for (RouterT::conn_iterator it = r->begin_connections();
+       it != r->end_connections(); ++it)
+    sa << "c " << number[it->from_eindex()] << ' ' << it->from_port()
+       << ' ' << number[it->to_eindex()] << ' ' << it->to_port() << '\n';
+  return sa.take_string();
+}
+
+static void
+write_router_image(RouterT *r, FILE *out, ErrorHandler *errh)
+{
+  Vector<ArchiveElement> narchive;
+  narchive.push_back(init_archive_element("config", 0644));
+  narchive.back().data = r->configuration_string();
+  narchive.push_back(init_archive_element("image", 0644));
+  narchive.back().data = router_image(r, narchive[0].data);
+
+  const Vector<ArchiveElement> &archive = r->archive();
+  for (int i = 0; i < archive.size(); i++)
+    if (archive[i].live() && archive[i].name != "config"
+	&& archive[i].name != "image")
+      narchive.push_back(archive[i]);
+
+  String s = ArchiveElement::unparse(narchive, errh);
+  ignore_result(fwrite(s.data(), 1, s.length(), out));
+}
+
 static void
 output_sorted_one_per_line(Vector<String> &v, FILE *out)
 {
@@ -161,6 +238,7 @@ particular purpose.\n");
      case DECLARATIONS_OPT:
      case ELEMENTS_OPT:
      case CONFIG_OPT:
+     case IMAGE_OPT:
       action = opt;
       break;
 
@@ -207,7 +285,7 @@ particular purpose.\n");
  done:
   RouterT *router = read_router(router_file, file_is_expr, errh);
   if (router)
-      router->flatten(errh, expand_vars);
+      router->flatten(errh, expand_vars || action == IMAGE_OPT);
   if (!router || errh->nerrors() > 0)
     exit(1);
 
@@ -225,6 +303,10 @@ particular purpose.\n");
     write_router_file(router, out, errh);
     break;
 
+   case IMAGE_OPT:
+    write_router_image(router, out, errh);
+    break;
+
    case CONFIG_OPT: {
      String s = router->configuration_string();
      ignore_result(fwrite(s.data(), 1, s.length(), out));
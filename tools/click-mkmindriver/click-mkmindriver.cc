@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <time.h>
+#include <unistd.h>
 
 #define HELP_OPT		300
 #define VERSION_OPT		301
@@ -50,6 +51,7 @@
 #define CHECK_OPT		313
 #define VERBOSE_OPT		314
 #define EXTRAS_OPT		315
+#define MINIOS_OPT		316
 
 static const Clp_Option options[] = {
   { "align", 'A', ALIGN_OPT, 0, 0 },
@@ -64,6 +66,7 @@ static const Clp_Option options[] = {
   { "help", 0, HELP_OPT, 0, 0 },
   { "kernel", 'k', KERNEL_OPT, 0, 0 }, // DEPRECATED
   { "linuxmodule", 'l', KERNEL_OPT, 0, 0 },
+  { "minios", 'm', MINIOS_OPT, 0, 0 },
   { "package", 'p', PACKAGE_OPT, Clp_ValString, 0 },
   { "userlevel", 'u', USERLEVEL_OPT, 0, 0 },
   { "verbose", 'V', VERBOSE_OPT, 0, Clp_Negate }
@@ -74,6 +77,7 @@ static const char *program_name;
 static int driver = -1;
 static String subpackage;
 static HashTable<String, int> initial_requirements(-1);
+static HashTable<String, int> excluded_classes(-1);
 static bool verbose = false;
 
 void
@@ -92,10 +96,10 @@ usage()
 which contains just the elements required to support one or more\n\
 configurations. Run 'click-mkmindriver' in the relevant driver's build\n\
 directory and supply a package name with the '-p PKG' option. Running\n\
-'make MINDRIVER=PKG' will build a 'PKGclick' user-level driver or 'PKGclick.ko'\n\
-kernel module.\n\
+'make MINDRIVER=PKG' will build a 'PKGclick' user-level driver, a\n\
+'PKGclick.ko' kernel module, or a 'PKGclickos' ClickOS image.\n\
 \n\
-Usage: %s -p PKG [-lu] [OPTION]... [ROUTERFILE]...\n\
+Usage: %s -p PKG [-lum] [OPTION]... [ROUTERFILE]...\n\
 \n\
 Options:\n\
   -p, --package PKG        Name of package is PKG.\n\
@@ -105,6 +109,7 @@ Options:\n\
                            even those in unused compound elements.\n\
   -l, --linuxmodule        Build Makefile for Linux kernel module driver.\n\
   -u, --userlevel          Build Makefile for user-level driver (default).\n\
+  -m, --minios             Build Makefile for ClickOS (MiniOS) driver.\n\
   -d, --directory DIR      Put files in DIR. DIR must contain a 'Makefile'\n\
                            for the relevant driver. Default is '.'.\n\
   -E, --elements ELTS      Include element classes ELTS.\n\
@@ -127,19 +132,25 @@ class Mindriver { public:
     void add_source_file(const String&, ErrorHandler*);
 
     void add_router_requirements(RouterT*, ElementMap&, ErrorHandler*);
+    void add_router_sources(RouterT*, ElementMap&, ErrorHandler*);
+    void write_router_sources(const String &directory, const String &package, ErrorHandler*);
     bool add_traits(const Traits&, const ElementMap&, ErrorHandler*);
     bool resolve_requirement(const String& requirement, const ElementMap& emap, ErrorHandler* errh, bool complain = true);
-    void print_elements_conf(FILE*, String package, const ElementMap&, const String &top_srcdir);
+    void print_elements_conf(FILE*, String package, const ElementMap&, const String &top_srcdir, const String &directory);
 
     HashTable<String, int> _provisions;
     HashTable<String, int> _requirements;
     HashTable<String, int> _source_files;
     int _nrequirements;
 
+    Vector<ArchiveElement> _router_sources;	// written to the build directory
+    HashTable<String, int> _local_files;
+
 };
 
 Mindriver::Mindriver()
-    : _provisions(-1), _requirements(-1), _source_files(-1), _nrequirements(0)
+    : _provisions(-1), _requirements(-1), _source_files(-1), _nrequirements(0),
+      _local_files(-1)
 {
 }
 
@@ -182,6 +193,7 @@ Mindriver::add_router_requirements(RouterT* router, ElementMap& emap, ErrorHandl
 	return;
     }
     emap.set_driver(driver);
+    add_router_sources(router, emap, errh);
 
     StringAccum missing_sa;
     int nmissing = 0;
@@ -204,6 +216,88 @@ Mindriver::add_router_requirements(RouterT* router, ElementMap& emap, ErrorHandl
 	errh->fatal("cannot locate these required element classes:\n  %s\n(This may be due to a missing or out-of-date %<elementmap.xml%>.)", missing_sa.c_str());
 }
 
+void
+Mindriver::add_router_sources(RouterT* router, ElementMap& emap, ErrorHandler* errh)
+{
+    // 'click-devirtualize --static' and 'click-fastclassifier --static'
+    // ship their classes' source code and elementmap in the configuration
+    // archive
+    const Vector<String> &requirements = router->requirements();
+    for (int i = 0; i < requirements.size(); i += 2)
+	if (requirements[i].equals("package", 7)
+	    && (requirements[i+1].substring(0, 8) == "clickdv_"
+		|| requirements[i+1].substring(0, 8) == "clickfc_")) {
+	    errh->error("%<%s%> is a loadable package\n(Run %<click-devirtualize%> or %<click-fastclassifier%> with %<--static%> to build it into a driver.)", requirements[i+1].c_str());
+	    return;
+	}
+
+    for (int aei = 0; aei < router->narchive(); aei++) {
+	const ArchiveElement &emap_ae = router->archive(aei);
+	if (emap_ae.name.substring(0, 11) != "elementmap-"
+	    || emap_ae.name.substring(-4) != ".xml")
+	    continue;
+	ElementMap local_emap(emap_ae.data);
+	bool any = false;
+	for (int i = 1; i < local_emap.size(); i++) {
+	    const Traits &t = local_emap.traits_at(i);
+	    const String *files[2] = { &t.source_file, &t.header_file };
+	    if (router->archive_index(t.source_file) < 0)
+		continue;
+	    any = true;
+	    for (int j = 0; j < 2; j++)
+		if (_local_files.get(*files[j]) < 0) {
+		    int fi = router->archive_index(*files[j]);
+		    if (fi < 0) {
+			errh->error("archive lacks %<%s%>", files[j]->c_str());
+			continue;
+		    }
+		    _local_files.set(*files[j], 1);
+		    _router_sources.push_back(router->archive(fi));
+		}
+	}
+	if (any)
+	    emap.parse(emap_ae.data);
+    }
+}
+
+void
+Mindriver::write_router_sources(const String &directory, const String &package, ErrorHandler* errh)
+{
+    if (!_router_sources.size())
+	return;
+
+    // the minios Makefile builds element objects in their own directory
+    String objdir = (driver == Driver::MINIOS ? "$(CLICK_ELEMENTS_OBJ_DIR)/" : "");
+    StringAccum flags;
+    for (ArchiveElement *ae = _router_sources.begin(); ae != _router_sources.end(); ++ae) {
+	String fn = directory + ae->name;
+	errh->message("Creating %s...", fn.c_str());
+	FILE *f = fopen(fn.c_str(), "w");
+	if (!f)
+	    errh->fatal("%s: %s", fn.c_str(), strerror(errno));
+	ignore_result(fwrite(ae->data.data(), 1, ae->data.length(), f));
+	fclose(f);
+
+	// pass on the compiler flags requested by a "click-compile:" comment
+	if (ae->name.substring(-3) == ".cc" && ae->data.substring(0, 18) == "/** click-compile:") {
+	    int end = ae->data.find_left("*/");
+	    flags << objdir << ae->name.substring(0, -3) << ".o: CXXFLAGS += "
+		  << cp_uncomment(ae->data.substring(18, end - 18)) << '\n';
+	}
+    }
+
+    if (flags.length()) {
+	String fn = directory + "elements_" + package + "-flags.mk";
+	errh->message("Creating %s...", fn.c_str());
+	FILE *f = fopen(fn.c_str(), "w");
+	if (!f)
+	    errh->fatal("%s: %s", fn.c_str(), strerror(errno));
+	// the element list includes the generated headers, too
+	fprintf(f, "# Generated by 'click-mkmindriver -p %s'\n%s%selements_%s.o: CXXFLAGS += -fno-access-control\n", package.c_str(), flags.c_str(), objdir.c_str(), package.c_str());
+	fclose(f);
+    }
+}
+
 static void
 handle_router(Mindriver& md, String filename_in, ElementMap &emap, ErrorHandler *errh)
 {
@@ -262,6 +356,12 @@ Mindriver::resolve_requirement(const String& requirement, const ElementMap& emap
     if (_provisions.get(requirement) > 0)
 	return true;
 
+    if (excluded_classes.get(requirement) > 0) {
+	if (complain)
+	    errh->error("%<%s%> is excluded from the %s driver", requirement.c_str(), Driver::name(driver));
+	return false;
+    }
+
     int try_name_emapi = emap.traits_index(requirement);
     if (try_name_emapi > 0) {
 	add_traits(emap.traits_at(try_name_emapi), emap, &lerrh);
@@ -269,7 +369,8 @@ Mindriver::resolve_requirement(const String& requirement, const ElementMap& emap
     }
 
     for (int i = 1; i < emap.size(); i++)
-	if (emap.traits_at(i).provides(requirement)) {
+	if (emap.traits_at(i).provides(requirement)
+	    && excluded_classes.get(emap.traits_at(i).name) < 0) {
 	    add_traits(emap.traits_at(i), emap, &lerrh);
 	    return true;
 	}
@@ -288,7 +389,7 @@ Mindriver::resolve_requirement(const String& requirement, const ElementMap& emap
 }
 
 void
-Mindriver::print_elements_conf(FILE *f, String package, const ElementMap &emap, const String &top_srcdir)
+Mindriver::print_elements_conf(FILE *f, String package, const ElementMap &emap, const String &top_srcdir, const String &directory)
 {
     Vector<String> sourcevec;
     for (HashTable<String, int>::iterator iter = _source_files.begin();
@@ -306,7 +407,8 @@ Mindriver::print_elements_conf(FILE *f, String package, const ElementMap &emap,
     for (int i = 1; i < emap.size(); i++) {
 	const Traits &elt = emap.traits_at(i);
 	int sourcei = _source_files.get(elt.source_file);
-	if (sourcei >= 0 && emap.package(elt) == subpackage) {
+	if (sourcei >= 0 && (emap.package(elt) == subpackage
+			     || _local_files.get(elt.source_file) > 0)) {
 	    // track ELEMENT_LIBS
 	    // ah, if only I had regular expressions
 	    if (!headervec[sourcei] && elt.libs) {
@@ -352,7 +454,10 @@ Mindriver::print_elements_conf(FILE *f, String package, const ElementMap &emap,
     for (int i = 0; i < sourcevec.size(); i++)
 	if (headervec[i]) {
 	    String classstr(classvec[i].begin() + 1, classvec[i].end());
-	    if (headervec[i][0] != '\"' && headervec[i][0] != '<')
+	    if (_local_files.get(sourcevec[i]) > 0)
+		// generated source lives in the build directory
+		fprintf(f, "%s%s\t\"%s%s\"\t%s\n", directory.c_str(), sourcevec[i].c_str(), directory.c_str(), headervec[i].c_str(), classstr.c_str());
+	    else if (headervec[i][0] != '\"' && headervec[i][0] != '<')
 		fprintf(f, "%s%s\t\"%s%s\"\t%s\n", top_srcdir.c_str(), sourcevec[i].c_str(), top_srcdir.c_str(), headervec[i].c_str(), classstr.c_str());
 	    else
 		fprintf(f, "%s%s\t%s\t%s\n", top_srcdir.c_str(), sourcevec[i].c_str(), headervec[i].c_str(), classstr.c_str());
@@ -385,6 +490,8 @@ analyze_makefile(const String &directory, ErrorHandler *errh)
             allowed_drivers |= 1 << Driver::USERLEVEL;
         if (text.find_left("\n## Click linuxmodule driver Makefile ##\n") >= 0)
             allowed_drivers |= 1 << Driver::LINUXMODULE;
+        if (text.find_left("\n## Click minios driver Makefile ##\n") >= 0)
+            allowed_drivers |= 1 << Driver::MINIOS;
     }
     if (allowed_drivers == 0) {
         errh->error("%s unrecognized as Click Makefile", fn.c_str());
@@ -392,18 +499,26 @@ analyze_makefile(const String &directory, ErrorHandler *errh)
     }
 
     if (driver < 0)
-        driver = (allowed_drivers & (1 << Driver::USERLEVEL) ? Driver::USERLEVEL : Driver::LINUXMODULE);
+        for (driver = 0; !(allowed_drivers & (1 << driver)); ++driver)
+            /* nada */;
     if (!(allowed_drivers & (1 << driver))) {
 	errh->error("%s does not support %s driver", fn.c_str(), Driver::name(driver));
 	return String();
     }
 
-    if ((pos = text.find_left("\ntop_srcdir := ")) < 0) {
+    // the minios Makefile aligns its assignments with tabs
+    const char *s = text.begin();
+    while ((pos = text.find_left("\ntop_srcdir", s - text.begin())) >= 0) {
+	s = cp_skip_space(text.begin() + pos + 11, text.end());
+	if (s + 2 < text.end() && s[0] == ':' && s[1] == '=')
+	    break;
+    }
+    if (pos < 0) {
 	errh->error("%s lacks top_srcdir variable", fn.c_str());
 	return String();
     }
-    int endpos = text.find_left('\n', pos + 1);
-    String top_srcdir = text.substring(pos + 15, endpos - (pos + 15));
+    s = cp_skip_space(s + 2, text.end());
+    String top_srcdir = text.substring(s, find(s, text.end(), '\n'));
     if (top_srcdir.back() != '/')
 	top_srcdir += '/';
     return top_srcdir;
@@ -464,6 +579,10 @@ particular purpose.\n");
 	    driver = Driver::USERLEVEL;
 	    break;
 
+	  case MINIOS_OPT:
+	    driver = Driver::MINIOS;
+	    break;
+
 	  case PACKAGE_OPT:
 	    package_name = clp->vstr;
 	    break;
@@ -531,6 +650,20 @@ particular purpose.\n");
 	errh->fatal("fatal error: no package name specified\nPlease supply the %<-p PKG%> option.");
 
     String top_srcdir = analyze_makefile(directory, (check ? errh : ErrorHandler::silent_handler()));
+    if (driver < 0)
+	driver = Driver::USERLEVEL;
+
+    // classes the driver's own build leaves out, like findelem -X
+    if (top_srcdir) {
+	String fn = (top_srcdir[0] == '/' ? top_srcdir : directory + top_srcdir);
+	fn += String(Driver::name(driver)) + "/elements.exclude";
+	if (access(fn.c_str(), F_OK) >= 0) {
+	    Vector<String> classes;
+	    cp_spacevec(file_string(fn, errh), classes);
+	    for (String *c = classes.begin(); c != classes.end(); ++c)
+		excluded_classes.set(*c, 1);
+	}
+    }
 
     if (extras && !subpackage) {
 	md.require("Align", errh);
@@ -598,8 +731,9 @@ particular purpose.\n");
 	FILE *f = fopen(fn.c_str(), "w");
 	if (!f)
 	    errh->fatal("%s: %s", fn.c_str(), strerror(errno));
-	md.print_elements_conf(f, package_name, default_emap, top_srcdir);
+	md.print_elements_conf(f, package_name, default_emap, top_srcdir, directory);
 	fclose(f);
+	md.write_router_sources(directory, package_name, errh);
     }
 
     // Final message
@@ -610,6 +744,8 @@ particular purpose.\n");
             errh->message("Build %<%s.ko%> with %<make MINDRIVER=%s%>.", package_name, package_name);
 	else if (driver == Driver::USERLEVEL)
 	    errh->message("Build %<%sclick%> with %<make MINDRIVER=%s%>.", package_name, package_name);
+	else if (driver == Driver::MINIOS)
+	    errh->message("Build %<%sclickos%> with %<make MINDRIVER=%s%>.\n(%<make MINDRIVER=%s size%> reports its size.)", package_name, package_name, package_name);
 	else
 	    errh->message("Build %<%sclick.ko%> with %<make MINDRIVER=%s%>.", package_name, package_name);
 	return 0;
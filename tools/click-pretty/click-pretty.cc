@@ -25,6 +25,7 @@
 #include "lexert.hh"
 #include "lexertinfo.hh"
 #include "html.hh"
+#include "livecounts.hh"
 #include <click/error.hh>
 #include <click/driver.hh>
 #include <click/straccum.hh>
@@ -49,6 +50,9 @@
 #define GML_OPT			312
 #define GRAPHML_OPT		313
 #define TEMPLATE_TEXT_OPT	314
+#define PORT_OPT		315
+#define INTERVAL_OPT		316
+#define ITERATIONS_OPT		317
 
 #define FIRST_DRIVER_OPT	1000
 #define USERLEVEL_OPT		(1000 + Driver::USERLEVEL)
@@ -66,10 +70,13 @@ static const Clp_Option options[] = {
     { "gml", 0, GML_OPT, 0, 0 },
     { "graphml", 0, GRAPHML_OPT, 0, 0 },
     { "help", 0, HELP_OPT, 0, 0 },
+    { "interval", 0, INTERVAL_OPT, Clp_ValDouble, 0 },
+    { "iterations", 0, ITERATIONS_OPT, Clp_ValInt, 0 },
     { "kernel", 'k', LINUXMODULE_OPT, 0, 0 }, // DEPRECATED
     { "linuxmodule", 'l', LINUXMODULE_OPT, 0, 0 },
     { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
     { "package-docs", 0, PACKAGE_URLS_OPT, Clp_ValString, 0 },
+    { "port", 'p', PORT_OPT, Clp_ValString, 0 },
     { "template", 't', TEMPLATE_OPT, Clp_ValString, Clp_PreferredMatch },
     { "template-text", 'T', TEMPLATE_TEXT_OPT, Clp_ValString, 0 },
     { "userlevel", 0, USERLEVEL_OPT, 0, 0 },
@@ -1106,17 +1113,16 @@ pretty_process(const char *infile, bool file_is_expr, const char *outfile,
 // This algorithm based on the original click-viz script,
 // donated by Jose Vasconcellos <jvasco@bellatlantic.net>
 static void
-pretty_process_dot(const char *infile, bool file_is_expr, const char *outfile,
-		   const String &the_template, ErrorHandler *errh)
+output_dot(PrettyRouter &pr, FILE *outf, const String &the_template,
+	   const LiveCounts *counts)
 {
-    PrettyRouter pr(infile, file_is_expr, outfile, errh);
-    if (!pr.ok())
-	return;
     HashTable<String, String> attrs;
     ElementsOutput eo(pr.r, *pr.processing, attrs);
+    if (counts && !counts->has_rates())
+	counts = 0;
 
     // write dot configuration
-    fprintf(pr.outf, "digraph clickrouter {\n\
+    fprintf(outf, "digraph clickrouter {\n\
   node [shape=record,height=.1]\n\
   edge [arrowhead=normal,arrowtail=none,tailclip=false]\n");
 
@@ -1126,57 +1132,139 @@ pretty_process_dot(const char *infile, bool file_is_expr, const char *outfile,
 	 ++n) {
 	String label_text = eo.run(the_template, n.operator->());
 #if 1
-	fprintf(pr.outf, "  \"%s\" [label=\"", n->name_c_str());
+	fprintf(outf, "  \"%s\" [label=\"", n->name_c_str());
 	if (n->ninputs() || n->noutputs())
-	    fprintf(pr.outf, "{");
+	    fprintf(outf, "{");
 	if (n->ninputs()) {
-	    fprintf(pr.outf, "{");
+	    fprintf(outf, "{");
 	    for (int i = 0; i < n->ninputs(); i++)
-		fprintf(pr.outf, (i ? "|<i%d>" : "<i%d>"), i);
-	    fprintf(pr.outf, "}|");
+		fprintf(outf, (i ? "|<i%d>" : "<i%d>"), i);
+	    fprintf(outf, "}|");
 	}
-	fputs(label_text.c_str(), pr.outf);
+	fputs(label_text.c_str(), outf);
+	double pps = (counts ? counts->element_pps(n->eindex()) : -1);
+	if (pps >= 0)
+	    fprintf(outf, "\\n%s", unparse_rate(pps, "pps").c_str());
 	if (n->noutputs()) {
-	    fprintf(pr.outf, "|{");
+	    fprintf(outf, "|{");
 	    for (int i = 0; i < n->noutputs(); i++)
-		fprintf(pr.outf, (i ? "|<o%d>" : "<o%d>"), i);
-	    fprintf(pr.outf, "}");
+		fprintf(outf, (i ? "|<o%d>" : "<o%d>"), i);
+	    fprintf(outf, "}");
 	}
 	if (n->ninputs() || n->noutputs())
-	    fprintf(pr.outf, "}");
-	fprintf(pr.outf, "\"];\n");
+	    fprintf(outf, "}");
+	fprintf(outf, "\"");
+	// shade elements by load: the busiest is fully red
+	if (pps > 0 && counts->max_element_pps() > 0)
+	    fprintf(outf, ",style=filled,fillcolor=\"0.000 %.3f 1.000\"",
+		    pps / counts->max_element_pps());
+	fprintf(outf, "];\n");
 #else
 	if (!n->ninputs() && !n->noutputs())
-	    fprintf(pr.outf, "  \"%s\" [label=\"%s\"];\n",
+	    fprintf(outf, "  \"%s\" [label=\"%s\"];\n",
 		    n->name_c_str(), label_text.c_str());
 	else {
-	    fprintf(pr.outf, "  \"%s\" [label=< <TABLE BORDER=\"0\">", n->name_c_str());
+	    fprintf(outf, "  \"%s\" [label=< <TABLE BORDER=\"0\">", n->name_c_str());
 	    if (n->ninputs() > 0) {
-		fprintf(pr.outf, "<TR><TD><TABLE BORDER=\"0\"><TR>");
+		fprintf(outf, "<TR><TD><TABLE BORDER=\"0\"><TR>");
 		for (int i = 0; i < n->ninputs(); i++)
-		    fprintf(pr.outf, "<TD PORT=\"i%d\">X</TD>", i);
-		fprintf(pr.outf, "</TR></TABLE></TD></TR>");
+		    fprintf(outf, "<TD PORT=\"i%d\">X</TD>", i);
+		fprintf(outf, "</TR></TABLE></TD></TR>");
 	    }
-	    fprintf(pr.outf, "<TR><TD>%s</TD></TR>", label_text.c_str());
+	    fprintf(outf, "<TR><TD>%s</TD></TR>", label_text.c_str());
 	    if (n->noutputs() > 0) {
-		fprintf(pr.outf, "<TR><TD><TABLE BORDER=\"0\"><TR>");
+		fprintf(outf, "<TR><TD><TABLE BORDER=\"0\"><TR>");
 		for (int i = 0; i < n->noutputs(); i++)
-		    fprintf(pr.outf, "<TD PORT=\"o%d\">X</TD>", i);
-		fprintf(pr.outf, "</TR></TABLE></TD></TR>");
+		    fprintf(outf, "<TD PORT=\"o%d\">X</TD>", i);
+		fprintf(outf, "</TR></TABLE></TD></TR>");
 	    }
-	    fprintf(pr.outf, "</TABLE> >];\n");
+	    fprintf(outf, "</TABLE> >];\n");
 	}
 #endif
     }
 
     // print all connections
     for (RouterT::conn_iterator it = pr.r->begin_connections();
-	 it != pr.r->end_connections(); ++it)
-	fprintf(pr.outf, "  \"%s\":o%d -> \"%s\":i%d;\n",
+	 it != pr.r->end_connections(); ++it) {
+	fprintf(outf, "  \"%s\":o%d -> \"%s\":i%d",
 		it->from_element()->name_c_str(), it->from_port(),
 		it->to_element()->name_c_str(), it->to_port());
+	double pps = (counts ? counts->connection_pps(*it) : -1);
+	if (pps >= 0) {
+	    double bps = counts->connection_bps(*it);
+	    double frac = (counts->max_element_pps() > 0 ? pps / counts->max_element_pps() : 0);
+	    fprintf(outf, " [label=\"%s", unparse_rate(pps, "pps").c_str());
+	    if (bps >= 0)
+		fprintf(outf, "\\n%s", unparse_rate(bps, "bps").c_str());
+	    fprintf(outf, "\",penwidth=%.1f]", 1 + 4 * (frac > 1 ? 1 : frac));
+	}
+	fprintf(outf, ";\n");
+    }
+
+    fprintf(outf, "}\n");
+}
 
-    fprintf(pr.outf, "}\n");
+static void
+pretty_process_dot(const char *infile, bool file_is_expr, const char *outfile,
+		   const String &the_template, ErrorHandler *errh)
+{
+    PrettyRouter pr(infile, file_is_expr, outfile, errh);
+    if (pr.ok())
+	output_dot(pr, pr.outf, the_template, 0);
+}
+
+static void
+pretty_process_live(const char *infile, bool file_is_expr, const char *outfile,
+		    const String &the_template, const String &port,
+		    double interval, int iterations, ErrorHandler *errh)
+{
+    ControlSocketClient client;
+    if (client.connect(port, errh) < 0)
+	return;
+
+    // without a configuration file, draw the running configuration
+    String config;
+    if (!infile) {
+	Vector<String> hnames, values;
+	hnames.push_back("flatconfig");
+	if (client.read(hnames, values, errh) < 0)
+	    return;
+	config = values[0];
+	infile = config.c_str();
+	file_is_expr = true;
+    }
+    PrettyRouter pr(infile, file_is_expr, 0, errh);
+    if (!pr.ok())
+	return;
+
+    // Redraw after every interval.  Each output file is written in full
+    // and then renamed, so a viewer never sees a partial graph.
+    LiveCounts counts(pr.r);
+    if (counts.poll(client, errh) < 0)
+	return;
+    String tmpfile = (outfile && strcmp(outfile, "-") != 0 ? String(outfile) + ".tmp" : String());
+    for (int i = 0; iterations <= 0 || i < iterations; i++) {
+	struct timespec ts;
+	ts.tv_sec = (time_t) interval;
+	ts.tv_nsec = (long) ((interval - ts.tv_sec) * 1e9);
+	nanosleep(&ts, 0);
+	if (counts.poll(client, errh) < 0)
+	    return;
+	if (tmpfile) {
+	    FILE *f = open_output_file(tmpfile.c_str(), errh);
+	    if (!f)
+		return;
+	    output_dot(pr, f, the_template, &counts);
+	    fclose(f);
+	    if (rename(tmpfile.c_str(), outfile) < 0) {
+		errh->error("%s: %s", outfile, strerror(errno));
+		return;
+	    }
+	} else {
+	    output_dot(pr, stdout, the_template, &counts);
+	    fflush(stdout);
+	}
+    }
 }
 
 static void
@@ -1289,6 +1377,11 @@ Options:\n\
       --dot                   Output a 'dot' graph definition.\n\
       --gml                   Output a GML graph definition.\n\
       --graphml               Output a GraphML XML graph definition.\n\
+  -p, --port [HOST:]PORT      Poll the ControlSocket at PORT (or the Unix\n\
+                              socket FILE) and output 'dot' graphs annotated\n\
+                              with packet rates.\n\
+      --interval SEC          With --port, output a graph every SEC seconds.\n\
+      --iterations N          With --port, stop after N graphs.\n\
   -C, --clickpath PATH        Use PATH for CLICKPATH.\n\
       --help                  Print this message and exit.\n\
   -v, --version               Print version number and exit.\n\
@@ -1316,6 +1409,9 @@ main(int argc, char **argv)
     bool explicit_template = false;
     String the_template;
     int action = 0;
+    String port;
+    double interval = 1;
+    int iterations = 0;
 
     while (1) {
 	int opt = Clp_Next(clp);
@@ -1400,6 +1496,22 @@ particular purpose.\n");
 	    output_file = clp->vstr;
 	    break;
 
+	  case PORT_OPT:
+	    port = clp->vstr;
+	    break;
+
+	  case INTERVAL_OPT:
+	    if (clp->val.d <= 0) {
+		p_errh->error("'--interval' must be positive");
+		goto bad_option;
+	    }
+	    interval = clp->val.d;
+	    break;
+
+	  case ITERATIONS_OPT:
+	    iterations = clp->val.i;
+	    break;
+
 	  case USERLEVEL_OPT:
 	  case LINUXMODULE_OPT:
 	  case BSDMODULE_OPT:
@@ -1434,6 +1546,13 @@ particular purpose.\n");
     }
 
   done:
+    if (port && !action)
+	action = DOT_OPT;
+    else if (port && action != DOT_OPT) {
+	p_errh->error("'--port' requires '--dot'");
+	short_usage();
+	exit(1);
+    }
     if (!explicit_template) {
 	if (action == DOT_OPT || action == GML_OPT || action == GRAPHML_OPT)
 	    the_template = default_graph_template;
@@ -1446,7 +1565,10 @@ particular purpose.\n");
 	    fputs(the_template.c_str(), f);
 	    fclose(f);
 	}
-    } else if (action == DOT_OPT)
+    } else if (port)
+	pretty_process_live(router_file, file_is_expr, output_file, the_template,
+			    port, interval, iterations, errh);
+    else if (action == DOT_OPT)
 	pretty_process_dot(router_file, file_is_expr, output_file, the_template, errh);
     else if (action == GML_OPT)
 	pretty_process_gml(router_file, file_is_expr, output_file, the_template, errh);
@@ -0,0 +1,352 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * livecounts.cc -- read packet counts from a running router for click-pretty
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+
+#include "livecounts.hh"
+#include "routert.hh"
+#include <click/error.hh>
+#include <click/confparse.hh>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+ControlSocketClient::ControlSocketClient()
+    : _fd(-1), _inpos(0)
+{
+}
+
+ControlSocketClient::~ControlSocketClient()
+{
+    if (_fd >= 0)
+	close(_fd);
+}
+
+int
+ControlSocketClient::connect(const String &where, ErrorHandler *errh)
+{
+    _where = where;
+    if (where.find_left('/') >= 0) {
+	struct sockaddr_un sa;
+	if ((size_t) where.length() >= sizeof(sa.sun_path))
+	    return errh->error("%s: filename too long", where.c_str());
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	memcpy(sa.sun_path, where.data(), where.length());
+	if ((_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+	    || ::connect(_fd, (struct sockaddr *) &sa, sizeof(sa)) < 0)
+	    return errh->error("%s: %s", where.c_str(), strerror(errno));
+    } else {
+	int colon = where.find_right(':');
+	String host = (colon >= 0 ? where.substring(0, colon) : String("localhost"));
+	String port = where.substring(colon + 1);
+	struct addrinfo hints, *ai;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	if (int r = getaddrinfo(host.c_str(), port.c_str(), &hints, &ai))
+	    return errh->error("%s: %s", where.c_str(), gai_strerror(r));
+	for (struct addrinfo *a = ai; a && _fd < 0; a = a->ai_next)
+	    if ((_fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol)) >= 0
+		&& ::connect(_fd, a->ai_addr, a->ai_addrlen) < 0) {
+		close(_fd);
+		_fd = -1;
+	    }
+	freeaddrinfo(ai);
+	if (_fd < 0)
+	    return errh->error("%s: %s", where.c_str(), strerror(errno));
+    }
+
+    String greeting;
+    if (!read_line(greeting, errh))
+	return -1;
+    if (!greeting.starts_with("Click::ControlSocket/"))
+	return errh->error("%s: not a Click ControlSocket", where.c_str());
+    return 0;
+}
+
+bool
+ControlSocketClient::fill(ErrorHandler *errh)
+{
+    if (_inpos == _in.length()) {
+	_in.clear();
+	_inpos = 0;
+    }
+    char *x = _in.reserve(8192);
+    if (!x) {
+	errh->error("%s: out of memory", _where.c_str());
+	return false;
+    }
+    ssize_t r = 0;
+    while ((r = ::read(_fd, x, 8192)) < 0 && errno == EINTR)
+	/* try again */;
+    if (r <= 0) {
+	errh->error("%s: %s", _where.c_str(), r == 0 ? "connection closed" : strerror(errno));
+	return false;
+    }
+    _in.adjust_length(r);
+    return true;
+}
+
+bool
+ControlSocketClient::read_line(String &line, ErrorHandler *errh)
+{
+    while (1) {
+	const char *s = _in.begin() + _inpos;
+	if (const char *nl = (const char *) memchr(s, '\n', _in.end() - s)) {
+	    const char *end = (nl > s && nl[-1] == '\r' ? nl - 1 : nl);
+	    line = String(s, end);
+	    _inpos = nl + 1 - _in.begin();
+	    return true;
+	} else if (!fill(errh))
+	    return false;
+    }
+}
+
+bool
+ControlSocketClient::read_data(int len, String &data, ErrorHandler *errh)
+{
+    while (_in.length() - _inpos < len)
+	if (!fill(errh))
+	    return false;
+    data = String(_in.begin() + _inpos, len);
+    _inpos += len;
+    return true;
+}
+
+int
+ControlSocketClient::read(const Vector<String> &hnames, Vector<String> &values,
+			  ErrorHandler *errh)
+{
+    values.clear();
+    for (int i = 0; i < hnames.size(); i++) {
+	// send requests in batches, so neither side's socket buffer fills
+	if (i % 256 == 0) {
+	    StringAccum request;
+	    for (int j = i; j < hnames.size() && j < i + 256; j++)
+		request << "READ " << hnames[j] << "\r\n";
+	    for (int pos = 0; pos < request.length(); ) {
+		ssize_t w = ::write(_fd, request.begin() + pos, request.length() - pos);
+		if (w < 0 && errno != EINTR)
+		    return errh->error("%s: %s", _where.c_str(), strerror(errno));
+		pos += (w > 0 ? w : 0);
+	    }
+	}
+
+	// a response is one or more "CODE-text" lines ending in "CODE text"
+	String line;
+	do {
+	    if (!read_line(line, errh))
+		return -1;
+	} while (line.length() > 3 && line[3] == '-');
+	int len;
+	if (line.starts_with("200")) {
+	    if (!read_line(line, errh))
+		return -1;
+	    if (!line.starts_with("DATA ")
+		|| cp_integer(line.begin() + 5, line.end(), 10, &len) != line.end()
+		|| len < 0)
+		return errh->error("%s: protocol error", _where.c_str());
+	    String data;
+	    if (!read_data(len, data, errh))
+		return -1;
+	    values.push_back(data);
+	} else
+	    values.push_back(String());
+    }
+    return 0;
+}
+
+
+LiveCounts::LiveCounts(RouterT *router)
+    : _router(router), _counts(router->nelements(), ElementCounts()),
+      _probed(false), _elapsed(0), _max_pps(0)
+{
+}
+
+int
+LiveCounts::probe(ControlSocketClient &client, ErrorHandler *errh)
+{
+    // Find out which counting handlers each element has.
+    static const char * const hnames[nh] = {
+	"icounts", "ocounts", "count", "byte_count"
+    };
+    Vector<String> names, values;
+    for (int i = 0; i < _router->nelements(); i++)
+	names.push_back(_router->element(i)->name() + ".handlers");
+    if (client.read(names, values, errh) < 0)
+	return -1;
+    for (int i = 0; i < values.size(); i++) {
+	const char *s = values[i].begin(), *end = values[i].end();
+	while (s != end) {
+	    const char *tab = find(s, end, '\t');
+	    const char *nl = find(tab, end, '\n');
+	    for (int h = 0; h < nh; h++)
+		if (String(s, tab) == hnames[h]) {
+		    _hnames.push_back(_router->element(i)->name() + "." + hnames[h]);
+		    _heindex.push_back(i);
+		    _hwhich.push_back(h);
+		}
+	    s = (nl == end ? nl : nl + 1);
+	}
+    }
+    _probed = true;
+    return 0;
+}
+
+static double
+rate(int64_t now, int64_t then, double elapsed)
+{
+    if (now < 0 || then < 0 || now < then)
+	return -1;
+    else
+	return (now - then) / elapsed;
+}
+
+int
+LiveCounts::poll(ControlSocketClient &client, ErrorHandler *errh)
+{
+    if (!_probed && probe(client, errh) < 0)
+	return -1;
+
+    Vector<String> values;
+    if (client.read(_hnames, values, errh) < 0)
+	return -1;
+    Timestamp now = Timestamp::now();
+    double elapsed = (_last ? (now - _last).doubleval() : 0);
+    _last = now;
+
+    Vector<ElementCounts> old(_counts);
+    for (int i = 0; i < values.size(); i++) {
+	ElementCounts &ec = _counts[_heindex[i]];
+	int which = _hwhich[i];
+	if (which == h_icounts || which == h_ocounts) {
+	    // one count per line; "??" marks a port that is not counted
+	    Vector<int64_t> &v = ec.ports[which == h_ocounts];
+	    v.clear();
+	    const char *s = values[i].begin(), *end = values[i].end();
+	    while (s != end) {
+		const char *nl = find(s, end, '\n');
+		int64_t x;
+		if (cp_integer(s, nl, 10, &x) != nl)
+		    x = -1;
+		v.push_back(x);
+		s = (nl == end ? nl : nl + 1);
+	    }
+	} else {
+	    int64_t x;
+	    String text = values[i].trim_space();
+	    if (cp_integer(text.begin(), text.end(), 10, &x) != text.end())
+		x = -1;
+	    (which == h_count ? ec.count : ec.byte_count) = x;
+	}
+    }
+
+    _elapsed = elapsed;
+    _max_pps = 0;
+    if (elapsed <= 0)
+	return 0;
+    for (int i = 0; i < _counts.size(); i++) {
+	ElementCounts &ec = _counts[i];
+	const ElementCounts &oc = old[i];
+	for (int k = 0; k < 2; k++) {
+	    ec.port_rates[k].assign(ec.ports[k].size(), -1);
+	    for (int p = 0; p < ec.ports[k].size() && p < oc.ports[k].size(); p++)
+		ec.port_rates[k][p] = rate(ec.ports[k][p], oc.ports[k][p], elapsed);
+	}
+	ec.count_rate = rate(ec.count, oc.count, elapsed);
+	ec.byte_rate = rate(ec.byte_count, oc.byte_count, elapsed);
+	double pps = element_pps(i);
+	if (pps > _max_pps)
+	    _max_pps = pps;
+    }
+    return 0;
+}
+
+double
+LiveCounts::element_pps(int eindex) const
+{
+    const ElementCounts &ec = _counts[eindex];
+    double pps = ec.count_rate;
+    for (int k = 0; k < 2; k++) {
+	double sum = -1;
+	for (const double *r = ec.port_rates[k].begin(); r != ec.port_rates[k].end(); ++r)
+	    if (*r >= 0)
+		sum = (sum < 0 ? *r : sum + *r);
+	if (sum > pps)
+	    pps = sum;
+    }
+    return pps;
+}
+
+double
+LiveCounts::single_port_rate(int eindex, int isoutput, int port, bool bits) const
+{
+    // An element's count measures a port if that port is the element's
+    // only one on its side and carries a single connection.
+    const ElementT *e = _router->element(eindex);
+    if ((isoutput ? e->noutputs() : e->ninputs()) != 1)
+	return -1;
+    int n = 0;
+    for (RouterT::conn_iterator it = _router->find_connections_touching(eindex, port, isoutput); it; ++it)
+	n++;
+    if (n != 1)
+	return -1;
+    const ElementCounts &ec = _counts[eindex];
+    if (bits)
+	return (ec.byte_rate >= 0 ? ec.byte_rate * 8 : -1);
+    else
+	return ec.count_rate;
+}
+
+double
+LiveCounts::connection_pps(const ConnectionT &conn) const
+{
+    const Vector<double> &orates = _counts[conn.from_eindex()].port_rates[1];
+    if (conn.from_port() < orates.size() && orates[conn.from_port()] >= 0)
+	return orates[conn.from_port()];
+    double r = single_port_rate(conn.from_eindex(), 1, conn.from_port(), false);
+    if (r < 0)
+	r = single_port_rate(conn.to_eindex(), 0, conn.to_port(), false);
+    return r;
+}
+
+double
+LiveCounts::connection_bps(const ConnectionT &conn) const
+{
+    double r = single_port_rate(conn.from_eindex(), 1, conn.from_port(), true);
+    if (r < 0)
+	r = single_port_rate(conn.to_eindex(), 0, conn.to_port(), true);
+    return r;
+}
+
+String
+unparse_rate(double rate, const char *unit)
+{
+    static const char prefixes[] = " kMGT";
+    int p = 0;
+    while (rate >= 1000 && p < 4)
+	rate /= 1000, p++;
+    StringAccum sa;
+    sa.snprintf(32, (rate < 10 && p ? "%.2f" : rate < 100 && p ? "%.1f" : "%.0f"), rate);
+    sa << ' ';
+    if (p)
+	sa << prefixes[p];
+    sa << unit;
+    return sa.take_string();
+}
@@ -0,0 +1,93 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_PRETTY_LIVECOUNTS_HH
+#define CLICK_PRETTY_LIVECOUNTS_HH
+#include <click/string.hh>
+#include <click/straccum.hh>
+#include <click/vector.hh>
+#include <click/timestamp.hh>
+class RouterT;
+class ConnectionT;
+class ErrorHandler;
+
+/* A minimal ControlSocket client: enough to read many handlers at once.
+ * Reads are pipelined, so polling a large router costs one round trip. */
+class ControlSocketClient { public:
+
+    ControlSocketClient();
+    ~ControlSocketClient();
+
+    // Connect to WHERE, which is [HOST:]PORT for a TCP ControlSocket or a
+    // filename (containing a slash) for a Unix-domain one.
+    int connect(const String &where, ErrorHandler *errh);
+
+    // Read the handler named by each element of HNAMES into the
+    // corresponding element of VALUES.  A handler that cannot be read
+    // yields a null String.  Returns -1 if the connection fails.
+    int read(const Vector<String> &hnames, Vector<String> &values,
+	     ErrorHandler *errh);
+
+  private:
+
+    int _fd;
+    String _where;
+    StringAccum _in;
+    int _inpos;
+
+    bool fill(ErrorHandler *errh);
+    bool read_line(String &line, ErrorHandler *errh);
+    bool read_data(int len, String &data, ErrorHandler *errh);
+
+};
+
+/* Packet and bit rates for a router's elements and connections, computed
+ * from successive polls of their counters.  Ports are counted by the
+ * icounts and ocounts handlers of a driver built with --enable-stats; an
+ * element with a single output (or input) that has count and byte_count
+ * handlers, such as Counter, also measures that port. */
+class LiveCounts { public:
+
+    LiveCounts(RouterT *router);
+
+    int poll(ControlSocketClient &client, ErrorHandler *errh);
+    bool has_rates() const		{ return _elapsed > 0; }
+
+    // Returns the packets per second through element EINDEX, or -1.
+    double element_pps(int eindex) const;
+    double max_element_pps() const	{ return _max_pps; }
+
+    // Return the rates across a connection, or -1 if unknown.
+    double connection_pps(const ConnectionT &conn) const;
+    double connection_bps(const ConnectionT &conn) const;
+
+  private:
+
+    enum { h_icounts, h_ocounts, h_count, h_byte_count, nh };
+
+    struct ElementCounts {
+	Vector<int64_t> ports[2];	// icounts, ocounts; -1 is unknown
+	int64_t count;
+	int64_t byte_count;
+	Vector<double> port_rates[2];
+	double count_rate;
+	double byte_rate;
+	ElementCounts() : count(-1), byte_count(-1), count_rate(-1), byte_rate(-1) { }
+    };
+
+    RouterT *_router;
+    Vector<ElementCounts> _counts;
+    Vector<String> _hnames;
+    Vector<int> _heindex;
+    Vector<int> _hwhich;
+    bool _probed;
+    Timestamp _last;
+    double _elapsed;
+    double _max_pps;
+
+    int probe(ControlSocketClient &client, ErrorHandler *errh);
+    double single_port_rate(int eindex, int isoutput, int port, bool bits) const;
+
+};
+
+String unparse_rate(double rate, const char *unit);
+
+#endif
@@ -27,6 +27,7 @@
 #include <click/clp.h>
 #include "toolutils.hh"
 #include "adjacency.hh"
+#include "profile.hh"
 #include <stdio.h>
 #include <ctype.h>
 #include <stdlib.h>
@@ -45,8 +46,11 @@ class Matcher { public:
   bool check_match();
   bool next_match();
 
+  uint64_t packets(const Profile &) const;
+
   void replace_config(ElementT *) const;
-  void replace(RouterT *, const String &, const LandmarkT &, ErrorHandler *);
+  void replace(RouterT *, const String &, const LandmarkT &, Profile *,
+	       ErrorHandler *);
 
  private:
 
@@ -242,6 +246,21 @@ Matcher::next_match()
 
 
 
+uint64_t
+Matcher::packets(const Profile &profile) const
+{
+  // the busiest matched element sets the match's packet count
+  uint64_t max = 0;
+  for (int i = 0; i < _match.size(); i++)
+    if (_match[i]) {
+      uint64_t p = profile.packets(_match[i]->name());
+      if (p > max)
+	max = p;
+    }
+  return max;
+}
+
+
 static String
 uniqueify_prefix(const String &base_prefix, RouterT *r)
 {
@@ -293,10 +312,11 @@ Matcher::replace_config(ElementT *e) const
 
 void
 Matcher::replace(RouterT *replacement, const String &try_prefix,
-		 const LandmarkT &landmark, ErrorHandler *errh)
+		 const LandmarkT &landmark, Profile *profile, ErrorHandler *errh)
 {
   //fprintf(stderr, "replace...\n");
   String prefix = uniqueify_prefix(try_prefix, _body);
+  uint64_t npackets = (profile ? packets(*profile) : 0);
 
   // free old elements
   Vector<int> changed_elements;
@@ -340,6 +360,14 @@ Matcher::replace(RouterT *replacement, const String &try_prefix,
 	_body->change_ename(new_index, old_names[i]);
     }
 
+  // replacement elements carry the matched elements' traffic
+  if (profile)
+    for (int i = 0; i < changed_elements.size(); i++) {
+      ElementT *e = _body->element(changed_elements[i]);
+      if (!e->dead() && !e->tunnel())
+	profile->set_packets(e->name(), npackets);
+    }
+
   // find input and output, add connections to tunnels
   ElementT *new_pp = _body->element(prefix);
   for (int i = 0; i < _to_pp_from.size(); i++)
@@ -412,14 +440,20 @@ match_config(const String &pat, const String &conf,
 #define OUTPUT_OPT		305
 #define PATTERNS_OPT		306
 #define REVERSE_OPT		307
+#define PROFILE_OPT		308
+#define HOT_OPT			309
+#define VERBOSE_OPT		310
 
 static const Clp_Option options[] = {
   { "expression", 'e', EXPRESSION_OPT, Clp_ValString, 0 },
   { "file", 'f', ROUTER_OPT, Clp_ValString, 0 },
   { "help", 0, HELP_OPT, 0, 0 },
+  { "hot", 0, HOT_OPT, Clp_ValDouble, 0 },
   { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
   { "patterns", 'p', PATTERNS_OPT, Clp_ValString, 0 },
+  { "profile", 'P', PROFILE_OPT, Clp_ValString, 0 },
   { "reverse", 'r', REVERSE_OPT, 0, Clp_Negate },
+  { "verbose", 'V', VERBOSE_OPT, 0, Clp_Negate },
   { "version", 'v', VERSION_OPT, 0, 0 },
 };
 
@@ -451,6 +485,12 @@ Options:\n\
   -e, --expression EXPR         Use EXPR as router configuration.\n\
   -o, --output FILE             Write output to FILE.\n\
   -r, --reverse                 Apply patterns in reverse.\n\
+  -P, --profile FILE            Read per-element packet counts from FILE and\n\
+                                optimize only hot parts of the configuration.\n\
+      --hot FRACTION            With --profile, an element is hot if it saw at\n\
+                                least FRACTION of the busiest element's\n\
+                                packets. Default 0.01.\n\
+  -V, --verbose                 Report each change on standard error.\n\
       --help                    Print this message and exit.\n\
   -v, --version                 Print version number and exit.\n\
 \n\
@@ -509,6 +549,10 @@ main(int argc, char **argv)
   bool file_is_expr = false;
   const char *output_file = 0;
   bool reverse = 0;
+  Profile profile;
+  bool use_profile = false;
+  double hot_fraction = 0.01;
+  bool verbose = false;
 
   while (1) {
     int opt = Clp_Next(clp);
@@ -554,6 +598,24 @@ particular purpose.\n");
       reverse = !clp->negated;
       break;
 
+     case PROFILE_OPT:
+      if (profile.read(clp->vstr, errh) < 0)
+	exit(1);
+      use_profile = true;
+      break;
+
+     case HOT_OPT:
+      if (clp->val.d < 0 || clp->val.d > 1) {
+	errh->error("%<--hot%> must be between 0 and 1");
+	goto bad_option;
+      }
+      hot_fraction = clp->val.d;
+      break;
+
+     case VERBOSE_OPT:
+      verbose = !clp->negated;
+      break;
+
      case Clp_NotOption:
       if (click_maybe_define(clp->vstr, errh))
 	  break;
@@ -586,9 +648,15 @@ particular purpose.\n");
   if (!r || errh->nerrors() > 0)
     exit(1);
 
-  if (!patterns_attempted)
+  if (!patterns_attempted && !use_profile)
     errh->warning("no patterns read");
 
+  // elements that saw fewer packets than 'hot' are left alone
+  uint64_t hot = (uint64_t) (profile.max_packets() * hot_fraction);
+  if (hot < 1)
+    hot = 1;
+  ErrorHandler *report = (verbose ? errh : 0);
+
   // manipulate patterns
   if (patterns.size()) {
     // reverse if necessary
@@ -624,15 +692,28 @@ particular purpose.\n");
     any = false;
     for (int i = 0; i < patterns.size(); i++) {
       Matcher m(patterns[i], patterns_adj[i], r, &matrix, i + 1, errh);
-      if (m.next_match()) {
-	m.replace(replacements[i], pat_names[i], LandmarkT(), errh);
+      while (m.next_match()) {
+	if (use_profile && m.packets(profile) < hot)
+	  continue;
+	m.replace(replacements[i], pat_names[i], LandmarkT(),
+		  (use_profile ? &profile : 0), errh);
+	if (report)
+	  report->message("applied pattern %s", pat_names[i].c_str());
 	nreplace++;
 	any = true;
 	break;
       }
+      if (any)
+	break;
     }
   }
 
+  // profile-guided transformations that patterns can't express
+  if (use_profile) {
+    nreplace += profile_collapse_counters(r, profile, hot, report);
+    nreplace += profile_reorder_classifiers(r, profile, hot, report);
+  }
+
   // write result
   if (nreplace)
     r->remove_dead_elements();
@@ -0,0 +1,381 @@
+/*
+ * profile.cc -- profile-guided transformations for click-xform
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+
+#include "profile.hh"
+#include "routert.hh"
+#include <click/error.hh>
+#include <click/confparse.hh>
+#include <click/userutils.hh>
+#include <stdio.h>
+#include <ctype.h>
+
+Profile::Profile()
+  : _map(-1), _max_packets(0)
+{
+}
+
+Profile::ElementProfile &
+Profile::force(const String &name)
+{
+  int &i = _map[name];
+  if (i < 0) {
+    i = _elts.size();
+    _elts.push_back(ElementProfile());
+  }
+  return _elts[i];
+}
+
+int
+Profile::read(const String &filename, ErrorHandler *errh)
+{
+  int before = errh->nerrors();
+  String text = file_string(filename, errh);
+  if (errh->nerrors() != before)
+    return -1;
+
+  // The text consists of "ELEMENT.HANDLER:" lines, each followed by the
+  // handler's value and a blank line.  Count handlers return one line per
+  // port; "??" marks a port whose count was not kept.
+  Vector<int64_t> *counts = 0;
+  const char *s = text.begin(), *end = text.end();
+  for (int lineno = 1; s < end; lineno++) {
+    const char *eol = find(s, end, '\n');
+    String line = text.substring(s, eol).trim_space();
+    s = (eol < end ? eol + 1 : end);
+
+    if (!line) {
+      counts = 0;
+      continue;
+    }
+    if (line.back() == ':') {
+      int dot = line.find_left('.');
+      if (dot <= 0) {
+	errh->lerror(filename + ":" + String(lineno), "expected %<ELEMENT.HANDLER:%>");
+	continue;
+      }
+      String ename = line.substring(0, dot);
+      String hname = line.substring(dot + 1, line.length() - dot - 2);
+      counts = 0;
+      if (hname == "icounts")
+	counts = &force(ename).icounts;
+      else if (hname == "ocounts")
+	counts = &force(ename).ocounts;
+      else if (hname == "count") {
+	ElementProfile &ep = force(ename);
+	counts = &ep.icounts;
+	ep.count = 0;
+      }
+      if (counts)
+	counts->clear();
+      continue;
+    }
+    if (!counts)
+      continue;
+
+    int64_t value = -1;
+    if (line != "??"
+	&& cp_integer(line.begin(), line.end(), 10, &value) != line.end()) {
+      errh->lerror(filename + ":" + String(lineno), "expected a packet count");
+      value = -1;
+    }
+    counts->push_back(value);
+  }
+
+  // summarize each element
+  for (HashTable<String, int>::iterator it = _map.begin(); it.live(); it++) {
+    ElementProfile &ep = _elts[it.value()];
+    if (ep.count >= 0 && ep.icounts.size())
+      ep.count = (ep.icounts[0] < 0 ? 0 : ep.icounts[0]), ep.icounts.clear();
+    else {
+      int64_t in = 0, out = 0;
+      for (int64_t *v = ep.icounts.begin(); v != ep.icounts.end(); ++v)
+	in += (*v > 0 ? *v : 0);
+      for (int64_t *v = ep.ocounts.begin(); v != ep.ocounts.end(); ++v)
+	out += (*v > 0 ? *v : 0);
+      ep.count = (in > out ? in : out);
+    }
+    if ((uint64_t) ep.count > _max_packets)
+      _max_packets = ep.count;
+  }
+
+  return (errh->nerrors() == before ? 0 : -1);
+}
+
+uint64_t
+Profile::packets(const String &name) const
+{
+  int i = _map.get(name);
+  return (i >= 0 ? _elts[i].count : 0);
+}
+
+int64_t
+Profile::output_packets(const String &name, int port) const
+{
+  int i = _map.get(name);
+  if (i >= 0 && port >= 0 && port < _elts[i].ocounts.size())
+    return _elts[i].ocounts[port];
+  else
+    return -1;
+}
+
+void
+Profile::set_packets(const String &name, uint64_t packets)
+{
+  ElementProfile &ep = force(name);
+  ep.count = packets;
+  ep.icounts.clear();
+  ep.ocounts.clear();
+}
+
+
+// CLASSIFIER REORDERING
+
+namespace {
+struct ClassifierPattern {
+  bool ok;
+  Vector<unsigned char> value;
+  Vector<unsigned char> mask;
+  ClassifierPattern() : ok(false) { }
+  bool parse(const String &pat);
+  bool disjoint(const ClassifierPattern &x) const;
+};
+}
+
+static void
+update_value_mask(int c, int shift, int &value, int &mask)
+{
+  int v = 0, m = 0xF;
+  if (c == '?')
+    v = m = 0;
+  else if (c >= '0' && c <= '9')
+    v = c - '0';
+  else
+    v = tolower(c) - 'a' + 10;
+  value |= (v << shift);
+  mask |= (m << shift);
+}
+
+bool
+ClassifierPattern::parse(const String &pat)
+{
+  // Collect the byte values required by the pattern's positive clauses.
+  // Negated clauses only shrink the set of matching packets, so they are
+  // skipped.  Syntax follows Classifier::parse_program.
+  ok = false;
+  const char *s = pat.begin(), *end = pat.end();
+  if (pat == "-")
+    return (ok = true);
+  while (1) {
+    while (s < end && isspace((unsigned char) *s))
+      s++;
+    if (s >= end)
+      break;
+    bool negated = false;
+    if (*s == '!') {
+      negated = true;
+      for (s++; s < end && isspace((unsigned char) *s); s++)
+	/* nada */;
+    }
+    int offset;
+    const char *t = cp_integer(s, end, 10, &offset);
+    if (t == s || t >= end || *t != '/')
+      return false;
+    const char *vbegin = t + 1, *vend = vbegin;
+    while (vend < end && (isxdigit((unsigned char) *vend) || *vend == '?'))
+      vend++;
+    const char *mbegin = vend, *mend = vend;
+    if (mend < end && *mend == '%') {
+      mbegin = mend = vend + 1;
+      while (mend < end && (isxdigit((unsigned char) *mend) || *mend == '?'))
+	mend++;
+      if (mend - mbegin != vend - vbegin)
+	return false;
+    }
+    if (vend - vbegin < 2 || (vend - vbegin) % 2)
+      return false;
+    s = mend;
+    if (negated)
+      continue;
+
+    for (; vbegin < vend; vbegin += 2, offset++) {
+      int v = 0, m = 0;
+      update_value_mask(vbegin[0], 4, v, m);
+      update_value_mask(vbegin[1], 0, v, m);
+      if (mbegin < mend) {
+	int mv = 0, mm = 0;
+	update_value_mask(mbegin[0], 4, mv, mm);
+	update_value_mask(mbegin[1], 0, mv, mm);
+	m = m & mv & mm;
+	mbegin += 2;
+      }
+      if (offset >= value.size()) {
+	value.resize(offset + 1, 0);
+	mask.resize(offset + 1, 0);
+      }
+      value[offset] |= v & m;
+      mask[offset] |= m;
+    }
+  }
+  return (ok = true);
+}
+
+bool
+ClassifierPattern::disjoint(const ClassifierPattern &x) const
+{
+  if (!ok || !x.ok)
+    return false;
+  int n = (value.size() < x.value.size() ? value.size() : x.value.size());
+  for (int i = 0; i < n; i++)
+    if ((value[i] ^ x.value[i]) & mask[i] & x.mask[i])
+      return true;
+  return false;
+}
+
+int
+profile_reorder_classifiers(RouterT *r, const Profile &profile, uint64_t hot,
+			    ErrorHandler *errh)
+{
+  int nchanged = 0;
+  for (RouterT::iterator e = r->begin_elements(); e; e++) {
+    if (e->type_name() != "Classifier" || profile.packets(e->name()) < hot)
+      continue;
+
+    Vector<String> conf;
+    cp_argvec(e->configuration(), conf);
+    Vector<ClassifierPattern> pats(conf.size(), ClassifierPattern());
+    Vector<int64_t> counts;
+    Vector<int> order;
+    for (int i = 0; i < conf.size(); i++) {
+      counts.push_back(profile.output_packets(e->name(), i));
+      if (counts.back() < 0)
+	break;
+      pats[i].parse(conf[i]);
+      order.push_back(i);
+    }
+    if (order.size() != conf.size())
+      continue;
+
+    // A packet can match at most one of two disjoint patterns, so swapping
+    // adjacent disjoint patterns never changes where a packet goes.
+    bool changed = false;
+    for (int i = 1; i < order.size(); i++)
+      for (int j = i; j > 0 && counts[order[j]] > counts[order[j-1]]
+	     && pats[order[j]].disjoint(pats[order[j-1]]); j--) {
+	int t = order[j];
+	order[j] = order[j-1];
+	order[j-1] = t;
+	changed = true;
+      }
+    if (!changed)
+      continue;
+
+    Vector<String> new_conf;
+    Vector<int> new_port(conf.size(), 0);
+    for (int i = 0; i < order.size(); i++) {
+      new_conf.push_back(conf[order[i]]);
+      new_port[order[i]] = i;
+    }
+    e->set_configuration(cp_unargvec(new_conf));
+    Vector<RouterT::conn_iterator> conns;
+    r->find_connection_vector_from(e.get(), conns);
+    for (int i = 0; i < conns.size(); i++)
+      r->change_connection_from(conns[i], PortT(e.get(), new_port[conns[i]->from_port()]));
+
+    if (errh)
+      errh->message("%s: reordered patterns by hit rate", e->name_c_str());
+    nchanged++;
+  }
+  return nchanged;
+}
+
+
+// COUNTER COLLAPSING
+
+static bool
+mentioned(RouterT *r, const String &name)
+{
+  // Another element, such as a Script, may use the Counter's handlers.
+  // Look for the last component of its name anywhere in a configuration.
+  String base = name.substring(name.find_right('/') + 1);
+  for (RouterT::iterator x = r->begin_elements(); x; x++) {
+    const String &conf = x->configuration();
+    for (int p = 0; (p = conf.find_left(base, p)) >= 0; p++) {
+      int q = p + base.length();
+      if ((p == 0 || (!isalnum((unsigned char) conf[p-1]) && conf[p-1] != '_'))
+	  && (q == conf.length() || (!isalnum((unsigned char) conf[q]) && conf[q] != '_' && conf[q] != '@')))
+	return true;
+    }
+  }
+  return false;
+}
+
+static bool
+removable_counter(RouterT *r, ElementT *e, const Profile &profile, uint64_t hot)
+{
+  // A named Counter may be read by a ControlSocket client, so only
+  // anonymous Counters go.
+  return e->type_name() == "Counter" && e->was_anonymous()
+    && !e->configuration().trim_space()
+    && profile.packets(e->name()) >= hot && !mentioned(r, e->name());
+}
+
+static ElementT *
+collapse_counter(RouterT *r, ElementT *up, const Profile &profile, uint64_t hot)
+{
+  // 'up' must feed 'down' and nothing else, and 'down' must be fed by 'up'
+  // alone; then both count the same packets.
+  Vector<PortT> v;
+  r->find_connections_from(PortT(up, 0), v);
+  if (v.size() != 1 || v[0].port != 0 || v[0].element == up)
+    return 0;
+  ElementT *down = v[0].element;
+  if (down->type_name() != "Counter")
+    return 0;
+  r->find_connections_to(PortT(down, 0), v);
+  if (v.size() != 1)
+    return 0;
+
+  if (removable_counter(r, down, profile, hot)) {
+    r->find_connections_from(PortT(down, 0), v);
+    for (int i = 0; i < v.size(); i++)
+      r->add_connection(PortT(up, 0), v[i]);
+    return down;
+  } else if (removable_counter(r, up, profile, hot)) {
+    r->find_connections_to(PortT(up, 0), v);
+    for (int i = 0; i < v.size(); i++)
+      r->add_connection(v[i], PortT(down, 0));
+    return up;
+  } else
+    return 0;
+}
+
+int
+profile_collapse_counters(RouterT *r, const Profile &profile, uint64_t hot,
+			  ErrorHandler *errh)
+{
+  int nremoved = 0;
+  for (RouterT::iterator up = r->begin_elements(); up; up++)
+    while (!up->dead() && up->type_name() == "Counter") {
+      ElementT *victim = collapse_counter(r, up.get(), profile, hot);
+      if (!victim)
+	break;
+      if (errh)
+	errh->message("%s: removed, counts the same packets as a neighbor", victim->name_c_str());
+      r->free_element(victim);
+      nremoved++;
+    }
+  return nremoved;
+}
@@ -0,0 +1,58 @@
+#ifndef CLICK_XFORM_PROFILE_HH
+#define CLICK_XFORM_PROFILE_HH
+#include <click/hashtable.hh>
+#include <click/vector.hh>
+#include <click/string.hh>
+class RouterT;
+class ElementT;
+class ErrorHandler;
+
+/* Per-element packet counts collected from a running router, as printed by
+ * "click -h '*.icounts' -h '*.ocounts'" on a driver configured with
+ * --enable-stats.  Counter "count" handlers are understood too.  Elements
+ * missing from the profile saw no packets. */
+class Profile { public:
+
+  Profile();
+
+  int read(const String &filename, ErrorHandler *);
+  bool empty() const			{ return _elts.size() == 0; }
+
+  // packets that passed through element 'name'
+  uint64_t packets(const String &name) const;
+  // packets emitted on 'name's output 'port', or -1 if unknown
+  int64_t output_packets(const String &name, int port) const;
+  uint64_t max_packets() const		{ return _max_packets; }
+
+  // record that a new element carries 'packets' packets
+  void set_packets(const String &name, uint64_t packets);
+
+ private:
+
+  struct ElementProfile {
+    Vector<int64_t> icounts;
+    Vector<int64_t> ocounts;
+    int64_t count;
+    ElementProfile() : count(-1) { }
+  };
+
+  HashTable<String, int> _map;
+  Vector<ElementProfile> _elts;
+  uint64_t _max_packets;
+
+  ElementProfile &force(const String &name);
+
+};
+
+// Reorder the patterns of hot Classifiers so that busier patterns come
+// first, swapping only patterns that no packet can match both of.  Returns
+// the number of Classifiers changed.
+int profile_reorder_classifiers(RouterT *, const Profile &, uint64_t hot,
+				ErrorHandler *);
+
+// Remove hot Counters that count exactly the same packets as an adjacent
+// Counter.  Returns the number of Counters removed.
+int profile_collapse_counters(RouterT *, const Profile &, uint64_t hot,
+			      ErrorHandler *);
+
+#endif
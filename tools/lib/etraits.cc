@@ -32,17 +32,17 @@
 ElementTraits ElementTraits::the_null_traits;
 
 static const char * const driver_names[] = {
-    "userlevel", "linuxmodule", "bsdmodule", "ns", "multithread"
+    "userlevel", "linuxmodule", "bsdmodule", "ns", "minios", "multithread"
 };
 
 static const char * const driver_multithread_names[] = {
-    "umultithread", "smpclick", "??", "??"
+    "umultithread", "smpclick", "??", "??", "??"
 };
 
 const char *
 Driver::name(int d)
 {
-    static_assert(USERLEVEL == 0 && LINUXMODULE == 1 && BSDMODULE == 2 && NSMODULE == 3, "Constant misassignments.");
+    static_assert(USERLEVEL == 0 && LINUXMODULE == 1 && BSDMODULE == 2 && NSMODULE == 3 && MINIOS == 4, "Constant misassignments.");
     if (d >= 0 && d <= COUNT)
 	return driver_names[d];
     else
@@ -175,6 +175,8 @@ ElementTraits::calculate_driver_mask()
 	driver_mask |= 1 << Driver::BSDMODULE;
     if (requirement_contains(requirements, "ns"))
 	driver_mask |= 1 << Driver::NSMODULE;
+    if (requirement_contains(requirements, "minios"))
+	driver_mask |= 1 << Driver::MINIOS;
     if (driver_mask == 0)
 	driver_mask = Driver::ALLMASK;
     if (requirement_contains(requirements, "multithread"))
@@ -6,7 +6,7 @@
 struct Driver {
     enum {
 	USERLEVEL = 0, LINUXMODULE = 1, BSDMODULE = 2, NSMODULE = 3,
-	ALLMASK = 0xF, COUNT = 4, MULTITHREAD = COUNT
+	MINIOS = 4, ALLMASK = 0x1F, COUNT = 5, MULTITHREAD = COUNT
     };
     static const char *name(int);
     static const char *multithread_name(int);